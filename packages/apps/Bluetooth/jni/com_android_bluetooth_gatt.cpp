@@ -20,13 +20,17 @@
 
 #include "com_android_bluetooth.h"
 #include "hardware/bt_gatt.h"
+#include "scan_result_batcher.h"
 #include "utils/Log.h"
 
 #include <base/bind.h>
 #include <base/callback.h>
 #include <string.h>
 #include <array>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include <cutils/log.h>
 #define info(fmt, ...) ALOGI("%s(L%d): " fmt, __func__, __LINE__, ##__VA_ARGS__)
@@ -113,6 +117,7 @@ namespace android {
 static jmethodID method_onClientRegistered;
 static jmethodID method_onScannerRegistered;
 static jmethodID method_onScanResult;
+static jmethodID method_onScanResultBatch;
 static jmethodID method_onConnected;
 static jmethodID method_onDisconnected;
 static jmethodID method_onReadCharacteristic;
@@ -192,6 +197,102 @@ static const btgatt_interface_t* sGattIf = NULL;
 static jobject mCallbacksObj = NULL;
 static jobject mAdvertiseCallbacksObj = NULL;
 static jobject mPeriodicScanCallbacksObj = NULL;
+static JavaVM* sJavaVm = NULL;
+
+/**
+ * Batched scan result delivery
+ *
+ * When enabled, scan results are packed into a native arena by the callback
+ * thread and handed to GattService.onScanResultBatch() as one direct
+ * ByteBuffer by a dedicated delivery thread, either once the count threshold
+ * is reached or once the oldest pending report is max_delay old.
+ *
+ * Every other scanner callback flushes the pending results on its own thread
+ * first, and deliveries are serialized by sScanBatchDeliveryMutex, so Java
+ * still sees scan results in order with scan start/stop, filter and batch scan
+ * callbacks.
+ */
+static std::mutex sScanBatchDeliveryMutex;
+static std::vector<uint8_t> sScanBatchDelivery;
+static std::mutex sScanBatchMutex;
+static std::condition_variable sScanBatchCv;
+static std::unique_ptr<android::ScanResultBatcher> sScanBatcher;
+static std::thread sScanBatchThread;
+static bool sScanBatchRunning = false;
+
+static void scan_result_batch_deliver(JNIEnv* env,
+                                      std::vector<uint8_t>& batch,
+                                      size_t count) {
+  ScopedLocalRef<jobject> buffer(
+      env, env->NewDirectByteBuffer(batch.data(), batch.size()));
+  if (buffer.get() == NULL) {
+    error("Unable to wrap %zu scan results", count);
+    env->ExceptionClear();
+    return;
+  }
+  env->CallVoidMethod(mCallbacksObj, method_onScanResultBatch, buffer.get(),
+                      (jint)count);
+  if (env->ExceptionCheck()) {
+    ALOGE("An exception was thrown by callback 'onScanResultBatch'.");
+    LOGE_EX(env);
+    env->ExceptionClear();
+  }
+}
+
+/* Deliver every pending batched scan result on the calling thread. Called by
+ * the delivery thread, and by the other scanner callbacks before they reach
+ * Java so that results received before them are not reported after them. */
+static void scan_result_batch_flush(JNIEnv* env) {
+  std::lock_guard<std::mutex> delivery_lock(sScanBatchDeliveryMutex);
+  size_t count;
+  {
+    std::lock_guard<std::mutex> lock(sScanBatchMutex);
+    if (!sScanBatchRunning || sScanBatcher->empty()) return;
+    count = sScanBatcher->Take(&sScanBatchDelivery);
+  }
+  scan_result_batch_deliver(env, sScanBatchDelivery, count);
+}
+
+static void scan_result_batch_thread() {
+  JNIEnv* env = NULL;
+  JavaVMAttachArgs args = {
+      .version = JNI_VERSION_1_6, .name = "BtGattScanBatch", .group = NULL};
+  if (sJavaVm->AttachCurrentThread(&env, &args) != JNI_OK) {
+    error("Unable to attach scan result batch thread");
+    // Fall back to per report delivery
+    std::lock_guard<std::mutex> lock(sScanBatchMutex);
+    sScanBatchRunning = false;
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(sScanBatchMutex);
+  while (sScanBatchRunning) {
+    if (sScanBatcher->empty()) {
+      sScanBatchCv.wait(lock);
+      continue;
+    }
+    if (!sScanBatcher->FlushDue(android::ScanResultBatcher::Clock::now())) {
+      sScanBatchCv.wait_until(lock, sScanBatcher->Deadline());
+      continue;
+    }
+    lock.unlock();
+    scan_result_batch_flush(env);
+    lock.lock();
+  }
+
+  sJavaVm->DetachCurrentThread();
+}
+
+static void scan_result_batch_stop() {
+  {
+    std::lock_guard<std::mutex> lock(sScanBatchMutex);
+    sScanBatchRunning = false;
+  }
+  sScanBatchCv.notify_all();
+  if (sScanBatchThread.joinable()) sScanBatchThread.join();
+  std::lock_guard<std::mutex> lock(sScanBatchMutex);
+  sScanBatcher.reset();
+}
 
 /**
  * BTA client callbacks
@@ -210,6 +311,21 @@ void btgattc_scan_result_cb(uint16_t event_type, uint8_t addr_type,
                             int8_t tx_power, int8_t rssi,
                             uint16_t periodic_adv_int,
                             std::vector<uint8_t> adv_data) {
+  {
+    std::unique_lock<std::mutex> lock(sScanBatchMutex);
+    if (sScanBatchRunning) {
+      bool was_empty = sScanBatcher->empty();
+      bool full = sScanBatcher->Append(
+          event_type, addr_type, *bda, primary_phy, secondary_phy,
+          advertising_sid, tx_power, rssi, periodic_adv_int, adv_data,
+          android::ScanResultBatcher::Clock::now());
+      lock.unlock();
+      // Wake the delivery thread to arm the deadline, or to flush
+      if (was_empty || full) sScanBatchCv.notify_one();
+      return;
+    }
+  }
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
@@ -373,6 +489,7 @@ void btgattc_batchscan_reports_cb(int client_if, int status, int report_format,
                                   int num_records, std::vector<uint8_t> data) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   ScopedLocalRef<jbyteArray> jb(sCallbackEnv.get(),
                                 sCallbackEnv->NewByteArray(data.size()));
   sCallbackEnv->SetByteArrayRegion(jb.get(), 0, data.size(),
@@ -385,6 +502,7 @@ void btgattc_batchscan_reports_cb(int client_if, int status, int report_format,
 void btgattc_batchscan_threshold_cb(int client_if) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj,
                                method_onBatchScanThresholdCrossed, client_if);
 }
@@ -392,6 +510,7 @@ void btgattc_batchscan_threshold_cb(int client_if) {
 void btgattc_track_adv_event_cb(btgatt_track_adv_info_t* p_adv_track_info) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
 
   ScopedLocalRef<jstring> address(
       sCallbackEnv.get(),
@@ -776,6 +895,8 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
       env->GetMethodID(clazz, "onScannerRegistered", "(IIJJ)V");
   method_onScanResult = env->GetMethodID(clazz, "onScanResult",
                                          "(IILjava/lang/String;IIIIII[B)V");
+  method_onScanResultBatch = env->GetMethodID(clazz, "onScanResultBatch",
+                                              "(Ljava/nio/ByteBuffer;I)V");
   method_onConnected =
       env->GetMethodID(clazz, "onConnected", "(IIILjava/lang/String;)V");
   method_onDisconnected =
@@ -872,6 +993,10 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
   method_onServerConnUpdate =
       env->GetMethodID(clazz, "onServerConnUpdate", "(IIIII)V");
 
+  if (env->GetJavaVM(&sJavaVm) != JNI_OK) {
+    error("Could not get JavaVM");
+  }
+
   info("classInitNative: Success!");
 }
 
@@ -918,6 +1043,9 @@ static void initializeNative(JNIEnv* env, jobject object) {
 static void cleanupNative(JNIEnv* env, jobject object) {
   if (!btIf) return;
 
+  // Pending batched results are dropped, the stack is going away.
+  scan_result_batch_stop();
+
   if (sGattIf != NULL) {
     sGattIf->cleanup();
     sGattIf = NULL;
@@ -930,6 +1058,23 @@ static void cleanupNative(JNIEnv* env, jobject object) {
   btIf = NULL;
 }
 
+static void setScanResultBatchingNative(JNIEnv* env, jobject object,
+                                        jint max_reports, jint max_delay_ms) {
+  scan_result_batch_stop();
+  if (max_reports <= 1 || max_delay_ms <= 0) return;
+
+  if (sJavaVm == NULL || method_onScanResultBatch == NULL) {
+    error("Batched scan result delivery is unavailable");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(sScanBatchMutex);
+  sScanBatcher = std::make_unique<android::ScanResultBatcher>(
+      max_reports, std::chrono::milliseconds(max_delay_ms));
+  sScanBatchRunning = true;
+  sScanBatchThread = std::thread(scan_result_batch_thread);
+}
+
 /**
  * Native Client functions
  */
@@ -958,6 +1103,7 @@ void btgattc_register_scanner_cb(const Uuid& app_uuid, uint8_t scannerId,
                                  uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScannerRegistered,
                                status, scannerId, UUID_PARAMS(app_uuid));
 }
@@ -1160,6 +1306,7 @@ static void gattClientReadRemoteRssiNative(JNIEnv* env, jobject object,
 void set_scan_params_cmpl_cb(int client_if, uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanParamSetupCompleted,
                                status, client_if);
 }
@@ -1177,6 +1324,7 @@ void scan_filter_param_cb(uint8_t client_if, uint8_t avbl_space, uint8_t action,
                           uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj,
                                method_onScanFilterParamsConfigured, action,
                                status, client_if, avbl_space);
@@ -1256,6 +1404,7 @@ static void scan_filter_cfg_cb(uint8_t client_if, uint8_t filt_type,
                                uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanFilterConfig, action,
                                status, client_if, filt_type, avbl_space);
 }
@@ -1381,6 +1530,7 @@ static void gattClientScanFilterClearNative(JNIEnv* env, jobject object,
 void scan_enable_cb(uint8_t client_if, uint8_t action, uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanFilterEnableDisabled,
                                action, status, client_if);
 }
@@ -1413,6 +1563,7 @@ static void gattConnectionParameterUpdateNative(JNIEnv* env, jobject object,
 void batchscan_cfg_storage_cb(uint8_t client_if, uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(
       mCallbacksObj, method_onBatchScanStorageConfigured, status, client_if);
 }
@@ -1430,6 +1581,7 @@ static void gattClientConfigBatchScanStorageNative(
 void batchscan_enable_cb(uint8_t client_if, uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
+  scan_result_batch_flush(sCallbackEnv.get());
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onBatchScanStartStopped,
                                0 /* unused */, status, client_if);
 }
@@ -2137,6 +2289,8 @@ static JNINativeMethod sMethods[] = {
     {"classInitNative", "()V", (void*)classInitNative},
     {"initializeNative", "()V", (void*)initializeNative},
     {"cleanupNative", "()V", (void*)cleanupNative},
+    {"setScanResultBatchingNative", "(II)V",
+     (void*)setScanResultBatchingNative},
     {"gattClientGetDeviceTypeNative", "(Ljava/lang/String;)I",
      (void*)gattClientGetDeviceTypeNative},
     {"gattClientRegisterAppNative", "(JJ)V",
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scan_result_batcher.h"
+
+#include <string.h>
+
+namespace android {
+
+namespace {
+
+// Extended advertising reports are at most 1650 bytes; size the arena for a
+// full batch of typical legacy reports up front.
+constexpr size_t kTypicalReportSize = ScanResultBatcher::kRecordHeaderSize + 31;
+
+inline uint8_t* put_u16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+}  // namespace
+
+ScanResultBatcher::ScanResultBatcher(size_t max_reports,
+                                     std::chrono::milliseconds max_delay)
+    : max_reports_(max_reports), max_delay_(max_delay) {
+  arena_.reserve(max_reports_ * kTypicalReportSize);
+}
+
+bool ScanResultBatcher::Append(uint16_t event_type, uint8_t addr_type,
+                               const RawAddress& bda, uint8_t primary_phy,
+                               uint8_t secondary_phy, uint8_t advertising_sid,
+                               int8_t tx_power, int8_t rssi,
+                               uint16_t periodic_adv_int,
+                               const std::vector<uint8_t>& adv_data,
+                               Clock::time_point now) {
+  uint16_t adv_data_len = adv_data.size() > UINT16_MAX
+                              ? UINT16_MAX
+                              : static_cast<uint16_t>(adv_data.size());
+  size_t offset = arena_.size();
+  arena_.resize(offset + kRecordHeaderSize + adv_data_len);
+
+  uint8_t* p = arena_.data() + offset;
+  p = put_u16(p, event_type);
+  *p++ = addr_type;
+  memcpy(p, bda.address, RawAddress::kLength);
+  p += RawAddress::kLength;
+  *p++ = primary_phy;
+  *p++ = secondary_phy;
+  *p++ = advertising_sid;
+  *p++ = static_cast<uint8_t>(tx_power);
+  *p++ = static_cast<uint8_t>(rssi);
+  p = put_u16(p, periodic_adv_int);
+  p = put_u16(p, adv_data_len);
+  if (adv_data_len) memcpy(p, adv_data.data(), adv_data_len);
+
+  if (count_++ == 0) oldest_ = now;
+  return count_ >= max_reports_;
+}
+
+bool ScanResultBatcher::FlushDue(Clock::time_point now) const {
+  if (count_ == 0) return false;
+  return count_ >= max_reports_ || now >= Deadline();
+}
+
+size_t ScanResultBatcher::Take(std::vector<uint8_t>* batch) {
+  size_t count = count_;
+  batch->clear();
+  arena_.swap(*batch);
+  count_ = 0;
+  return count;
+}
+
+}  // namespace android
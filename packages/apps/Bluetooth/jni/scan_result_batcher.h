@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SCAN_RESULT_BATCHER_H
+#define SCAN_RESULT_BATCHER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types/raw_address.h"
+
+namespace android {
+
+/**
+ * Packs scan results into a contiguous arena so that they can be handed to
+ * Java as one direct ByteBuffer instead of one JNI call per report.
+ *
+ * Each record is laid out as follows, multi-byte fields little endian:
+ *
+ *   uint16_t event_type
+ *   uint8_t  addr_type
+ *   uint8_t  address[6]   (same order as RawAddress::address)
+ *   uint8_t  primary_phy
+ *   uint8_t  secondary_phy
+ *   uint8_t  advertising_sid
+ *   int8_t   tx_power
+ *   int8_t   rssi
+ *   uint16_t periodic_adv_int
+ *   uint16_t adv_data_len
+ *   uint8_t  adv_data[adv_data_len]
+ *
+ * This layout is mirrored by com.android.bluetooth.gatt.ScanResultBatch.
+ *
+ * Not thread safe; callers serialize access.
+ */
+class ScanResultBatcher {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kRecordHeaderSize = 18;
+
+  ScanResultBatcher(size_t max_reports, std::chrono::milliseconds max_delay);
+
+  // Appends one report to the arena. Returns true if the batch should now be
+  // flushed because it holds |max_reports| reports.
+  bool Append(uint16_t event_type, uint8_t addr_type, const RawAddress& bda,
+              uint8_t primary_phy, uint8_t secondary_phy,
+              uint8_t advertising_sid, int8_t tx_power, int8_t rssi,
+              uint16_t periodic_adv_int, const std::vector<uint8_t>& adv_data,
+              Clock::time_point now);
+
+  // True if the pending reports should be flushed at |now|, either because
+  // the count threshold is reached or the oldest report is |max_delay| old.
+  bool FlushDue(Clock::time_point now) const;
+
+  // Time at which the oldest pending report reaches |max_delay|. Only
+  // meaningful if there are pending reports.
+  Clock::time_point Deadline() const { return oldest_ + max_delay_; }
+
+  // Moves the pending reports into |batch| and returns how many there are.
+  // The previous contents of |batch| are discarded and its storage is reused
+  // as the next arena, so steady state flushing does not allocate.
+  size_t Take(std::vector<uint8_t>* batch);
+
+  size_t pending() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+ private:
+  size_t max_reports_;
+  std::chrono::milliseconds max_delay_;
+  std::vector<uint8_t> arena_;
+  size_t count_ = 0;
+  Clock::time_point oldest_;
+};
+
+}  // namespace android
+
+#endif  // SCAN_RESULT_BATCHER_H
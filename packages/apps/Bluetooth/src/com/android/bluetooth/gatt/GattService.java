@@ -51,6 +51,7 @@ import android.os.IBinder;
 import android.os.ParcelUuid;
 import android.os.RemoteException;
 import android.os.SystemClock;
+import android.os.SystemProperties;
 import android.os.UserHandle;
 import android.os.WorkSource;
 import android.util.Log;
@@ -64,6 +65,7 @@ import com.android.bluetooth.btservice.ProfileService;
 import com.android.bluetooth.util.NumberUtils;
 import com.android.internal.annotations.VisibleForTesting;
 
+import java.nio.ByteBuffer;
 import java.util.ArrayDeque;
 import java.util.ArrayList;
 import java.util.Arrays;
@@ -100,6 +102,13 @@ public class GattService extends ProfileService {
 
     private static final int ET_LEGACY_MASK = 0x10;
 
+    // Batched scan result delivery, disabled when the batch size is 0 or 1.
+    private static final String SCAN_RESULT_BATCH_SIZE_PROPERTY =
+            "persist.bluetooth.gatt.scan_result_batch_size";
+    private static final String SCAN_RESULT_BATCH_DELAY_PROPERTY =
+            "persist.bluetooth.gatt.scan_result_batch_delay_ms";
+    private static final int SCAN_RESULT_BATCH_DELAY_MS_DEFAULT = 50;
+
     private static final UUID HID_SERVICE_UUID =
             UUID.fromString("00001812-0000-1000-8000-00805F9B34FB");
 
@@ -176,6 +185,11 @@ public class GattService extends ProfileService {
      */
     private final Map<Integer, Set<Integer>> mRestrictedHandles = new HashMap<>();
 
+    /**
+     * Cursor reused for every batch of scan results delivered by native code
+     */
+    private final ScanResultBatch mScanResultBatch = new ScanResultBatch();
+
     private BluetoothAdapter mAdapter;
     private AdvertiseManager mAdvertiseManager;
     private PeriodicScanManager mPeriodicScanManager;
@@ -204,6 +218,9 @@ public class GattService extends ProfileService {
             Log.d(TAG, "start()");
         }
         initializeNative();
+        setScanResultBatchingNative(SystemProperties.getInt(SCAN_RESULT_BATCH_SIZE_PROPERTY, 0),
+                SystemProperties.getInt(SCAN_RESULT_BATCH_DELAY_PROPERTY,
+                        SCAN_RESULT_BATCH_DELAY_MS_DEFAULT));
         mAdapter = BluetoothAdapter.getDefaultAdapter();
         mAppOps = getSystemService(AppOpsManager.class);
         mAdvertiseManager = new AdvertiseManager(this, AdapterService.getAdapterService());
@@ -1040,6 +1057,27 @@ public class GattService extends ProfileService {
         }
     }
 
+    void onScanResultBatch(ByteBuffer batch, int count) {
+        if (VDBG) {
+            Log.d(TAG, "onScanResultBatch() - count=" + count);
+        }
+        // Nothing consumes regular scan results, skip decoding entirely
+        if (mScanManager == null || mScanManager.getRegularScanQueue().isEmpty()) {
+            return;
+        }
+
+        // The scratch arrays handed out by mScanResultBatch are safe to reuse here as
+        // onScanResult() parcels every result before returning and keeps nothing
+        ScanResultBatch results = mScanResultBatch;
+        results.reset(batch, count);
+        while (results.next()) {
+            onScanResult(results.getEventType(), results.getAddressType(),
+                    results.getAddress(), results.getPrimaryPhy(), results.getSecondaryPhy(),
+                    results.getAdvertisingSid(), results.getTxPower(), results.getRssi(),
+                    results.getPeriodicAdvInt(), results.getAdvData());
+        }
+    }
+
     private void sendResultByPendingIntent(PendingIntentInfo pii, ScanResult result,
             int callbackType, ScanClient client) {
         ArrayList<ScanResult> results = new ArrayList<>();
@@ -3266,6 +3304,8 @@ public class GattService extends ProfileService {
 
     private native void cleanupNative();
 
+    private native void setScanResultBatchingNative(int maxReports, int maxDelayMs);
+
     private native int gattClientGetDeviceTypeNative(String address);
 
     private native void gattClientRegisterAppNative(long appUuidLsb, long appUuidMsb);
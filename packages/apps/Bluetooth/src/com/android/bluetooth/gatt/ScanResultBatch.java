@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.bluetooth.gatt;
+
+import com.android.bluetooth.Utils;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Cursor over a batch of scan results packed by the native ScanResultBatcher.
+ *
+ * Fields are read straight out of the packed buffer when asked for, so the
+ * address string and advertising data are only materialized for reports that
+ * somebody consumes. The buffer is owned by native code and is only valid for
+ * the duration of the onScanResultBatch() callback.
+ *
+ * One instance is reused for every batch, and the arrays returned by
+ * getAdvData() are scratch arrays that are overwritten by later reports, so
+ * callers must be done with them before moving to the next report. Batches are
+ * delivered one at a time by native code, so no locking is needed here.
+ */
+class ScanResultBatch {
+    // Must match the record layout in jni/scan_result_batcher.h
+    private static final int OFFSET_EVENT_TYPE = 0;
+    private static final int OFFSET_ADDRESS_TYPE = 2;
+    private static final int OFFSET_ADDRESS = 3;
+    private static final int OFFSET_PRIMARY_PHY = 9;
+    private static final int OFFSET_SECONDARY_PHY = 10;
+    private static final int OFFSET_ADVERTISING_SID = 11;
+    private static final int OFFSET_TX_POWER = 12;
+    private static final int OFFSET_RSSI = 13;
+    private static final int OFFSET_PERIODIC_ADV_INT = 14;
+    private static final int OFFSET_ADV_DATA_LENGTH = 16;
+    private static final int RECORD_HEADER_SIZE = 18;
+
+    private static final int ADDRESS_LENGTH = 6;
+    // Largest extended advertising data a controller can report
+    private static final int MAX_ADV_DATA_LENGTH = 1650;
+
+    private ByteBuffer mBuffer;
+    private int mCount;
+    private int mIndex;
+    private int mRecord;
+    private int mNextRecord;
+
+    // Reused across reports: the last address seen and its string form, and one
+    // advertising data array per length since callers need exact sized arrays
+    private final byte[] mAddress = new byte[ADDRESS_LENGTH];
+    private String mAddressString;
+    private final byte[][] mAdvData = new byte[MAX_ADV_DATA_LENGTH + 1][];
+
+    /** Points this cursor at a new batch, before its first report. */
+    void reset(ByteBuffer buffer, int count) {
+        mBuffer = buffer.order(ByteOrder.LITTLE_ENDIAN);
+        mCount = count;
+        mIndex = -1;
+        mRecord = 0;
+        mNextRecord = 0;
+    }
+
+    int size() {
+        return mCount;
+    }
+
+    /**
+     * Advances to the next report. Returns false once all reports were visited or the
+     * buffer is truncated.
+     */
+    boolean next() {
+        if (mIndex + 1 >= mCount || mNextRecord + RECORD_HEADER_SIZE > mBuffer.limit()) {
+            return false;
+        }
+        int advDataLength = mBuffer.getShort(mNextRecord + OFFSET_ADV_DATA_LENGTH) & 0xFFFF;
+        if (mNextRecord + RECORD_HEADER_SIZE + advDataLength > mBuffer.limit()) {
+            return false;
+        }
+        mIndex++;
+        mRecord = mNextRecord;
+        mNextRecord += RECORD_HEADER_SIZE + advDataLength;
+        return true;
+    }
+
+    int getEventType() {
+        return mBuffer.getShort(mRecord + OFFSET_EVENT_TYPE) & 0xFFFF;
+    }
+
+    int getAddressType() {
+        return mBuffer.get(mRecord + OFFSET_ADDRESS_TYPE) & 0xFF;
+    }
+
+    String getAddress() {
+        boolean same = mAddressString != null;
+        for (int i = 0; i < ADDRESS_LENGTH; i++) {
+            byte b = mBuffer.get(mRecord + OFFSET_ADDRESS + i);
+            same &= (mAddress[i] == b);
+            mAddress[i] = b;
+        }
+        if (!same) {
+            mAddressString = Utils.getAddressStringFromByte(mAddress);
+        }
+        return mAddressString;
+    }
+
+    int getPrimaryPhy() {
+        return mBuffer.get(mRecord + OFFSET_PRIMARY_PHY) & 0xFF;
+    }
+
+    int getSecondaryPhy() {
+        return mBuffer.get(mRecord + OFFSET_SECONDARY_PHY) & 0xFF;
+    }
+
+    int getAdvertisingSid() {
+        return mBuffer.get(mRecord + OFFSET_ADVERTISING_SID) & 0xFF;
+    }
+
+    int getTxPower() {
+        return mBuffer.get(mRecord + OFFSET_TX_POWER);
+    }
+
+    int getRssi() {
+        return mBuffer.get(mRecord + OFFSET_RSSI);
+    }
+
+    int getPeriodicAdvInt() {
+        return mBuffer.getShort(mRecord + OFFSET_PERIODIC_ADV_INT) & 0xFFFF;
+    }
+
+    /**
+     * Returns the advertising data of the current report. The array is only valid until the
+     * next call to getAdvData() with the same length.
+     */
+    byte[] getAdvData() {
+        int length = mNextRecord - mRecord - RECORD_HEADER_SIZE;
+        byte[] advData = length <= MAX_ADV_DATA_LENGTH ? mAdvData[length] : null;
+        if (advData == null) {
+            advData = new byte[length];
+            if (length <= MAX_ADV_DATA_LENGTH) {
+                mAdvData[length] = advData;
+            }
+        }
+        for (int i = 0; i < length; i++) {
+            advData[i] = mBuffer.get(mRecord + RECORD_HEADER_SIZE + i);
+        }
+        return advData;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "scan_result_batcher.h"
+
+using ::android::ScanResultBatcher;
+
+namespace {
+
+// Two packed reports. The same bytes are parsed by ScanResultBatchTest on the
+// Java side, keep both in sync when the layout changes.
+const std::vector<uint8_t> kGoldenBatch = {
+    // event_type 0x001b, addr_type 1, address 00:11:22:33:44:55
+    0x1b, 0x00, 0x01, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+    // primary_phy 1, secondary_phy 2, sid 3, tx_power -5, rssi -70
+    0x01, 0x02, 0x03, 0xfb, 0xba,
+    // periodic_adv_int 0x1234, adv_data_len 3, adv_data
+    0x34, 0x12, 0x03, 0x00, 0x02, 0x01, 0x06,
+    // event_type 0x0010, addr_type 0, address c0:de:c0:de:00:01
+    0x10, 0x00, 0x00, 0xc0, 0xde, 0xc0, 0xde, 0x00, 0x01,
+    // primary_phy 3, secondary_phy 0, sid 0xff, tx_power 127, rssi -128
+    0x03, 0x00, 0xff, 0x7f, 0x80,
+    // periodic_adv_int 0, no adv_data
+    0x00, 0x00, 0x00, 0x00};
+
+ScanResultBatcher::Clock::time_point kNow = ScanResultBatcher::Clock::now();
+
+void AppendGoldenReports(ScanResultBatcher* batcher) {
+  batcher->Append(0x001b, 0x01,
+                  RawAddress({0x00, 0x11, 0x22, 0x33, 0x44, 0x55}), 0x01,
+                  0x02, 0x03, -5, -70, 0x1234, {0x02, 0x01, 0x06}, kNow);
+  batcher->Append(0x0010, 0x00,
+                  RawAddress({0xc0, 0xde, 0xc0, 0xde, 0x00, 0x01}), 0x03,
+                  0x00, 0xff, 127, -128, 0x0000, {}, kNow);
+}
+
+}  // namespace
+
+TEST(ScanResultBatcherTest, packs_the_layout_parsed_by_java) {
+  ScanResultBatcher batcher(16, std::chrono::milliseconds(50));
+  AppendGoldenReports(&batcher);
+
+  std::vector<uint8_t> batch;
+  EXPECT_EQ(2u, batcher.Take(&batch));
+  EXPECT_EQ(kGoldenBatch, batch);
+  EXPECT_TRUE(batcher.empty());
+}
+
+TEST(ScanResultBatcherTest, reused_arena_packs_the_same_layout) {
+  ScanResultBatcher batcher(16, std::chrono::milliseconds(50));
+  std::vector<uint8_t> batch;
+  AppendGoldenReports(&batcher);
+  batcher.Take(&batch);
+
+  // The second batch is packed into the storage handed back by Take()
+  AppendGoldenReports(&batcher);
+  EXPECT_EQ(2u, batcher.Take(&batch));
+  EXPECT_EQ(kGoldenBatch, batch);
+}
+
+TEST(ScanResultBatcherTest, flush_is_due_on_count_or_delay) {
+  ScanResultBatcher batcher(2, std::chrono::milliseconds(50));
+  EXPECT_FALSE(batcher.Append(0x1b, 0x01, RawAddress::kEmpty, 0x01, 0x00, 0xff,
+                              127, -60, 0, {}, kNow));
+  EXPECT_FALSE(batcher.FlushDue(kNow));
+  EXPECT_TRUE(batcher.FlushDue(kNow + std::chrono::milliseconds(50)));
+  EXPECT_TRUE(batcher.Append(0x1b, 0x01, RawAddress::kEmpty, 0x01, 0x00, 0xff,
+                             127, -60, 0, {}, kNow));
+  EXPECT_TRUE(batcher.FlushDue(kNow));
+}
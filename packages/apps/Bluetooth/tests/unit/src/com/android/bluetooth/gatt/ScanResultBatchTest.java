@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.bluetooth.gatt;
+
+import androidx.test.filters.SmallTest;
+import androidx.test.runner.AndroidJUnit4;
+
+import org.junit.Assert;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Test cases for {@link ScanResultBatch}.
+ */
+@SmallTest
+@RunWith(AndroidJUnit4.class)
+public class ScanResultBatchTest {
+    // Two reports as packed by the native ScanResultBatcher. The same bytes are checked against
+    // the packer in tests/jni/scan_result_batcher_test.cpp, keep both in sync.
+    private static final byte[] GOLDEN_BATCH = {
+            // event_type 0x001b, addr_type 1, address 00:11:22:33:44:55
+            0x1b, 0x00, 0x01, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+            // primary_phy 1, secondary_phy 2, sid 3, tx_power -5, rssi -70
+            0x01, 0x02, 0x03, (byte) 0xfb, (byte) 0xba,
+            // periodic_adv_int 0x1234, adv_data_len 3, adv_data
+            0x34, 0x12, 0x03, 0x00, 0x02, 0x01, 0x06,
+            // event_type 0x0010, addr_type 0, address c0:de:c0:de:00:01
+            0x10, 0x00, 0x00, (byte) 0xc0, (byte) 0xde, (byte) 0xc0, (byte) 0xde, 0x00, 0x01,
+            // primary_phy 3, secondary_phy 0, sid 0xff, tx_power 127, rssi -128
+            0x03, 0x00, (byte) 0xff, 0x7f, (byte) 0x80,
+            // periodic_adv_int 0, no adv_data
+            0x00, 0x00, 0x00, 0x00};
+
+    private static ByteBuffer goldenBuffer() {
+        ByteBuffer buffer = ByteBuffer.allocateDirect(GOLDEN_BATCH.length);
+        buffer.put(GOLDEN_BATCH);
+        buffer.rewind();
+        return buffer;
+    }
+
+    @Test
+    public void testParsesNativeLayout() {
+        ScanResultBatch batch = new ScanResultBatch();
+        batch.reset(goldenBuffer(), 2);
+        Assert.assertEquals(2, batch.size());
+
+        Assert.assertTrue(batch.next());
+        Assert.assertEquals(0x001b, batch.getEventType());
+        Assert.assertEquals(1, batch.getAddressType());
+        Assert.assertEquals("00:11:22:33:44:55", batch.getAddress());
+        Assert.assertEquals(1, batch.getPrimaryPhy());
+        Assert.assertEquals(2, batch.getSecondaryPhy());
+        Assert.assertEquals(3, batch.getAdvertisingSid());
+        Assert.assertEquals(-5, batch.getTxPower());
+        Assert.assertEquals(-70, batch.getRssi());
+        Assert.assertEquals(0x1234, batch.getPeriodicAdvInt());
+        Assert.assertArrayEquals(new byte[] {0x02, 0x01, 0x06}, batch.getAdvData());
+
+        Assert.assertTrue(batch.next());
+        Assert.assertEquals(0x0010, batch.getEventType());
+        Assert.assertEquals(0, batch.getAddressType());
+        Assert.assertEquals("C0:DE:C0:DE:00:01", batch.getAddress());
+        Assert.assertEquals(3, batch.getPrimaryPhy());
+        Assert.assertEquals(0, batch.getSecondaryPhy());
+        Assert.assertEquals(0xff, batch.getAdvertisingSid());
+        Assert.assertEquals(127, batch.getTxPower());
+        Assert.assertEquals(-128, batch.getRssi());
+        Assert.assertEquals(0, batch.getPeriodicAdvInt());
+        Assert.assertEquals(0, batch.getAdvData().length);
+
+        Assert.assertFalse(batch.next());
+    }
+
+    @Test
+    public void testReusedCursorStartsOver() {
+        ScanResultBatch batch = new ScanResultBatch();
+        batch.reset(goldenBuffer(), 2);
+        while (batch.next()) {
+            batch.getAddress();
+        }
+
+        batch.reset(goldenBuffer(), 1);
+        Assert.assertTrue(batch.next());
+        Assert.assertEquals("00:11:22:33:44:55", batch.getAddress());
+        Assert.assertArrayEquals(new byte[] {0x02, 0x01, 0x06}, batch.getAdvData());
+        Assert.assertFalse(batch.next());
+    }
+
+    @Test
+    public void testTruncatedBufferStops() {
+        ByteBuffer buffer = goldenBuffer();
+        // Cut into the advertising data of the first report
+        buffer.limit(20);
+        ScanResultBatch batch = new ScanResultBatch();
+        batch.reset(buffer, 2);
+        Assert.assertFalse(batch.next());
+    }
+}
@@ -0,0 +1,159 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*****************************************************************************
+ *
+ *  Filename:      audio_a2dp_hw_pcm_ring.h
+ *
+ *  Description:   Shared memory PCM transport between the A2DP audio HAL
+ *                 and the A2DP source in the Bluetooth stack
+ *
+ *****************************************************************************/
+
+#ifndef AUDIO_A2DP_HW_PCM_RING_H
+#define AUDIO_A2DP_HW_PCM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+/*****************************************************************************
+ *  Constants & Macros
+ *****************************************************************************/
+
+#define A2DP_PCM_RING_MAGIC 0x52504432 /* "2DPR" */
+#define A2DP_PCM_RING_VERSION 1
+
+/*****************************************************************************
+ *  Type definitions
+ *****************************************************************************/
+
+// Layout of the start of the shared memory region, followed by |capacity|
+// bytes of PCM data. The HAL is the only writer of |write_pos| and the stack
+// the only reader of |read_pos|. Both positions are free running byte counts,
+// the capacity is a power of two.
+//
+// A side only signals the peer's eventfd when the peer flagged that it is
+// about to sleep, so a stream that neither underruns nor overruns costs no
+// system calls at all.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  std::atomic<uint32_t> closed;
+
+  alignas(64) std::atomic<uint32_t> write_pos;
+  std::atomic<uint32_t> reader_waiting;
+
+  alignas(64) std::atomic<uint32_t> read_pos;
+  std::atomic<uint32_t> writer_waiting;
+} tA2DP_PCM_RING_SHARED;
+
+typedef struct {
+  tA2DP_PCM_RING_SHARED* shared;
+  uint8_t* data;
+  size_t map_size;
+  int mem_fd;
+  int data_evt_fd;  /* signalled by the writer once data was added */
+  int space_evt_fd; /* signalled by the reader once space was freed */
+} tA2DP_PCM_RING;
+
+// First message sent by the HAL on a newly connected data socket. When
+// |capacity| is non zero, the memfd and both eventfds of the ring are attached
+// as SCM_RIGHTS, in that order. The stack answers with a single byte
+// A2DP_CTRL_ACK_SUCCESS if it will read from the ring, anything else means
+// PCM keeps flowing over the socket.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+} tA2DP_PCM_RING_HELLO;
+
+// Progress of the stack side of the handshake
+typedef enum {
+  A2DP_PCM_RING_ACCEPT_PENDING,  /* the hello has not fully arrived yet */
+  A2DP_PCM_RING_ACCEPT_DONE,     /* the hello was answered */
+  A2DP_PCM_RING_ACCEPT_NO_HELLO, /* the peer sent something else */
+  A2DP_PCM_RING_ACCEPT_FAILED,   /* the peer went away or sent a bad hello */
+} tA2DP_PCM_RING_ACCEPT;
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+// Initializes |ring| to the detached state.
+void a2dp_pcm_ring_init(tA2DP_PCM_RING* ring);
+
+// Creates a new ring able to hold at least |capacity| bytes. Returns false
+// if shared memory is not available, in which case the socket is used.
+bool a2dp_pcm_ring_create(tA2DP_PCM_RING* ring, size_t capacity);
+
+// Marks |ring| closed and wakes up both sides, so that a read or write in
+// progress on another thread returns. The ring stays mapped.
+void a2dp_pcm_ring_close(tA2DP_PCM_RING* ring);
+
+// Closes |ring|, unmaps it and closes its file descriptors.
+void a2dp_pcm_ring_destroy(tA2DP_PCM_RING* ring);
+
+// Returns true if |ring| is mapped.
+inline bool a2dp_pcm_ring_is_attached(const tA2DP_PCM_RING* ring) {
+  return ring->shared != nullptr;
+}
+
+// Writes |len| bytes, waiting up to |timeout_ms| for the reader to free up
+// space. |hangup_fd| is polled alongside so that a vanished peer is noticed.
+// Returns |len| on success, -1 on timeout or if the reader went away.
+ssize_t a2dp_pcm_ring_write(tA2DP_PCM_RING* ring, const void* p, size_t len,
+                            int timeout_ms, int hangup_fd);
+
+// Reads up to |len| bytes, waiting up to |timeout_ms| for the writer to
+// provide them. Returns the number of bytes read, which is short on timeout,
+// or -1 if the writer went away and the ring is drained.
+ssize_t a2dp_pcm_ring_read(tA2DP_PCM_RING* ring, void* p, size_t len,
+                           int timeout_ms, int hangup_fd);
+
+// Returns the number of bytes available to the reader.
+size_t a2dp_pcm_ring_readable(const tA2DP_PCM_RING* ring);
+
+// Discards all data available to the reader.
+void a2dp_pcm_ring_flush(tA2DP_PCM_RING* ring);
+
+// HAL side of the handshake on the data socket |skt_fd|. Offers |ring| if it
+// is attached, and waits up to |timeout_ms| for the stack's answer. Returns
+// false if the stack did not answer. If the stack declined the ring, |ring|
+// is destroyed and PCM is written to the socket.
+bool a2dp_pcm_ring_offer(int skt_fd, tA2DP_PCM_RING* ring, int timeout_ms);
+
+// Stack side of the handshake, without blocking. Takes the HAL's hello from
+// |skt_fd| if it fully arrived and, if |use_ring| is set, maps the offered
+// ring into |ring|. Once done, PCM is read from |ring| if it is attached, and
+// from the socket if not. A peer that starts with anything other than a hello
+// gets A2DP_PCM_RING_ACCEPT_NO_HELLO and nothing is taken from the socket.
+tA2DP_PCM_RING_ACCEPT a2dp_pcm_ring_try_accept(int skt_fd, bool use_ring,
+                                              tA2DP_PCM_RING* ring);
+
+// Stack side of the handshake. Waits up to |timeout_ms| for the HAL's hello
+// on |skt_fd| and, if |use_ring| is set, maps the offered ring into |ring|.
+// Returns false if no valid hello arrived. Otherwise PCM is read from |ring|
+// if it is attached, and from the socket if not.
+bool a2dp_pcm_ring_accept(int skt_fd, bool use_ring, tA2DP_PCM_RING* ring,
+                          int timeout_ms);
+
+#endif /* AUDIO_A2DP_HW_PCM_RING_H */
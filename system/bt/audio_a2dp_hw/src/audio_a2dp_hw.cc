@@ -49,6 +49,7 @@
 #include "osi/include/socket_utils/sockets.h"
 
 #include "audio_a2dp_hw.h"
+#include "audio_a2dp_hw_pcm_ring.h"
 
 /*****************************************************************************
  *  Constants & Macros
@@ -58,6 +59,7 @@
 #define USEC_PER_SEC 1000000L
 #define SOCK_SEND_TIMEOUT_MS 2000 /* Timeout for sending */
 #define SOCK_RECV_TIMEOUT_MS 5000 /* Timeout for receiving */
+#define PCM_RING_HANDSHAKE_TIMEOUT_MS 500
 #define SEC_TO_MS 1000
 #define SEC_TO_NS 1000000000
 #define MS_TO_NS 1000000
@@ -121,6 +123,9 @@ struct a2dp_stream_common {
   std::recursive_mutex* mutex;  // See note below on mutex acquisition order.
   int ctrl_fd;
   int audio_fd;
+  bool use_pcm_ring;        // Offer the stack a shared memory PCM ring
+  tA2DP_PCM_RING pcm_ring;  // Attached while PCM flows through the ring
+  bool pcm_ring_writing;    // out_write() uses the ring without the mutex
   size_t buffer_sz;
   struct a2dp_config cfg;
   a2dp_state_t state;
@@ -816,6 +821,9 @@ static void a2dp_stream_common_init(struct a2dp_stream_common* common) {
 
   common->ctrl_fd = AUDIO_SKT_DISCONNECTED;
   common->audio_fd = AUDIO_SKT_DISCONNECTED;
+  common->use_pcm_ring = false;
+  a2dp_pcm_ring_init(&common->pcm_ring);
+  common->pcm_ring_writing = false;
   common->state = AUDIO_A2DP_STATE_STOPPED;
 
   /* manages max capacity of socket pipe */
@@ -829,6 +837,35 @@ static void a2dp_stream_common_destroy(struct a2dp_stream_common* common) {
   common->mutex = NULL;
 }
 
+/* Negotiates the PCM transport on a freshly connected data socket */
+static bool open_pcm_ring(struct a2dp_stream_common* common) {
+  if (common->use_pcm_ring &&
+      !a2dp_pcm_ring_create(&common->pcm_ring, common->buffer_sz)) {
+    WARN("shared memory unavailable, using the data socket");
+  }
+
+  if (!a2dp_pcm_ring_offer(common->audio_fd, &common->pcm_ring,
+                           PCM_RING_HANDSHAKE_TIMEOUT_MS)) {
+    return false;
+  }
+
+  INFO("PCM transport: %s",
+       a2dp_pcm_ring_is_attached(&common->pcm_ring) ? "shared memory ring"
+                                                    : "socket");
+  return true;
+}
+
+static void close_audio_path(struct a2dp_stream_common* common) {
+  if (common->pcm_ring_writing) {
+    // Unblock the writer, it releases the ring once it holds the mutex again
+    a2dp_pcm_ring_close(&common->pcm_ring);
+  } else {
+    a2dp_pcm_ring_destroy(&common->pcm_ring);
+  }
+  skt_disconnect(common->audio_fd);
+  common->audio_fd = AUDIO_SKT_DISCONNECTED;
+}
+
 static int start_audio_datapath(struct a2dp_stream_common* common) {
   INFO("state %d", common->state);
 
@@ -851,6 +888,11 @@ static int start_audio_datapath(struct a2dp_stream_common* common) {
       ERROR("Audiopath start failed - error opening data socket");
       goto error;
     }
+    if (!open_pcm_ring(common)) {
+      ERROR("Audiopath start failed - data socket handshake");
+      close_audio_path(common);
+      goto error;
+    }
   }
   common->state = (a2dp_state_t)AUDIO_A2DP_STATE_STARTED;
 
@@ -882,8 +924,7 @@ static int stop_audio_datapath(struct a2dp_stream_common* common) {
   common->state = (a2dp_state_t)AUDIO_A2DP_STATE_STOPPED;
 
   /* disconnect audio path */
-  skt_disconnect(common->audio_fd);
-  common->audio_fd = AUDIO_SKT_DISCONNECTED;
+  close_audio_path(common);
 
   return 0;
 }
@@ -902,9 +943,7 @@ static int suspend_audio_datapath(struct a2dp_stream_common* common,
     common->state = AUDIO_A2DP_STATE_SUSPENDED;
 
   /* disconnect audio path */
-  skt_disconnect(common->audio_fd);
-
-  common->audio_fd = AUDIO_SKT_DISCONNECTED;
+  close_audio_path(common);
 
   return 0;
 }
@@ -954,13 +993,24 @@ static ssize_t out_write(struct audio_stream_out* stream, const void* buffer,
           out->common.audio_fd);
   }
 
+  out->common.pcm_ring_writing =
+      a2dp_pcm_ring_is_attached(&out->common.pcm_ring);
   lock.unlock();
-  sent = skt_write(out->common.audio_fd, buffer, write_bytes);
+  if (out->common.pcm_ring_writing) {
+    sent = a2dp_pcm_ring_write(&out->common.pcm_ring, buffer, write_bytes,
+                               SOCK_SEND_TIMEOUT_MS, out->common.audio_fd);
+  } else {
+    sent = skt_write(out->common.audio_fd, buffer, write_bytes);
+  }
   lock.lock();
+  out->common.pcm_ring_writing = false;
+  if (out->common.audio_fd == AUDIO_SKT_DISCONNECTED) {
+    // The audio path was closed while writing
+    a2dp_pcm_ring_destroy(&out->common.pcm_ring);
+  }
 
   if (sent == -1) {
-    skt_disconnect(out->common.audio_fd);
-    out->common.audio_fd = AUDIO_SKT_DISCONNECTED;
+    close_audio_path(&out->common);
     if ((out->common.state != AUDIO_A2DP_STATE_SUSPENDED) &&
         (out->common.state != AUDIO_A2DP_STATE_STOPPING)) {
       out->common.state = AUDIO_A2DP_STATE_STOPPED;
@@ -1520,8 +1570,7 @@ static ssize_t in_read(struct audio_stream_in* stream, void* buffer,
   read = skt_read(in->common.audio_fd, buffer, bytes);
   lock.lock();
   if (read == -1) {
-    skt_disconnect(in->common.audio_fd);
-    in->common.audio_fd = AUDIO_SKT_DISCONNECTED;
+    close_audio_path(&in->common);
     if ((in->common.state != AUDIO_A2DP_STATE_SUSPENDED) &&
         (in->common.state != AUDIO_A2DP_STATE_STOPPING)) {
       in->common.state = AUDIO_A2DP_STATE_STOPPED;
@@ -1607,6 +1656,7 @@ static int adev_open_output_stream(struct audio_hw_device* dev,
 
   /* initialize a2dp specifics */
   a2dp_stream_common_init(&out->common);
+  out->common.use_pcm_ring = true;
 
   // Make sure we always have the feeding parameters configured
   btav_a2dp_codec_config_t codec_config;
@@ -0,0 +1,511 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*****************************************************************************
+ *
+ *  Filename:      audio_a2dp_hw_pcm_ring.cc
+ *
+ *  Description:   Single producer / single consumer PCM ring in a memfd,
+ *                 shared between the A2DP audio HAL and the Bluetooth stack
+ *
+ *****************************************************************************/
+
+#define LOG_TAG "bt_a2dp_pcm_ring"
+
+#include "audio_a2dp_hw_pcm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+
+#include "audio_a2dp_hw.h"
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+/*****************************************************************************
+ *  Constants & Macros
+ *****************************************************************************/
+
+#define A2DP_PCM_RING_DATA_OFFSET 256
+#define A2DP_PCM_RING_NUM_FDS 3
+
+static_assert(sizeof(tA2DP_PCM_RING_SHARED) <= A2DP_PCM_RING_DATA_OFFSET,
+              "ring header overlaps the PCM data");
+
+typedef enum {
+  A2DP_PCM_RING_WAIT_SIGNALLED,
+  A2DP_PCM_RING_WAIT_TIMEOUT,
+  A2DP_PCM_RING_WAIT_HANGUP,
+} tA2DP_PCM_RING_WAIT;
+
+/*****************************************************************************
+ *  Static functions
+ *****************************************************************************/
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void signal_evt_fd(int fd) {
+  uint64_t one = 1;
+  ssize_t ret;
+  OSI_NO_INTR(ret = write(fd, &one, sizeof(one)));
+  if (ret < 0 && errno != EAGAIN) {
+    LOG_ERROR("%s: eventfd write failed (%s)", __func__, strerror(errno));
+  }
+}
+
+// Sleeps on |evt_fd| until it is signalled, |hangup_fd| becomes readable
+// (the peer never sends anything after the handshake, so that means it hung
+// up), or |deadline_ms| passes.
+static tA2DP_PCM_RING_WAIT wait_evt_fd(int evt_fd, int hangup_fd,
+                                       uint64_t deadline_ms) {
+  uint64_t now = now_ms();
+  if (now >= deadline_ms) return A2DP_PCM_RING_WAIT_TIMEOUT;
+
+  struct pollfd pfd[2];
+  pfd[0].fd = evt_fd;
+  pfd[0].events = POLLIN;
+  pfd[0].revents = 0;
+  pfd[1].fd = hangup_fd;
+  pfd[1].events = POLLIN;
+  pfd[1].revents = 0;
+
+  int ret;
+  OSI_NO_INTR(ret = poll(pfd, 2, (int)(deadline_ms - now)));
+  if (ret == 0) return A2DP_PCM_RING_WAIT_TIMEOUT;
+  if (ret < 0) {
+    LOG_ERROR("%s: poll failed (%s)", __func__, strerror(errno));
+    return A2DP_PCM_RING_WAIT_HANGUP;
+  }
+  if (pfd[1].revents) return A2DP_PCM_RING_WAIT_HANGUP;
+
+  uint64_t count;
+  OSI_NO_INTR(ret = read(evt_fd, &count, sizeof(count)));
+  return A2DP_PCM_RING_WAIT_SIGNALLED;
+}
+
+static void close_fd(int* fd) {
+  if (*fd != -1) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+static bool map_ring(tA2DP_PCM_RING* ring, size_t map_size) {
+  void* addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    ring->mem_fd, 0);
+  if (addr == MAP_FAILED) {
+    LOG_ERROR("%s: mmap failed (%s)", __func__, strerror(errno));
+    return false;
+  }
+  ring->shared = static_cast<tA2DP_PCM_RING_SHARED*>(addr);
+  ring->data = static_cast<uint8_t*>(addr) + A2DP_PCM_RING_DATA_OFFSET;
+  ring->map_size = map_size;
+  return true;
+}
+
+// Attaches the reader to a ring created by the HAL.
+static bool attach_ring(tA2DP_PCM_RING* ring, int mem_fd, int data_evt_fd,
+                        int space_evt_fd) {
+  ring->mem_fd = mem_fd;
+  ring->data_evt_fd = data_evt_fd;
+  ring->space_evt_fd = space_evt_fd;
+
+  struct stat st;
+  if (fstat(mem_fd, &st) < 0 || st.st_size <= A2DP_PCM_RING_DATA_OFFSET) {
+    LOG_ERROR("%s: invalid ring memory", __func__);
+    a2dp_pcm_ring_destroy(ring);
+    return false;
+  }
+  if (!map_ring(ring, st.st_size)) {
+    a2dp_pcm_ring_destroy(ring);
+    return false;
+  }
+
+  uint32_t capacity = ring->shared->capacity;
+  if (ring->shared->magic != A2DP_PCM_RING_MAGIC ||
+      ring->shared->version != A2DP_PCM_RING_VERSION || capacity == 0 ||
+      (capacity & (capacity - 1)) != 0 ||
+      capacity > ring->map_size - A2DP_PCM_RING_DATA_OFFSET) {
+    LOG_ERROR("%s: invalid ring header", __func__);
+    a2dp_pcm_ring_destroy(ring);
+    return false;
+  }
+  return true;
+}
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+void a2dp_pcm_ring_init(tA2DP_PCM_RING* ring) {
+  ring->shared = nullptr;
+  ring->data = nullptr;
+  ring->map_size = 0;
+  ring->mem_fd = -1;
+  ring->data_evt_fd = -1;
+  ring->space_evt_fd = -1;
+}
+
+bool a2dp_pcm_ring_create(tA2DP_PCM_RING* ring, size_t capacity) {
+  a2dp_pcm_ring_init(ring);
+
+  uint32_t pow2 = 1;
+  while (pow2 < capacity) pow2 <<= 1;
+  size_t map_size = A2DP_PCM_RING_DATA_OFFSET + pow2;
+
+  ring->mem_fd = syscall(__NR_memfd_create, "a2dp_pcm_ring", MFD_CLOEXEC);
+  if (ring->mem_fd < 0) {
+    LOG_WARN("%s: memfd_create failed (%s)", __func__, strerror(errno));
+    a2dp_pcm_ring_destroy(ring);
+    return false;
+  }
+  if (ftruncate(ring->mem_fd, map_size) < 0) {
+    LOG_ERROR("%s: ftruncate failed (%s)", __func__, strerror(errno));
+    a2dp_pcm_ring_destroy(ring);
+    return false;
+  }
+  ring->data_evt_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  ring->space_evt_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (ring->data_evt_fd < 0 || ring->space_evt_fd < 0 ||
+      !map_ring(ring, map_size)) {
+    LOG_ERROR("%s: unable to set up ring", __func__);
+    a2dp_pcm_ring_destroy(ring);
+    return false;
+  }
+
+  tA2DP_PCM_RING_SHARED* shared = new (ring->shared) tA2DP_PCM_RING_SHARED;
+  shared->magic = A2DP_PCM_RING_MAGIC;
+  shared->version = A2DP_PCM_RING_VERSION;
+  shared->capacity = pow2;
+  shared->closed.store(0);
+  shared->write_pos.store(0);
+  shared->reader_waiting.store(0);
+  shared->read_pos.store(0);
+  shared->writer_waiting.store(0);
+  return true;
+}
+
+void a2dp_pcm_ring_close(tA2DP_PCM_RING* ring) {
+  if (ring->shared == nullptr) return;
+  ring->shared->closed.store(1);
+  signal_evt_fd(ring->data_evt_fd);
+  signal_evt_fd(ring->space_evt_fd);
+}
+
+void a2dp_pcm_ring_destroy(tA2DP_PCM_RING* ring) {
+  if (ring->shared != nullptr) {
+    a2dp_pcm_ring_close(ring);
+    munmap(ring->shared, ring->map_size);
+  }
+  close_fd(&ring->mem_fd);
+  close_fd(&ring->data_evt_fd);
+  close_fd(&ring->space_evt_fd);
+  ring->shared = nullptr;
+  ring->data = nullptr;
+  ring->map_size = 0;
+}
+
+ssize_t a2dp_pcm_ring_write(tA2DP_PCM_RING* ring, const void* p, size_t len,
+                            int timeout_ms, int hangup_fd) {
+  tA2DP_PCM_RING_SHARED* shared = ring->shared;
+  const uint32_t capacity = shared->capacity;
+  const uint8_t* src = static_cast<const uint8_t*>(p);
+  uint64_t deadline_ms = now_ms() + timeout_ms;
+  size_t count = 0;
+
+  while (count < len) {
+    if (shared->closed.load(std::memory_order_acquire)) return -1;
+
+    uint32_t write_pos = shared->write_pos.load(std::memory_order_relaxed);
+    uint32_t read_pos = shared->read_pos.load(std::memory_order_acquire);
+    uint32_t space = capacity - (write_pos - read_pos);
+    if (space == 0) {
+      // Publish that we are about to sleep, then check again so that a
+      // concurrent read is not missed.
+      shared->writer_waiting.store(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      read_pos = shared->read_pos.load(std::memory_order_relaxed);
+      tA2DP_PCM_RING_WAIT result = A2DP_PCM_RING_WAIT_SIGNALLED;
+      if (read_pos == write_pos - capacity) {
+        result = wait_evt_fd(ring->space_evt_fd, hangup_fd, deadline_ms);
+      }
+      shared->writer_waiting.store(0, std::memory_order_relaxed);
+      if (result == A2DP_PCM_RING_WAIT_TIMEOUT) {
+        LOG_WARN("%s: write timeout exceeded, sent %zu bytes", __func__,
+                 count);
+        return -1;
+      }
+      if (result == A2DP_PCM_RING_WAIT_HANGUP) return -1;
+      continue;
+    }
+
+    uint32_t n = std::min<size_t>(space, len - count);
+    uint32_t offset = write_pos & (capacity - 1);
+    uint32_t first = std::min(n, capacity - offset);
+    memcpy(ring->data + offset, src + count, first);
+    memcpy(ring->data, src + count + first, n - first);
+    shared->write_pos.store(write_pos + n, std::memory_order_release);
+    count += n;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (shared->reader_waiting.load(std::memory_order_relaxed)) {
+      signal_evt_fd(ring->data_evt_fd);
+    }
+  }
+  return count;
+}
+
+ssize_t a2dp_pcm_ring_read(tA2DP_PCM_RING* ring, void* p, size_t len,
+                           int timeout_ms, int hangup_fd) {
+  tA2DP_PCM_RING_SHARED* shared = ring->shared;
+  const uint32_t capacity = shared->capacity;
+  uint8_t* dst = static_cast<uint8_t*>(p);
+  uint64_t deadline_ms = now_ms() + timeout_ms;
+  size_t count = 0;
+
+  while (count < len) {
+    uint32_t read_pos = shared->read_pos.load(std::memory_order_relaxed);
+    uint32_t write_pos = shared->write_pos.load(std::memory_order_acquire);
+    uint32_t available = write_pos - read_pos;
+    if (available == 0) {
+      if (shared->closed.load(std::memory_order_acquire)) {
+        return count > 0 ? (ssize_t)count : -1;
+      }
+      shared->reader_waiting.store(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      write_pos = shared->write_pos.load(std::memory_order_relaxed);
+      tA2DP_PCM_RING_WAIT result = A2DP_PCM_RING_WAIT_SIGNALLED;
+      if (write_pos == read_pos) {
+        result = wait_evt_fd(ring->data_evt_fd, hangup_fd, deadline_ms);
+      }
+      shared->reader_waiting.store(0, std::memory_order_relaxed);
+      if (result == A2DP_PCM_RING_WAIT_TIMEOUT) break;
+      if (result == A2DP_PCM_RING_WAIT_HANGUP) {
+        return count > 0 ? (ssize_t)count : -1;
+      }
+      continue;
+    }
+
+    uint32_t n = std::min<size_t>(available, len - count);
+    uint32_t offset = read_pos & (capacity - 1);
+    uint32_t first = std::min(n, capacity - offset);
+    memcpy(dst + count, ring->data + offset, first);
+    memcpy(dst + count + first, ring->data, n - first);
+    shared->read_pos.store(read_pos + n, std::memory_order_release);
+    count += n;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (shared->writer_waiting.load(std::memory_order_relaxed)) {
+      signal_evt_fd(ring->space_evt_fd);
+    }
+  }
+  return count;
+}
+
+size_t a2dp_pcm_ring_readable(const tA2DP_PCM_RING* ring) {
+  return ring->shared->write_pos.load(std::memory_order_acquire) -
+         ring->shared->read_pos.load(std::memory_order_relaxed);
+}
+
+void a2dp_pcm_ring_flush(tA2DP_PCM_RING* ring) {
+  tA2DP_PCM_RING_SHARED* shared = ring->shared;
+  shared->read_pos.store(shared->write_pos.load(std::memory_order_acquire),
+                         std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (shared->writer_waiting.load(std::memory_order_relaxed)) {
+    signal_evt_fd(ring->space_evt_fd);
+  }
+}
+
+bool a2dp_pcm_ring_offer(int skt_fd, tA2DP_PCM_RING* ring, int timeout_ms) {
+  tA2DP_PCM_RING_HELLO hello;
+  hello.magic = A2DP_PCM_RING_MAGIC;
+  hello.version = A2DP_PCM_RING_VERSION;
+  hello.capacity = a2dp_pcm_ring_is_attached(ring) ? ring->shared->capacity : 0;
+
+  struct iovec iov;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * A2DP_PCM_RING_NUM_FDS)];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (hello.capacity != 0) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * A2DP_PCM_RING_NUM_FDS);
+    int fds[A2DP_PCM_RING_NUM_FDS] = {ring->mem_fd, ring->data_evt_fd,
+                                      ring->space_evt_fd};
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  }
+
+  ssize_t ret;
+  OSI_NO_INTR(ret = sendmsg(skt_fd, &msg, MSG_NOSIGNAL));
+  if (ret != (ssize_t)sizeof(hello)) {
+    LOG_ERROR("%s: unable to send hello (%s)", __func__, strerror(errno));
+    return false;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = skt_fd;
+  pfd.events = POLLIN;
+  OSI_NO_INTR(ret = poll(&pfd, 1, timeout_ms));
+  if (ret <= 0) {
+    LOG_ERROR("%s: no answer from the stack", __func__);
+    return false;
+  }
+
+  uint8_t ack = A2DP_CTRL_ACK_FAILURE;
+  OSI_NO_INTR(ret = recv(skt_fd, &ack, sizeof(ack), MSG_NOSIGNAL));
+  if (ret != sizeof(ack)) {
+    LOG_ERROR("%s: no answer from the stack", __func__);
+    return false;
+  }
+  if (ack != A2DP_CTRL_ACK_SUCCESS) a2dp_pcm_ring_destroy(ring);
+  return true;
+}
+
+tA2DP_PCM_RING_ACCEPT a2dp_pcm_ring_try_accept(int skt_fd, bool use_ring,
+                                              tA2DP_PCM_RING* ring) {
+  a2dp_pcm_ring_init(ring);
+
+  // Look at what the peer sent so far without taking it, so that PCM from a
+  // peer that does not know about the ring is left in the socket
+  tA2DP_PCM_RING_HELLO hello;
+  ssize_t ret;
+  OSI_NO_INTR(ret = recv(skt_fd, &hello, sizeof(hello),
+                         MSG_PEEK | MSG_DONTWAIT));
+  if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return A2DP_PCM_RING_ACCEPT_PENDING;
+  if (ret <= 0) {
+    LOG_ERROR("%s: audio HAL went away before the hello", __func__);
+    return A2DP_PCM_RING_ACCEPT_FAILED;
+  }
+
+  const uint32_t magic = A2DP_PCM_RING_MAGIC;
+  size_t magic_len = std::min((size_t)ret, sizeof(magic));
+  if (memcmp(&hello.magic, &magic, magic_len) != 0)
+    return A2DP_PCM_RING_ACCEPT_NO_HELLO;
+  if (ret < (ssize_t)sizeof(hello)) return A2DP_PCM_RING_ACCEPT_PENDING;
+
+  struct iovec iov;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * A2DP_PCM_RING_NUM_FDS)];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  OSI_NO_INTR(ret = recvmsg(skt_fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT));
+
+  int fds[A2DP_PCM_RING_NUM_FDS] = {-1, -1, -1};
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+      memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+  }
+
+  if (ret != (ssize_t)sizeof(hello) || hello.version != A2DP_PCM_RING_VERSION) {
+    LOG_ERROR("%s: invalid hello from the audio HAL", __func__);
+    for (int i = 0; i < A2DP_PCM_RING_NUM_FDS; i++) close_fd(&fds[i]);
+    return A2DP_PCM_RING_ACCEPT_FAILED;
+  }
+
+  bool attached = false;
+  if (use_ring && hello.capacity != 0 && fds[0] != -1) {
+    attached = attach_ring(ring, fds[0], fds[1], fds[2]);
+    // attach_ring() owns the descriptors from here on
+    fds[0] = fds[1] = fds[2] = -1;
+  }
+  for (int i = 0; i < A2DP_PCM_RING_NUM_FDS; i++) close_fd(&fds[i]);
+
+  // The HAL waits for the answer before writing anything, the socket has
+  // room for it
+  uint8_t ack = attached ? A2DP_CTRL_ACK_SUCCESS : A2DP_CTRL_ACK_FAILURE;
+  OSI_NO_INTR(ret = send(skt_fd, &ack, sizeof(ack),
+                         MSG_NOSIGNAL | MSG_DONTWAIT));
+  if (ret != sizeof(ack)) {
+    LOG_ERROR("%s: unable to answer the audio HAL (%s)", __func__,
+              strerror(errno));
+    a2dp_pcm_ring_destroy(ring);
+    return A2DP_PCM_RING_ACCEPT_FAILED;
+  }
+  return A2DP_PCM_RING_ACCEPT_DONE;
+}
+
+bool a2dp_pcm_ring_accept(int skt_fd, bool use_ring, tA2DP_PCM_RING* ring,
+                          int timeout_ms) {
+  uint64_t deadline_ms = now_ms() + timeout_ms;
+  while (true) {
+    tA2DP_PCM_RING_ACCEPT status =
+        a2dp_pcm_ring_try_accept(skt_fd, use_ring, ring);
+    if (status == A2DP_PCM_RING_ACCEPT_DONE) return true;
+    if (status != A2DP_PCM_RING_ACCEPT_PENDING) return false;
+
+    uint64_t now = now_ms();
+    if (now >= deadline_ms) break;
+
+    struct pollfd pfd;
+    pfd.fd = skt_fd;
+    pfd.events = POLLIN;
+    int poll_ret;
+    OSI_NO_INTR(poll_ret = poll(&pfd, 1, deadline_ms - now));
+    if (poll_ret <= 0) break;
+  }
+  LOG_ERROR("%s: no hello from the audio HAL", __func__);
+  return false;
+}
@@ -0,0 +1,246 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+// Loopback benchmark of the two PCM transports between the audio HAL and the
+// A2DP source: the data socket and the shared memory ring. The socket side
+// mirrors skt_write() in the HAL and the poll()/recv() loop of UIPC_Read().
+//
+// BM_*Throughput moves one second of 44.1kHz stereo PCM per iteration and
+// reports the process CPU time spent per second of audio. BM_*Latency keeps
+// a single time stamped HAL period in flight and reports the average time
+// until the encoder side has read all of it.
+
+#include <benchmark/benchmark.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "audio_a2dp_hw/include/audio_a2dp_hw.h"
+#include "audio_a2dp_hw/include/audio_a2dp_hw_pcm_ring.h"
+
+namespace {
+
+constexpr size_t kBytesPerSecond = 44100 * 2 * 2;
+constexpr size_t kHalPeriodBytes =
+    AUDIO_STREAM_OUTPUT_BUFFER_SZ / AUDIO_STREAM_OUTPUT_BUFFER_PERIODS;
+// One SBC frame worth of PCM, 128 stereo 16-bit samples
+constexpr size_t kEncoderReadBytes = 512;
+constexpr int kTimeoutMs = 1000;
+
+int64_t now_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+class Transport {
+ public:
+  virtual ~Transport() = default;
+  virtual bool Write(const uint8_t* p, size_t len) = 0;
+  virtual ssize_t Read(uint8_t* p, size_t len) = 0;
+};
+
+class SocketTransport : public Transport {
+ public:
+  SocketTransport() {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds_);
+    int len = AUDIO_STREAM_OUTPUT_BUFFER_SZ;
+    setsockopt(fds_[0], SOL_SOCKET, SO_SNDBUF, &len, sizeof(len));
+  }
+  ~SocketTransport() override {
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+
+  bool Write(const uint8_t* p, size_t len) override {
+    size_t count = 0;
+    while (count < len) {
+      ssize_t sent =
+          send(fds_[0], p + count, len - count, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        // The HAL backs off for WRITE_POLL_MS, which would dominate the wall
+        // clock here; the CPU cost of a retry is the same with a yield.
+        std::this_thread::yield();
+        continue;
+      }
+      count += sent;
+    }
+    return true;
+  }
+
+  ssize_t Read(uint8_t* p, size_t len) override {
+    size_t n_read = 0;
+    while (n_read < len) {
+      struct pollfd pfd = {};
+      pfd.fd = fds_[1];
+      pfd.events = POLLIN | POLLHUP;
+      if (poll(&pfd, 1, kTimeoutMs) <= 0) break;
+      ssize_t n = recv(fds_[1], p + n_read, len - n_read, 0);
+      if (n <= 0) return -1;
+      n_read += n;
+    }
+    return n_read;
+  }
+
+ private:
+  int fds_[2];
+};
+
+class RingTransport : public Transport {
+ public:
+  RingTransport() {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds_);
+    a2dp_pcm_ring_init(&writer_);
+    a2dp_pcm_ring_init(&reader_);
+    a2dp_pcm_ring_create(&writer_, AUDIO_STREAM_OUTPUT_BUFFER_SZ);
+    auto accepted = std::async(std::launch::async, [this] {
+      return a2dp_pcm_ring_accept(fds_[1], true, &reader_, kTimeoutMs);
+    });
+    a2dp_pcm_ring_offer(fds_[0], &writer_, kTimeoutMs);
+    accepted.get();
+  }
+  ~RingTransport() override {
+    a2dp_pcm_ring_destroy(&writer_);
+    a2dp_pcm_ring_destroy(&reader_);
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+
+  bool attached() const { return a2dp_pcm_ring_is_attached(&reader_); }
+
+  bool Write(const uint8_t* p, size_t len) override {
+    return a2dp_pcm_ring_write(&writer_, p, len, kTimeoutMs, fds_[0]) ==
+           (ssize_t)len;
+  }
+
+  ssize_t Read(uint8_t* p, size_t len) override {
+    return a2dp_pcm_ring_read(&reader_, p, len, kTimeoutMs, fds_[1]);
+  }
+
+ private:
+  int fds_[2];
+  tA2DP_PCM_RING writer_;
+  tA2DP_PCM_RING reader_;
+};
+
+void RunThroughput(benchmark::State& state, Transport* transport) {
+  std::vector<uint8_t> period(kHalPeriodBytes, 0x33);
+  std::vector<uint8_t> frame(kEncoderReadBytes);
+  int64_t cpu_ns = 0;
+
+  for (auto _ : state) {
+    int64_t cpu_start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    std::thread producer([transport, &period] {
+      for (size_t sent = 0; sent < kBytesPerSecond; sent += period.size()) {
+        if (!transport->Write(period.data(), period.size())) return;
+      }
+    });
+    size_t total = (kBytesPerSecond + kHalPeriodBytes - 1) / kHalPeriodBytes *
+                   kHalPeriodBytes;
+    for (size_t received = 0; received < total;) {
+      ssize_t n = transport->Read(
+          frame.data(), std::min(frame.size(), total - received));
+      if (n <= 0) {
+        state.SkipWithError("transport stalled");
+        break;
+      }
+      received += n;
+    }
+    producer.join();
+    cpu_ns += now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+  }
+
+  state.SetBytesProcessed(state.iterations() * kBytesPerSecond);
+  state.counters["cpu_us_per_audio_s"] =
+      benchmark::Counter(cpu_ns / 1000.0 / state.iterations());
+}
+
+void RunLatency(benchmark::State& state, Transport* transport) {
+  std::vector<uint8_t> period(kHalPeriodBytes);
+  std::vector<uint8_t> frame(kHalPeriodBytes);
+  int64_t latency_ns = 0;
+
+  for (auto _ : state) {
+    std::thread producer([transport, &period] {
+      int64_t stamp = now_ns(CLOCK_MONOTONIC);
+      memcpy(period.data(), &stamp, sizeof(stamp));
+      transport->Write(period.data(), period.size());
+    });
+    size_t received = 0;
+    while (received < frame.size()) {
+      ssize_t n = transport->Read(
+          frame.data() + received,
+          std::min(kEncoderReadBytes, frame.size() - received));
+      if (n <= 0) break;
+      received += n;
+    }
+    int64_t stamp;
+    memcpy(&stamp, frame.data(), sizeof(stamp));
+    latency_ns += now_ns(CLOCK_MONOTONIC) - stamp;
+    producer.join();
+  }
+
+  state.counters["latency_us"] =
+      benchmark::Counter(latency_ns / 1000.0 / state.iterations());
+}
+
+void BM_SocketThroughput(benchmark::State& state) {
+  SocketTransport transport;
+  RunThroughput(state, &transport);
+}
+BENCHMARK(BM_SocketThroughput)->UseRealTime();
+
+void BM_RingThroughput(benchmark::State& state) {
+  RingTransport transport;
+  if (!transport.attached()) {
+    state.SkipWithError("shared memory ring unavailable");
+    return;
+  }
+  RunThroughput(state, &transport);
+}
+BENCHMARK(BM_RingThroughput)->UseRealTime();
+
+void BM_SocketLatency(benchmark::State& state) {
+  SocketTransport transport;
+  RunLatency(state, &transport);
+}
+BENCHMARK(BM_SocketLatency)->UseRealTime();
+
+void BM_RingLatency(benchmark::State& state) {
+  RingTransport transport;
+  if (!transport.attached()) {
+    state.SkipWithError("shared memory ring unavailable");
+    return;
+  }
+  RunLatency(state, &transport);
+}
+BENCHMARK(BM_RingLatency)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
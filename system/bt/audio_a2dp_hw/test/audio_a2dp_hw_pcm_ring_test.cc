@@ -0,0 +1,206 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <future>
+#include <vector>
+
+#include "audio_a2dp_hw/include/audio_a2dp_hw.h"
+#include "audio_a2dp_hw/include/audio_a2dp_hw_pcm_ring.h"
+
+class AudioA2dpHwPcmRingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_), 0);
+    a2dp_pcm_ring_init(&writer_);
+    a2dp_pcm_ring_init(&reader_);
+  }
+
+  void TearDown() override {
+    a2dp_pcm_ring_destroy(&writer_);
+    a2dp_pcm_ring_destroy(&reader_);
+    if (fds_[0] != -1) close(fds_[0]);
+    if (fds_[1] != -1) close(fds_[1]);
+  }
+
+  // Runs the handshake between the HAL end fds_[0] and the stack end fds_[1]
+  void Handshake(bool use_ring) {
+    auto accepted = std::async(std::launch::async, [this, use_ring] {
+      return a2dp_pcm_ring_accept(fds_[1], use_ring, &reader_, 1000);
+    });
+    ASSERT_TRUE(a2dp_pcm_ring_offer(fds_[0], &writer_, 1000));
+    ASSERT_TRUE(accepted.get());
+  }
+
+  int fds_[2] = {-1, -1};
+  tA2DP_PCM_RING writer_;
+  tA2DP_PCM_RING reader_;
+};
+
+TEST_F(AudioA2dpHwPcmRingTest, test_handshake_accept) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 3000));
+  Handshake(true);
+  EXPECT_TRUE(a2dp_pcm_ring_is_attached(&writer_));
+  EXPECT_TRUE(a2dp_pcm_ring_is_attached(&reader_));
+  EXPECT_EQ(reader_.shared->capacity, 4096u);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_handshake_decline) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 4096));
+  Handshake(false);
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&writer_));
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&reader_));
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_handshake_without_ring) {
+  Handshake(true);
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&writer_));
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&reader_));
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_try_accept_waits_for_the_hello) {
+  EXPECT_EQ(a2dp_pcm_ring_try_accept(fds_[1], true, &reader_),
+            A2DP_PCM_RING_ACCEPT_PENDING);
+
+  // A hello cut short is not taken from the socket
+  tA2DP_PCM_RING_HELLO hello = {A2DP_PCM_RING_MAGIC, A2DP_PCM_RING_VERSION, 0};
+  const uint8_t* bytes = (const uint8_t*)&hello;
+  ASSERT_EQ(send(fds_[0], bytes, 6, 0), 6);
+  EXPECT_EQ(a2dp_pcm_ring_try_accept(fds_[1], true, &reader_),
+            A2DP_PCM_RING_ACCEPT_PENDING);
+
+  ASSERT_EQ(send(fds_[0], bytes + 6, sizeof(hello) - 6, 0),
+            (ssize_t)(sizeof(hello) - 6));
+  EXPECT_EQ(a2dp_pcm_ring_try_accept(fds_[1], true, &reader_),
+            A2DP_PCM_RING_ACCEPT_DONE);
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&reader_));
+
+  uint8_t ack = 0;
+  ASSERT_EQ(recv(fds_[0], &ack, sizeof(ack), MSG_DONTWAIT), 1);
+  EXPECT_NE(ack, A2DP_CTRL_ACK_SUCCESS);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_try_accept_leaves_pcm_in_the_socket) {
+  // A HAL without the ring starts writing PCM right away. These samples
+  // begin like the magic of a hello.
+  uint8_t pcm[8] = {0x32, 0x44, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05};
+  ASSERT_EQ(send(fds_[0], pcm, 1, 0), 1);
+  EXPECT_EQ(a2dp_pcm_ring_try_accept(fds_[1], true, &reader_),
+            A2DP_PCM_RING_ACCEPT_PENDING);
+  ASSERT_EQ(send(fds_[0], pcm + 1, sizeof(pcm) - 1, 0),
+            (ssize_t)sizeof(pcm) - 1);
+  EXPECT_EQ(a2dp_pcm_ring_try_accept(fds_[1], true, &reader_),
+            A2DP_PCM_RING_ACCEPT_NO_HELLO);
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&reader_));
+
+  uint8_t out[sizeof(pcm)] = {};
+  ASSERT_EQ(recv(fds_[1], out, sizeof(out), MSG_DONTWAIT),
+            (ssize_t)sizeof(out));
+  EXPECT_EQ(memcmp(pcm, out, sizeof(pcm)), 0);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_try_accept_fails_on_hangup) {
+  close(fds_[0]);
+  fds_[0] = -1;
+  EXPECT_EQ(a2dp_pcm_ring_try_accept(fds_[1], true, &reader_),
+            A2DP_PCM_RING_ACCEPT_FAILED);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_write_read_wraps_around) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 1024));
+  Handshake(true);
+
+  std::vector<uint8_t> in(700);
+  std::vector<uint8_t> out(700);
+  for (int round = 0; round < 10; round++) {
+    for (size_t i = 0; i < in.size(); i++) in[i] = round * 7 + i;
+    ASSERT_EQ(a2dp_pcm_ring_write(&writer_, in.data(), in.size(), 0, fds_[0]),
+              (ssize_t)in.size());
+    EXPECT_EQ(a2dp_pcm_ring_readable(&reader_), in.size());
+    ASSERT_EQ(a2dp_pcm_ring_read(&reader_, out.data(), out.size(), 0, fds_[1]),
+              (ssize_t)out.size());
+    EXPECT_EQ(in, out);
+  }
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_read_times_out_short) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 1024));
+  Handshake(true);
+
+  uint8_t buf[256] = {};
+  ASSERT_EQ(a2dp_pcm_ring_write(&writer_, buf, 100, 0, fds_[0]), 100);
+  EXPECT_EQ(a2dp_pcm_ring_read(&reader_, buf, sizeof(buf), 10, fds_[1]), 100);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_write_blocks_until_read) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 1024));
+  Handshake(true);
+
+  std::vector<uint8_t> in(4096, 0x5a);
+  auto written = std::async(std::launch::async, [this, &in] {
+    return a2dp_pcm_ring_write(&writer_, in.data(), in.size(), 5000, fds_[0]);
+  });
+
+  std::vector<uint8_t> out(in.size());
+  size_t count = 0;
+  while (count < out.size()) {
+    ssize_t n = a2dp_pcm_ring_read(&reader_, out.data() + count,
+                                   out.size() - count, 1000, fds_[1]);
+    ASSERT_GT(n, 0);
+    count += n;
+  }
+  EXPECT_EQ(written.get(), (ssize_t)in.size());
+  EXPECT_EQ(in, out);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_write_fails_when_reader_hangs_up) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 1024));
+  Handshake(true);
+
+  std::vector<uint8_t> in(2048);
+  close(fds_[1]);
+  fds_[1] = -1;
+  EXPECT_EQ(a2dp_pcm_ring_write(&writer_, in.data(), in.size(), 5000, fds_[0]),
+            -1);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_read_drains_before_reporting_close) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 1024));
+  Handshake(true);
+
+  uint8_t buf[64] = {};
+  ASSERT_EQ(a2dp_pcm_ring_write(&writer_, buf, 32, 0, fds_[0]), 32);
+  a2dp_pcm_ring_destroy(&writer_);
+  EXPECT_EQ(a2dp_pcm_ring_read(&reader_, buf, sizeof(buf), 100, fds_[1]), 32);
+  EXPECT_EQ(a2dp_pcm_ring_read(&reader_, buf, sizeof(buf), 100, fds_[1]), -1);
+}
+
+TEST_F(AudioA2dpHwPcmRingTest, test_flush) {
+  ASSERT_TRUE(a2dp_pcm_ring_create(&writer_, 1024));
+  Handshake(true);
+
+  uint8_t buf[64] = {};
+  ASSERT_EQ(a2dp_pcm_ring_write(&writer_, buf, sizeof(buf), 0, fds_[0]), 64);
+  a2dp_pcm_ring_flush(&reader_);
+  EXPECT_EQ(a2dp_pcm_ring_readable(&reader_), 0u);
+}
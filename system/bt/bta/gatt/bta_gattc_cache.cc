@@ -154,7 +154,9 @@ static void bta_gattc_explore_next_service(uint16_t conn_id,
     return;
   }
 
-  if (!p_srvc_cb->pending_discovery.StartNextServiceExploration()) {
+  /* adjacent services are explored together, so that the included service and
+   * characteristic discovery responses are filled up to the MTU */
+  if (!p_srvc_cb->pending_discovery.StartNextServiceRangeExploration()) {
     bta_gattc_explore_srvc_finished(conn_id, p_srvc_cb);
     return;
   }
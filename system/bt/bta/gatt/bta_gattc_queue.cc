@@ -19,6 +19,8 @@
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 using gatt_operation = BtaGattQueue::gatt_operation;
 
@@ -27,9 +29,10 @@ constexpr uint8_t GATT_READ_DESC = 2;
 constexpr uint8_t GATT_WRITE_CHAR = 3;
 constexpr uint8_t GATT_WRITE_DESC = 4;
 
+/* Reads of the same handle that were queued next to each other are served by
+ * a single ATT request, every requester gets its own callback. */
 struct gatt_read_op_data {
-  GATT_READ_OP_CB cb;
-  void* cb_data;
+  std::vector<std::pair<GATT_READ_OP_CB, void*>> callbacks;
 };
 
 std::unordered_map<uint16_t, std::list<gatt_operation>>
@@ -44,17 +47,16 @@ void BtaGattQueue::gatt_read_op_finished(uint16_t conn_id, tGATT_STATUS status,
                                          uint16_t handle, uint16_t len,
                                          uint8_t* value, void* data) {
   gatt_read_op_data* tmp = (gatt_read_op_data*)data;
-  GATT_READ_OP_CB tmp_cb = tmp->cb;
-  void* tmp_cb_data = tmp->cb_data;
+  std::vector<std::pair<GATT_READ_OP_CB, void*>> callbacks =
+      std::move(tmp->callbacks);
 
-  osi_free(data);
+  delete tmp;
 
   mark_as_not_executing(conn_id);
   gatt_execute_next_op(conn_id);
 
-  if (tmp_cb) {
-    tmp_cb(conn_id, status, handle, len, value, tmp_cb_data);
-    return;
+  for (const auto& cb : callbacks) {
+    if (cb.first) cb.first(conn_id, status, handle, len, value, cb.second);
   }
 }
 
@@ -80,6 +82,27 @@ void BtaGattQueue::gatt_write_op_finished(uint16_t conn_id, tGATT_STATUS status,
   }
 }
 
+/* Move the callbacks of the reads queued right behind the read at the front of
+ * |gatt_ops|, for the same handle, into |data|. Any other operation ends the
+ * search: the app may rely on it taking effect before the reads queued after
+ * it, e.g. a write to a control point. */
+void BtaGattQueue::coalesce_queued_reads(std::list<gatt_operation>& gatt_ops,
+                                         gatt_read_op_data* data) {
+  const gatt_operation& op = gatt_ops.front();
+
+  for (auto it = std::next(gatt_ops.begin()); it != gatt_ops.end();) {
+    if (it->type != op.type || it->handle != op.handle) break;
+
+    data->callbacks.emplace_back(it->read_cb, it->read_cb_data);
+    it = gatt_ops.erase(it);
+  }
+
+  if (data->callbacks.size() > 1) {
+    APPL_TRACE_DEBUG("%s: handle=0x%04x served %zu reads", __func__, op.handle,
+                     data->callbacks.size());
+  }
+}
+
 void BtaGattQueue::gatt_execute_next_op(uint16_t conn_id) {
   APPL_TRACE_DEBUG("%s: conn_id=0x%x", __func__, conn_id);
   if (gatt_op_queue.empty()) {
@@ -106,18 +129,16 @@ void BtaGattQueue::gatt_execute_next_op(uint16_t conn_id) {
   gatt_operation& op = gatt_ops.front();
 
   if (op.type == GATT_READ_CHAR) {
-    gatt_read_op_data* data =
-        (gatt_read_op_data*)osi_malloc(sizeof(gatt_read_op_data));
-    data->cb = op.read_cb;
-    data->cb_data = op.read_cb_data;
+    gatt_read_op_data* data = new gatt_read_op_data();
+    data->callbacks.emplace_back(op.read_cb, op.read_cb_data);
+    coalesce_queued_reads(gatt_ops, data);
     BTA_GATTC_ReadCharacteristic(conn_id, op.handle, GATT_AUTH_REQ_NONE,
                                  gatt_read_op_finished, data);
 
   } else if (op.type == GATT_READ_DESC) {
-    gatt_read_op_data* data =
-        (gatt_read_op_data*)osi_malloc(sizeof(gatt_read_op_data));
-    data->cb = op.read_cb;
-    data->cb_data = op.read_cb_data;
+    gatt_read_op_data* data = new gatt_read_op_data();
+    data->callbacks.emplace_back(op.read_cb, op.read_cb_data);
+    coalesce_queued_reads(gatt_ops, data);
     BTA_GATTC_ReadCharDescr(conn_id, op.handle, GATT_AUTH_REQ_NONE,
                             gatt_read_op_finished, data);
 
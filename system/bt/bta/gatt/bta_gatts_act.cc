@@ -417,6 +417,51 @@ void bta_gatts_indicate_handle(tBTA_GATTS_CB* p_cb, tBTA_GATTS_DATA* p_msg) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         bta_gatts_notify_multi
+ *
+ * Description      GATTS send the same handle value notification to several
+ *                  connections of a server, the PDU is encoded once.
+ *
+ * Returns          none.
+ *
+ ******************************************************************************/
+void bta_gatts_notify_multi(tGATT_IF server_if, std::vector<uint16_t> conn_ids,
+                            uint16_t attr_id, std::vector<uint8_t> value) {
+  if (!bta_gatts_find_srvc_cb_by_attr_id(&bta_gatts_cb, attr_id)) {
+    LOG(ERROR) << "Not an registered servce attribute ID: " << loghex(attr_id);
+    return;
+  }
+
+  std::vector<tGATT_STATUS> status = GATTS_HandleValueNotificationMulti(
+      server_if, conn_ids, attr_id, value.size(), value.data());
+
+  tBTA_GATTS_RCB* p_rcb = bta_gatts_find_app_rcb_by_app_if(server_if);
+  for (size_t i = 0; i < conn_ids.size(); i++) {
+    uint16_t conn_id = conn_ids[i];
+    tGATT_IF gatt_if;
+    RawAddress remote_bda;
+    tBTA_TRANSPORT transport;
+
+    /* if over BR_EDR, inform PM for mode change */
+    if (GATT_GetConnectionInfor(conn_id, &gatt_if, remote_bda, &transport) &&
+        transport == BTA_TRANSPORT_BR_EDR) {
+      bta_sys_busy(BTA_ID_GATTS, BTA_ALL_APP_ID, remote_bda);
+      bta_sys_idle(BTA_ID_GATTS, BTA_ALL_APP_ID, remote_bda);
+    }
+
+    /* notifications are not confirmed, report how each one was sent */
+    if (p_rcb && p_rcb->p_cback) {
+      tBTA_GATTS cb_data;
+      cb_data.req_data.status = status[i];
+      cb_data.req_data.conn_id = conn_id;
+
+      (*p_rcb->p_cback)(BTA_GATTS_CONF_EVT, &cb_data);
+    }
+  }
+}
+
 /*******************************************************************************
  *
  * Function         bta_gatts_open
@@ -249,6 +249,32 @@ void BTA_GATTS_HandleValueIndication(uint16_t conn_id, uint16_t attr_id,
   bta_sys_sendmsg(p_buf);
 }
 
+/*******************************************************************************
+ *
+ * Function         BTA_GATTS_HandleValueNotificationMulti
+ *
+ * Description      This function is called to send the same handle value
+ *                  notification to several connections of a server. The
+ *                  notification is encoded once and each client receives
+ *                  the value truncated to its own ATT MTU.
+ *
+ * Parameters       server_if - server interface.
+ *                  conn_ids - connection identifiers to notify.
+ *                  attr_id - attribute ID to notify.
+ *                  value - data to notify.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void BTA_GATTS_HandleValueNotificationMulti(tGATT_IF server_if,
+                                            std::vector<uint16_t> conn_ids,
+                                            uint16_t attr_id,
+                                            std::vector<uint8_t> value) {
+  do_in_main_thread(FROM_HERE,
+                    base::Bind(&bta_gatts_notify_multi, server_if,
+                               std::move(conn_ids), attr_id, std::move(value)));
+}
+
 /*******************************************************************************
  *
  * Function         BTA_GATTS_SendRsp
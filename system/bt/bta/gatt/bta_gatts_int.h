@@ -171,6 +171,10 @@ extern void bta_gatts_stop_service(tBTA_GATTS_SRVC_CB* p_srvc_cb,
 extern void bta_gatts_send_rsp(tBTA_GATTS_CB* p_cb, tBTA_GATTS_DATA* p_msg);
 extern void bta_gatts_indicate_handle(tBTA_GATTS_CB* p_cb,
                                       tBTA_GATTS_DATA* p_msg);
+extern void bta_gatts_notify_multi(tGATT_IF server_if,
+                                   std::vector<uint16_t> conn_ids,
+                                   uint16_t attr_id,
+                                   std::vector<uint8_t> value);
 
 extern void bta_gatts_open(tBTA_GATTS_CB* p_cb, tBTA_GATTS_DATA* p_msg);
 extern void bta_gatts_cancel_open(tBTA_GATTS_CB* p_cb, tBTA_GATTS_DATA* p_msg);
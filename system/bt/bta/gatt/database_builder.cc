@@ -142,37 +142,52 @@ bool DatabaseBuilder::StartNextServiceExploration() {
   return false;
 }
 
+bool DatabaseBuilder::StartNextServiceRangeExploration() {
+  if (!StartNextServiceExploration()) return false;
+
+  while (!services_to_discover.empty()) {
+    auto next = services_to_discover.begin();
+    if (next->first != pending_service.second + 1) break;
+
+    pending_service.second = next->second;
+    services_to_discover.erase(next);
+  }
+  return true;
+}
+
 const std::pair<uint16_t, uint16_t>&
 DatabaseBuilder::CurrentlyExploredService() {
   return pending_service;
 }
 
 std::pair<uint16_t, uint16_t> DatabaseBuilder::NextDescriptorRangeToExplore() {
-  Service* service = FindService(database.services, pending_service.first);
-  if (!service || service->characteristics.empty()) {
-    return {HANDLE_MAX, HANDLE_MAX};
-  }
-
-  for (auto it = service->characteristics.cbegin();
-       it != service->characteristics.cend(); it++) {
-    if (it->declaration_handle > pending_characteristic) {
-      auto next = std::next(it);
-
-      /* Characteristic Declaration is followed by Characteristic Value
-       * Declaration, first descriptor is after that, see BT Spect 5.0 Vol 3,
-       * Part G 3.3.2 and 3.3.3 */
-      uint16_t start = it->declaration_handle + 2;
-      uint16_t end;
-      if (next != service->characteristics.end())
-        end = next->declaration_handle - 1;
-      else
-        end = service->end_handle;
-
-      // No place for descriptor - skip to next characteristic
-      if (start > end) continue;
-
-      pending_characteristic = start;
-      return {start, end};
+  /* services are sorted by handle, and so are characteristics across all
+   * services in the explored range */
+  for (Service& service : database.services) {
+    if (service.end_handle < pending_service.first) continue;
+    if (service.handle > pending_service.second) break;
+
+    for (auto it = service.characteristics.cbegin();
+         it != service.characteristics.cend(); it++) {
+      if (it->declaration_handle > pending_characteristic) {
+        auto next = std::next(it);
+
+        /* Characteristic Declaration is followed by Characteristic Value
+         * Declaration, first descriptor is after that, see BT Spect 5.0 Vol 3,
+         * Part G 3.3.2 and 3.3.3 */
+        uint16_t start = it->declaration_handle + 2;
+        uint16_t end;
+        if (next != service.characteristics.end())
+          end = next->declaration_handle - 1;
+        else
+          end = service.end_handle;
+
+        // No place for descriptor - skip to next characteristic
+        if (start > end) continue;
+
+        pending_characteristic = start;
+        return {start, end};
+      }
     }
   }
 
@@ -41,7 +41,14 @@ class DatabaseBuilder {
    * more services to explore. */
   bool StartNextServiceExploration();
 
-  /* Return pair with start and end handle of the currently explored service.
+  /* Same as StartNextServiceExploration, but services with adjacent handle
+   * ranges are explored together, so that a single discovery request can
+   * return the content of more than one service. Returns false if there are no
+   * more services to explore. */
+  bool StartNextServiceRangeExploration();
+
+  /* Return pair with start and end handle of the currently explored service,
+   * or range of services.
    */
   const std::pair<uint16_t, uint16_t>& CurrentlyExploredService();
 
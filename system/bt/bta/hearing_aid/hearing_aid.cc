@@ -1197,17 +1197,30 @@ class HearingAidImpl : public HearingAid {
 
     // TODO: make those buffers static and global to prevent constant
     // reallocations
-    // TODO: this should basically fit the encoded data, tune the size later
+    // G.722 produces one byte per pair of samples. Both ears are encoded in
+    // a single pass.
     std::vector<uint8_t> encoded_data_left;
+    std::vector<uint8_t> encoded_data_right;
+    g722_encode_state_t* encoder_states[2];
+    uint8_t* encoded_data[2];
+    const int16_t* channel_data[2];
+    int streams = 0;
     if (left) {
-      // TODO: instead of a magic number, we need to figure out the correct
-      // buffer size
-      encoded_data_left.resize(4000);
-      int encoded_size =
-          g722_encode(encoder_state_left, encoded_data_left.data(),
-                      (const int16_t*)chan_left.data(), chan_left.size());
-      encoded_data_left.resize(encoded_size);
+      encoded_data_left.resize(num_samples / 2);
+      encoder_states[streams] = encoder_state_left;
+      encoded_data[streams] = encoded_data_left.data();
+      channel_data[streams++] = (const int16_t*)chan_left.data();
+    }
+    if (right) {
+      encoded_data_right.resize(num_samples / 2);
+      encoder_states[streams] = encoder_state_right;
+      encoded_data[streams] = encoded_data_right.data();
+      channel_data[streams++] = (const int16_t*)chan_right.data();
+    }
+    g722_encode_multi(encoder_states, encoded_data, channel_data, streams,
+                      num_samples);
 
+    if (left) {
       uint16_t cid = GAP_ConnGetL2CAPCid(left->gap_handle);
       uint16_t packets_to_flush = L2CA_FlushChannel(cid, L2CAP_FLUSH_CHANS_GET);
       if (packets_to_flush) {
@@ -1222,16 +1235,7 @@ class HearingAidImpl : public HearingAid {
       check_and_do_rssi_read(left);
     }
 
-    std::vector<uint8_t> encoded_data_right;
     if (right) {
-      // TODO: instead of a magic number, we need to figure out the correct
-      // buffer size
-      encoded_data_right.resize(4000);
-      int encoded_size =
-          g722_encode(encoder_state_right, encoded_data_right.data(),
-                      (const int16_t*)chan_right.data(), chan_right.size());
-      encoded_data_right.resize(encoded_size);
-
       uint16_t cid = GAP_ConnGetL2CAPCid(right->gap_handle);
       uint16_t packets_to_flush = L2CA_FlushChannel(cid, L2CAP_FLUSH_CHANS_GET);
       if (packets_to_flush) {
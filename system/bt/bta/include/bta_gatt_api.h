@@ -894,6 +894,26 @@ extern void BTA_GATTS_HandleValueIndication(uint16_t conn_id, uint16_t attr_id,
                                             std::vector<uint8_t> value,
                                             bool need_confirm);
 
+/*******************************************************************************
+ *
+ * Function         BTA_GATTS_HandleValueNotificationMulti
+ *
+ * Description      This function is called to send the same handle value
+ *                  notification to several connections of a server.
+ *                  BTA_GATTS_CONF_EVT is reported for each connection.
+ *
+ * Parameters       server_if - server interface.
+ *                  conn_ids - connection identifiers to notify.
+ *                  attr_id - attribute ID to notify.
+ *                  value - data to notify.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+extern void BTA_GATTS_HandleValueNotificationMulti(
+    tGATT_IF server_if, std::vector<uint16_t> conn_ids, uint16_t attr_id,
+    std::vector<uint8_t> value);
+
 /*******************************************************************************
  *
  * Function         BTA_GATTS_SendRsp
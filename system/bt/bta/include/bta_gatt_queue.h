@@ -29,6 +29,9 @@
  * Methods below can be used as replacement to BTA_GATTC_* in BTA app. They do
  * queue the commands if another command is currently being executed.
  *
+ * Reads of a handle that are queued next to each other, with no other
+ * operation in between, are served with a single read request.
+ *
  * If you decide to use those methods in your app, make sure to not mix it with
  * existing BTA_GATTC_* API.
  */
@@ -64,6 +67,8 @@ class BtaGattQueue {
 
  private:
   static void mark_as_not_executing(uint16_t conn_id);
+  static void coalesce_queued_reads(std::list<gatt_operation>& gatt_ops,
+                                    struct gatt_read_op_data* data);
   static void gatt_execute_next_op(uint16_t conn_id);
   static void gatt_read_op_finished(uint16_t conn_id, tGATT_STATUS status,
                                     uint16_t handle, uint16_t len,
@@ -24,6 +24,8 @@
 #ifndef BTA_JV_CO_H
 #define BTA_JV_CO_H
 
+#include <sys/uio.h>
+
 #include "bta_jv_api.h"
 
 /*****************************************************************************
@@ -45,5 +47,8 @@ extern int bta_co_rfc_data_incoming(uint32_t rfcomm_slot_id, BT_HDR* p_buf);
 extern int bta_co_rfc_data_outgoing_size(uint32_t rfcomm_slot_id, int* size);
 extern int bta_co_rfc_data_outgoing(uint32_t rfcomm_slot_id, uint8_t* buf,
                                     uint16_t size);
+/* Fills the |iovcnt| buffers of |iov| with a single read from the socket */
+extern int bta_co_rfc_data_outgoing_iov(uint32_t rfcomm_slot_id,
+                                        const struct iovec* iov, int iovcnt);
 
 #endif /* BTA_DG_CO_H */
@@ -1233,6 +1233,9 @@ static int bta_jv_port_data_co_cback(uint16_t port_handle, uint8_t* buf,
         return bta_co_rfc_data_outgoing_size(p_pcb->rfcomm_slot_id, (int*)buf);
       case DATA_CO_CALLBACK_TYPE_OUTGOING:
         return bta_co_rfc_data_outgoing(p_pcb->rfcomm_slot_id, buf, len);
+      case DATA_CO_CALLBACK_TYPE_OUTGOING_IOV:
+        return bta_co_rfc_data_outgoing_iov(p_pcb->rfcomm_slot_id,
+                                            (const struct iovec*)buf, len);
       default:
         LOG(ERROR) << __func__ << ": unknown callout type=" << type;
         break;
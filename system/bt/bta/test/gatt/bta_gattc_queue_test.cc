@@ -0,0 +1,158 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "bta_gatt_queue.h"
+
+namespace {
+
+constexpr uint16_t kConnId = 0x0001;
+constexpr uint16_t kValueHandle = 0x0010;
+constexpr uint16_t kControlPointHandle = 0x0020;
+
+enum class OpType { READ_CHAR, READ_DESC, WRITE_CHAR, WRITE_DESC };
+
+// What was sent to BTA GATTC, in order, and how to complete it
+struct SentOp {
+  OpType type;
+  uint16_t handle;
+  GATT_READ_OP_CB read_cb;
+  GATT_WRITE_OP_CB write_cb;
+  void* cb_data;
+};
+
+std::vector<SentOp> sent_ops;
+
+// Values the read callbacks were called with, in order
+std::vector<uint8_t> read_values;
+
+void read_cb(uint16_t conn_id, tGATT_STATUS status, uint16_t handle,
+             uint16_t len, uint8_t* value, void* data) {
+  ASSERT_EQ(1, len);
+  read_values.push_back(value[0]);
+}
+
+// Complete the operation sent at |index| with |value| for reads
+void complete(size_t index, uint8_t value = 0) {
+  ASSERT_LT(index, sent_ops.size());
+  const SentOp& op = sent_ops[index];
+  if (op.read_cb) {
+    op.read_cb(kConnId, GATT_SUCCESS, op.handle, 1, &value, op.cb_data);
+  } else {
+    op.write_cb(kConnId, GATT_SUCCESS, op.handle, op.cb_data);
+  }
+}
+
+}  // namespace
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+uint8_t appl_trace_level = BT_TRACE_LEVEL_NONE;
+
+void BTA_GATTC_ReadCharacteristic(uint16_t conn_id, uint16_t handle,
+                                  tGATT_AUTH_REQ auth_req,
+                                  GATT_READ_OP_CB callback, void* cb_data) {
+  sent_ops.push_back({OpType::READ_CHAR, handle, callback, nullptr, cb_data});
+}
+
+void BTA_GATTC_ReadCharDescr(uint16_t conn_id, uint16_t handle,
+                             tGATT_AUTH_REQ auth_req, GATT_READ_OP_CB callback,
+                             void* cb_data) {
+  sent_ops.push_back({OpType::READ_DESC, handle, callback, nullptr, cb_data});
+}
+
+void BTA_GATTC_WriteCharValue(uint16_t conn_id, uint16_t handle,
+                              tGATT_WRITE_TYPE write_type,
+                              std::vector<uint8_t> value,
+                              tGATT_AUTH_REQ auth_req,
+                              GATT_WRITE_OP_CB callback, void* cb_data) {
+  sent_ops.push_back({OpType::WRITE_CHAR, handle, nullptr, callback, cb_data});
+}
+
+void BTA_GATTC_WriteCharDescr(uint16_t conn_id, uint16_t handle,
+                              std::vector<uint8_t> value,
+                              tGATT_AUTH_REQ auth_req,
+                              GATT_WRITE_OP_CB callback, void* cb_data) {
+  sent_ops.push_back({OpType::WRITE_DESC, handle, nullptr, callback, cb_data});
+}
+
+class BtaGattQueueTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    sent_ops.clear();
+    read_values.clear();
+  }
+
+  void TearDown() override { BtaGattQueue::Clean(kConnId); }
+};
+
+TEST_F(BtaGattQueueTest, adjacent_reads_are_coalesced) {
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  ASSERT_EQ(1u, sent_ops.size());
+
+  complete(0, 1);
+  ASSERT_EQ(2u, sent_ops.size());
+  EXPECT_EQ(OpType::READ_CHAR, sent_ops[1].type);
+
+  // Both reads queued while the first one was executing get the same value
+  complete(1, 2);
+  EXPECT_EQ(2u, sent_ops.size());
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 2}), read_values);
+}
+
+TEST_F(BtaGattQueueTest, reads_are_not_moved_ahead_of_a_write) {
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  BtaGattQueue::WriteCharacteristic(kConnId, kControlPointHandle, {0x01},
+                                    GATT_WRITE, nullptr, nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+
+  // Complete every operation as it hits the wire
+  for (size_t i = 0; i < sent_ops.size(); i++) complete(i, i);
+
+  ASSERT_EQ(4u, sent_ops.size());
+  EXPECT_EQ(OpType::READ_CHAR, sent_ops[0].type);
+  EXPECT_EQ(OpType::READ_CHAR, sent_ops[1].type);
+  EXPECT_EQ(OpType::WRITE_CHAR, sent_ops[2].type);
+  EXPECT_EQ(kControlPointHandle, sent_ops[2].handle);
+  EXPECT_EQ(OpType::READ_CHAR, sent_ops[3].type);
+  EXPECT_EQ(kValueHandle, sent_ops[3].handle);
+
+  // The last read sees what followed the write
+  EXPECT_EQ(std::vector<uint8_t>({0, 1, 3}), read_values);
+}
+
+TEST_F(BtaGattQueueTest, reads_separated_by_another_read_are_not_coalesced) {
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+  BtaGattQueue::ReadDescriptor(kConnId, kValueHandle + 1, read_cb, nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, kValueHandle, read_cb, nullptr);
+
+  for (size_t i = 0; i < sent_ops.size(); i++) complete(i, i);
+
+  ASSERT_EQ(4u, sent_ops.size());
+  EXPECT_EQ(OpType::READ_CHAR, sent_ops[1].type);
+  EXPECT_EQ(OpType::READ_DESC, sent_ops[2].type);
+  EXPECT_EQ(OpType::READ_CHAR, sent_ops[3].type);
+  EXPECT_EQ(std::vector<uint8_t>({0, 1, 2, 3}), read_values);
+}
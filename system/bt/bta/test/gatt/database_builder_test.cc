@@ -171,4 +171,50 @@ TEST(DatabaseBuilderTest, SecondaryServiceOutOfOrderTest) {
   ASSERT_EQ(service, result.Services().end());
 }
 
-}  // namespace gatt
\ No newline at end of file
+/* Verify that services with adjacent handle ranges are explored together, and
+ * that descriptor ranges are reported for all characteristics in the range */
+TEST(DatabaseBuilderTest, AdjacentServicesExploredTogetherTest) {
+  DatabaseBuilder builder;
+
+  builder.AddService(0x0001, 0x0005, SERVICE_1_UUID, true);
+  builder.AddService(0x0006, 0x000a, SERVICE_2_UUID, true);
+  builder.AddService(0x0020, 0x0025, SERVICE_3_UUID, true);
+
+  EXPECT_TRUE(builder.StartNextServiceRangeExploration());
+  EXPECT_EQ(builder.CurrentlyExploredService(), make_pair_u16(0x0001, 0x000a));
+
+  // single characteristic discovery over both services
+  builder.AddCharacteristic(0x0002, 0x0003, SERVICE_1_CHAR_1_UUID, 0x02);
+  builder.AddCharacteristic(0x0007, 0x0008, SERVICE_1_CHAR_1_UUID, 0x02);
+
+  EXPECT_EQ(builder.NextDescriptorRangeToExplore(),
+            make_pair_u16(0x0004, 0x0005));
+  builder.AddDescriptor(0x0004, SERVICE_1_CHAR_1_DESC_1_UUID);
+  EXPECT_EQ(builder.NextDescriptorRangeToExplore(),
+            make_pair_u16(0x0009, 0x000a));
+  builder.AddDescriptor(0x0009, SERVICE_1_CHAR_1_DESC_1_UUID);
+  EXPECT_EQ(builder.NextDescriptorRangeToExplore(),
+            DatabaseBuilder::EXPLORE_END);
+
+  // not adjacent, explored on its own
+  EXPECT_TRUE(builder.StartNextServiceRangeExploration());
+  EXPECT_EQ(builder.CurrentlyExploredService(), make_pair_u16(0x0020, 0x0025));
+  EXPECT_EQ(builder.NextDescriptorRangeToExplore(),
+            DatabaseBuilder::EXPLORE_END);
+
+  EXPECT_FALSE(builder.StartNextServiceRangeExploration());
+
+  Database result = builder.Build();
+
+  auto service = result.Services().begin();
+  EXPECT_EQ(service->handle, 0x0001);
+  ASSERT_EQ(service->characteristics.size(), 1u);
+  EXPECT_EQ(service->characteristics[0].descriptors[0].handle, 0x0004);
+
+  service++;
+  EXPECT_EQ(service->handle, 0x0006);
+  ASSERT_EQ(service->characteristics.size(), 1u);
+  EXPECT_EQ(service->characteristics[0].descriptors[0].handle, 0x0009);
+}
+
+}  // namespace gatt
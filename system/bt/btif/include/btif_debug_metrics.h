@@ -0,0 +1,27 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+// Starts exporting the stack counters and latency histograms periodically,
+// to dumpsys and to the file and local socket set in the
+// persist.bluetooth.metrics.* properties.
+void btif_debug_metrics_init(void);
+
+// Dumps the counters and latency histograms last exported.
+void btif_debug_metrics_dump(int fd);
@@ -27,8 +27,12 @@
 #ifndef BTIF_PAN_INTERNAL_H
 #define BTIF_PAN_INTERNAL_H
 
+#include <sys/types.h>
+
+#include "bt_target.h"
 #include "bt_types.h"
 #include "btif_pan.h"
+#include "osi/include/fixed_queue.h"
 
 /*******************************************************************************
  *  Constants & Macros
@@ -38,6 +42,16 @@
 #define PANU_SERVICE_NAME "Android Network User"
 #define TAP_IF_NAME "bt-pan"
 #define TAP_MAX_PKT_WRITE_LEN 2000
+// Largest frame read from the TAP device, Ethernet header included
+#define BTPAN_MAX_FRAME_SIZE 1600
+// Frames read from the TAP device held back for connections whose BNEP
+// transmit queue is full. The TAP device is not read while it is full.
+#define BTPAN_CONGEST_Q_MAX 32
+// Results of forwarding a frame read from the TAP device
+#define FORWARD_IGNORE 1
+#define FORWARD_SUCCESS 0
+#define FORWARD_FAILURE (-1)
+#define FORWARD_CONGEST (-2)
 #ifndef PAN_SECURITY
 #define PAN_SECURITY                                                         \
   (BTM_SEC_IN_AUTHENTICATE | BTM_SEC_OUT_AUTHENTICATE | BTM_SEC_IN_ENCRYPT | \
@@ -79,8 +93,9 @@ typedef struct {
   int open_count;
   int flow;  // 1: outbound data flow on; 0: outbound data flow off
   btpan_conn_t conns[MAX_PAN_CONNS];
-  int congest_packet_size;
-  unsigned char congest_packet[1600];  // max ethernet packet size
+  // Frames read from the TAP device that could not be forwarded yet, in the
+  // order they were read, Ethernet header included
+  fixed_queue_t* congest_q;
 } btpan_cb_t;
 
 /*******************************************************************************
@@ -102,6 +117,34 @@ int btpan_tap_send(int tap_fd, const RawAddress& src, const RawAddress& dst,
                    uint16_t protocol, const char* buff, uint16_t size, bool ext,
                    bool forward);
 
+// Allocates a buffer for a frame of up to BTPAN_MAX_FRAME_SIZE bytes, with
+// the headroom BNEP needs. Released with osi_free.
+BT_HDR* btpan_frame_alloc(void);
+// Reads one frame from |tap_fd| straight into a new frame buffer, stored in
+// |p_frame| on success. Returns the result of the read.
+ssize_t btpan_tap_read_frame(int tap_fd, BT_HDR** p_frame);
+// Forwards a frame read from the TAP device. The frame is kept by the caller
+// when FORWARD_CONGEST is returned, and consumed otherwise. |p_congested| is
+// shared by the frames of one pass, see btpan_tap_forward_frames.
+typedef int (*btpan_forward_cb)(BT_HDR* frame, uint32_t* p_congested);
+// Offers the frames held in |congest_q| to |forward| again, in the order they
+// were read. Frames still congested stay held, in the same order.
+void btpan_forward_held_frames(fixed_queue_t* congest_q,
+                               btpan_forward_cb forward,
+                               uint32_t* p_congested);
+// Reads up to |max_frames| frames from |tap_fd| and passes them to |forward|.
+// Frames it reports congested are held in |congest_q|. Reading stops early
+// when the device runs dry or BTPAN_CONGEST_Q_MAX frames are held. Returns
+// false when |congest_q| is full: |tap_fd| must not be polled again until
+// held frames were forwarded, or it would be signaled without being read.
+bool btpan_tap_forward_frames(int tap_fd, int max_frames,
+                              fixed_queue_t* congest_q,
+                              btpan_forward_cb forward, uint32_t* p_congested);
+// Writes the frame made of |eth_hdr| and |len| bytes of |payload| to |tap_fd|
+// with a single system call. Returns the result of the write.
+ssize_t btpan_tap_write_frame(int tap_fd, const tETH_HDR* eth_hdr,
+                              const uint8_t* payload, uint16_t len);
+
 static inline int is_empty_eth_addr(const RawAddress& addr) {
   return addr == RawAddress::kEmpty;
 }
@@ -53,6 +53,12 @@ int btsock_thread_post_cmd(int handle, int cmd_type,
                            uint32_t user_id);
 int btsock_thread_create(btsock_signaled_cb callback,
                          btsock_cmd_cb cmd_callback);
+/* Same as btsock_thread_create() with |num_workers| poll threads. A socket is
+ * always watched by the same worker, so |callback| is called concurrently for
+ * different sockets but never for the same one. User commands posted with
+ * btsock_thread_post_cmd() all run on the first worker. */
+int btsock_thread_create_workers(btsock_signaled_cb callback,
+                                 btsock_cmd_cb cmd_callback, int num_workers);
 int btsock_thread_exit(int handle);
 
 #endif
@@ -27,10 +27,24 @@
 #ifndef BTIF_SOCK_UTIL_H
 #define BTIF_SOCK_UTIL_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
+
+#include "osi/include/list.h"
+
+/* Maximum number of buffers written by a single sock_send_bufs() call */
+#define SOCK_MAX_SEND_BUFS 16
 
 int sock_send_fd(int sock_fd, const uint8_t* buffer, int len, int send_fd);
 int sock_send_all(int sock_fd, const uint8_t* buf, int len);
 int sock_recv_all(int sock_fd, uint8_t* buf, int len);
 
+/* Writes the BT_HDR buffers of |queue| to the non-blocking |sock_fd|, up to
+ * |max_bufs| of them per sendmsg(), until |queue| is empty or |sock_fd| is
+ * full. Buffers written in full are removed from |queue|, and the buffer
+ * written in part is trimmed to its remaining data. Returns the number of
+ * bytes written, or -1 if |sock_fd| failed. */
+ssize_t sock_send_bufs(int sock_fd, list_t* queue, size_t max_bufs);
+
 #endif
@@ -58,6 +58,7 @@
 #include "btif_debug.h"
 #include "btif_debug_btsnoop.h"
 #include "btif_debug_conn.h"
+#include "btif_debug_metrics.h"
 #include "btif_hf.h"
 #include "btif_storage.h"
 #include "btsnoop.h"
@@ -65,6 +66,7 @@
 #include "common/address_obfuscator.h"
 #include "common/metric_id_allocator.h"
 #include "common/metrics.h"
+#include "device/include/controller.h"
 #include "device/include/interop.h"
 #include "main/shim/dumpsys.h"
 #include "main/shim/shim.h"
@@ -327,12 +329,14 @@ static void dump(int fd, const char** arguments) {
   wakelock_debug_dump(fd);
   osi_allocator_debug_dump(fd);
   alarm_debug_dump(fd);
+  btif_debug_metrics_dump(fd);
   HearingAid::DebugDump(fd);
   connection_manager::dump(fd);
   bluetooth::bqr::DebugDump(fd);
   if (bluetooth::shim::is_gd_shim_enabled()) {
     bluetooth::shim::Dump(fd, arguments);
   } else {
+    controller_debug_dump(fd);
 #if (BTSNOOP_MEM == TRUE)
     btif_debug_btsnoop_dump(fd);
 #endif
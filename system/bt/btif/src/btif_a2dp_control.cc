@@ -33,10 +33,14 @@
 #include "btif_av_co.h"
 #include "btif_hf.h"
 #include "osi/include/osi.h"
+#include "osi/include/properties.h"
 #include "uipc.h"
 
 #define A2DP_DATA_READ_POLL_MS 10
 
+#define A2DP_PCM_RING_DISABLED_PROPERTY \
+  "persist.bluetooth.a2dp_pcm_ring.disabled"
+
 struct {
   uint64_t total_bytes_read = 0;
   uint16_t audio_delay = 0;
@@ -53,6 +57,15 @@ std::unique_ptr<tUIPC_STATE> a2dp_uipc = nullptr;
 void btif_a2dp_control_init(void) {
   a2dp_uipc = UIPC_Init();
   UIPC_Open(*a2dp_uipc, UIPC_CH_ID_AV_CTRL, btif_a2dp_ctrl_cb, A2DP_CTRL_PATH);
+
+  /* The audio HAL offers a shared memory ring on every data connection. A HAL
+     that sends no hello keeps writing PCM to the socket. */
+  tUIPC_PCM_RING_MODE pcm_ring_mode =
+      osi_property_get_bool(A2DP_PCM_RING_DISABLED_PROPERTY, false)
+          ? UIPC_PCM_RING_DECLINE
+          : UIPC_PCM_RING_ACCEPT;
+  UIPC_Ioctl(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, UIPC_SET_PCM_RING_MODE,
+             reinterpret_cast<void*>(pcm_ring_mode));
 }
 
 void btif_a2dp_control_cleanup(void) {
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <algorithm>
 
+#include "a2dp_media_clock.h"
 #include "audio_a2dp_hw/include/audio_a2dp_hw.h"
 #include "audio_hal_interface/a2dp_encoding.h"
 #include "bt_common.h"
@@ -42,7 +43,8 @@
 #include "btif_util.h"
 #include "common/message_loop_thread.h"
 #include "common/metrics.h"
-#include "common/repeating_timer.h"
+#include "common/metrics_collector.h"
+#include "common/precise_repeating_timer.h"
 #include "common/time_util.h"
 #include "osi/include/fixed_queue.h"
 #include "osi/include/log.h"
@@ -52,7 +54,8 @@
 
 using bluetooth::common::A2dpSessionMetrics;
 using bluetooth::common::BluetoothMetricsLogger;
-using bluetooth::common::RepeatingTimer;
+using bluetooth::common::LatencyHistogram;
+using bluetooth::common::PreciseRepeatingTimer;
 
 extern std::unique_ptr<tUIPC_STATE> a2dp_uipc;
 
@@ -63,6 +66,17 @@ extern std::unique_ptr<tUIPC_STATE> a2dp_uipc;
  */
 #define MAX_OUTPUT_A2DP_FRAME_QUEUE_SZ (MAX_PCM_FRAME_NUM_PER_TICK * 2)
 
+// Upper bounds of the media tick lateness histogram buckets, in us. The last
+// bucket counts the ticks that are later than the last bound.
+static const uint64_t kMediaTickLatenessBoundsUs[] = {100,  250,  500,  1000,
+                                                      2000, 5000, 10000};
+#define MEDIA_TICK_LATENESS_BUCKETS \
+  (sizeof(kMediaTickLatenessBoundsUs) / sizeof(uint64_t) + 1)
+
+// Short PCM reads are counted by the missing quarter of the read. The last
+// bucket counts the reads that returned no data at all.
+#define MEDIA_READ_UNDERRUN_BUCKETS 5
+
 class SchedulingStats {
  public:
   SchedulingStats() { Reset(); }
@@ -133,6 +147,16 @@ class BtifMediaStats {
     media_read_total_underflow_bytes = 0;
     media_read_total_underflow_count = 0;
     media_read_last_underflow_us = 0;
+    media_tick_count = 0;
+    media_tick_total_encode_us = 0;
+    media_tick_max_encode_us = 0;
+    media_tick_total_queue_length = 0;
+    media_tick_max_queue_length = 0;
+    media_tick_heap_allocations = 0;
+    memset(media_tick_lateness_histogram, 0,
+           sizeof(media_tick_lateness_histogram));
+    memset(media_read_underrun_histogram, 0,
+           sizeof(media_read_underrun_histogram));
     codec_index = -1;
   }
 
@@ -163,6 +187,24 @@ class BtifMediaStats {
   size_t media_read_total_underflow_count;
   uint64_t media_read_last_underflow_us;
 
+  // Media ticks: time spent in the encoder, TX queue length when the tick
+  // fired and media packets that could not be taken from a packet buffer
+  // class
+  size_t media_tick_count;
+  uint64_t media_tick_total_encode_us;
+  uint64_t media_tick_max_encode_us;
+  size_t media_tick_total_queue_length;
+  size_t media_tick_max_queue_length;
+  size_t media_tick_heap_allocations;
+
+  // Media tick lateness against the timer deadline, bucketed by
+  // |kMediaTickLatenessBoundsUs|
+  size_t media_tick_lateness_histogram[MEDIA_TICK_LATENESS_BUCKETS];
+
+  // Short PCM reads from the audio HAL, by the missing part of the read:
+  // less than 25%, 50%, 75%, 100%, and nothing read
+  size_t media_read_underrun_histogram[MEDIA_READ_UNDERRUN_BUCKETS];
+
   int codec_index = -1;
 };
 
@@ -213,7 +255,7 @@ class BtifA2dpSource {
 
   fixed_queue_t* tx_audio_queue;
   bool tx_flush; /* Discards any outgoing data when true */
-  RepeatingTimer media_alarm;
+  PreciseRepeatingTimer media_alarm;
   const tA2DP_ENCODER_INTERFACE* encoder_interface;
   uint64_t encoder_interval_ms; /* Local copy of the encoder interval */
   BtifMediaStats stats;
@@ -227,6 +269,10 @@ static bluetooth::common::MessageLoopThread btif_a2dp_source_thread(
     "bt_a2dp_source_worker_thread");
 static BtifA2dpSource btif_a2dp_source_cb;
 
+// Time spent encoding and enqueueing the media packets of one timer tick
+static LatencyHistogram a2dp_encode_tick_time(
+    "bluetooth.a2dp.source.encode_tick_time");
+
 static void btif_a2dp_source_init_delayed(void);
 static void btif_a2dp_source_startup_delayed(void);
 static void btif_a2dp_source_start_session_delayed(
@@ -251,7 +297,7 @@ static void btif_a2dp_source_encoder_user_config_update_event(
 static void btif_a2dp_source_audio_feeding_update_event(
     const btav_a2dp_codec_config_t& codec_audio_config);
 static bool btif_a2dp_source_audio_tx_flush_req(void);
-static void btif_a2dp_source_audio_handle_timer(void);
+static void btif_a2dp_source_audio_handle_timer(uint64_t deadline_ns);
 static uint32_t btif_a2dp_source_read_callback(uint8_t* p_buf, uint32_t len);
 static bool btif_a2dp_source_enqueue_callback(BT_HDR* p_buf, size_t frames_n,
                                               uint32_t bytes_read);
@@ -308,6 +354,22 @@ void btif_a2dp_source_accumulate_stats(BtifMediaStats* src,
   dst->media_read_total_underflow_count +=
       src->media_read_total_underflow_count;
   dst->media_read_last_underflow_us = src->media_read_last_underflow_us;
+  dst->media_tick_count += src->media_tick_count;
+  dst->media_tick_total_encode_us += src->media_tick_total_encode_us;
+  dst->media_tick_max_encode_us =
+      std::max(dst->media_tick_max_encode_us, src->media_tick_max_encode_us);
+  dst->media_tick_total_queue_length += src->media_tick_total_queue_length;
+  dst->media_tick_max_queue_length = std::max(
+      dst->media_tick_max_queue_length, src->media_tick_max_queue_length);
+  dst->media_tick_heap_allocations += src->media_tick_heap_allocations;
+  for (size_t i = 0; i < MEDIA_TICK_LATENESS_BUCKETS; i++) {
+    dst->media_tick_lateness_histogram[i] +=
+        src->media_tick_lateness_histogram[i];
+  }
+  for (size_t i = 0; i < MEDIA_READ_UNDERRUN_BUCKETS; i++) {
+    dst->media_read_underrun_histogram[i] +=
+        src->media_read_underrun_histogram[i];
+  }
   if (dst->codec_index < 0) dst->codec_index = src->codec_index;
   btif_a2dp_source_accumulate_scheduling_stats(&src->tx_queue_enqueue_stats,
                                                &dst->tx_queue_enqueue_stats);
@@ -777,9 +839,10 @@ static void btif_a2dp_source_audio_tx_start_event(void) {
   CHECK(btif_a2dp_source_cb.encoder_interface != nullptr);
   btif_a2dp_source_cb.encoder_interface->feeding_reset();
 
-  APPL_TRACE_EVENT(
-      "%s: starting timer %" PRIu64 " ms", __func__,
-      btif_a2dp_source_cb.encoder_interface->get_encoder_interval_ms());
+  // The media tick runs at the exact period of the media clock: the encoder
+  // interval in milliseconds is rounded down for some codecs.
+  uint64_t interval_us = A2DP_MediaClockGetIntervalUs();
+  APPL_TRACE_EVENT("%s: starting timer %" PRIu64 " us", __func__, interval_us);
 
   /* audio engine starting, reset tx suspended flag */
   btif_a2dp_source_cb.tx_flush = false;
@@ -788,8 +851,7 @@ static void btif_a2dp_source_audio_tx_start_event(void) {
   btif_a2dp_source_cb.media_alarm.SchedulePeriodic(
       btif_a2dp_source_thread.GetWeakPtr(), FROM_HERE,
       base::Bind(&btif_a2dp_source_audio_handle_timer),
-      base::TimeDelta::FromMilliseconds(
-          btif_a2dp_source_cb.encoder_interface->get_encoder_interval_ms()));
+      std::chrono::microseconds(interval_us));
 
   btif_a2dp_source_cb.stats.Reset();
   // Assign session_start_us to 1 when
@@ -867,9 +929,12 @@ static void btif_a2dp_source_audio_tx_stop_event(void) {
     btif_a2dp_source_cb.encoder_interface->feeding_reset();
 }
 
-static void btif_a2dp_source_audio_handle_timer(void) {
+static void btif_a2dp_source_audio_handle_timer(uint64_t deadline_ns) {
   if (btif_av_is_a2dp_offload_running()) return;
 
+  uint64_t now_ns = bluetooth::common::time_get_os_monotonic_ns();
+  uint64_t lateness_us =
+      (now_ns > deadline_ns) ? (now_ns - deadline_ns) / 1000 : 0;
   uint64_t timestamp_us = bluetooth::common::time_get_os_boottime_us();
   log_tstamps_us("A2DP Source tx timer", timestamp_us);
 
@@ -888,7 +953,38 @@ static void btif_a2dp_source_audio_handle_timer(void) {
     btif_a2dp_source_cb.encoder_interface->set_transmit_queue_length(
         transmit_queue_length);
   }
-  btif_a2dp_source_cb.encoder_interface->send_frames(timestamp_us);
+  A2DP_MediaClockSetTransmitQueueLength(transmit_queue_length);
+
+  packet_allocator_stats_t packet_stats;
+  A2DP_GetMediaPacketStats(&packet_stats);
+  uint64_t heap_allocations = packet_stats.total_fallbacks;
+  uint64_t encode_start_us = bluetooth::common::time_get_os_boottime_us();
+
+  // The encoders are paced by the deadlines rather than by the time the task
+  // runs, so that the wake up latency does not turn into PCM jitter
+  btif_a2dp_source_cb.encoder_interface->send_frames(deadline_ns / 1000);
+
+  uint64_t encode_us =
+      bluetooth::common::time_get_os_boottime_us() - encode_start_us;
+  a2dp_encode_tick_time.Record(encode_us);
+  A2DP_GetMediaPacketStats(&packet_stats);
+  BtifMediaStats* stats = &btif_a2dp_source_cb.stats;
+  stats->media_tick_count++;
+  stats->media_tick_total_encode_us += encode_us;
+  stats->media_tick_max_encode_us =
+      std::max(stats->media_tick_max_encode_us, encode_us);
+  stats->media_tick_total_queue_length += transmit_queue_length;
+  stats->media_tick_max_queue_length =
+      std::max(stats->media_tick_max_queue_length, transmit_queue_length);
+  stats->media_tick_heap_allocations +=
+      packet_stats.total_fallbacks - heap_allocations;
+  size_t bucket = 0;
+  while (bucket < MEDIA_TICK_LATENESS_BUCKETS - 1 &&
+         lateness_us >= kMediaTickLatenessBoundsUs[bucket]) {
+    bucket++;
+  }
+  stats->media_tick_lateness_histogram[bucket]++;
+
   bta_av_ci_src_data_ready(BTA_AV_CHNL_AUDIO);
   update_scheduling_stats(&btif_a2dp_source_cb.stats.tx_queue_enqueue_stats,
                           timestamp_us,
@@ -911,6 +1007,10 @@ static uint32_t btif_a2dp_source_read_callback(uint8_t* p_buf, uint32_t len) {
     btif_a2dp_source_cb.stats.media_read_total_underflow_bytes +=
         (len - bytes_read);
     btif_a2dp_source_cb.stats.media_read_total_underflow_count++;
+    size_t bucket = (bytes_read == 0)
+                        ? MEDIA_READ_UNDERRUN_BUCKETS - 1
+                        : (uint64_t)(len - bytes_read) * 4 / len;
+    btif_a2dp_source_cb.stats.media_read_underrun_histogram[bucket]++;
     btif_a2dp_source_cb.stats.media_read_last_underflow_us =
         bluetooth::common::time_get_os_boottime_us();
     bluetooth::common::LogA2dpAudioUnderrunEvent(
@@ -1194,6 +1294,89 @@ void btif_a2dp_source_debug_dump(int fd) {
                     1000
               : 0);
 
+  ave_time_us = 0;
+  ave_size = 0;
+  if (accumulated_stats->media_tick_count != 0) {
+    ave_time_us = accumulated_stats->media_tick_total_encode_us /
+                  accumulated_stats->media_tick_count;
+    ave_size = accumulated_stats->media_tick_total_queue_length /
+               accumulated_stats->media_tick_count;
+  }
+  dprintf(fd,
+          "  Media ticks (count/heap allocations)                    : %zu / "
+          "%zu\n",
+          accumulated_stats->media_tick_count,
+          accumulated_stats->media_tick_heap_allocations);
+
+  dprintf(fd,
+          "  Media tick encoding time in us (total/max/ave)          : "
+          "%llu / %llu / %llu\n",
+          (unsigned long long)accumulated_stats->media_tick_total_encode_us,
+          (unsigned long long)accumulated_stats->media_tick_max_encode_us,
+          (unsigned long long)ave_time_us);
+
+  dprintf(fd,
+          "  Media tick TX queue length (max/ave)                    : %zu / "
+          "%zu\n",
+          accumulated_stats->media_tick_max_queue_length, ave_size);
+
+  const size_t* lateness = accumulated_stats->media_tick_lateness_histogram;
+  dprintf(fd,
+          "  Media tick lateness in us "
+          "(<100/<250/<500/<1000/<2000/<5000/<10000/more) : "
+          "%zu / %zu / %zu / %zu / %zu / %zu / %zu / %zu\n",
+          lateness[0], lateness[1], lateness[2], lateness[3], lateness[4],
+          lateness[5], lateness[6], lateness[7]);
+  dprintf(fd,
+          "  Media tick coalesced deadlines                          : %llu\n",
+          (unsigned long long)btif_a2dp_source_cb.media_alarm
+              .GetCoalescedTicks());
+
+  const size_t* underrun = accumulated_stats->media_read_underrun_histogram;
+  dprintf(fd,
+          "  Media read underruns by missing part "
+          "(<25%%/<50%%/<75%%/<100%%/all) : %zu / %zu / %zu / %zu / %zu\n",
+          underrun[0], underrun[1], underrun[2], underrun[3], underrun[4]);
+
+  tA2DP_MEDIA_CLOCK_STATS clock_stats;
+  A2DP_MediaClockGetStats(&clock_stats);
+  dprintf(fd,
+          "  Media clock rate correction in ppm (current/min/max)    : "
+          "%d / %d / %d\n",
+          clock_stats.correction_ppm, clock_stats.min_correction_ppm,
+          clock_stats.max_correction_ppm);
+  dprintf(fd,
+          "  Media clock PCM bytes (credited/underflow/discarded)    : "
+          "%llu / %llu / %llu\n",
+          (unsigned long long)clock_stats.total_credited_bytes,
+          (unsigned long long)clock_stats.total_underflow_bytes,
+          (unsigned long long)clock_stats.total_discarded_bytes);
+
+  packet_allocator_stats_t packet_stats;
+  A2DP_GetMediaPacketStats(&packet_stats);
+  dprintf(fd,
+          "  Media packet buffers (carved/in use/max in use)         : "
+          "%zu / %zu / %zu\n",
+          packet_stats.buffer_count, packet_stats.in_use,
+          packet_stats.max_in_use);
+
+  tUIPC_CHAN_STATS uipc_stats = {};
+  if (a2dp_uipc != nullptr) {
+    UIPC_Ioctl(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, UIPC_REQ_GET_STATS,
+               &uipc_stats);
+  }
+  dprintf(fd,
+          "  UIPC audio counts (wakeups/reads/stalls/timeouts)       : "
+          "%llu / %llu / %llu / %llu\n",
+          (unsigned long long)uipc_stats.wakeups,
+          (unsigned long long)uipc_stats.reads,
+          (unsigned long long)uipc_stats.stalls,
+          (unsigned long long)uipc_stats.timeouts);
+
+  dprintf(fd,
+          "  UIPC audio bytes read                                   : %llu\n",
+          (unsigned long long)uipc_stats.rx_bytes);
+
   //
   // TxQueue enqueue stats
   //
@@ -21,10 +21,12 @@
 
 #include "btif/include/btif_debug.h"
 #include "btif/include/btif_debug_btsnoop.h"
+#include "btif/include/btif_debug_metrics.h"
 #include "internal_include/bt_target.h"
 
 void btif_debug_init(void) {
 #if (BTSNOOP_MEM == TRUE)
   btif_debug_btsnoop_init();
 #endif
+  btif_debug_metrics_init();
 }
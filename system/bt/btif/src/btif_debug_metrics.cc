@@ -0,0 +1,73 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_btif_debug_metrics"
+
+#include "btif/include/btif_debug_metrics.h"
+
+#include <memory>
+
+#include "common/metrics_collector.h"
+#include "osi/include/log.h"
+#include "osi/include/properties.h"
+
+using bluetooth::common::DumpsysMetricsSink;
+using bluetooth::common::FileMetricsSink;
+using bluetooth::common::MetricsExporter;
+using bluetooth::common::SocketMetricsSink;
+
+// Path of a file the snapshots are appended to
+static const char METRICS_FILE_PROPERTY[] = "persist.bluetooth.metrics.file";
+// Path of a local datagram socket the snapshots are sent to
+static const char METRICS_SOCKET_PROPERTY[] =
+    "persist.bluetooth.metrics.socket";
+static const char METRICS_PERIOD_PROPERTY[] =
+    "persist.bluetooth.metrics.period_ms";
+
+static std::shared_ptr<DumpsysMetricsSink> dumpsys_sink;
+
+void btif_debug_metrics_init(void) {
+  // The exporter outlives the stack, so that it is set up once
+  if (dumpsys_sink != nullptr) return;
+
+  MetricsExporter& exporter = MetricsExporter::GetInstance();
+  dumpsys_sink = std::make_shared<DumpsysMetricsSink>();
+  exporter.AddSink(dumpsys_sink);
+
+  char path[PROPERTY_VALUE_MAX] = "";
+  if (osi_property_get(METRICS_FILE_PROPERTY, path, "") > 0) {
+    exporter.AddSink(std::make_shared<FileMetricsSink>(path));
+  }
+  if (osi_property_get(METRICS_SOCKET_PROPERTY, path, "") > 0) {
+    exporter.AddSink(std::make_shared<SocketMetricsSink>(path));
+  }
+
+  int32_t period_ms = osi_property_get_int32(
+      METRICS_PERIOD_PROPERTY, MetricsExporter::kDefaultPeriod.count());
+  if (period_ms <= 0) {
+    LOG_WARN("%s: ignoring period of %d ms", __func__, period_ms);
+    period_ms = MetricsExporter::kDefaultPeriod.count();
+  }
+  if (!exporter.Start(std::chrono::milliseconds(period_ms))) {
+    LOG_ERROR("%s: unable to start exporting metrics", __func__);
+  }
+}
+
+void btif_debug_metrics_dump(int fd) {
+  if (dumpsys_sink != nullptr) dumpsys_sink->Dump(fd);
+}
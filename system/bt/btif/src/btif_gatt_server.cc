@@ -399,6 +399,27 @@ static bt_status_t btif_gatts_send_indication(int server_if,
   //       invoked without need for confirmation.
 }
 
+static bt_status_t btif_gatts_send_notification_multi(
+    int server_if, int attribute_handle, vector<int> conn_ids,
+    vector<uint8_t> value) {
+  CHECK_BTGATT_INIT();
+
+  if (value.size() > BTGATT_MAX_ATTR_LEN) value.resize(BTGATT_MAX_ATTR_LEN);
+
+  vector<uint16_t> bta_conn_ids;
+  bta_conn_ids.reserve(conn_ids.size());
+  for (int conn_id : conn_ids) {
+    if (conn_id < 0 || conn_id > UINT16_MAX) {
+      LOG_ERROR("%s: invalid conn_id %d", __func__, conn_id);
+      return BT_STATUS_PARM_INVALID;
+    }
+    bta_conn_ids.push_back(conn_id);
+  }
+  return do_in_jni_thread(Bind(&BTA_GATTS_HandleValueNotificationMulti,
+                               server_if, std::move(bta_conn_ids),
+                               attribute_handle, std::move(value)));
+}
+
 static void btif_gatts_send_response_impl(int conn_id, int trans_id, int status,
                                           btgatt_response_t response) {
   tGATTS_RSP rsp_struct;
@@ -442,4 +463,4 @@ const btgatt_server_interface_t btgattServerInterface = {
     btif_gatts_add_service,    btif_gatts_stop_service,
     btif_gatts_delete_service, btif_gatts_send_indication,
     btif_gatts_send_response,  btif_gatts_set_preferred_phy,
-    btif_gatts_read_phy};
+    btif_gatts_read_phy,       btif_gatts_send_notification_multi};
@@ -66,11 +66,6 @@
 #include "osi/include/osi.h"
 #include "stack/include/btu.h"
 
-#define FORWARD_IGNORE 1
-#define FORWARD_SUCCESS 0
-#define FORWARD_FAILURE (-1)
-#define FORWARD_CONGEST (-2)
-
 #if (PAN_NAP_DISABLED == TRUE && PANU_DISABLED == TRUE)
 #define BTPAN_LOCAL_ROLE BTPAN_ROLE_NONE
 #elif PAN_NAP_DISABLED == TRUE
@@ -88,8 +83,6 @@
                        __func__, #s, __LINE__)                           \
   } while (0)
 
-#define MIN(x, y) (((x) < (y)) ? (x) : (y))
-
 btpan_cb_t btpan_cb;
 
 static bool jni_initialized;
@@ -134,6 +127,7 @@ void btif_pan_init() {
     memset(&btpan_cb, 0, sizeof(btpan_cb));
     btpan_cb.tap_fd = INVALID_FD;
     btpan_cb.flow = 1;
+    btpan_cb.congest_q = fixed_queue_new(SIZE_MAX);
     for (int i = 0; i < MAX_PAN_CONNS; i++)
       btpan_cleanup_conn(&btpan_cb.conns[i]);
     BTA_PanEnable(bta_pan_callback);
@@ -150,6 +144,8 @@ static void pan_disable() {
       btpan_tap_close(btpan_cb.tap_fd);
       btpan_cb.tap_fd = INVALID_FD;
     }
+    fixed_queue_free(btpan_cb.congest_q, osi_free);
+    btpan_cb.congest_q = NULL;
   }
 }
 
@@ -367,8 +363,10 @@ void btpan_set_flow_control(bool enable) {
   if (btpan_cb.tap_fd == -1) return;
 
   btpan_cb.flow = enable;
+  // BNEP turns the flow back on once its transmit queue drained: the frames
+  // held back for it are sent first, and the TAP device is polled again if
+  // there is room for more
   if (enable) {
-    btsock_thread_add_fd(pan_pth, btpan_cb.tap_fd, 0, SOCK_THREAD_FD_RD, 0);
     do_in_main_thread(FROM_HERE,
                       base::Bind(btu_exec_tap_fd_read, btpan_cb.tap_fd));
   }
@@ -417,17 +415,14 @@ int btpan_tap_send(int tap_fd, const RawAddress& src, const RawAddress& dst,
     eth_hdr.h_dest = dst;
     eth_hdr.h_src = src;
     eth_hdr.h_proto = htons(proto);
-    char packet[TAP_MAX_PKT_WRITE_LEN + sizeof(tETH_HDR)];
-    memcpy(packet, &eth_hdr, sizeof(tETH_HDR));
     if (len > TAP_MAX_PKT_WRITE_LEN) {
       LOG_ERROR("btpan_tap_send eth packet size:%d is exceeded limit!", len);
       return -1;
     }
-    memcpy(packet + sizeof(tETH_HDR), buf, len);
 
     /* Send data to network interface */
-    ssize_t ret;
-    OSI_NO_INTR(ret = write(tap_fd, packet, len + sizeof(tETH_HDR)));
+    ssize_t ret =
+        btpan_tap_write_frame(tap_fd, &eth_hdr, (const uint8_t*)buf, len);
     BTIF_TRACE_DEBUG("ret:%d", ret);
     return (int)ret;
   }
@@ -473,6 +468,8 @@ static void btpan_open_conn(btpan_conn_t* conn, tBTA_PAN* p_data) {
     btpan_cb.open_count++;
     conn->handle = p_data->open.handle;
     if (btpan_cb.tap_fd < 0) {
+      // Frames read from a former TAP device are stale
+      fixed_queue_flush(btpan_cb.congest_q, osi_free);
       btpan_cb.tap_fd = btpan_tap_open();
       if (btpan_cb.tap_fd >= 0) create_tap_read_thread(btpan_cb.tap_fd);
     }
@@ -499,6 +496,7 @@ static void btpan_close_conn(btpan_conn_t* conn) {
         btpan_tap_close(btpan_cb.tap_fd);
         btpan_cb.tap_fd = INVALID_FD;
       }
+      fixed_queue_flush(btpan_cb.congest_q, osi_free);
     }
   }
 }
@@ -549,28 +547,58 @@ static inline bool should_forward(tETH_HDR* hdr) {
   return false;
 }
 
-static int forward_bnep(tETH_HDR* eth_hdr, BT_HDR* hdr) {
-  int broadcast = eth_hdr->h_dest.address[0] & 1;
+// Forwards |frame|, read from the TAP device with its Ethernet header, to the
+// connection it is meant for. The frame is kept by the caller when
+// FORWARD_CONGEST is returned, and consumed otherwise. |p_congested| has a bit
+// set per connection found congested during this pass over the frames, so
+// that frames keep their order on each connection.
+static int forward_bnep(BT_HDR* frame, uint32_t* p_congested) {
+  uint8_t* packet = frame->data + frame->offset;
+  if (frame->len <= sizeof(tETH_HDR) || !should_forward((tETH_HDR*)packet)) {
+    BTIF_TRACE_WARNING("%s dropping packet of length %d", __func__,
+                       frame->len);
+    osi_free(frame);
+    return FORWARD_IGNORE;
+  }
+
+  // Extract the ethernet header from the buffer since the PAN_WriteBuf can't
+  // handle two pointers that point inside the same buffer.
+  tETH_HDR eth_hdr;
+  memcpy(&eth_hdr, packet, sizeof(tETH_HDR));
+  int broadcast = eth_hdr.h_dest.address[0] & 1;
 
   // Find the right connection to send this frame over.
   for (int i = 0; i < MAX_PAN_CONNS; i++) {
     uint16_t handle = btpan_cb.conns[i].handle;
     if (handle != (uint16_t)-1 &&
-        (broadcast || btpan_cb.conns[i].eth_addr == eth_hdr->h_dest ||
-         btpan_cb.conns[i].peer == eth_hdr->h_dest)) {
-      int result = PAN_WriteBuf(handle, eth_hdr->h_dest, eth_hdr->h_src,
-                                ntohs(eth_hdr->h_proto), hdr, 0);
+        (broadcast || btpan_cb.conns[i].eth_addr == eth_hdr.h_dest ||
+         btpan_cb.conns[i].peer == eth_hdr.h_dest)) {
+      // PAN_WriteBuf copies broadcasts to every connection, whichever
+      // connection they are written on. They are never held back.
+      if (!broadcast &&
+          ((*p_congested & (1 << i)) || PAN_IsTxQueueFull(handle))) {
+        *p_congested |= 1 << i;
+        return FORWARD_CONGEST;
+      }
+
+      // Skip the ethernet header.
+      frame->len -= sizeof(tETH_HDR);
+      frame->offset += sizeof(tETH_HDR);
+      int result = PAN_WriteBuf(handle, eth_hdr.h_dest, eth_hdr.h_src,
+                                ntohs(eth_hdr.h_proto), frame, 0);
       switch (result) {
-        case PAN_Q_SIZE_EXCEEDED:
-          return FORWARD_CONGEST;
         case PAN_SUCCESS:
           return FORWARD_SUCCESS;
+        case PAN_Q_SIZE_EXCEEDED:
+          // The frame was dropped by BNEP
+          *p_congested |= 1 << i;
+          return FORWARD_FAILURE;
         default:
           return FORWARD_FAILURE;
       }
     }
   }
-  osi_free(hdr);
+  osi_free(frame);
   return FORWARD_IGNORE;
 }
 
@@ -664,87 +692,26 @@ static void bta_pan_callback(tBTA_PAN_EVT event, tBTA_PAN* p_data) {
                         sizeof(tBTA_PAN), NULL);
 }
 
-#define IS_EXCEPTION(e) ((e) & (POLLHUP | POLLRDHUP | POLLERR | POLLNVAL))
 static void btu_exec_tap_fd_read(int fd) {
-  struct pollfd ufd;
-
   if (fd == INVALID_FD || fd != btpan_cb.tap_fd) return;
 
-  // Don't occupy BTU context too long, avoid buffer overruns and
-  // give other profiles a chance to run by limiting the amount of memory
-  // PAN can use.
-  for (int i = 0; i < PAN_BUF_MAX && btif_is_enabled() && btpan_cb.flow; i++) {
-    BT_HDR* buffer = (BT_HDR*)osi_malloc(PAN_BUF_SIZE);
-    buffer->offset = PAN_MINIMUM_OFFSET;
-    buffer->len = PAN_BUF_SIZE - sizeof(BT_HDR) - buffer->offset;
-
-    uint8_t* packet = (uint8_t*)buffer + sizeof(BT_HDR) + buffer->offset;
-
-    // If we don't have an undelivered packet left over, pull one from the TAP
-    // driver.
-    // We save it in the congest_packet right away in case we can't deliver it
-    // in this
-    // attempt.
-    if (!btpan_cb.congest_packet_size) {
-      ssize_t ret;
-      OSI_NO_INTR(ret = read(fd, btpan_cb.congest_packet,
-                             sizeof(btpan_cb.congest_packet)));
-      switch (ret) {
-        case -1:
-          BTIF_TRACE_ERROR("%s unable to read from driver: %s", __func__,
-                           strerror(errno));
-          osi_free(buffer);
-          // add fd back to monitor thread to try it again later
-          btsock_thread_add_fd(pan_pth, fd, 0, SOCK_THREAD_FD_RD, 0);
-          return;
-        case 0:
-          BTIF_TRACE_WARNING("%s end of file reached.", __func__);
-          osi_free(buffer);
-          // add fd back to monitor thread to process the exception
-          btsock_thread_add_fd(pan_pth, fd, 0, SOCK_THREAD_FD_RD, 0);
-          return;
-        default:
-          btpan_cb.congest_packet_size = ret;
-          break;
-      }
-    }
-
-    memcpy(packet, btpan_cb.congest_packet,
-           MIN(btpan_cb.congest_packet_size, buffer->len));
-    buffer->len = MIN(btpan_cb.congest_packet_size, buffer->len);
-
-    if (buffer->len > sizeof(tETH_HDR) && should_forward((tETH_HDR*)packet)) {
-      // Extract the ethernet header from the buffer since the PAN_WriteBuf
-      // inside
-      // forward_bnep can't handle two pointers that point inside the same GKI
-      // buffer.
-      tETH_HDR hdr;
-      memcpy(&hdr, packet, sizeof(tETH_HDR));
+  // Nothing is sent while the flow is off. The TAP device is polled again
+  // when it is turned back on.
+  if (!btpan_cb.flow) return;
 
-      // Skip the ethernet header.
-      buffer->len -= sizeof(tETH_HDR);
-      buffer->offset += sizeof(tETH_HDR);
-      if (forward_bnep(&hdr, buffer) != FORWARD_CONGEST)
-        btpan_cb.congest_packet_size = 0;
-    } else {
-      BTIF_TRACE_WARNING("%s dropping packet of length %d", __func__,
-                         buffer->len);
-      btpan_cb.congest_packet_size = 0;
-      osi_free(buffer);
-    }
-
-    // Bail out of the loop if reading from the TAP fd would block.
-    ufd.fd = fd;
-    ufd.events = POLLIN;
-    ufd.revents = 0;
+  uint32_t congested = 0;
 
-    int ret;
-    OSI_NO_INTR(ret = poll(&ufd, 1, 0));
-    if (ret <= 0 || IS_EXCEPTION(ufd.revents)) break;
-  }
+  // Frames held back by an earlier pass go first
+  btpan_forward_held_frames(btpan_cb.congest_q, forward_bnep, &congested);
 
-  if (btpan_cb.flow) {
-    // add fd back to monitor thread when the flow is on
+  // Don't occupy BTU context too long, avoid buffer overruns and
+  // give other profiles a chance to run by limiting the amount of memory
+  // PAN can use. The TAP device hands out a frame per read, read them until
+  // it runs dry.
+  int max_frames = btif_is_enabled() ? PAN_BUF_MAX : 0;
+  if (btpan_tap_forward_frames(fd, max_frames, btpan_cb.congest_q,
+                               forward_bnep, &congested)) {
+    // add fd back to monitor thread when there is room for more frames
     btsock_thread_add_fd(pan_pth, fd, 0, SOCK_THREAD_FD_RD, 0);
   }
 }
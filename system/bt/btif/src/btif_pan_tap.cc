@@ -0,0 +1,121 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*******************************************************************************
+ *
+ *  Filename:      btif_pan_tap.cc
+ *
+ *  Description:   PAN data path to and from the TAP device
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_btif_pan"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "btif_pan_internal.h"
+#include "osi/include/allocator.h"
+#include "osi/include/log.h"
+#include "osi/include/packet_allocator.h"
+#include "osi/include/osi.h"
+#include "stack/include/pan_api.h"
+
+// Frames read from the TAP device are written to BNEP in place, behind the
+// headroom BNEP and L2CAP need for their own headers.
+#define BTPAN_FRAME_BUF_SIZE \
+  (sizeof(BT_HDR) + PAN_MINIMUM_OFFSET + BTPAN_MAX_FRAME_SIZE)
+
+BT_HDR* btpan_frame_alloc(void) {
+  BT_HDR* frame = (BT_HDR*)osi_pkt_alloc(BTPAN_FRAME_BUF_SIZE);
+  frame->event = 0;
+  frame->layer_specific = 0;
+  frame->offset = PAN_MINIMUM_OFFSET;
+  frame->len = 0;
+  return frame;
+}
+
+ssize_t btpan_tap_read_frame(int tap_fd, BT_HDR** p_frame) {
+  BT_HDR* frame = btpan_frame_alloc();
+  ssize_t ret;
+  OSI_NO_INTR(ret = read(tap_fd, frame->data + frame->offset,
+                         BTPAN_MAX_FRAME_SIZE));
+  if (ret <= 0) {
+    osi_free(frame);
+    *p_frame = NULL;
+    return ret;
+  }
+  frame->len = ret;
+  *p_frame = frame;
+  return ret;
+}
+
+void btpan_forward_held_frames(fixed_queue_t* congest_q,
+                               btpan_forward_cb forward,
+                               uint32_t* p_congested) {
+  size_t held = fixed_queue_length(congest_q);
+  for (size_t i = 0; i < held; i++) {
+    BT_HDR* frame = (BT_HDR*)fixed_queue_try_dequeue(congest_q);
+    if (frame == NULL) break;
+    if (forward(frame, p_congested) == FORWARD_CONGEST)
+      fixed_queue_enqueue(congest_q, frame);
+  }
+}
+
+bool btpan_tap_forward_frames(int tap_fd, int max_frames,
+                              fixed_queue_t* congest_q,
+                              btpan_forward_cb forward,
+                              uint32_t* p_congested) {
+  for (int i = 0; i < max_frames; i++) {
+    if (fixed_queue_length(congest_q) >= BTPAN_CONGEST_Q_MAX) break;
+
+    BT_HDR* frame;
+    ssize_t ret = btpan_tap_read_frame(tap_fd, &frame);
+    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (ret == -1) {
+      LOG_ERROR("%s unable to read from driver: %s", __func__, strerror(errno));
+      break;
+    }
+    if (ret == 0) {
+      LOG_WARN("%s end of file reached.", __func__);
+      break;
+    }
+
+    if (forward(frame, p_congested) == FORWARD_CONGEST)
+      fixed_queue_enqueue(congest_q, frame);
+  }
+
+  return fixed_queue_length(congest_q) < BTPAN_CONGEST_Q_MAX;
+}
+
+ssize_t btpan_tap_write_frame(int tap_fd, const tETH_HDR* eth_hdr,
+                              const uint8_t* payload, uint16_t len) {
+  // The TAP device takes a frame per write: gather the header and payload
+  // rather than copying them together first
+  struct iovec iov[2];
+  iov[0].iov_base = (void*)eth_hdr;
+  iov[0].iov_len = sizeof(tETH_HDR);
+  iov[1].iov_base = (void*)payload;
+  iov[1].iov_len = len;
+
+  ssize_t ret;
+  OSI_NO_INTR(ret = writev(tap_fd, iov, 2));
+  return ret;
+}
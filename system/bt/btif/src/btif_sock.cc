@@ -18,6 +18,7 @@
 
 #define LOG_TAG "bt_btif_sock"
 
+#include <algorithm>
 #include <atomic>
 
 #include <base/logging.h>
@@ -38,6 +39,7 @@
 #include "btif_util.h"
 #include "common/metrics.h"
 #include "device/include/controller.h"
+#include "osi/include/properties.h"
 #include "osi/include/thread.h"
 
 using bluetooth::Uuid;
@@ -53,6 +55,11 @@ static void btsock_request_max_tx_data_length(const RawAddress& bd_addr);
 
 static void btsock_signaled(int fd, int type, int flags, uint32_t user_id);
 
+// Poll threads serving the RFCOMM and L2CAP sockets. Gateways multiplexing
+// many connections can spread them over more than one.
+#define BTSOCK_WORKER_THREADS_PROPERTY "persist.bluetooth.sock_worker_threads"
+#define BTSOCK_MAX_WORKER_THREADS 8
+
 static std::atomic_int thread_handle{-1};
 static thread_t* thread;
 
@@ -71,8 +78,11 @@ bt_status_t btif_sock_init(uid_set_t* uid_set) {
   CHECK(thread == NULL);
 
   bt_status_t status;
+  int num_workers = osi_property_get_int32(BTSOCK_WORKER_THREADS_PROPERTY, 1);
+  num_workers = std::min(std::max(num_workers, 1), BTSOCK_MAX_WORKER_THREADS);
   btsock_thread_init();
-  thread_handle = btsock_thread_create(btsock_signaled, NULL);
+  thread_handle =
+      btsock_thread_create_workers(btsock_signaled, NULL, num_workers);
   if (thread_handle == -1) {
     LOG_ERROR("%s unable to create btsock_thread.", __func__);
     goto error;
@@ -817,24 +817,17 @@ static sent_status_t send_data_to_app(int fd, BT_HDR* p_buf) {
 }
 
 static bool flush_incoming_que_on_wr_signal(rfc_slot_t* slot) {
-  while (!list_is_empty(slot->incoming_queue)) {
-    BT_HDR* p_buf = (BT_HDR*)list_front(slot->incoming_queue);
-    switch (send_data_to_app(slot->fd, p_buf)) {
-      case SENT_NONE:
-      case SENT_PARTIAL:
-        // monitor the fd to get callback when app is ready to receive data
-        btsock_thread_add_fd(pth, slot->fd, BTSOCK_RFCOMM, SOCK_THREAD_FD_WR,
-                             slot->id);
-        return true;
-
-      case SENT_ALL:
-        list_remove(slot->incoming_queue, p_buf);
-        break;
+  if (sock_send_bufs(slot->fd, slot->incoming_queue, SOCK_MAX_SEND_BUFS) ==
+      -1) {
+    LOG_ERROR("%s error writing RFCOMM data back to app", __func__);
+    return false;
+  }
 
-      case SENT_FAILED:
-        list_remove(slot->incoming_queue, p_buf);
-        return false;
-    }
+  if (!list_is_empty(slot->incoming_queue)) {
+    // monitor the fd to get callback when app is ready to receive data
+    btsock_thread_add_fd(pth, slot->fd, BTSOCK_RFCOMM, SOCK_THREAD_FD_WR,
+                         slot->id);
+    return true;
   }
 
   // app is ready to receive data, tell stack to start the data flow
@@ -962,3 +955,25 @@ int bta_co_rfc_data_outgoing(uint32_t id, uint8_t* buf, uint16_t size) {
 
   return true;
 }
+
+int bta_co_rfc_data_outgoing_iov(uint32_t id, const struct iovec* iov,
+                                 int iovcnt) {
+  std::unique_lock<std::recursive_mutex> lock(slot_lock);
+  rfc_slot_t* slot = find_rfc_slot_by_id(id);
+  if (!slot) return false;
+
+  ssize_t size = 0;
+  for (int i = 0; i < iovcnt; i++) size += iov[i].iov_len;
+
+  ssize_t received;
+  OSI_NO_INTR(received = readv(slot->fd, iov, iovcnt));
+
+  if (received != size) {
+    LOG_ERROR("%s error receiving RFCOMM data from app: %s", __func__,
+              strerror(errno));
+    cleanup_rfc_slot(slot);
+    return false;
+  }
+
+  return true;
+}
@@ -20,7 +20,7 @@
  *
  *  Filename:      btif_sock_thread.cc
  *
- *  Description:   socket select thread
+ *  Description:   socket poll threads
  *
  ******************************************************************************/
 
@@ -29,25 +29,20 @@
 #include "btif_sock_thread.h"
 
 #include <alloca.h>
-#include <ctype.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <features.h>
 #include <pthread.h>
-#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/poll.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <sys/un.h>
-#include <time.h>
 #include <unistd.h>
 
 #include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include "bta_api.h"
 #include "btif_common.h"
@@ -63,12 +58,16 @@
                        __LINE__)                                             \
   } while (0)
 
+/* Number of socket thread handles. Each handle runs its own workers. */
 #define MAX_THREAD 8
-#define MAX_POLL 64
-#define POLL_EXCEPTION_EVENTS (POLLHUP | POLLRDHUP | POLLERR | POLLNVAL)
+/* Events returned by a single epoll_wait() */
+#define MAX_EVENTS 64
+/* Commands handled per wake up, so that sockets are not starved */
+#define MAX_CMDS_PER_WAKEUP 64
+#define POLL_EXCEPTION_EVENTS (EPOLLHUP | EPOLLRDHUP | EPOLLERR)
 #define IS_EXCEPTION(e) ((e)&POLL_EXCEPTION_EVENTS)
-#define IS_READ(e) ((e)&POLLIN)
-#define IS_WRITE(e) ((e)&POLLOUT)
+#define IS_READ(e) ((e)&EPOLLIN)
+#define IS_WRITE(e) ((e)&EPOLLOUT)
 /*cmd executes in socket poll thread */
 #define CMD_WAKEUP 1
 #define CMD_EXIT 2
@@ -77,17 +76,24 @@
 #define CMD_USER_PRIVATE 5
 
 typedef struct {
-  struct pollfd pfd;
   uint32_t user_id;
   int type;
   int flags;
 } poll_slot_t;
+
+/* A worker owns an epoll set and the thread waiting on it. Its poll slots are
+ * only accessed from that thread: other threads go through the cmd socket. */
 typedef struct {
+  int h;
+  int epoll_fd;
   int cmd_fdr, cmd_fdw;
-  int poll_count;
-  poll_slot_t ps[MAX_POLL];
-  int psi[MAX_POLL];  // index of poll slot
   pthread_t thread_id;
+  std::unordered_map<int, poll_slot_t> poll_slots;  // keyed by fd
+} sock_worker_t;
+
+typedef struct {
+  int worker_count;
+  sock_worker_t* workers;
   btsock_signaled_cb callback;
   btsock_cmd_cb cmd_callback;
   int used;
@@ -95,10 +101,6 @@ typedef struct {
 static thread_slot_t ts[MAX_THREAD];
 
 static void* sock_poll_thread(void* arg);
-static inline void close_cmd_fd(int h);
-
-static inline void add_poll(int h, int fd, int type, int flags,
-                            uint32_t user_id);
 
 static std::recursive_mutex thread_slot_lock;
 
@@ -127,7 +129,8 @@ static inline int create_thread(void* (*start_routine)(void*), void* arg,
   pthread_setschedparam(*thread_id, policy, &param);
   return ret;
 }
-static void init_poll(int cmd_fd);
+static bool init_worker(sock_worker_t* w, int h);
+static void free_worker(sock_worker_t* w);
 static int alloc_thread_slot() {
   std::unique_lock<std::recursive_mutex> lock(thread_slot_lock);
   int i;
@@ -144,11 +147,23 @@ static int alloc_thread_slot() {
 }
 static void free_thread_slot(int h) {
   if (0 <= h && h < MAX_THREAD) {
-    close_cmd_fd(h);
+    for (int i = 0; i < ts[h].worker_count; i++) free_worker(&ts[h].workers[i]);
+    delete[] ts[h].workers;
+    ts[h].workers = NULL;
+    ts[h].worker_count = 0;
+    ts[h].callback = NULL;
+    ts[h].cmd_callback = NULL;
     ts[h].used = 0;
   } else
     APPL_TRACE_ERROR("invalid thread handle:%d", h);
 }
+static inline bool is_valid_handle(int h) {
+  return 0 <= h && h < MAX_THREAD && ts[h].worker_count > 0;
+}
+/* A socket always goes to the same worker, so its events stay ordered */
+static inline sock_worker_t* worker_for_fd(int h, int fd) {
+  return &ts[h].workers[(unsigned int)fd % ts[h].worker_count];
+}
 int btsock_thread_init() {
   static int initialized;
   APPL_TRACE_DEBUG("in initialized:%d", initialized);
@@ -156,10 +171,9 @@ int btsock_thread_init() {
     initialized = 1;
     int h;
     for (h = 0; h < MAX_THREAD; h++) {
-      ts[h].cmd_fdr = ts[h].cmd_fdw = -1;
       ts[h].used = 0;
-      ts[h].thread_id = -1;
-      ts[h].poll_count = 0;
+      ts[h].worker_count = 0;
+      ts[h].workers = NULL;
       ts[h].callback = NULL;
       ts[h].cmd_callback = NULL;
     }
@@ -168,49 +182,99 @@ int btsock_thread_init() {
 }
 int btsock_thread_create(btsock_signaled_cb callback,
                          btsock_cmd_cb cmd_callback) {
+  return btsock_thread_create_workers(callback, cmd_callback, 1);
+}
+int btsock_thread_create_workers(btsock_signaled_cb callback,
+                                 btsock_cmd_cb cmd_callback, int num_workers) {
   asrt(callback || cmd_callback);
+  if (num_workers < 1) {
+    APPL_TRACE_ERROR("invalid number of workers:%d", num_workers);
+    return -1;
+  }
   int h = alloc_thread_slot();
   APPL_TRACE_DEBUG("alloc_thread_slot ret:%d", h);
   if (h >= 0) {
-    init_poll(h);
-    pthread_t thread;
-    int status = create_thread(sock_poll_thread, (void*)(uintptr_t)h, &thread);
-    if (status) {
-      APPL_TRACE_ERROR("create_thread failed: %s", strerror(status));
-      free_thread_slot(h);
-      return -1;
-    }
-
-    ts[h].thread_id = thread;
-    APPL_TRACE_DEBUG("h:%d, thread id:%d", h, ts[h].thread_id);
     ts[h].callback = callback;
     ts[h].cmd_callback = cmd_callback;
+    ts[h].workers = new sock_worker_t[num_workers];
+    for (int i = 0; i < num_workers; i++) {
+      sock_worker_t* w = &ts[h].workers[i];
+      if (!init_worker(w, h)) {
+        ts[h].worker_count = i + 1;
+        btsock_thread_exit(h);
+        return -1;
+      }
+      int status = create_thread(sock_poll_thread, w, &w->thread_id);
+      if (status) {
+        APPL_TRACE_ERROR("create_thread failed: %s", strerror(status));
+        w->thread_id = -1;
+        ts[h].worker_count = i + 1;
+        btsock_thread_exit(h);
+        return -1;
+      }
+      APPL_TRACE_DEBUG("h:%d, worker:%d, thread id:%d", h, i, w->thread_id);
+    }
+    ts[h].worker_count = num_workers;
   }
   return h;
 }
 
-/* create dummy socket pair used to wake up select loop */
-static inline void init_cmd_fd(int h) {
-  asrt(ts[h].cmd_fdr == -1 && ts[h].cmd_fdw == -1);
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, &ts[h].cmd_fdr) < 0) {
+static inline unsigned int flags2events(int flags) {
+  unsigned int events = 0;
+  if (flags & SOCK_THREAD_FD_WR) events |= EPOLLOUT;
+  if (flags & SOCK_THREAD_FD_RD) events |= EPOLLIN;
+  events |= POLL_EXCEPTION_EVENTS;
+  return events;
+}
+static bool set_epoll(sock_worker_t* w, int op, int fd, int flags) {
+  struct epoll_event event = {};
+  event.events = flags2events(flags);
+  event.data.fd = fd;
+  if (epoll_ctl(w->epoll_fd, op, fd, &event) == 0) return true;
+  // A socket closed without being removed left the epoll set on its own,
+  // and a new one may have been given the same fd since
+  if (op == EPOLL_CTL_MOD && errno == ENOENT &&
+      epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)
+    return true;
+  APPL_TRACE_ERROR("epoll_ctl op:%d, fd:%d failed: %s", op, fd,
+                   strerror(errno));
+  return false;
+}
+
+/* create the epoll set, and a socket pair used to post commands to it */
+static bool init_worker(sock_worker_t* w, int h) {
+  w->h = h;
+  w->thread_id = -1;
+  w->cmd_fdr = w->cmd_fdw = -1;
+  w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (w->epoll_fd == -1) {
+    APPL_TRACE_ERROR("epoll_create1 failed: %s", strerror(errno));
+    return false;
+  }
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, &w->cmd_fdr) < 0) {
     APPL_TRACE_ERROR("socketpair failed: %s", strerror(errno));
-    return;
+    return false;
   }
-  APPL_TRACE_DEBUG("h:%d, cmd_fdr:%d, cmd_fdw:%d", h, ts[h].cmd_fdr,
-                   ts[h].cmd_fdw);
-  // add the cmd fd for read & write
-  add_poll(h, ts[h].cmd_fdr, 0, SOCK_THREAD_FD_RD, 0);
+  APPL_TRACE_DEBUG("h:%d, cmd_fdr:%d, cmd_fdw:%d", h, w->cmd_fdr, w->cmd_fdw);
+  // the cmd fd is not a poll slot, it is told apart by its fd
+  return set_epoll(w, EPOLL_CTL_ADD, w->cmd_fdr, SOCK_THREAD_FD_RD);
 }
-static inline void close_cmd_fd(int h) {
-  if (ts[h].cmd_fdr != -1) {
-    close(ts[h].cmd_fdr);
-    ts[h].cmd_fdr = -1;
+static void free_worker(sock_worker_t* w) {
+  if (w->cmd_fdr != -1) {
+    close(w->cmd_fdr);
+    w->cmd_fdr = -1;
+  }
+  if (w->cmd_fdw != -1) {
+    close(w->cmd_fdw);
+    w->cmd_fdw = -1;
   }
-  if (ts[h].cmd_fdw != -1) {
-    close(ts[h].cmd_fdw);
-    ts[h].cmd_fdw = -1;
+  if (w->epoll_fd != -1) {
+    close(w->epoll_fd);
+    w->epoll_fd = -1;
   }
+  w->poll_slots.clear();
 }
+
 typedef struct {
   int id;
   int fd;
@@ -218,38 +282,50 @@ typedef struct {
   int flags;
   uint32_t user_id;
 } sock_cmd_t;
+
+static bool send_cmd(sock_worker_t* w, const sock_cmd_t* cmd, int size) {
+  if (w->cmd_fdw == -1) {
+    APPL_TRACE_ERROR(
+        "cmd socket is not created. socket thread may not initialized");
+    return false;
+  }
+  ssize_t ret;
+  OSI_NO_INTR(ret = send(w->cmd_fdw, cmd, size, 0));
+  return ret == size;
+}
+
+static void add_poll(sock_worker_t* w, int fd, int type, int flags,
+                     uint32_t user_id);
+
 int btsock_thread_add_fd(int h, int fd, int type, int flags, uint32_t user_id) {
-  if (h < 0 || h >= MAX_THREAD) {
+  if (!is_valid_handle(h)) {
     APPL_TRACE_ERROR("invalid bt thread handle:%d", h);
     return false;
   }
-  if (ts[h].cmd_fdw == -1) {
-    APPL_TRACE_ERROR(
-        "cmd socket is not created. socket thread may not initialized");
+  if (fd == -1) {
+    APPL_TRACE_ERROR("invalid file descriptor");
     return false;
   }
-  if (flags & SOCK_THREAD_ADD_FD_SYNC) {
-    // must executed in socket poll thread
-    if (ts[h].thread_id == pthread_self()) {
-      // cleanup one-time flags
-      flags &= ~SOCK_THREAD_ADD_FD_SYNC;
-      add_poll(h, fd, type, flags, user_id);
-      return true;
-    }
+  sock_worker_t* w = worker_for_fd(h, fd);
+  // cleanup one-time flags
+  bool sync = flags & SOCK_THREAD_ADD_FD_SYNC;
+  flags &= ~SOCK_THREAD_ADD_FD_SYNC;
+  // The poll thread that owns the socket adds it right away: a poll thread
+  // posting to its own cmd socket would block once that socket is full
+  if (w->thread_id == pthread_self()) {
+    add_poll(w, fd, type, flags, user_id);
+    return true;
+  }
+  if (sync)
     APPL_TRACE_DEBUG(
         "THREAD_ADD_FD_SYNC is not called in poll thread, fallback to async");
-  }
   sock_cmd_t cmd = {CMD_ADD_FD, fd, type, flags, user_id};
   APPL_TRACE_DEBUG("adding fd:%d, flags:0x%x", fd, flags);
-
-  ssize_t ret;
-  OSI_NO_INTR(ret = send(ts[h].cmd_fdw, &cmd, sizeof(cmd), 0));
-
-  return ret == sizeof(cmd);
+  return send_cmd(w, &cmd, sizeof(cmd));
 }
 
 bool btsock_thread_remove_fd_and_close(int thread_handle, int fd) {
-  if (thread_handle < 0 || thread_handle >= MAX_THREAD) {
+  if (!is_valid_handle(thread_handle)) {
     APPL_TRACE_ERROR("%s invalid thread handle: %d", __func__, thread_handle);
     return false;
   }
@@ -259,24 +335,15 @@ bool btsock_thread_remove_fd_and_close(int thread_handle, int fd) {
   }
 
   sock_cmd_t cmd = {CMD_REMOVE_FD, fd, 0, 0, 0};
-
-  ssize_t ret;
-  OSI_NO_INTR(ret = send(ts[thread_handle].cmd_fdw, &cmd, sizeof(cmd), 0));
-
-  return ret == sizeof(cmd);
+  return send_cmd(worker_for_fd(thread_handle, fd), &cmd, sizeof(cmd));
 }
 
 int btsock_thread_post_cmd(int h, int type, const unsigned char* data, int size,
                            uint32_t user_id) {
-  if (h < 0 || h >= MAX_THREAD) {
+  if (!is_valid_handle(h)) {
     APPL_TRACE_ERROR("invalid bt thread handle:%d", h);
     return false;
   }
-  if (ts[h].cmd_fdw == -1) {
-    APPL_TRACE_ERROR(
-        "cmd socket is not created. socket thread may not initialized");
-    return false;
-  }
   sock_cmd_t cmd = {CMD_USER_PRIVATE, 0, type, size, user_id};
   APPL_TRACE_DEBUG("post cmd type:%d, size:%d, h:%d, ", type, size, h);
   sock_cmd_t* cmd_send = &cmd;
@@ -294,74 +361,43 @@ int btsock_thread_post_cmd(int h, int type, const unsigned char* data, int size,
     }
   }
 
-  ssize_t ret;
-  OSI_NO_INTR(ret = send(ts[h].cmd_fdw, cmd_send, size_send, 0));
-
-  return ret == size_send;
+  // user commands are all run by the first worker, in order
+  return send_cmd(&ts[h].workers[0], cmd_send, size_send);
 }
 int btsock_thread_wakeup(int h) {
-  if (h < 0 || h >= MAX_THREAD) {
+  if (!is_valid_handle(h)) {
     APPL_TRACE_ERROR("invalid bt thread handle:%d", h);
     return false;
   }
-  if (ts[h].cmd_fdw == -1) {
-    APPL_TRACE_ERROR("thread handle:%d, cmd socket is not created", h);
-    return false;
-  }
   sock_cmd_t cmd = {CMD_WAKEUP, 0, 0, 0, 0};
-
-  ssize_t ret;
-  OSI_NO_INTR(ret = send(ts[h].cmd_fdw, &cmd, sizeof(cmd), 0));
-
-  return ret == sizeof(cmd);
+  bool ret = true;
+  for (int i = 0; i < ts[h].worker_count; i++)
+    ret = send_cmd(&ts[h].workers[i], &cmd, sizeof(cmd)) && ret;
+  return ret;
 }
 int btsock_thread_exit(int h) {
-  if (h < 0 || h >= MAX_THREAD) {
+  if (!is_valid_handle(h)) {
     APPL_TRACE_ERROR("invalid bt thread slot:%d", h);
     return false;
   }
-  if (ts[h].cmd_fdw == -1) {
-    APPL_TRACE_ERROR("cmd socket is not created");
-    return false;
-  }
   sock_cmd_t cmd = {CMD_EXIT, 0, 0, 0, 0};
-
-  ssize_t ret;
-  OSI_NO_INTR(ret = send(ts[h].cmd_fdw, &cmd, sizeof(cmd), 0));
-
-  if (ret == sizeof(cmd)) {
-    if (ts[h].thread_id != -1) {
-      pthread_join(ts[h].thread_id, 0);
-      ts[h].thread_id = -1;
+  bool ret = true;
+  for (int i = 0; i < ts[h].worker_count; i++) {
+    sock_worker_t* w = &ts[h].workers[i];
+    if (w->thread_id == (pthread_t)-1) continue;
+    if (!send_cmd(w, &cmd, sizeof(cmd))) {
+      ret = false;
+      continue;
     }
-    free_thread_slot(h);
-    return true;
-  }
-  return false;
-}
-static void init_poll(int h) {
-  int i;
-  ts[h].poll_count = 0;
-  ts[h].thread_id = -1;
-  ts[h].callback = NULL;
-  ts[h].cmd_callback = NULL;
-  for (i = 0; i < MAX_POLL; i++) {
-    ts[h].ps[i].pfd.fd = -1;
-    ts[h].psi[i] = -1;
+    pthread_join(w->thread_id, 0);
+    w->thread_id = -1;
   }
-  init_cmd_fd(h);
-}
-static inline unsigned int flags2pevents(int flags) {
-  unsigned int pevents = 0;
-  if (flags & SOCK_THREAD_FD_WR) pevents |= POLLOUT;
-  if (flags & SOCK_THREAD_FD_RD) pevents |= POLLIN;
-  pevents |= POLL_EXCEPTION_EVENTS;
-  return pevents;
+  if (ret) free_thread_slot(h);
+  return ret;
 }
 
-static inline void set_poll(poll_slot_t* ps, int fd, int type, int flags,
+static inline void set_poll(poll_slot_t* ps, int type, int flags,
                             uint32_t user_id) {
-  ps->pfd.fd = fd;
   ps->user_id = user_id;
   if (ps->type != 0 && ps->type != type)
     APPL_TRACE_ERROR(
@@ -369,49 +405,36 @@ static inline void set_poll(poll_slot_t* ps, int fd, int type, int flags,
         ps->type, type);
   ps->type = type;
   ps->flags = flags;
-  ps->pfd.events = flags2pevents(flags);
-  ps->pfd.revents = 0;
 }
-static inline void add_poll(int h, int fd, int type, int flags,
-                            uint32_t user_id) {
+static void add_poll(sock_worker_t* w, int fd, int type, int flags,
+                     uint32_t user_id) {
   asrt(fd != -1);
-  int i;
-  int empty = -1;
-  poll_slot_t* ps = ts[h].ps;
-
-  for (i = 0; i < MAX_POLL; i++) {
-    if (ps[i].pfd.fd == fd) {
-      asrt(ts[h].poll_count < MAX_POLL);
-
-      set_poll(&ps[i], fd, type, flags | ps[i].flags, user_id);
-      return;
-    } else if (empty < 0 && ps[i].pfd.fd == -1)
-      empty = i;
-  }
-  if (empty >= 0) {
-    asrt(ts[h].poll_count < MAX_POLL);
-    set_poll(&ps[empty], fd, type, flags, user_id);
-    ++ts[h].poll_count;
+  auto it = w->poll_slots.find(fd);
+  if (it != w->poll_slots.end()) {
+    set_poll(&it->second, type, flags | it->second.flags, user_id);
+    if (!set_epoll(w, EPOLL_CTL_MOD, fd, it->second.flags))
+      w->poll_slots.erase(it);
     return;
   }
-  APPL_TRACE_ERROR("exceeded max poll slot:%d!", MAX_POLL);
+  poll_slot_t ps = {};
+  set_poll(&ps, type, flags, user_id);
+  if (set_epoll(w, EPOLL_CTL_ADD, fd, flags)) w->poll_slots[fd] = ps;
 }
-static inline void remove_poll(int h, poll_slot_t* ps, int flags) {
+static void remove_poll(sock_worker_t* w, int fd, poll_slot_t* ps, int flags) {
   if (flags == ps->flags) {
     // all monitored events signaled. To remove it, just clear the slot
-    --ts[h].poll_count;
-    memset(ps, 0, sizeof(*ps));
-    ps->pfd.fd = -1;
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    w->poll_slots.erase(fd);
   } else {
     // one read or one write monitor event signaled, removed the accordding bit
     ps->flags &= ~flags;
     // update the poll events mask
-    ps->pfd.events = flags2pevents(ps->flags);
+    set_epoll(w, EPOLL_CTL_MOD, fd, ps->flags);
   }
 }
-static int process_cmd_sock(int h) {
+static int process_cmd_sock(sock_worker_t* w) {
   sock_cmd_t cmd = {-1, 0, 0, 0, 0};
-  int fd = ts[h].cmd_fdr;
+  int fd = w->cmd_fdr;
 
   ssize_t ret;
   OSI_NO_INTR(ret = recv(fd, &cmd, sizeof(cmd), MSG_WAITALL));
@@ -423,24 +446,21 @@ static int process_cmd_sock(int h) {
   APPL_TRACE_DEBUG("cmd.id:%d", cmd.id);
   switch (cmd.id) {
     case CMD_ADD_FD:
-      add_poll(h, cmd.fd, cmd.type, cmd.flags, cmd.user_id);
+      add_poll(w, cmd.fd, cmd.type, cmd.flags, cmd.user_id);
       break;
-    case CMD_REMOVE_FD:
-      for (int i = 1; i < MAX_POLL; ++i) {
-        poll_slot_t* poll_slot = &ts[h].ps[i];
-        if (poll_slot->pfd.fd == cmd.fd) {
-          remove_poll(h, poll_slot, poll_slot->flags);
-          break;
-        }
-      }
+    case CMD_REMOVE_FD: {
+      auto it = w->poll_slots.find(cmd.fd);
+      if (it != w->poll_slots.end())
+        remove_poll(w, cmd.fd, &it->second, it->second.flags);
       close(cmd.fd);
       break;
+    }
     case CMD_WAKEUP:
       break;
     case CMD_USER_PRIVATE:
-      asrt(ts[h].cmd_callback);
-      if (ts[h].cmd_callback)
-        ts[h].cmd_callback(fd, cmd.type, cmd.flags, cmd.user_id);
+      asrt(ts[w->h].cmd_callback);
+      if (ts[w->h].cmd_callback)
+        ts[w->h].cmd_callback(fd, cmd.type, cmd.flags, cmd.user_id);
       break;
     case CMD_EXIT:
       return false;
@@ -451,102 +471,78 @@ static int process_cmd_sock(int h) {
   return true;
 }
 
-static void print_events(short events) {
+/* Runs the commands queued on the cmd socket, a bounded number at a time */
+static int process_cmds(sock_worker_t* w) {
+  for (int i = 0; i < MAX_CMDS_PER_WAKEUP; i++) {
+    if (!process_cmd_sock(w)) return false;
+    int pending = 0;
+    if (ioctl(w->cmd_fdr, FIONREAD, &pending) != 0 ||
+        pending < (int)sizeof(sock_cmd_t))
+      break;
+  }
+  return true;
+}
+
+static void print_events(uint32_t events) {
   std::string flags("");
-  if ((events)&POLLIN) flags += " POLLIN";
-  if ((events)&POLLPRI) flags += " POLLPRI";
-  if ((events)&POLLOUT) flags += " POLLOUT";
-  if ((events)&POLLERR) flags += " POLLERR";
-  if ((events)&POLLHUP) flags += " POLLHUP ";
-  if ((events)&POLLNVAL) flags += " POLLNVAL";
-  if ((events)&POLLRDHUP) flags += " POLLRDHUP";
+  if ((events)&EPOLLIN) flags += " EPOLLIN";
+  if ((events)&EPOLLPRI) flags += " EPOLLPRI";
+  if ((events)&EPOLLOUT) flags += " EPOLLOUT";
+  if ((events)&EPOLLERR) flags += " EPOLLERR";
+  if ((events)&EPOLLHUP) flags += " EPOLLHUP ";
+  if ((events)&EPOLLRDHUP) flags += " EPOLLRDHUP";
   APPL_TRACE_DEBUG("print poll event:%x = %s", (events), flags.c_str());
 }
 
-static void process_data_sock(int h, struct pollfd* pfds, int count) {
-  asrt(count <= ts[h].poll_count);
-  int i;
-  for (i = 1; i < ts[h].poll_count; i++) {
-    if (pfds[i].revents) {
-      int ps_i = ts[h].psi[i];
-      asrt(pfds[i].fd == ts[h].ps[ps_i].pfd.fd);
-      uint32_t user_id = ts[h].ps[ps_i].user_id;
-      int type = ts[h].ps[ps_i].type;
-      int flags = 0;
-      print_events(pfds[i].revents);
-      if (IS_READ(pfds[i].revents)) {
-        flags |= SOCK_THREAD_FD_RD;
-      }
-      if (IS_WRITE(pfds[i].revents)) {
-        flags |= SOCK_THREAD_FD_WR;
-      }
-      if (IS_EXCEPTION(pfds[i].revents)) {
-        flags |= SOCK_THREAD_FD_EXCEPTION;
-        // remove the whole slot not flags
-        remove_poll(h, &ts[h].ps[ps_i], ts[h].ps[ps_i].flags);
-      } else if (flags)
-        remove_poll(h, &ts[h].ps[ps_i],
-                    flags);  // remove the monitor flags that already processed
-      if (flags) ts[h].callback(pfds[i].fd, type, flags, user_id);
-    }
+static void process_data_sock(sock_worker_t* w, int fd, uint32_t events) {
+  auto it = w->poll_slots.find(fd);
+  if (it == w->poll_slots.end()) return;
+  poll_slot_t* ps = &it->second;
+  uint32_t user_id = ps->user_id;
+  int type = ps->type;
+  int flags = 0;
+  print_events(events);
+  if (IS_READ(events) && (ps->flags & SOCK_THREAD_FD_RD)) {
+    flags |= SOCK_THREAD_FD_RD;
   }
-}
-
-static void prepare_poll_fds(int h, struct pollfd* pfds) {
-  int count = 0;
-  int ps_i = 0;
-  int pfd_i = 0;
-  asrt(ts[h].poll_count <= MAX_POLL);
-  memset(pfds, 0, sizeof(pfds[0]) * ts[h].poll_count);
-  while (count < ts[h].poll_count) {
-    if (ps_i >= MAX_POLL) {
-      APPL_TRACE_ERROR(
-          "exceed max poll range, ps_i:%d, MAX_POLL:%d, count:%d, "
-          "ts[h].poll_count:%d",
-          ps_i, MAX_POLL, count, ts[h].poll_count);
-      return;
-    }
-    if (ts[h].ps[ps_i].pfd.fd >= 0) {
-      pfds[pfd_i] = ts[h].ps[ps_i].pfd;
-      ts[h].psi[pfd_i] = ps_i;
-      count++;
-      pfd_i++;
-    }
-    ps_i++;
+  if (IS_WRITE(events) && (ps->flags & SOCK_THREAD_FD_WR)) {
+    flags |= SOCK_THREAD_FD_WR;
   }
+  if (IS_EXCEPTION(events)) {
+    flags |= SOCK_THREAD_FD_EXCEPTION;
+    // remove the whole slot not flags
+    remove_poll(w, fd, ps, ps->flags);
+  } else if (flags)
+    remove_poll(w, fd, ps,
+                flags);  // remove the monitor flags that already processed
+  if (flags) ts[w->h].callback(fd, type, flags, user_id);
 }
+
 static void* sock_poll_thread(void* arg) {
-  struct pollfd pfds[MAX_POLL];
-  memset(pfds, 0, sizeof(pfds));
-  int h = (intptr_t)arg;
+  sock_worker_t* w = (sock_worker_t*)arg;
+  struct epoll_event events[MAX_EVENTS];
   for (;;) {
-    prepare_poll_fds(h, pfds);
     int ret;
-    OSI_NO_INTR(ret = poll(pfds, ts[h].poll_count, -1));
+    OSI_NO_INTR(ret = epoll_wait(w->epoll_fd, events, MAX_EVENTS, -1));
     if (ret == -1) {
-      APPL_TRACE_ERROR("poll ret -1, exit the thread, errno:%d, err:%s", errno,
-                       strerror(errno));
+      APPL_TRACE_ERROR("epoll_wait ret -1, exit the thread, errno:%d, err:%s",
+                       errno, strerror(errno));
+      break;
+    }
+    // Commands run after the socket events of this round: they may close a
+    // socket and let its fd be reused before a stale event is handled
+    bool has_cmd = false;
+    for (int i = 0; i < ret; i++) {
+      if (events[i].data.fd == w->cmd_fdr)
+        has_cmd = true;
+      else
+        process_data_sock(w, events[i].data.fd, events[i].events);
+    }
+    if (has_cmd && !process_cmds(w)) {
+      APPL_TRACE_DEBUG("h:%d, process_cmd_sock return false, exit...", w->h);
       break;
     }
-    if (ret != 0) {
-      int need_process_data_fd = true;
-      if (pfds[0].revents)  // cmd fd always is the first one
-      {
-        asrt(pfds[0].fd == ts[h].cmd_fdr);
-        if (!process_cmd_sock(h)) {
-          APPL_TRACE_DEBUG("h:%d, process_cmd_sock return false, exit...", h);
-          break;
-        }
-        if (ret == 1)
-          need_process_data_fd = false;
-        else
-          ret--;  // exclude the cmd fd
-      }
-      if (need_process_data_fd) process_data_sock(h, pfds, ret);
-    } else {
-      APPL_TRACE_DEBUG("no data, select ret: %d", ret)
-    };
   }
-  APPL_TRACE_DEBUG("socket poll thread exiting, h:%d", h);
+  APPL_TRACE_DEBUG("socket poll thread exiting, h:%d", w->h);
   return 0;
 }
@@ -30,9 +30,12 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <hardware/bluetooth.h>
 #include <hardware/bt_sock.h>
 
@@ -145,3 +148,52 @@ int sock_send_fd(int sock_fd, const uint8_t* buf, int len, int send_fd) {
   close(send_fd);
   return ret_len;
 }
+
+ssize_t sock_send_bufs(int sock_fd, list_t* queue, size_t max_bufs) {
+  struct iovec iov[SOCK_MAX_SEND_BUFS];
+  max_bufs = std::min<size_t>(std::max<size_t>(max_bufs, 1),
+                              SOCK_MAX_SEND_BUFS);
+  ssize_t total = 0;
+
+  while (!list_is_empty(queue)) {
+    size_t count = 0;
+    size_t len = 0;
+    for (list_node_t* node = list_begin(queue);
+         node != list_end(queue) && count < max_bufs; node = list_next(node)) {
+      BT_HDR* p_buf = (BT_HDR*)list_node(node);
+      iov[count].iov_base = p_buf->data + p_buf->offset;
+      iov[count].iov_len = p_buf->len;
+      len += p_buf->len;
+      count++;
+    }
+
+    ssize_t sent = 0;
+    if (len > 0) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      OSI_NO_INTR(sent = sendmsg(sock_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL));
+      if (sent == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return total;
+        BTIF_TRACE_ERROR("sock fd:%d sendmsg errno:%d", sock_fd, errno);
+        return -1;
+      }
+      if (sent == 0) return -1;
+    }
+    total += sent;
+
+    // Release what was written, trim the buffer written in part
+    for (size_t i = 0; i < count; i++) {
+      BT_HDR* p_buf = (BT_HDR*)list_front(queue);
+      if ((size_t)sent < p_buf->len) {
+        p_buf->offset += sent;
+        p_buf->len -= sent;
+        return total;
+      }
+      sent -= p_buf->len;
+      list_remove(queue, p_buf);
+    }
+  }
+  return total;
+}
@@ -0,0 +1,231 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <arpa/inet.h>
+#include <benchmark/benchmark.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if_ether.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#include "btif/include/btif_pan_internal.h"
+#include "osi/include/allocator.h"
+#include "osi/include/osi.h"
+#include "stack/include/pan_api.h"
+
+using ::benchmark::State;
+
+namespace {
+
+// A full size Ethernet frame, as sent by iperf over the PAN interface
+constexpr size_t kFrameSize = 1514;
+constexpr size_t kFramesPerBurst = 64;
+
+uint64_t process_cpu_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Stands in for the TAP device: a datagram socket pair keeps the frame
+// boundaries, and the network end is non blocking like the TAP fd. A thread
+// plays the network stack on the other side of a bulk transfer.
+class TapLoopback {
+ public:
+  bool Open() {
+    int fds[2];
+    if (socketpair(AF_LOCAL, SOCK_SEQPACKET, 0, fds) != 0) return false;
+    net_fd_ = fds[0];
+    tap_fd_ = fds[1];
+    int flags = fcntl(tap_fd_, F_GETFL, 0);
+    return fcntl(tap_fd_, F_SETFL, flags | O_NONBLOCK) == 0;
+  }
+
+  void Close() {
+    running_ = false;
+    // Unblocks the network thread
+    shutdown(tap_fd_, SHUT_RDWR);
+    if (net_thread_.joinable()) net_thread_.join();
+    close(net_fd_);
+    close(tap_fd_);
+  }
+
+  // The network stack sends frames as fast as PAN takes them
+  void StartSender() {
+    net_thread_ = std::thread([this] {
+      uint8_t frame[kFrameSize] = {};
+      tETH_HDR* eth_hdr = (tETH_HDR*)frame;
+      eth_hdr->h_proto = htons(ETH_P_IP);
+      while (running_) {
+        ssize_t ret;
+        OSI_NO_INTR(ret = send(net_fd_, frame, sizeof(frame), MSG_NOSIGNAL));
+        if (ret <= 0) break;
+      }
+    });
+  }
+
+  // The network stack takes every frame PAN writes
+  void StartReceiver() {
+    net_thread_ = std::thread([this] {
+      uint8_t frame[BTPAN_MAX_FRAME_SIZE];
+      while (running_) {
+        ssize_t ret;
+        OSI_NO_INTR(ret = recv(net_fd_, frame, sizeof(frame), 0));
+        if (ret <= 0) break;
+      }
+    });
+  }
+
+  void Wait(short events) {
+    struct pollfd pfd = {tap_fd_, events, 0};
+    OSI_NO_INTR(poll(&pfd, 1, -1));
+  }
+
+  int tap_fd() const { return tap_fd_; }
+
+ private:
+  int net_fd_ = -1;
+  int tap_fd_ = -1;
+  std::atomic<bool> running_{true};
+  std::thread net_thread_;
+};
+
+void ReportCpu(State& state, uint64_t start_cpu_ns, uint64_t bytes) {
+  uint64_t cpu_ns = process_cpu_time_ns() - start_cpu_ns;
+  state.SetBytesProcessed(bytes);
+  state.counters["cpu_us_per_mb"] =
+      bytes ? (double)cpu_ns / 1000 / ((double)bytes / (1 << 20)) : 0;
+}
+
+// The former read: a frame is staged, copied into a new buffer, and the TAP
+// device is polled before the next read
+ssize_t LegacyReadFrame(int tap_fd, BT_HDR** p_frame) {
+  static uint8_t staging[1600];
+  ssize_t ret;
+  OSI_NO_INTR(ret = read(tap_fd, staging, sizeof(staging)));
+  if (ret <= 0) return ret;
+  BT_HDR* frame = (BT_HDR*)osi_malloc(PAN_BUF_SIZE);
+  frame->offset = PAN_MINIMUM_OFFSET;
+  memcpy(frame->data + frame->offset, staging, ret);
+  frame->len = ret;
+  *p_frame = frame;
+
+  struct pollfd pfd = {tap_fd, POLLIN, 0};
+  OSI_NO_INTR(poll(&pfd, 1, 0));
+  return ret;
+}
+
+// Network to peer: frames are read from the TAP device and handed to BNEP,
+// which drops the Ethernet header. Argument 0 is the former path.
+void BM_PanTapToBnep(State& state) {
+  const bool legacy = state.range(0) == 0;
+  TapLoopback tap;
+  if (!tap.Open()) {
+    state.SkipWithError("Unable to open the socket pair");
+    return;
+  }
+  tap.StartSender();
+
+  uint64_t bytes = 0;
+  uint64_t start_cpu_ns = process_cpu_time_ns();
+  for (auto _ : state) {
+    size_t frames = 0;
+    while (frames < kFramesPerBurst) {
+      BT_HDR* frame = nullptr;
+      ssize_t ret = legacy ? LegacyReadFrame(tap.tap_fd(), &frame)
+                           : btpan_tap_read_frame(tap.tap_fd(), &frame);
+      if (ret == -1 && errno == EAGAIN) {
+        tap.Wait(POLLIN);
+        continue;
+      }
+      if (ret <= 0) {
+        state.SkipWithError("Unable to read from the TAP device");
+        break;
+      }
+      frame->offset += sizeof(tETH_HDR);
+      frame->len -= sizeof(tETH_HDR);
+      bytes += frame->len;
+      osi_free(frame);
+      frames++;
+    }
+  }
+  ReportCpu(state, start_cpu_ns, bytes);
+
+  tap.Close();
+}
+
+// Peer to network: frames received from BNEP are written to the TAP device
+// behind their Ethernet header. Argument 0 is the former path.
+void BM_PanBnepToTap(State& state) {
+  const bool legacy = state.range(0) == 0;
+  TapLoopback tap;
+  if (!tap.Open()) {
+    state.SkipWithError("Unable to open the socket pair");
+    return;
+  }
+  tap.StartReceiver();
+  tETH_HDR eth_hdr = {};
+  eth_hdr.h_proto = htons(ETH_P_IP);
+  const uint16_t len = kFrameSize - sizeof(tETH_HDR);
+  uint8_t payload[kFrameSize] = {};
+
+  uint64_t bytes = 0;
+  uint64_t start_cpu_ns = process_cpu_time_ns();
+  for (auto _ : state) {
+    size_t frames = 0;
+    while (frames < kFramesPerBurst) {
+      ssize_t ret;
+      if (legacy) {
+        char packet[TAP_MAX_PKT_WRITE_LEN + sizeof(tETH_HDR)];
+        memcpy(packet, &eth_hdr, sizeof(tETH_HDR));
+        memcpy(packet + sizeof(tETH_HDR), payload, len);
+        OSI_NO_INTR(ret =
+                        write(tap.tap_fd(), packet, len + sizeof(tETH_HDR)));
+      } else {
+        ret = btpan_tap_write_frame(tap.tap_fd(), &eth_hdr, payload, len);
+      }
+      if (ret == -1 && errno == EAGAIN) {
+        tap.Wait(POLLOUT);
+        continue;
+      }
+      if (ret <= 0) {
+        state.SkipWithError("Unable to write to the TAP device");
+        break;
+      }
+      bytes += len;
+      frames++;
+    }
+  }
+  ReportCpu(state, start_cpu_ns, bytes);
+
+  tap.Close();
+}
+
+BENCHMARK(BM_PanTapToBnep)->Arg(0)->Arg(1)->UseRealTime();
+BENCHMARK(BM_PanBnepToTap)->Arg(0)->Arg(1)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
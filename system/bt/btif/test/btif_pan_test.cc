@@ -0,0 +1,206 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <utility>
+#include <vector>
+
+#include "btif/include/btif_pan_internal.h"
+#include "osi/include/allocator.h"
+#include "osi/include/osi.h"
+
+namespace {
+
+constexpr int kMaxFrames = 64;
+// Frames for this connection are not forwarded anywhere
+constexpr uint8_t kUnknownConn = 0xff;
+
+// A frame is told apart by the connection it is for and its sequence number
+using Frame = std::pair<uint8_t, uint8_t>;
+
+// Connections whose BNEP transmit queue is full
+uint32_t full_conns;
+std::vector<Frame> forwarded;
+
+// Follows the contract of forward_bnep: a frame is held when its connection
+// is full, or when an earlier frame for it was held during the same pass
+int fake_forward(BT_HDR* frame, uint32_t* p_congested) {
+  uint8_t* data = frame->data + frame->offset;
+  uint8_t conn = data[0];
+  if (conn == kUnknownConn) {
+    osi_free(frame);
+    return FORWARD_IGNORE;
+  }
+  if ((*p_congested | full_conns) & (1 << conn)) {
+    *p_congested |= 1 << conn;
+    return FORWARD_CONGEST;
+  }
+  forwarded.push_back(Frame(conn, data[1]));
+  osi_free(frame);
+  return FORWARD_SUCCESS;
+}
+
+class BtifPanTapTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    full_conns = 0;
+    forwarded.clear();
+    congest_q_ = fixed_queue_new(SIZE_MAX);
+
+    // A datagram socket pair keeps the frame boundaries of the TAP device
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_LOCAL, SOCK_SEQPACKET, 0, fds));
+    net_fd_ = fds[0];
+    tap_fd_ = fds[1];
+    int flags = fcntl(tap_fd_, F_GETFL, 0);
+    ASSERT_EQ(0, fcntl(tap_fd_, F_SETFL, flags | O_NONBLOCK));
+  }
+
+  void TearDown() override {
+    fixed_queue_free(congest_q_, osi_free);
+    if (net_fd_ != -1) close(net_fd_);
+    close(tap_fd_);
+  }
+
+  // The network stack sends a frame for |conn| to the TAP device
+  void Send(uint8_t conn) {
+    uint8_t frame[sizeof(tETH_HDR) + 2] = {conn, seq_++};
+    ASSERT_EQ((ssize_t)sizeof(frame), send(net_fd_, frame, sizeof(frame), 0));
+  }
+
+  // One pass of the BTU read handler
+  bool ReadPass(int max_frames = kMaxFrames) {
+    uint32_t congested = 0;
+    btpan_forward_held_frames(congest_q_, fake_forward, &congested);
+    return btpan_tap_forward_frames(tap_fd_, max_frames, congest_q_,
+                                    fake_forward, &congested);
+  }
+
+  fixed_queue_t* congest_q_;
+  int net_fd_ = -1;
+  int tap_fd_ = -1;
+  uint8_t seq_ = 0;
+};
+
+TEST_F(BtifPanTapTest, reads_until_the_device_runs_dry) {
+  for (int i = 0; i < 5; i++) Send(0);
+
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ(5u, forwarded.size());
+  EXPECT_TRUE(fixed_queue_is_empty(congest_q_));
+}
+
+TEST_F(BtifPanTapTest, reads_at_most_max_frames_per_pass) {
+  for (int i = 0; i < 5; i++) Send(0);
+
+  EXPECT_TRUE(ReadPass(3));
+  EXPECT_EQ(3u, forwarded.size());
+  EXPECT_TRUE(ReadPass(3));
+  EXPECT_EQ(5u, forwarded.size());
+}
+
+TEST_F(BtifPanTapTest, holds_frames_for_a_full_connection_only) {
+  full_conns = 1 << 1;
+  for (int i = 0; i < 3; i++) {
+    Send(0);
+    Send(1);
+  }
+
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ((std::vector<Frame>{{0, 0}, {0, 2}, {0, 4}}), forwarded);
+  EXPECT_EQ(3u, fixed_queue_length(congest_q_));
+
+  // The transmit queue drained: held frames go out in the order they were
+  // read, ahead of the frames read after them
+  full_conns = 0;
+  forwarded.clear();
+  Send(1);
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ((std::vector<Frame>{{1, 1}, {1, 3}, {1, 5}, {1, 6}}), forwarded);
+  EXPECT_TRUE(fixed_queue_is_empty(congest_q_));
+}
+
+TEST_F(BtifPanTapTest, keeps_order_when_a_connection_fills_during_a_pass) {
+  full_conns = 1 << 0;
+  Send(0);
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ(1u, fixed_queue_length(congest_q_));
+
+  // The held frame is retried first and is congested again. Frames read
+  // after it must not overtake it, even though the queue drained meanwhile.
+  Send(0);
+  uint32_t congested = 0;
+  btpan_forward_held_frames(congest_q_, fake_forward, &congested);
+  full_conns = 0;
+  EXPECT_TRUE(btpan_tap_forward_frames(tap_fd_, kMaxFrames, congest_q_,
+                                       fake_forward, &congested));
+  EXPECT_TRUE(forwarded.empty());
+  EXPECT_EQ(2u, fixed_queue_length(congest_q_));
+
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ((std::vector<Frame>{{0, 0}, {0, 1}}), forwarded);
+}
+
+TEST_F(BtifPanTapTest, stops_polling_while_the_held_queue_is_full) {
+  full_conns = 1 << 0;
+  for (int i = 0; i < BTPAN_CONGEST_Q_MAX + 4; i++) Send(0);
+
+  // The device is left readable, but must not be polled until frames were
+  // forwarded, or the poll thread would spin on it
+  EXPECT_FALSE(ReadPass());
+  EXPECT_EQ((size_t)BTPAN_CONGEST_Q_MAX, fixed_queue_length(congest_q_));
+  EXPECT_FALSE(ReadPass());
+  EXPECT_EQ((size_t)BTPAN_CONGEST_Q_MAX, fixed_queue_length(congest_q_));
+
+  // The pass run when BNEP turns the flow back on sends the held frames and
+  // reads the rest
+  full_conns = 0;
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ((size_t)BTPAN_CONGEST_Q_MAX + 4, forwarded.size());
+  EXPECT_TRUE(fixed_queue_is_empty(congest_q_));
+  for (size_t i = 0; i < forwarded.size(); i++)
+    EXPECT_EQ(i, forwarded[i].second);
+}
+
+TEST_F(BtifPanTapTest, does_not_hold_dropped_frames) {
+  full_conns = 1 << 0;
+  Send(kUnknownConn);
+  Send(0);
+  Send(kUnknownConn);
+
+  EXPECT_TRUE(ReadPass());
+  EXPECT_TRUE(forwarded.empty());
+  EXPECT_EQ(1u, fixed_queue_length(congest_q_));
+}
+
+TEST_F(BtifPanTapTest, polls_again_at_end_of_file) {
+  Send(0);
+  close(net_fd_);
+  net_fd_ = -1;
+
+  // Polling the device again reports the exception that closes it
+  EXPECT_TRUE(ReadPass());
+  EXPECT_EQ(1u, forwarded.size());
+}
+
+}  // namespace
@@ -0,0 +1,229 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "btif/include/btif_sock_util.h"
+#include "internal_include/bt_target.h"
+#include "internal_include/bt_trace.h"
+#include "osi/include/allocator.h"
+#include "osi/include/list.h"
+#include "osi/include/osi.h"
+#include "stack/include/bt_types.h"
+#include "stack/include/l2c_api.h"
+#include "stack/include/rfcdefs.h"
+
+using ::benchmark::State;
+
+uint8_t btif_trace_level = BT_TRACE_LEVEL_NONE;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+// One RFCOMM frame of the default MTU, as received from or sent to the peer
+constexpr size_t kFrameSize = BTA_RFC_MTU_SIZE;
+constexpr size_t kFramesPerBurst = 64;
+constexpr size_t kHeadroom = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
+
+uint64_t process_cpu_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// A connected RFCOMM socket: the app end and the end owned by the stack,
+// with a thread playing the app on the other side of a bulk transfer
+class SppLink {
+ public:
+  bool Open() {
+    int fds[2];
+    if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) != 0) return false;
+    app_fd_ = fds[0];
+    stack_fd_ = fds[1];
+    return true;
+  }
+
+  void Close() {
+    running_ = false;
+    // Unblocks the app thread
+    shutdown(stack_fd_, SHUT_RDWR);
+    if (app_thread_.joinable()) app_thread_.join();
+    close(app_fd_);
+    close(stack_fd_);
+  }
+
+  // The app reads everything the stack writes
+  void StartReader() {
+    app_thread_ = std::thread([this] {
+      uint8_t buf[16384];
+      while (running_) {
+        ssize_t ret;
+        OSI_NO_INTR(ret = recv(app_fd_, buf, sizeof(buf), 0));
+        if (ret <= 0) break;
+      }
+    });
+  }
+
+  // The app writes as much as the stack lets it
+  void StartWriter() {
+    app_thread_ = std::thread([this] {
+      uint8_t buf[16384] = {};
+      while (running_) {
+        ssize_t ret;
+        OSI_NO_INTR(ret = send(app_fd_, buf, sizeof(buf), MSG_NOSIGNAL));
+        if (ret <= 0) break;
+      }
+    });
+  }
+
+  void WaitUntilWritable() {
+    struct pollfd pfd = {stack_fd_, POLLOUT, 0};
+    OSI_NO_INTR(poll(&pfd, 1, -1));
+  }
+
+  void WaitUntilReadable() {
+    struct pollfd pfd = {stack_fd_, POLLIN, 0};
+    OSI_NO_INTR(poll(&pfd, 1, -1));
+  }
+
+  int stack_fd() const { return stack_fd_; }
+
+ private:
+  int app_fd_ = -1;
+  int stack_fd_ = -1;
+  std::atomic<bool> running_{true};
+  std::thread app_thread_;
+};
+
+void ReportCpu(State& state, uint64_t start_cpu_ns, uint64_t bytes) {
+  uint64_t cpu_ns = process_cpu_time_ns() - start_cpu_ns;
+  state.SetBytesProcessed(bytes);
+  state.counters["cpu_us_per_mb"] =
+      bytes ? (double)cpu_ns / 1000 / ((double)bytes / (1 << 20)) : 0;
+}
+
+// Peer to app: bursts of frames queued on the slot are written to the app,
+// |state.range(0)| frames per system call. The argument 1 is the former path.
+void BM_SppToApp(State& state) {
+  const size_t max_bufs = state.range(0);
+  SppLink link;
+  if (!link.Open()) {
+    state.SkipWithError("Unable to open the socket pair");
+    return;
+  }
+  link.StartReader();
+  list_t* queue = list_new(osi_free);
+
+  uint64_t bytes = 0;
+  uint64_t start_cpu_ns = process_cpu_time_ns();
+  for (auto _ : state) {
+    for (size_t i = 0; i < kFramesPerBurst; i++) {
+      BT_HDR* p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+      p_buf->offset = kHeadroom;
+      p_buf->len = kFrameSize;
+      list_append(queue, p_buf);
+    }
+    while (!list_is_empty(queue)) {
+      ssize_t sent = sock_send_bufs(link.stack_fd(), queue, max_bufs);
+      if (sent == -1) {
+        state.SkipWithError("Unable to write to the app");
+        break;
+      }
+      bytes += sent;
+      if (!list_is_empty(queue)) link.WaitUntilWritable();
+    }
+  }
+  ReportCpu(state, start_cpu_ns, bytes);
+
+  list_free(queue);
+  link.Close();
+}
+
+// App to peer: the data the app wrote is read into frame buffers with their
+// headroom, |state.range(0)| frames per system call, the way
+// PORT_WriteDataCO() fills the transmit queue
+void BM_SppFromApp(State& state) {
+  const size_t bufs_per_read = state.range(0);
+  SppLink link;
+  if (!link.Open()) {
+    state.SkipWithError("Unable to open the socket pair");
+    return;
+  }
+  link.StartWriter();
+  BT_HDR* bufs[kFramesPerBurst];
+  struct iovec iov[kFramesPerBurst];
+
+  uint64_t bytes = 0;
+  uint64_t start_cpu_ns = process_cpu_time_ns();
+  for (auto _ : state) {
+    size_t frames = 0;
+    while (frames < kFramesPerBurst) {
+      int available = 0;
+      if (ioctl(link.stack_fd(), FIONREAD, &available) != 0) break;
+      if (available == 0) {
+        link.WaitUntilReadable();
+        continue;
+      }
+      size_t count = 0;
+      int read_len = 0;
+      while (count < bufs_per_read && frames + count < kFramesPerBurst &&
+             read_len < available) {
+        BT_HDR* p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+        p_buf->offset = kHeadroom;
+        p_buf->len = std::min<int>(kFrameSize, available - read_len);
+        iov[count].iov_base = p_buf->data + p_buf->offset;
+        iov[count].iov_len = p_buf->len;
+        bufs[count++] = p_buf;
+        read_len += p_buf->len;
+      }
+      ssize_t received;
+      OSI_NO_INTR(received = readv(link.stack_fd(), iov, count));
+      for (size_t i = 0; i < count; i++) osi_free(bufs[i]);
+      if (received != read_len) {
+        state.SkipWithError("Unable to read from the app");
+        break;
+      }
+      bytes += received;
+      frames += count;
+    }
+  }
+  ReportCpu(state, start_cpu_ns, bytes);
+
+  link.Close();
+}
+
+BENCHMARK(BM_SppToApp)->Arg(1)->Arg(4)->Arg(SOCK_MAX_SEND_BUFS)->UseRealTime();
+BENCHMARK(BM_SppFromApp)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(PORT_TX_BUF_HIGH_WM + 1)
+    ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,166 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "btif/include/btif_sock.h"
+#include "btif/include/btif_sock_thread.h"
+#include "internal_include/bt_trace.h"
+#include "osi/include/osi.h"
+
+using ::benchmark::State;
+
+uint8_t appl_trace_level = BT_TRACE_LEVEL_NONE;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+constexpr size_t kChunkSize = 64;
+
+// Stands in for the RFCOMM socket layer: every socket is a connected pair
+// whose app end is written by the benchmark, while the stack end is watched
+// by the socket threads. When an app writes, the stand-in drains the data the
+// way BTA_JvRfcommWrite() would, then watches the socket again through the
+// command socket like the RFCOMM socket layer does.
+class RfcommStandIn {
+ public:
+  static RfcommStandIn* instance;
+
+  bool Open(size_t num_sockets, int num_workers) {
+    handle_ = btsock_thread_create_workers(Signaled, NULL, num_workers);
+    if (handle_ < 0) return false;
+    for (size_t i = 0; i < num_sockets; i++) {
+      int fds[2];
+      if (socketpair(AF_LOCAL, SOCK_SEQPACKET, 0, fds) != 0) return false;
+      app_fds_.push_back(fds[0]);
+      stack_fds_.push_back(fds[1]);
+      btsock_thread_add_fd(handle_, fds[1], BTSOCK_RFCOMM, SOCK_THREAD_FD_RD,
+                           i);
+    }
+    return true;
+  }
+
+  void Close() {
+    for (int fd : stack_fds_) btsock_thread_remove_fd_and_close(handle_, fd);
+    if (handle_ >= 0) btsock_thread_exit(handle_);
+    for (int fd : app_fds_) close(fd);
+    app_fds_.clear();
+    stack_fds_.clear();
+    handle_ = -1;
+  }
+
+  // Every app writes one chunk, then waits for the stack to take them all
+  bool Round() {
+    uint8_t chunk[kChunkSize] = {};
+    received_ = 0;
+    for (int fd : app_fds_) {
+      ssize_t ret;
+      OSI_NO_INTR(ret = send(fd, chunk, sizeof(chunk), 0));
+      if (ret != sizeof(chunk)) return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    return done_.wait_for(lock, std::chrono::seconds(10), [this] {
+      return received_ == app_fds_.size();
+    });
+  }
+
+ private:
+  static void Signaled(int fd, int type, int flags, uint32_t user_id) {
+    if (!(flags & SOCK_THREAD_FD_RD)) return;
+    uint8_t chunk[kChunkSize];
+    ssize_t ret;
+    OSI_NO_INTR(ret = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT));
+    if (ret <= 0) return;
+    btsock_thread_add_fd(instance->handle_, fd, type, SOCK_THREAD_FD_RD,
+                         user_id);
+    if (++instance->received_ == instance->app_fds_.size()) {
+      std::lock_guard<std::mutex> lock(instance->mutex_);
+      instance->done_.notify_one();
+    }
+  }
+
+  int handle_ = -1;
+  std::vector<int> app_fds_;
+  std::vector<int> stack_fds_;
+  std::atomic<size_t> received_{0};
+  std::mutex mutex_;
+  std::condition_variable done_;
+};
+
+RfcommStandIn* RfcommStandIn::instance;
+
+// Each socket is a pair, and a pair of descriptors per worker on top
+bool RaiseFileLimit(size_t num_fds) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return false;
+  if (limit.rlim_cur >= num_fds) return true;
+  if (limit.rlim_max < num_fds) return false;
+  limit.rlim_cur = num_fds;
+  return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+}
+
+// Arguments are the number of sockets, and the number of socket threads
+void BM_SockThreadRfcomm(State& state) {
+  const size_t num_sockets = state.range(0);
+  const int num_workers = state.range(1);
+  if (!RaiseFileLimit(2 * num_sockets + 64)) {
+    state.SkipWithError("Not enough file descriptors");
+    return;
+  }
+
+  btsock_thread_init();
+  RfcommStandIn stand_in;
+  RfcommStandIn::instance = &stand_in;
+  if (!stand_in.Open(num_sockets, num_workers)) {
+    stand_in.Close();
+    state.SkipWithError("Unable to open the sockets");
+    return;
+  }
+
+  for (auto _ : state) {
+    if (!stand_in.Round()) {
+      state.SkipWithError("Data was not delivered to every socket");
+      break;
+    }
+  }
+  stand_in.Close();
+  state.SetItemsProcessed(state.iterations() * num_sockets);
+  state.SetBytesProcessed(state.iterations() * num_sockets * kChunkSize);
+}
+
+BENCHMARK(BM_SockThreadRfcomm)
+    ->ArgNames({"sockets", "threads"})
+    ->Args({32, 1})
+    ->Args({256, 1})
+    ->Args({256, 2})
+    ->Args({256, 4})
+    ->Args({1024, 1})
+    ->Args({1024, 4})
+    ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
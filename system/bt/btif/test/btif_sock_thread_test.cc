@@ -0,0 +1,384 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "btif/include/btif_sock_thread.h"
+#include "internal_include/bt_trace.h"
+#include "osi/include/osi.h"
+#include "stack/include/bt_types.h"
+
+uint8_t appl_trace_level = BT_TRACE_LEVEL_NONE;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+constexpr int kType = BTSOCK_RFCOMM;
+constexpr auto kTimeout = std::chrono::seconds(2);
+
+// What a poll thread reported, in order
+struct Signal {
+  int fd;
+  int type;
+  int flags;
+  uint32_t user_id;
+  pthread_t thread;
+};
+
+std::mutex signals_mutex;
+std::condition_variable signals_cv;
+std::vector<Signal> signals;
+// User command ids, and where signals were when each one ran
+std::vector<std::pair<uint32_t, size_t>> cmds;
+
+// Run by the poll thread for the next signal or command, outside the lock
+std::function<void()> on_signal;
+std::function<void()> on_cmd;
+
+void signaled_cb(int fd, int type, int flags, uint32_t user_id) {
+  std::function<void()> hook;
+  {
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    signals.push_back(Signal{fd, type, flags, user_id, pthread_self()});
+    hook.swap(on_signal);
+  }
+  signals_cv.notify_all();
+  if (hook) hook();
+}
+
+void cmd_cb(int cmd_fd, int type, int size, uint32_t user_id) {
+  std::function<void()> hook;
+  {
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    cmds.emplace_back(user_id, signals.size());
+    hook.swap(on_cmd);
+  }
+  signals_cv.notify_all();
+  if (hook) hook();
+}
+
+// A connected socket: |fd| is watched by the poll thread, |peer| plays the
+// remote end
+struct SocketPair {
+  int fd = -1;
+  int peer = -1;
+};
+
+class BtifSockThreadTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    btsock_thread_init();
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    signals.clear();
+    cmds.clear();
+    on_signal = nullptr;
+    on_cmd = nullptr;
+  }
+
+  void TearDown() override {
+    if (handle_ >= 0) EXPECT_TRUE(btsock_thread_exit(handle_));
+    for (const SocketPair& pair : pairs_) close(pair.peer);
+    for (int fd : open_fds_) close(fd);
+  }
+
+  void Create(int num_workers) {
+    handle_ = btsock_thread_create_workers(signaled_cb, cmd_cb, num_workers);
+    ASSERT_GE(handle_, 0);
+  }
+
+  // |fd| is closed by the test unless the poll thread is to close it.
+  // |swap_ends| watches the higher numbered end instead.
+  SocketPair NewPair(bool watched_fd_closed_by_test = true,
+                     bool swap_ends = false) {
+    int fds[2];
+    EXPECT_EQ(0, socketpair(AF_LOCAL, SOCK_STREAM, 0, fds));
+    SocketPair pair = {fds[swap_ends], fds[!swap_ends]};
+    pairs_.push_back(pair);
+    if (watched_fd_closed_by_test) open_fds_.insert(pair.fd);
+    return pair;
+  }
+
+  static void Write(int fd) {
+    uint8_t byte = 0;
+    ASSERT_EQ(1, write(fd, &byte, 1));
+  }
+
+  static bool WaitFor(const std::function<bool()>& done) {
+    std::unique_lock<std::mutex> lock(signals_mutex);
+    return signals_cv.wait_for(lock, kTimeout, done);
+  }
+
+  static bool WaitForSignals(size_t count) {
+    return WaitFor([count] { return signals.size() >= count; });
+  }
+
+  // Waits until the poll thread closed the other end of |peer|
+  static bool WaitForClose(int peer) {
+    struct pollfd pfd = {peer, POLLIN, 0};
+    int ret;
+    OSI_NO_INTR(ret = poll(&pfd, 1, 2000));
+    if (ret != 1) return false;
+    uint8_t byte;
+    ssize_t len;
+    OSI_NO_INTR(len = recv(peer, &byte, 1, MSG_DONTWAIT));
+    return len == 0;
+  }
+
+  int handle_ = -1;
+  std::vector<SocketPair> pairs_;
+  std::set<int> open_fds_;
+};
+
+TEST_F(BtifSockThreadTest, read_is_signaled_once) {
+  Create(1);
+  SocketPair pair = NewPair();
+
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, pair.fd, kType, SOCK_THREAD_FD_RD,
+                                   42));
+  Write(pair.peer);
+  ASSERT_TRUE(WaitForSignals(1));
+
+  // Signals are one shot: more data is not reported until the fd is added
+  Write(pair.peer);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  {
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    ASSERT_EQ(1u, signals.size());
+    EXPECT_EQ(pair.fd, signals[0].fd);
+    EXPECT_EQ(kType, signals[0].type);
+    EXPECT_EQ(SOCK_THREAD_FD_RD, signals[0].flags);
+    EXPECT_EQ(42u, signals[0].user_id);
+  }
+
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, pair.fd, kType, SOCK_THREAD_FD_RD,
+                                   42));
+  EXPECT_TRUE(WaitForSignals(2));
+}
+
+TEST_F(BtifSockThreadTest, add_remove_close_across_workers) {
+  constexpr int kWorkers = 4;
+  constexpr int kSockets = 16;
+  Create(kWorkers);
+
+  // Socket pairs take two fds: swap ends every other pair so the watched fds
+  // map to every worker
+  std::map<int, SocketPair> by_fd;
+  for (uint32_t i = 0; i < kSockets; i++) {
+    SocketPair pair = NewPair(false, (i / 2) % 2);
+    by_fd[pair.fd] = pair;
+    ASSERT_TRUE(btsock_thread_add_fd(handle_, pair.fd, kType,
+                                     SOCK_THREAD_FD_RD, 100 + pair.fd));
+    Write(pair.peer);
+  }
+  ASSERT_TRUE(WaitForSignals(kSockets));
+
+  {
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    ASSERT_EQ((size_t)kSockets, signals.size());
+    // Each socket is signaled once, by the worker its fd maps to
+    std::set<int> seen;
+    std::map<int, pthread_t> worker_thread;
+    for (const Signal& signal : signals) {
+      EXPECT_TRUE(seen.insert(signal.fd).second);
+      EXPECT_EQ(100u + signal.fd, signal.user_id);
+      auto it = worker_thread.find(signal.fd % kWorkers);
+      if (it == worker_thread.end())
+        worker_thread[signal.fd % kWorkers] = signal.thread;
+      else
+        EXPECT_TRUE(pthread_equal(it->second, signal.thread));
+    }
+    EXPECT_EQ((size_t)kWorkers, worker_thread.size());
+    for (auto& a : worker_thread) {
+      for (auto& b : worker_thread) {
+        if (a.first != b.first)
+          EXPECT_FALSE(pthread_equal(a.second, b.second));
+      }
+    }
+  }
+
+  // Watched again, then removed: the worker closes the fd and reports nothing
+  for (auto& entry : by_fd) {
+    uint8_t byte;
+    ASSERT_EQ(1, recv(entry.first, &byte, 1, MSG_DONTWAIT));
+    ASSERT_TRUE(btsock_thread_add_fd(handle_, entry.first, kType,
+                                     SOCK_THREAD_FD_RD, 0));
+    ASSERT_TRUE(btsock_thread_remove_fd_and_close(handle_, entry.first));
+  }
+  for (auto& entry : by_fd) EXPECT_TRUE(WaitForClose(entry.second.peer));
+
+  std::lock_guard<std::mutex> lock(signals_mutex);
+  EXPECT_EQ((size_t)kSockets, signals.size());
+}
+
+TEST_F(BtifSockThreadTest, removed_fd_is_reused) {
+  Create(1);
+  SocketPair old_pair = NewPair(false);
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, old_pair.fd, kType,
+                                   SOCK_THREAD_FD_RD, 1));
+  ASSERT_TRUE(btsock_thread_remove_fd_and_close(handle_, old_pair.fd));
+  ASSERT_TRUE(WaitForClose(old_pair.peer));
+
+  // The lowest free fd is given out again
+  SocketPair pair = NewPair();
+  ASSERT_EQ(old_pair.fd, pair.fd);
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, pair.fd, kType,
+                                   SOCK_THREAD_FD_WR, 2));
+  ASSERT_TRUE(WaitForSignals(1));
+
+  std::lock_guard<std::mutex> lock(signals_mutex);
+  ASSERT_EQ(1u, signals.size());
+  EXPECT_EQ(pair.fd, signals[0].fd);
+  EXPECT_EQ(SOCK_THREAD_FD_WR, signals[0].flags);
+  EXPECT_EQ(2u, signals[0].user_id);
+}
+
+TEST_F(BtifSockThreadTest, fd_closed_without_remove_is_reused) {
+  Create(1);
+  SocketPair old_pair = NewPair(false);
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, old_pair.fd, kType,
+                                   SOCK_THREAD_FD_RD, 1));
+  // Wait for the add to be done by posting a command after it
+  ASSERT_TRUE(btsock_thread_post_cmd(handle_, 0, NULL, 0, 0));
+  ASSERT_TRUE(WaitFor([] { return cmds.size() == 1; }));
+
+  // Closing the fd drops it from the epoll set, but not its poll slot
+  close(old_pair.fd);
+  SocketPair pair = NewPair();
+  ASSERT_EQ(old_pair.fd, pair.fd);
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, pair.fd, kType,
+                                   SOCK_THREAD_FD_WR, 2));
+  ASSERT_TRUE(WaitForSignals(1));
+
+  std::lock_guard<std::mutex> lock(signals_mutex);
+  EXPECT_EQ(pair.fd, signals[0].fd);
+  EXPECT_TRUE(signals[0].flags & SOCK_THREAD_FD_WR);
+  EXPECT_EQ(2u, signals[0].user_id);
+}
+
+TEST_F(BtifSockThreadTest, sync_add_outside_poll_thread_is_async) {
+  Create(1);
+  SocketPair pair = NewPair();
+
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, pair.fd, kType,
+                                   SOCK_THREAD_FD_RD | SOCK_THREAD_ADD_FD_SYNC,
+                                   7));
+  Write(pair.peer);
+  ASSERT_TRUE(WaitForSignals(1));
+
+  std::lock_guard<std::mutex> lock(signals_mutex);
+  // The one time flag is not kept
+  EXPECT_EQ(SOCK_THREAD_FD_RD, signals[0].flags);
+  EXPECT_EQ(7u, signals[0].user_id);
+}
+
+TEST_F(BtifSockThreadTest, sync_add_in_poll_thread_is_immediate) {
+  Create(1);
+  SocketPair pair = NewPair();
+  Write(pair.peer);
+
+  // More adds than the cmd socket can hold: posting them to itself would
+  // block the poll thread for good
+  constexpr int kAdds = 50000;
+  bool added = true;
+  {
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    on_cmd = [this, pair, &added] {
+      for (int i = 0; i < kAdds; i++) {
+        added = btsock_thread_add_fd(handle_, pair.fd, kType,
+                                     SOCK_THREAD_FD_RD |
+                                         SOCK_THREAD_ADD_FD_SYNC,
+                                     i) &&
+                added;
+      }
+    };
+  }
+  ASSERT_TRUE(btsock_thread_post_cmd(handle_, 0, NULL, 0, 0));
+  ASSERT_TRUE(WaitForSignals(1));
+
+  std::lock_guard<std::mutex> lock(signals_mutex);
+  EXPECT_TRUE(added);
+  EXPECT_EQ(pair.fd, signals[0].fd);
+  EXPECT_EQ(SOCK_THREAD_FD_RD, signals[0].flags);
+  EXPECT_EQ((uint32_t)kAdds - 1, signals[0].user_id);
+}
+
+TEST_F(BtifSockThreadTest, commands_run_after_events) {
+  Create(1);
+  SocketPair busy = NewPair();
+  SocketPair data = NewPair();
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, busy.fd, kType,
+                                   SOCK_THREAD_FD_RD, 1));
+  ASSERT_TRUE(btsock_thread_add_fd(handle_, data.fd, kType,
+                                   SOCK_THREAD_FD_RD, 2));
+  ASSERT_TRUE(btsock_thread_post_cmd(handle_, 0, NULL, 0, 10));
+  ASSERT_TRUE(WaitFor([] { return cmds.size() == 1; }));
+
+  // Hold the poll thread in a callback while both an event and a command
+  // become pending
+  std::mutex hold_mutex;
+  std::condition_variable hold_cv;
+  bool held = false;
+  bool released = false;
+  {
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    on_signal = [&] {
+      std::unique_lock<std::mutex> lock(hold_mutex);
+      held = true;
+      hold_cv.notify_all();
+      hold_cv.wait(lock, [&] { return released; });
+    };
+  }
+  Write(busy.peer);
+  {
+    std::unique_lock<std::mutex> lock(hold_mutex);
+    ASSERT_TRUE(hold_cv.wait_for(lock, kTimeout, [&] { return held; }));
+  }
+
+  ASSERT_TRUE(btsock_thread_post_cmd(handle_, 0, NULL, 0, 11));
+  Write(data.peer);
+  {
+    std::lock_guard<std::mutex> lock(hold_mutex);
+    released = true;
+  }
+  hold_cv.notify_all();
+  ASSERT_TRUE(WaitFor([] { return cmds.size() == 2; }));
+
+  std::lock_guard<std::mutex> lock(signals_mutex);
+  ASSERT_EQ(2u, signals.size());
+  EXPECT_EQ(1u, signals[0].user_id);
+  EXPECT_EQ(2u, signals[1].user_id);
+  // The command saw the event of the same round handled
+  EXPECT_EQ(11u, cmds[1].first);
+  EXPECT_EQ(2u, cmds[1].second);
+}
+
+}  // namespace
@@ -0,0 +1,220 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "btif/include/btif_sock_util.h"
+#include "internal_include/bt_trace.h"
+#include "osi/include/allocator.h"
+#include "osi/include/list.h"
+#include "osi/include/osi.h"
+#include "stack/include/bt_types.h"
+
+uint8_t btif_trace_level = BT_TRACE_LEVEL_NONE;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+// Room left in front of the data, as in the RFCOMM buffers
+constexpr uint16_t kHeadroom = 13;
+
+class BtifSockSendBufsTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_LOCAL, SOCK_STREAM, 0, fds));
+    app_fd_ = fds[0];
+    stack_fd_ = fds[1];
+    queue_ = list_new(osi_free);
+  }
+
+  void TearDown() override {
+    list_free(queue_);
+    if (app_fd_ != -1) close(app_fd_);
+    close(stack_fd_);
+  }
+
+  // Queue a buffer of |len| bytes, continuing the byte pattern of the stream
+  void QueueBuf(uint16_t len) {
+    BT_HDR* p_buf = (BT_HDR*)osi_malloc(sizeof(BT_HDR) + kHeadroom + len);
+    p_buf->offset = kHeadroom;
+    p_buf->len = len;
+    for (uint16_t i = 0; i < len; i++) {
+      p_buf->data[kHeadroom + i] = (uint8_t)(queued_ % 251);
+      queued_++;
+    }
+    list_append(queue_, p_buf);
+  }
+
+  // Read everything the app end has received so far
+  void ReadApp() {
+    uint8_t buf[4096];
+    ssize_t ret;
+    while (true) {
+      OSI_NO_INTR(ret = recv(app_fd_, buf, sizeof(buf), MSG_DONTWAIT));
+      if (ret <= 0) break;
+      received_.insert(received_.end(), buf, buf + ret);
+    }
+  }
+
+  // Check that the app got a prefix of the stream, and that the queue holds
+  // the rest of it
+  void ExpectStreamIntact() {
+    for (size_t i = 0; i < received_.size(); i++) {
+      ASSERT_EQ(i % 251, received_[i]) << "at byte " << i;
+    }
+    size_t pos = received_.size();
+    for (list_node_t* node = list_begin(queue_); node != list_end(queue_);
+         node = list_next(node)) {
+      BT_HDR* p_buf = (BT_HDR*)list_node(node);
+      for (uint16_t i = 0; i < p_buf->len; i++, pos++) {
+        ASSERT_EQ(pos % 251, p_buf->data[p_buf->offset + i]) << "at " << pos;
+      }
+    }
+    EXPECT_EQ(queued_, pos);
+  }
+
+  int app_fd_ = -1;
+  int stack_fd_ = -1;
+  list_t* queue_ = nullptr;
+  size_t queued_ = 0;
+  std::vector<uint8_t> received_;
+};
+
+TEST_F(BtifSockSendBufsTest, sends_whole_queue) {
+  for (int i = 0; i < 5; i++) QueueBuf(100);
+
+  EXPECT_EQ(500, sock_send_bufs(stack_fd_, queue_, SOCK_MAX_SEND_BUFS));
+  EXPECT_TRUE(list_is_empty(queue_));
+
+  ReadApp();
+  EXPECT_EQ(500u, received_.size());
+  ExpectStreamIntact();
+}
+
+TEST_F(BtifSockSendBufsTest, sends_more_than_max_bufs_in_several_calls) {
+  const int num_bufs = 3 * SOCK_MAX_SEND_BUFS + 5;
+  for (int i = 0; i < num_bufs; i++) QueueBuf(10 + i);
+
+  ssize_t sent = sock_send_bufs(stack_fd_, queue_, SOCK_MAX_SEND_BUFS);
+  EXPECT_EQ((ssize_t)queued_, sent);
+  EXPECT_TRUE(list_is_empty(queue_));
+
+  ReadApp();
+  EXPECT_EQ(queued_, received_.size());
+  ExpectStreamIntact();
+}
+
+TEST_F(BtifSockSendBufsTest, max_bufs_is_clamped) {
+  for (int i = 0; i < 2 * SOCK_MAX_SEND_BUFS; i++) QueueBuf(7);
+
+  // Above the iovec array, and zero, still send everything
+  EXPECT_EQ((ssize_t)queued_,
+            sock_send_bufs(stack_fd_, queue_, 4 * SOCK_MAX_SEND_BUFS));
+  EXPECT_TRUE(list_is_empty(queue_));
+
+  QueueBuf(7);
+  QueueBuf(7);
+  EXPECT_EQ(14, sock_send_bufs(stack_fd_, queue_, 0));
+  EXPECT_TRUE(list_is_empty(queue_));
+
+  ReadApp();
+  ExpectStreamIntact();
+}
+
+TEST_F(BtifSockSendBufsTest, empty_buffers_are_released) {
+  QueueBuf(0);
+  QueueBuf(20);
+  QueueBuf(0);
+  QueueBuf(0);
+
+  EXPECT_EQ(20, sock_send_bufs(stack_fd_, queue_, SOCK_MAX_SEND_BUFS));
+  EXPECT_TRUE(list_is_empty(queue_));
+
+  ReadApp();
+  ExpectStreamIntact();
+}
+
+TEST_F(BtifSockSendBufsTest, short_write_trims_buffer_written_in_part) {
+  int sndbuf = 4096;
+  ASSERT_EQ(0, setsockopt(stack_fd_, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                          sizeof(sndbuf)));
+
+  // Odd sized buffers, so the socket fills up in the middle of one
+  for (int i = 0; i < 200; i++) QueueBuf(997);
+
+  bool split = false;
+  size_t total = 0;
+  while (!list_is_empty(queue_)) {
+    ssize_t sent = sock_send_bufs(stack_fd_, queue_, SOCK_MAX_SEND_BUFS);
+    ASSERT_GE(sent, 0);
+    total += sent;
+
+    if (!list_is_empty(queue_)) {
+      // The socket is full: the front buffer holds exactly what is left
+      BT_HDR* p_front = (BT_HDR*)list_front(queue_);
+      if (p_front->len != 997) split = true;
+      EXPECT_EQ(total % 997, (size_t)(997 - p_front->len) % 997);
+    }
+
+    ReadApp();
+    ASSERT_EQ(total, received_.size());
+    ExpectStreamIntact();
+  }
+
+  EXPECT_EQ(queued_, total);
+  EXPECT_TRUE(split);
+}
+
+TEST_F(BtifSockSendBufsTest, full_socket_returns_zero) {
+  // Fill the socket to the brim
+  uint8_t filler[4096] = {0};
+  ssize_t ret;
+  do {
+    OSI_NO_INTR(ret = send(stack_fd_, filler, sizeof(filler), MSG_DONTWAIT));
+  } while (ret > 0);
+  ASSERT_TRUE(errno == EAGAIN || errno == EWOULDBLOCK);
+
+  for (int i = 0; i < 3; i++) QueueBuf(100);
+
+  EXPECT_EQ(0, sock_send_bufs(stack_fd_, queue_, SOCK_MAX_SEND_BUFS));
+  EXPECT_EQ(3u, list_length(queue_));
+  for (list_node_t* node = list_begin(queue_); node != list_end(queue_);
+       node = list_next(node)) {
+    BT_HDR* p_buf = (BT_HDR*)list_node(node);
+    EXPECT_EQ(kHeadroom, p_buf->offset);
+    EXPECT_EQ(100, p_buf->len);
+  }
+}
+
+TEST_F(BtifSockSendBufsTest, closed_peer_fails) {
+  close(app_fd_);
+  app_fd_ = -1;
+
+  QueueBuf(100);
+  EXPECT_EQ(-1, sock_send_bufs(stack_fd_, queue_, SOCK_MAX_SEND_BUFS));
+  EXPECT_EQ(1u, list_length(queue_));
+}
+
+}  // namespace
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include "osi/include/allocation_sampler.h"
+#include "osi/include/allocator.h"
+
+using ::benchmark::State;
+
+// Allocations kept alive at once, the way queued packets and pending
+// callbacks are, so that frees go through the lookup of live samples
+#define NUM_LIVE_ALLOCATIONS 64
+
+// Sizes of typical stack allocations: callback closures, L2CAP and GATT
+// packets, and media packets
+static const size_t kSizes[] = {24, 64, 128, 300, 680, 1024, 4112};
+static const size_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+
+// Argument is the sampling interval in bytes, 0 disabling sampling
+static void BM_MallocFree(State& state) {
+  allocation_sampler_set_interval(state.range(0));
+  void* ptrs[NUM_LIVE_ALLOCATIONS];
+  size_t index = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < NUM_LIVE_ALLOCATIONS; i++) {
+      ptrs[i] = osi_malloc(kSizes[index++ % kNumSizes]);
+      memset(ptrs[i], 0, 16);
+    }
+    for (void* ptr : ptrs) osi_free(ptr);
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_LIVE_ALLOCATIONS);
+  allocation_sampler_set_interval(ALLOCATION_SAMPLER_DEFAULT_INTERVAL);
+  allocation_sampler_reset();
+}
+BENCHMARK(BM_MallocFree)
+    ->ArgName("interval")
+    ->Arg(0)
+    ->Arg(ALLOCATION_SAMPLER_DEFAULT_INTERVAL)
+    ->Arg(64 * 1024)
+    ->Arg(4 * 1024);
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "osi/include/fixed_queue.h"
+#include "osi/include/list.h"
+#include "osi/include/reactor.h"
+#include "osi/include/semaphore.h"
+#include "osi/include/thread.h"
+
+using ::benchmark::State;
+
+#define NUM_MESSAGES_TO_SEND 100000
+#define DEQUEUE_BATCH_SIZE 16
+
+// The previous fixed_queue design, kept as a reference point: one list node
+// per element, and a pair of eventfd semaphores posted for every element.
+struct list_queue_t {
+  list_t* list = list_new(nullptr);
+  semaphore_t* enqueue_sem = semaphore_new(NUM_MESSAGES_TO_SEND);
+  semaphore_t* dequeue_sem = semaphore_new(0);
+  std::mutex mutex;
+
+  ~list_queue_t() {
+    list_free(list);
+    semaphore_free(enqueue_sem);
+    semaphore_free(dequeue_sem);
+  }
+
+  void enqueue(void* data) {
+    semaphore_wait(enqueue_sem);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      list_append(list, data);
+    }
+    semaphore_post(dequeue_sem);
+  }
+
+  void* dequeue() {
+    semaphore_wait(dequeue_sem);
+    void* data;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      data = list_front(list);
+      list_remove(list, data);
+    }
+    semaphore_post(enqueue_sem);
+    return data;
+  }
+};
+
+static int g_counter = 0;
+static std::unique_ptr<std::promise<void>> g_counter_promise = nullptr;
+
+static void count_messages(int num_messages) {
+  g_counter += num_messages;
+  if (g_counter >= NUM_MESSAGES_TO_SEND) {
+    g_counter_promise->set_value();
+  }
+}
+
+static void list_queue_ready(void* context) {
+  static_cast<list_queue_t*>(context)->dequeue();
+  count_messages(1);
+}
+
+static void fixed_queue_ready(fixed_queue_t* queue, void* context) {
+  fixed_queue_dequeue(queue);
+  count_messages(1);
+}
+
+static void fixed_queue_ready_batch(fixed_queue_t* queue, void* context) {
+  void* data[DEQUEUE_BATCH_SIZE];
+  count_messages(fixed_queue_dequeue_n(queue, data, DEQUEUE_BATCH_SIZE));
+}
+
+// Argument is the number of messages in flight between enqueue and dequeue
+static void BM_ListQueueSameThread(State& state) {
+  list_queue_t queue;
+  for (auto _ : state) {
+    for (int i = 0; i < state.range(0); i++) {
+      queue.enqueue(&g_counter);
+    }
+    for (int i = 0; i < state.range(0); i++) {
+      benchmark::DoNotOptimize(queue.dequeue());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ListQueueSameThread)->Arg(1)->Arg(64);
+
+static void BM_FixedQueueSameThread(State& state) {
+  fixed_queue_t* queue = fixed_queue_new(SIZE_MAX);
+  for (auto _ : state) {
+    for (int i = 0; i < state.range(0); i++) {
+      fixed_queue_enqueue(queue, &g_counter);
+    }
+    for (int i = 0; i < state.range(0); i++) {
+      benchmark::DoNotOptimize(fixed_queue_dequeue(queue));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  fixed_queue_free(queue, nullptr);
+}
+BENCHMARK(BM_FixedQueueSameThread)->Arg(1)->Arg(64);
+
+class BM_CrossThread : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    benchmark::Fixture::SetUp(st);
+    thread_ = thread_new("BM_CrossThread thread");
+  }
+  void TearDown(State& st) override {
+    thread_free(thread_);
+    thread_ = nullptr;
+    benchmark::Fixture::TearDown(st);
+  }
+
+  // Enqueues all messages from this thread and waits for the reactor thread
+  // to have dequeued them
+  template <typename EnqueueFn>
+  void SendMessages(State& state, EnqueueFn enqueue) {
+    for (auto _ : state) {
+      g_counter = 0;
+      g_counter_promise = std::make_unique<std::promise<void>>();
+      std::future<void> counter_future = g_counter_promise->get_future();
+      for (int i = 0; i < NUM_MESSAGES_TO_SEND; i++) {
+        enqueue();
+      }
+      counter_future.wait();
+    }
+    state.SetItemsProcessed(state.iterations() * NUM_MESSAGES_TO_SEND);
+  }
+
+  thread_t* thread_ = nullptr;
+};
+
+BENCHMARK_DEFINE_F(BM_CrossThread, list_queue)(State& state) {
+  list_queue_t queue;
+  reactor_object_t* object =
+      reactor_register(thread_get_reactor(thread_),
+                       semaphore_get_fd(queue.dequeue_sem), &queue,
+                       list_queue_ready, nullptr);
+  SendMessages(state, [&queue]() { queue.enqueue(&g_counter); });
+  reactor_unregister(object);
+}
+BENCHMARK_REGISTER_F(BM_CrossThread, list_queue)->UseRealTime();
+
+BENCHMARK_DEFINE_F(BM_CrossThread, fixed_queue)(State& state) {
+  fixed_queue_t* queue = fixed_queue_new(SIZE_MAX);
+  fixed_queue_register_dequeue(queue, thread_get_reactor(thread_),
+                               fixed_queue_ready, nullptr);
+  SendMessages(state, [queue]() { fixed_queue_enqueue(queue, &g_counter); });
+  fixed_queue_free(queue, nullptr);
+}
+BENCHMARK_REGISTER_F(BM_CrossThread, fixed_queue)->UseRealTime();
+
+BENCHMARK_DEFINE_F(BM_CrossThread, fixed_queue_dequeue_n)(State& state) {
+  fixed_queue_t* queue = fixed_queue_new(SIZE_MAX);
+  fixed_queue_register_dequeue(queue, thread_get_reactor(thread_),
+                               fixed_queue_ready_batch, nullptr);
+  SendMessages(state, [queue]() { fixed_queue_enqueue(queue, &g_counter); });
+  fixed_queue_free(queue, nullptr);
+}
+BENCHMARK_REGISTER_F(BM_CrossThread, fixed_queue_dequeue_n)->UseRealTime();
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+
+#include "common/metrics_collector.h"
+
+using ::benchmark::State;
+using bluetooth::common::LatencyHistogram;
+using bluetooth::common::MetricsCounter;
+
+static MetricsCounter counter("benchmark.counter");
+static LatencyHistogram histogram("benchmark.histogram");
+// What the counter replaces: one value shared by all the threads
+static std::atomic<uint64_t> shared_counter(0);
+
+static void BM_SharedAtomicAdd(State& state) {
+  for (auto _ : state) {
+    shared_counter.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+BENCHMARK(BM_SharedAtomicAdd)->ThreadRange(1, 4);
+
+static void BM_CounterAdd(State& state) {
+  for (auto _ : state) {
+    counter.Add();
+  }
+}
+BENCHMARK(BM_CounterAdd)->ThreadRange(1, 4);
+
+static void BM_HistogramRecord(State& state) {
+  uint64_t value = 0;
+  for (auto _ : state) {
+    // Spread over the buckets of latencies up to a few ms
+    histogram.Record(value);
+    value = (value * 7 + 13) & 4095;
+  }
+}
+BENCHMARK(BM_HistogramRecord)->ThreadRange(1, 4);
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <string.h>
+#include <thread>
+
+#include "osi/include/allocator.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/packet_allocator.h"
+
+using ::benchmark::State;
+
+// Sizes of the buffers an A2DP stream and GATT notifications allocate:
+// BT_DEFAULT_BUFFER_SIZE for media packets, and BT_HDR + L2CAP_MIN_OFFSET +
+// ATT header + value for notifications.
+#define MEDIA_PACKET_SIZE (4096 + 16)
+#define NOTIFICATION_OVERHEAD (8 + 13 + 3)
+#define NOTIFICATIONS_PER_MEDIA_PACKET 4
+#define NUM_MEDIA_PACKETS 10000
+
+static const size_t kNotificationSizes[NOTIFICATIONS_PER_MEDIA_PACKET] = {
+    NOTIFICATION_OVERHEAD + 20, NOTIFICATION_OVERHEAD + 20,
+    NOTIFICATION_OVERHEAD + 182, NOTIFICATION_OVERHEAD + 244};
+
+// Argument selects the allocator: 0 for osi_malloc, 1 for osi_pkt_alloc
+static void* alloc_packet(State& state, size_t size) {
+  void* buffer = state.range(0) ? osi_pkt_alloc(size) : osi_malloc(size);
+  // Stacks write the BT_HDR and the start of the payload of every buffer
+  memset(buffer, 0, 32);
+  return buffer;
+}
+
+static void free_packet(State& state, void* buffer) {
+  if (state.range(0)) {
+    osi_pkt_free(buffer);
+  } else {
+    osi_free(buffer);
+  }
+}
+
+// Every buffer is allocated and freed on the same thread
+static void BM_MediaAndNotificationsSameThread(State& state) {
+  void* buffers[NOTIFICATIONS_PER_MEDIA_PACKET + 1];
+  for (auto _ : state) {
+    buffers[0] = alloc_packet(state, MEDIA_PACKET_SIZE);
+    for (int i = 0; i < NOTIFICATIONS_PER_MEDIA_PACKET; i++) {
+      buffers[i + 1] = alloc_packet(state, kNotificationSizes[i]);
+    }
+    for (void* buffer : buffers) {
+      free_packet(state, buffer);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          (NOTIFICATIONS_PER_MEDIA_PACKET + 1));
+}
+BENCHMARK(BM_MediaAndNotificationsSameThread)
+    ->ArgName("pkt_alloc")
+    ->Arg(0)
+    ->Arg(1);
+
+// Buffers are allocated by one thread, the way the encoder and GATT build
+// packets, and freed by another once sent, the way the HCI thread does.
+static void BM_MediaAndNotificationsCrossThread(State& state) {
+  fixed_queue_t* queue = fixed_queue_new(256);
+  for (auto _ : state) {
+    std::thread sender([&state, queue]() {
+      for (int i = 0;
+           i < NUM_MEDIA_PACKETS * (NOTIFICATIONS_PER_MEDIA_PACKET + 1); i++) {
+        free_packet(state, fixed_queue_dequeue(queue));
+      }
+    });
+    for (int i = 0; i < NUM_MEDIA_PACKETS; i++) {
+      fixed_queue_enqueue(queue, alloc_packet(state, MEDIA_PACKET_SIZE));
+      for (size_t size : kNotificationSizes) {
+        fixed_queue_enqueue(queue, alloc_packet(state, size));
+      }
+    }
+    sender.join();
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_MEDIA_PACKETS *
+                          (NOTIFICATIONS_PER_MEDIA_PACKET + 1));
+  fixed_queue_free(queue, nullptr);
+}
+BENCHMARK(BM_MediaAndNotificationsCrossThread)
+    ->ArgName("pkt_alloc")
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime();
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,326 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "common/metrics_collector.h"
+
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "common/time_util.h"
+
+namespace bluetooth {
+
+namespace common {
+
+namespace {
+
+// All the counters and histograms alive, for the exporter
+struct MetricsRegistry {
+  std::mutex mutex;
+  std::vector<const MetricsCounter*> counters;
+  std::vector<const LatencyHistogram*> histograms;
+};
+
+// Never destroyed, so that static metrics can unregister whatever the order
+// of destruction
+MetricsRegistry& GetRegistry() {
+  static MetricsRegistry* registry = new MetricsRegistry();
+  return *registry;
+}
+
+template <typename T>
+void Unregister(std::vector<const T*>* metrics, const T* metric) {
+  metrics->erase(std::remove(metrics->begin(), metrics->end(), metric),
+                 metrics->end());
+}
+
+}  // namespace
+
+size_t GetMetricsShard() {
+  static std::atomic<size_t> next_shard(0);
+  thread_local size_t shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % kMetricsShardCount;
+  return shard;
+}
+
+MetricsCounter::MetricsCounter(std::string name) : name_(std::move(name)) {
+  MetricsRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.counters.push_back(this);
+}
+
+MetricsCounter::~MetricsCounter() {
+  MetricsRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  Unregister(&registry.counters, static_cast<const MetricsCounter*>(this));
+}
+
+uint64_t MetricsCounter::Sum() const {
+  uint64_t sum = 0;
+  for (const Shard& shard : shards_) {
+    sum += shard.value.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+uint64_t HistogramSnapshot::GetPercentile(double percentile) const {
+  if (count == 0) return 0;
+  uint64_t rank = static_cast<uint64_t>(percentile / 100 * count + 0.5);
+  rank = std::min(std::max(rank, uint64_t{1}), count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if (seen >= rank) return LatencyHistogram::GetBucketUpperBound(i);
+  }
+  return GetMax();
+}
+
+uint64_t HistogramSnapshot::GetMax() const {
+  for (size_t i = buckets.size(); i > 0; i--) {
+    if (buckets[i - 1] != 0) {
+      return LatencyHistogram::GetBucketUpperBound(i - 1);
+    }
+  }
+  return 0;
+}
+
+HistogramSnapshot HistogramSnapshot::Since(
+    const HistogramSnapshot& earlier) const {
+  HistogramSnapshot delta = *this;
+  // Nothing to subtract if |earlier| is empty, or from another histogram
+  if (earlier.buckets.size() != buckets.size() || earlier.count > count) {
+    return delta;
+  }
+  delta.count -= earlier.count;
+  delta.sum -= earlier.sum;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    delta.buckets[i] -= earlier.buckets[i];
+  }
+  return delta;
+}
+
+LatencyHistogram::LatencyHistogram(std::string name) : name_(std::move(name)) {
+  MetricsRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.histograms.push_back(this);
+}
+
+LatencyHistogram::~LatencyHistogram() {
+  MetricsRegistry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  Unregister(&registry.histograms, static_cast<const LatencyHistogram*>(this));
+}
+
+HistogramSnapshot LatencyHistogram::TakeSnapshot() const {
+  HistogramSnapshot snapshot;
+  snapshot.name = name_;
+  snapshot.buckets.resize(kBucketCount);
+  for (const Shard& shard : shards_) {
+    for (size_t i = 0; i < kBucketCount; i++) {
+      uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+      snapshot.buckets[i] += count;
+      snapshot.count += count;
+    }
+    snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+  if (index < kSubBucketCount) return index;
+  size_t shift = index / kSubBucketCount - 1;
+  uint64_t lower = static_cast<uint64_t>(kSubBucketCount +
+                                         index % kSubBucketCount)
+                   << shift;
+  return lower + (uint64_t{1} << shift) - 1;
+}
+
+std::string MetricsSnapshot::ToString() const {
+  std::string result = base::StringPrintf(
+      "timestamp_us=%llu period_us=%llu\n", (unsigned long long)timestamp_us,
+      (unsigned long long)period_us);
+  for (const Counter& counter : counters) {
+    result += base::StringPrintf("counter %s total=%llu delta=%llu\n",
+                                 counter.name.c_str(),
+                                 (unsigned long long)counter.total,
+                                 (unsigned long long)counter.delta);
+  }
+  for (const HistogramSnapshot& histogram : histograms) {
+    result += base::StringPrintf(
+        "histogram %s count=%llu mean_us=%llu p50_us=%llu p90_us=%llu "
+        "p99_us=%llu max_us=%llu\n",
+        histogram.name.c_str(), (unsigned long long)histogram.count,
+        (unsigned long long)(histogram.count == 0
+                                 ? 0
+                                 : histogram.sum / histogram.count),
+        (unsigned long long)histogram.GetPercentile(50),
+        (unsigned long long)histogram.GetPercentile(90),
+        (unsigned long long)histogram.GetPercentile(99),
+        (unsigned long long)histogram.GetMax());
+  }
+  return result;
+}
+
+void FileMetricsSink::Export(const MetricsSnapshot& snapshot) {
+  FILE* file = fopen(path_.c_str(), "a");
+  if (file == nullptr) {
+    LOG(ERROR) << __func__ << ": unable to open " << path_ << ": "
+               << strerror(errno);
+    return;
+  }
+  std::string text = snapshot.ToString();
+  fwrite(text.data(), 1, text.size(), file);
+  fclose(file);
+}
+
+SocketMetricsSink::SocketMetricsSink(std::string path)
+    : path_(std::move(path)),
+      fd_(socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) {
+  if (fd_ == -1) {
+    LOG(ERROR) << __func__ << ": unable to create socket: " << strerror(errno);
+  }
+}
+
+SocketMetricsSink::~SocketMetricsSink() {
+  if (fd_ != -1) close(fd_);
+}
+
+void SocketMetricsSink::Export(const MetricsSnapshot& snapshot) {
+  if (fd_ == -1) return;
+
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path_.size() >= sizeof(address.sun_path)) {
+    LOG(ERROR) << __func__ << ": socket path too long: " << path_;
+    return;
+  }
+  strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+
+  std::string text = snapshot.ToString();
+  // Dropped if nothing listens, or if the listener doesn't keep up
+  sendto(fd_, text.data(), text.size(), MSG_DONTWAIT,
+         reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+}
+
+void DumpsysMetricsSink::Export(const MetricsSnapshot& snapshot) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  last_snapshot_ = snapshot;
+}
+
+void DumpsysMetricsSink::Dump(int fd) const {
+  std::string text;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    text = last_snapshot_.ToString();
+  }
+  dprintf(fd, "\nBluetooth Metrics:\n%s", text.c_str());
+}
+
+constexpr std::chrono::milliseconds MetricsExporter::kDefaultPeriod;
+
+MetricsExporter::MetricsExporter()
+    : last_export_us_(time_get_os_boottime_us()) {}
+
+MetricsExporter::~MetricsExporter() { Stop(); }
+
+MetricsExporter& MetricsExporter::GetInstance() {
+  static MetricsExporter exporter;
+  return exporter;
+}
+
+void MetricsExporter::AddSink(std::shared_ptr<MetricsSink> sink) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sinks_.push_back(std::move(sink));
+}
+
+bool MetricsExporter::Start(std::chrono::milliseconds period) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_ != nullptr) {
+    LOG(ERROR) << __func__ << ": already started";
+    return false;
+  }
+  thread_ = std::make_unique<MessageLoopThread>("bt_metrics_exporter");
+  thread_->StartUp();
+  if (!thread_->IsRunning() ||
+      !timer_.SchedulePeriodic(
+          thread_->GetWeakPtr(), FROM_HERE,
+          base::Bind(&MetricsExporter::Export, base::Unretained(this)),
+          base::TimeDelta::FromMilliseconds(period.count()))) {
+    LOG(ERROR) << __func__ << ": unable to start the export thread";
+    thread_->ShutDown();
+    thread_.reset();
+    return false;
+  }
+  return true;
+}
+
+void MetricsExporter::Stop() {
+  std::unique_ptr<MessageLoopThread> thread;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_ == nullptr) return;
+    thread = std::move(thread_);
+  }
+  // Without holding the lock, which an export may be waiting on
+  timer_.CancelAndWait();
+  thread->ShutDown();
+  Export();
+}
+
+void MetricsExporter::Export() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MetricsSnapshot snapshot;
+  snapshot.timestamp_us = time_get_os_boottime_us();
+  snapshot.period_us = snapshot.timestamp_us - last_export_us_;
+  last_export_us_ = snapshot.timestamp_us;
+
+  {
+    MetricsRegistry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const MetricsCounter* counter : registry.counters) {
+      uint64_t total = counter->Sum();
+      uint64_t& last = last_counters_[counter->GetName()];
+      // Unless the counter was created again since
+      if (last > total) last = 0;
+      snapshot.counters.push_back({counter->GetName(), total, total - last});
+      last = total;
+    }
+    for (const LatencyHistogram* histogram : registry.histograms) {
+      HistogramSnapshot total = histogram->TakeSnapshot();
+      HistogramSnapshot& last = last_histograms_[histogram->GetName()];
+      snapshot.histograms.push_back(total.Since(last));
+      last = std::move(total);
+    }
+  }
+
+  for (const std::shared_ptr<MetricsSink>& sink : sinks_) {
+    sink->Export(snapshot);
+  }
+}
+
+}  // namespace common
+
+}  // namespace bluetooth
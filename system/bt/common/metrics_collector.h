@@ -0,0 +1,323 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/message_loop_thread.h"
+#include "common/repeating_timer.h"
+
+namespace bluetooth {
+
+namespace common {
+
+/**
+ * Number of shards each metric is split into. A thread is assigned a shard
+ * the first time it updates a metric, so that threads updating the same
+ * metric don't contend on the same cache line, as long as there are no more
+ * of them than shards.
+ */
+constexpr size_t kMetricsShardCount = 8;
+
+/**
+ * Returns the shard of the calling thread
+ */
+size_t GetMetricsShard();
+
+/**
+ * A monotonic counter, which can be incremented from any thread without
+ * taking a lock.
+ *
+ * Counters are meant to be static: they register themselves when created, and
+ * are exported until destroyed.
+ */
+class MetricsCounter final {
+ public:
+  explicit MetricsCounter(std::string name);
+  ~MetricsCounter();
+
+  /**
+   * Add |value| to the counter
+   */
+  void Add(uint64_t value = 1) {
+    shards_[GetMetricsShard()].value.fetch_add(value,
+                                               std::memory_order_relaxed);
+  }
+
+  /**
+   * @return the sum of all the values added so far
+   */
+  uint64_t Sum() const;
+
+  const std::string& GetName() const { return name_; }
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+
+  const std::string name_;
+  Shard shards_[kMetricsShardCount];
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsCounter);
+};
+
+/**
+ * A snapshot of the values recorded in a LatencyHistogram
+ */
+struct HistogramSnapshot {
+  std::string name;
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  std::vector<uint64_t> buckets;
+
+  /**
+   * @param percentile between 0 and 100
+   * @return the highest value which may have been recorded in the bucket
+   * holding |percentile|, or 0 if nothing was recorded
+   */
+  uint64_t GetPercentile(double percentile) const;
+
+  /**
+   * @return the highest value which may have been recorded
+   */
+  uint64_t GetMax() const;
+
+  /**
+   * @return the values recorded since |earlier| was taken, from the same
+   * histogram
+   */
+  HistogramSnapshot Since(const HistogramSnapshot& earlier) const;
+};
+
+/**
+ * A histogram of durations in microseconds, which can be recorded from any
+ * thread without taking a lock.
+ *
+ * Like HdrHistogram, values are kept with three significant bits: each power
+ * of two is split into eight buckets, so that percentiles are within 12.5% of
+ * the recorded values, from 1 us up to more than a minute.
+ *
+ * Histograms are meant to be static: they register themselves when created,
+ * and are exported until destroyed.
+ */
+class LatencyHistogram final {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBucketCount = 1 << kSubBucketBits;
+  // Values larger than 2^36 us are kept in the last bucket
+  static constexpr size_t kMaxValueBits = 36;
+  static constexpr size_t kBucketCount =
+      (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+  explicit LatencyHistogram(std::string name);
+  ~LatencyHistogram();
+
+  /**
+   * Record a duration of |value_us| microseconds
+   */
+  void Record(uint64_t value_us) {
+    Shard& shard = shards_[GetMetricsShard()];
+    shard.buckets[GetBucketIndex(value_us)].fetch_add(
+        1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value_us, std::memory_order_relaxed);
+  }
+
+  /**
+   * @return the values recorded so far
+   */
+  HistogramSnapshot TakeSnapshot() const;
+
+  const std::string& GetName() const { return name_; }
+
+  /**
+   * @return the index of the bucket holding |value|
+   */
+  static size_t GetBucketIndex(uint64_t value) {
+    if (value < kSubBucketCount) return value;
+    size_t msb = 63 - __builtin_clzll(value);
+    if (msb >= kMaxValueBits) return kBucketCount - 1;
+    size_t shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBucketCount + (value >> shift) - kSubBucketCount;
+  }
+
+  /**
+   * @return the highest value held by the bucket at |index|
+   */
+  static uint64_t GetBucketUpperBound(size_t index);
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> buckets[kBucketCount] = {};
+    std::atomic<uint64_t> sum{0};
+  };
+
+  const std::string name_;
+  Shard shards_[kMetricsShardCount];
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+/**
+ * What was collected over one export period
+ */
+struct MetricsSnapshot {
+  struct Counter {
+    std::string name;
+    uint64_t total;
+    uint64_t delta;
+  };
+
+  // Using clock boot time in time_util.h
+  uint64_t timestamp_us = 0;
+  uint64_t period_us = 0;
+  std::vector<Counter> counters;
+  // Values recorded over the period only
+  std::vector<HistogramSnapshot> histograms;
+
+  /**
+   * @return one line per metric, in a format meant for humans and scripts
+   * alike
+   */
+  std::string ToString() const;
+};
+
+/**
+ * Destination of the snapshots taken by the MetricsExporter. Sinks are called
+ * on the exporter thread, never on the threads updating metrics.
+ */
+class MetricsSink {
+ public:
+  virtual ~MetricsSink() = default;
+
+  virtual void Export(const MetricsSnapshot& snapshot) = 0;
+};
+
+/**
+ * Appends snapshots to a file
+ */
+class FileMetricsSink final : public MetricsSink {
+ public:
+  explicit FileMetricsSink(std::string path) : path_(std::move(path)) {}
+
+  void Export(const MetricsSnapshot& snapshot) override;
+
+ private:
+  const std::string path_;
+};
+
+/**
+ * Sends each snapshot as a datagram to a local (unix domain) socket, without
+ * blocking. Snapshots are dropped while nothing listens on the socket.
+ */
+class SocketMetricsSink final : public MetricsSink {
+ public:
+  explicit SocketMetricsSink(std::string path);
+  ~SocketMetricsSink() override;
+
+  void Export(const MetricsSnapshot& snapshot) override;
+
+ private:
+  const std::string path_;
+  int fd_;
+};
+
+/**
+ * Keeps the last snapshot, for dumpsys
+ */
+class DumpsysMetricsSink final : public MetricsSink {
+ public:
+  void Export(const MetricsSnapshot& snapshot) override;
+
+  /**
+   * Write the last snapshot to |fd|
+   */
+  void Dump(int fd) const;
+
+ private:
+  mutable std::mutex mutex_;
+  MetricsSnapshot last_snapshot_;
+};
+
+/**
+ * Periodically takes a snapshot of all the counters and histograms, and
+ * exports it to its sinks from a thread of its own.
+ */
+class MetricsExporter final {
+ public:
+  static constexpr std::chrono::milliseconds kDefaultPeriod =
+      std::chrono::minutes(1);
+
+  MetricsExporter();
+  ~MetricsExporter();
+
+  /**
+   * Get the instance of singleton
+   *
+   * @return MetricsExporter&
+   */
+  static MetricsExporter& GetInstance();
+
+  /**
+   * Add a sink, which receives the snapshots taken from then on
+   */
+  void AddSink(std::shared_ptr<MetricsSink> sink);
+
+  /**
+   * Start exporting every |period|
+   *
+   * @return true iff the export thread was started
+   */
+  bool Start(std::chrono::milliseconds period = kDefaultPeriod);
+
+  /**
+   * Export what was collected since the last export, and stop
+   */
+  void Stop();
+
+  /**
+   * Take a snapshot and export it now, on the calling thread
+   */
+  void Export();
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<MetricsSink>> sinks_;
+  // Totals at the last export by name, to compute what changed since
+  std::unordered_map<std::string, uint64_t> last_counters_;
+  std::unordered_map<std::string, HistogramSnapshot> last_histograms_;
+  uint64_t last_export_us_;
+  std::unique_ptr<MessageLoopThread> thread_;
+  RepeatingTimer timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsExporter);
+};
+
+}  // namespace common
+
+}  // namespace bluetooth
@@ -0,0 +1,254 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "common/metrics_collector.h"
+
+namespace testing {
+
+using bluetooth::common::DumpsysMetricsSink;
+using bluetooth::common::FileMetricsSink;
+using bluetooth::common::HistogramSnapshot;
+using bluetooth::common::LatencyHistogram;
+using bluetooth::common::MetricsCounter;
+using bluetooth::common::MetricsExporter;
+using bluetooth::common::MetricsSink;
+using bluetooth::common::MetricsSnapshot;
+using bluetooth::common::SocketMetricsSink;
+
+class TestMetricsSink : public MetricsSink {
+ public:
+  void Export(const MetricsSnapshot& snapshot) override {
+    snapshots.push_back(snapshot);
+  }
+
+  const MetricsSnapshot::Counter* FindCounter(const std::string& name) const {
+    for (const MetricsSnapshot::Counter& counter : snapshots.back().counters) {
+      if (counter.name == name) return &counter;
+    }
+    return nullptr;
+  }
+
+  const HistogramSnapshot* FindHistogram(const std::string& name) const {
+    for (const HistogramSnapshot& histogram : snapshots.back().histograms) {
+      if (histogram.name == name) return &histogram;
+    }
+    return nullptr;
+  }
+
+  std::vector<MetricsSnapshot> snapshots;
+};
+
+TEST(MetricsCollectorTest, counter_sums_all_threads) {
+  MetricsCounter counter("test.counter");
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 12; i++) {
+    threads.emplace_back([&counter]() {
+      for (int j = 0; j < 1000; j++) counter.Add();
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  counter.Add(5);
+  EXPECT_EQ(12005u, counter.Sum());
+}
+
+TEST(MetricsCollectorTest, bucket_bounds) {
+  // Exact below 8
+  for (uint64_t value = 0; value < 8; value++) {
+    EXPECT_EQ(value, LatencyHistogram::GetBucketIndex(value));
+    EXPECT_EQ(value, LatencyHistogram::GetBucketUpperBound(value));
+  }
+
+  // Then within 12.5%, with every value held by the bucket it maps to
+  for (uint64_t value : {8ull, 9ull, 15ull, 16ull, 17ull, 100ull, 1000ull,
+                         12345ull, 1000000ull, 60000000ull}) {
+    size_t index = LatencyHistogram::GetBucketIndex(value);
+    uint64_t upper = LatencyHistogram::GetBucketUpperBound(index);
+    EXPECT_GE(upper, value);
+    EXPECT_LE(upper - value, value / 8);
+    if (index > 0) {
+      EXPECT_LT(LatencyHistogram::GetBucketUpperBound(index - 1), value);
+    }
+  }
+
+  EXPECT_EQ(LatencyHistogram::kBucketCount - 1,
+            LatencyHistogram::GetBucketIndex(UINT64_MAX));
+}
+
+TEST(MetricsCollectorTest, histogram_percentiles) {
+  LatencyHistogram histogram("test.histogram");
+  for (uint64_t value = 1; value <= 1000; value++) histogram.Record(value);
+
+  HistogramSnapshot snapshot = histogram.TakeSnapshot();
+  EXPECT_EQ(1000u, snapshot.count);
+  EXPECT_EQ(500500u, snapshot.sum);
+  EXPECT_NEAR(500, snapshot.GetPercentile(50), 500 / 8);
+  EXPECT_NEAR(900, snapshot.GetPercentile(90), 900 / 8);
+  EXPECT_NEAR(990, snapshot.GetPercentile(99), 990 / 8);
+  EXPECT_GE(snapshot.GetMax(), 1000u);
+  EXPECT_LE(snapshot.GetMax(), 1000u + 1000u / 8);
+
+  HistogramSnapshot empty = LatencyHistogram("test.empty").TakeSnapshot();
+  EXPECT_EQ(0u, empty.GetPercentile(50));
+  EXPECT_EQ(0u, empty.GetMax());
+}
+
+TEST(MetricsCollectorTest, export_reports_what_changed) {
+  MetricsCounter counter("test.export.counter");
+  LatencyHistogram histogram("test.export.histogram");
+  auto sink = std::make_shared<TestMetricsSink>();
+  MetricsExporter exporter;
+  exporter.AddSink(sink);
+
+  counter.Add(3);
+  histogram.Record(100);
+  histogram.Record(100);
+  exporter.Export();
+  ASSERT_EQ(1u, sink->snapshots.size());
+  ASSERT_NE(nullptr, sink->FindCounter("test.export.counter"));
+  EXPECT_EQ(3u, sink->FindCounter("test.export.counter")->total);
+  EXPECT_EQ(3u, sink->FindCounter("test.export.counter")->delta);
+  ASSERT_NE(nullptr, sink->FindHistogram("test.export.histogram"));
+  EXPECT_EQ(2u, sink->FindHistogram("test.export.histogram")->count);
+
+  counter.Add(2);
+  histogram.Record(5000);
+  exporter.Export();
+  ASSERT_EQ(2u, sink->snapshots.size());
+  EXPECT_EQ(5u, sink->FindCounter("test.export.counter")->total);
+  EXPECT_EQ(2u, sink->FindCounter("test.export.counter")->delta);
+  const HistogramSnapshot* period =
+      sink->FindHistogram("test.export.histogram");
+  EXPECT_EQ(1u, period->count);
+  EXPECT_EQ(5000u, period->sum);
+  EXPECT_GE(period->GetPercentile(50), 5000u);
+}
+
+TEST(MetricsCollectorTest, destroyed_metrics_are_not_exported) {
+  auto sink = std::make_shared<TestMetricsSink>();
+  MetricsExporter exporter;
+  exporter.AddSink(sink);
+  {
+    MetricsCounter counter("test.destroyed");
+    exporter.Export();
+    EXPECT_NE(nullptr, sink->FindCounter("test.destroyed"));
+  }
+  exporter.Export();
+  EXPECT_EQ(nullptr, sink->FindCounter("test.destroyed"));
+}
+
+TEST(MetricsCollectorTest, start_and_stop_exports) {
+  auto sink = std::make_shared<TestMetricsSink>();
+  MetricsExporter exporter;
+  exporter.AddSink(sink);
+  ASSERT_TRUE(exporter.Start(std::chrono::minutes(1)));
+  EXPECT_FALSE(exporter.Start(std::chrono::minutes(1)));
+
+  // What remains is exported when stopping
+  exporter.Stop();
+  EXPECT_EQ(1u, sink->snapshots.size());
+  exporter.Stop();
+  EXPECT_EQ(1u, sink->snapshots.size());
+}
+
+TEST(MetricsCollectorTest, file_sink_appends) {
+  char path[] = "/tmp/bt_metrics_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  MetricsCounter counter("test.file.counter");
+  MetricsExporter exporter;
+  exporter.AddSink(std::make_shared<FileMetricsSink>(path));
+  counter.Add(7);
+  exporter.Export();
+  exporter.Export();
+
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string text = contents.str();
+  EXPECT_NE(std::string::npos,
+            text.find("counter test.file.counter total=7 delta=7\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("counter test.file.counter total=7 delta=0\n"));
+  unlink(path);
+}
+
+TEST(MetricsCollectorTest, socket_sink_sends_datagrams) {
+  const std::string path = "/tmp/bt_metrics_test_socket";
+  unlink(path.c_str());
+  int listener = socket(AF_UNIX, SOCK_DGRAM, 0);
+  ASSERT_NE(-1, listener);
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  ASSERT_EQ(0, bind(listener, reinterpret_cast<struct sockaddr*>(&address),
+                    sizeof(address)));
+
+  MetricsCounter counter("test.socket.counter");
+  MetricsExporter exporter;
+  exporter.AddSink(std::make_shared<SocketMetricsSink>(path));
+  counter.Add(2);
+  exporter.Export();
+
+  char datagram[4096] = {};
+  ASSERT_GT(recv(listener, datagram, sizeof(datagram) - 1, MSG_DONTWAIT), 0);
+  EXPECT_NE(nullptr,
+            strstr(datagram, "counter test.socket.counter total=2 delta=2\n"));
+  close(listener);
+  unlink(path.c_str());
+
+  // Dropped, without blocking, once nothing listens
+  exporter.Export();
+}
+
+TEST(MetricsCollectorTest, dumpsys_sink_keeps_last_snapshot) {
+  LatencyHistogram histogram("test.dumpsys.histogram");
+  auto sink = std::make_shared<DumpsysMetricsSink>();
+  MetricsExporter exporter;
+  exporter.AddSink(sink);
+  histogram.Record(3);
+  exporter.Export();
+
+  FILE* file = tmpfile();
+  ASSERT_NE(nullptr, file);
+  sink->Dump(fileno(file));
+  char dump[4096] = {};
+  rewind(file);
+  fread(dump, 1, sizeof(dump) - 1, file);
+  fclose(file);
+  EXPECT_NE(nullptr, strstr(dump, "Bluetooth Metrics:"));
+  EXPECT_NE(nullptr,
+            strstr(dump,
+                   "histogram test.dumpsys.histogram count=1 mean_us=3 "
+                   "p50_us=3 p90_us=3 p99_us=3 max_us=3\n"));
+}
+
+}  // namespace testing
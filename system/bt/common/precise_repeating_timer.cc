@@ -0,0 +1,222 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "precise_repeating_timer.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <future>
+
+#include <base/logging.h>
+#include <base/threading/platform_thread.h>
+
+#include "message_loop_thread.h"
+#include "time_util.h"
+
+namespace bluetooth {
+
+namespace common {
+
+static constexpr int kRealTimeFifoSchedulingPriority = 1;
+static constexpr int64_t kNanosecondsPerSecond = 1000000000LL;
+
+static bool arm_timer_fd(int fd, uint64_t deadline_ns) {
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = deadline_ns / kNanosecondsPerSecond;
+  spec.it_value.tv_nsec = deadline_ns % kNanosecondsPerSecond;
+  return timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0;
+}
+
+PreciseRepeatingTimer::PreciseRepeatingTimer()
+    : timer_fd_(-1),
+      stop_fd_(-1),
+      timer_thread_(nullptr),
+      generation_(0),
+      task_pending_(false),
+      last_deadline_ns_(0),
+      coalesced_ticks_(0) {}
+
+// This runs on user thread
+PreciseRepeatingTimer::~PreciseRepeatingTimer() { CancelAndWait(); }
+
+// This runs on user thread
+bool PreciseRepeatingTimer::SchedulePeriodic(
+    const base::WeakPtr<MessageLoopThread>& thread,
+    const base::Location& from_here, Task task,
+    std::chrono::nanoseconds period) {
+  if (period.count() <= 0) {
+    LOG(ERROR) << __func__ << ": period must be positive";
+    return false;
+  }
+  if (thread == nullptr || !thread->IsRunning()) {
+    LOG(ERROR) << __func__ << ": thread must be non-null and running";
+    return false;
+  }
+  CancelAndWait();
+
+  std::lock_guard<std::recursive_mutex> api_lock(api_mutex_);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (timer_fd_ == -1 || stop_fd_ == -1) {
+    LOG(ERROR) << __func__ << ": unable to create timer: " << strerror(errno);
+    if (timer_fd_ != -1) close(timer_fd_);
+    if (stop_fd_ != -1) close(stop_fd_);
+    timer_fd_ = -1;
+    stop_fd_ = -1;
+    return false;
+  }
+
+  message_loop_thread_ = thread;
+  task_ = std::move(task);
+  task_pending_ = false;
+  coalesced_ticks_ = 0;
+  timer_thread_ = new std::thread(&PreciseRepeatingTimer::RunTimerThread, this,
+                                  thread.get(), from_here, generation_.load(),
+                                  period.count());
+  return true;
+}
+
+// This runs on user thread
+void PreciseRepeatingTimer::CancelAndWait() {
+  base::WeakPtr<MessageLoopThread> thread;
+  {
+    std::lock_guard<std::recursive_mutex> api_lock(api_mutex_);
+    if (timer_thread_ == nullptr) return;
+
+    eventfd_write(stop_fd_, 1);
+    timer_thread_->join();
+    delete timer_thread_;
+    timer_thread_ = nullptr;
+    close(timer_fd_);
+    close(stop_fd_);
+    timer_fd_ = -1;
+    stop_fd_ = -1;
+
+    // Tasks already posted see a stale generation and do nothing
+    generation_++;
+    task_pending_ = false;
+    thread = message_loop_thread_;
+    message_loop_thread_ = nullptr;
+  }
+
+  // Wait for a task that may be running right now, unless this is that task
+  if (thread != nullptr && thread->IsRunning() &&
+      thread->GetThreadId() != base::PlatformThread::CurrentId()) {
+    std::promise<void> promise;
+    auto future = promise.get_future();
+    if (thread->DoInThread(FROM_HERE,
+                           base::BindOnce(
+                               [](std::promise<void>* promise) {
+                                 promise->set_value();
+                               },
+                               &promise))) {
+      future.wait();
+    }
+  }
+}
+
+// This runs on user thread
+bool PreciseRepeatingTimer::IsScheduled() const {
+  std::lock_guard<std::recursive_mutex> api_lock(api_mutex_);
+  return timer_thread_ != nullptr && message_loop_thread_ != nullptr &&
+         message_loop_thread_->IsRunning();
+}
+
+uint64_t PreciseRepeatingTimer::GetCoalescedTicks() const {
+  return coalesced_ticks_;
+}
+
+// This runs on the timer thread
+void PreciseRepeatingTimer::RunTimerThread(MessageLoopThread* thread,
+                                           base::Location from_here,
+                                           uint64_t generation,
+                                           int64_t period_ns) {
+  struct sched_param rt_params = {.sched_priority =
+                                      kRealTimeFifoSchedulingPriority};
+  if (sched_setscheduler(0, SCHED_FIFO, &rt_params) != 0) {
+    LOG(WARNING) << __func__ << ": unable to set SCHED_FIFO priority: "
+                 << strerror(errno);
+  }
+
+  uint64_t deadline_ns = time_get_os_monotonic_ns() + period_ns;
+  if (!arm_timer_fd(timer_fd_, deadline_ns)) {
+    LOG(ERROR) << __func__ << ": unable to arm timer: " << strerror(errno);
+    return;
+  }
+
+  struct pollfd fds[2] = {};
+  fds[0].fd = timer_fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = stop_fd_;
+  fds[1].events = POLLIN;
+  while (true) {
+    int ret = poll(fds, 2, -1);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret == -1 || (fds[1].revents & POLLIN)) break;
+
+    uint64_t expirations;
+    if (read(timer_fd_, &expirations, sizeof(expirations)) == -1) continue;
+
+    // Keep the phase of the deadlines: if the thread itself was held up for
+    // more than a period, the missed deadlines are folded into this one.
+    uint64_t now_ns = time_get_os_monotonic_ns();
+    uint64_t fired_ns = deadline_ns;
+    deadline_ns += period_ns;
+    while (deadline_ns <= now_ns) {
+      fired_ns = deadline_ns;
+      deadline_ns += period_ns;
+      coalesced_ticks_++;
+    }
+    if (!arm_timer_fd(timer_fd_, deadline_ns)) {
+      LOG(ERROR) << __func__ << ": unable to arm timer: " << strerror(errno);
+      break;
+    }
+
+    last_deadline_ns_ = fired_ns;
+    if (task_pending_.exchange(true)) {
+      coalesced_ticks_++;
+      continue;
+    }
+    if (!thread->DoInThread(
+            from_here, base::BindOnce(&PreciseRepeatingTimer::RunTask,
+                                      base::Unretained(this), generation))) {
+      LOG(ERROR) << __func__ << ": failed to post task to message loop for "
+                 << "thread " << *thread << ", from " << from_here.ToString();
+      break;
+    }
+  }
+}
+
+// This runs on message loop thread
+void PreciseRepeatingTimer::RunTask(uint64_t generation) {
+  if (generation != generation_) return;
+  // Deadlines that expired after the task was posted were merged into it
+  uint64_t deadline_ns = last_deadline_ns_;
+  task_pending_ = false;
+
+  // The task may reschedule the timer, which replaces |task_|
+  Task task = task_;
+  task.Run(deadline_ns);
+}
+
+}  // namespace common
+
+}  // namespace bluetooth
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace bluetooth {
+
+namespace common {
+
+class MessageLoopThread;
+
+/**
+ * A periodic alarm with nanosecond resolution for tasks that pace real time
+ * data, such as the A2DP media tick.
+ *
+ * Deadlines are absolute CLOCK_MONOTONIC times armed on a timerfd, so the
+ * period does not drift with the time spent in the task and is not rounded to
+ * milliseconds. A dedicated thread waits on the timerfd and posts the task to
+ * the MessageLoopThread. At most one task is outstanding: if the message loop
+ * is still busy when the next deadline expires, that tick is coalesced into
+ * the pending one instead of piling up behind it, and the task is handed the
+ * latest expired deadline when it runs.
+ *
+ * Warning: MessageLoopThread must be running when any task is scheduled or
+ * being executed
+ */
+class PreciseRepeatingTimer final {
+ public:
+  // |deadline_ns| is the CLOCK_MONOTONIC time the task was due at
+  using Task = base::RepeatingCallback<void(uint64_t deadline_ns)>;
+
+  PreciseRepeatingTimer();
+  ~PreciseRepeatingTimer();
+
+  /**
+   * Schedule a periodic task to the MessageLoopThread, the first run being one
+   * |period| from now. Only one task can be scheduled at a time. If another
+   * task is scheduled, it is cancelled synchronously first.
+   *
+   * @param thread thread to run the task
+   * @param from_here location where this task is originated
+   * @param task task created through base::Bind()
+   * @param period period for the task to be executed
+   * @return true iff task is scheduled successfully
+   */
+  bool SchedulePeriodic(const base::WeakPtr<MessageLoopThread>& thread,
+                        const base::Location& from_here, Task task,
+                        std::chrono::nanoseconds period);
+
+  /**
+   * Cancel the current task and wait until it is guaranteed not to run
+   * anymore. Safe to call from the task itself.
+   */
+  void CancelAndWait();
+
+  /**
+   * Returns true when a task is scheduled, otherwise false.
+   */
+  bool IsScheduled() const;
+
+  /**
+   * Returns the number of deadlines that expired while a previous task was
+   * still pending, and were therefore merged into it.
+   */
+  uint64_t GetCoalescedTicks() const;
+
+ private:
+  void RunTimerThread(MessageLoopThread* thread, base::Location from_here,
+                      uint64_t generation, int64_t period_ns);
+  void RunTask(uint64_t generation);
+
+  mutable std::recursive_mutex api_mutex_;
+  base::WeakPtr<MessageLoopThread> message_loop_thread_;
+  Task task_;
+  int timer_fd_;
+  int stop_fd_;
+  std::thread* timer_thread_;
+  std::atomic<uint64_t> generation_;
+  std::atomic<bool> task_pending_;
+  std::atomic<uint64_t> last_deadline_ns_;
+  std::atomic<uint64_t> coalesced_ticks_;
+
+  DISALLOW_COPY_AND_ASSIGN(PreciseRepeatingTimer);
+};
+
+}  // namespace common
+
+}  // namespace bluetooth
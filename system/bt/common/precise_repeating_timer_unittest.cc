@@ -0,0 +1,172 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/logging.h>
+#include <gtest/gtest.h>
+#include <future>
+#include <vector>
+
+#include "message_loop_thread.h"
+#include "precise_repeating_timer.h"
+#include "time_util.h"
+
+using bluetooth::common::MessageLoopThread;
+using bluetooth::common::PreciseRepeatingTimer;
+
+// Allowed error between the expected and actual run time of a task
+constexpr uint32_t delay_error_ms = 100;
+
+class PreciseRepeatingTimerTest : public ::testing::Test {
+ public:
+  void ShouldNotHappen(uint64_t deadline_ns) { FAIL() << "Should not happen"; }
+
+  void RecordDeadline(size_t scheduled_tasks, int task_length_ms,
+                      uint64_t deadline_ns) {
+    deadlines_.push_back(deadline_ns);
+    if (deadlines_.size() == scheduled_tasks) promise_.set_value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(task_length_ms));
+  }
+
+  void CancelFromTask(uint64_t deadline_ns) {
+    counter_++;
+    timer_.CancelAndWait();
+    promise_.set_value();
+  }
+
+ protected:
+  PreciseRepeatingTimer timer_;
+  std::promise<void> promise_;
+  std::vector<uint64_t> deadlines_;
+  int counter_ = 0;
+};
+
+TEST_F(PreciseRepeatingTimerTest, initial_is_not_scheduled) {
+  ASSERT_FALSE(timer_.IsScheduled());
+}
+
+TEST_F(PreciseRepeatingTimerTest, schedule_zero_period) {
+  MessageLoopThread message_loop_thread("test_thread");
+  message_loop_thread.StartUp();
+
+  ASSERT_FALSE(timer_.SchedulePeriodic(
+      message_loop_thread.GetWeakPtr(), FROM_HERE,
+      base::BindRepeating(&PreciseRepeatingTimerTest::ShouldNotHappen,
+                          base::Unretained(this)),
+      std::chrono::nanoseconds(0)));
+  EXPECT_FALSE(timer_.IsScheduled());
+}
+
+// Deadlines are exactly one period apart, whatever the wake up latency
+TEST_F(PreciseRepeatingTimerTest, deadlines_do_not_drift) {
+  MessageLoopThread message_loop_thread("test_thread");
+  message_loop_thread.StartUp();
+  auto future = promise_.get_future();
+  const std::chrono::nanoseconds period(2500000);
+  const size_t num_tasks = 20;
+
+  uint64_t start_ns = bluetooth::common::time_get_os_monotonic_ns();
+  ASSERT_TRUE(timer_.SchedulePeriodic(
+      message_loop_thread.GetWeakPtr(), FROM_HERE,
+      base::BindRepeating(&PreciseRepeatingTimerTest::RecordDeadline,
+                          base::Unretained(this), num_tasks, 0),
+      period));
+  EXPECT_TRUE(timer_.IsScheduled());
+  future.get();
+  timer_.CancelAndWait();
+  EXPECT_FALSE(timer_.IsScheduled());
+
+  ASSERT_EQ(deadlines_.size(), num_tasks);
+  EXPECT_GE(deadlines_[0], start_ns + period.count());
+  EXPECT_LT(deadlines_[0],
+            start_ns + period.count() + delay_error_ms * 1000 * 1000);
+  for (size_t i = 1; i < deadlines_.size(); i++) {
+    EXPECT_EQ((deadlines_[i] - deadlines_[0]) % period.count(), 0u);
+    EXPECT_GT(deadlines_[i], deadlines_[i - 1]);
+  }
+}
+
+// A task longer than the period does not queue up ticks behind it
+TEST_F(PreciseRepeatingTimerTest, slow_task_coalesces_ticks) {
+  MessageLoopThread message_loop_thread("test_thread");
+  message_loop_thread.StartUp();
+  auto future = promise_.get_future();
+  const size_t num_tasks = 5;
+
+  timer_.SchedulePeriodic(
+      message_loop_thread.GetWeakPtr(), FROM_HERE,
+      base::BindRepeating(&PreciseRepeatingTimerTest::RecordDeadline,
+                          base::Unretained(this), num_tasks, 5),
+      std::chrono::milliseconds(1));
+  future.get();
+  timer_.CancelAndWait();
+
+  EXPECT_GT(timer_.GetCoalescedTicks(), 0u);
+  // The deadline handed to each run is the latest one that expired
+  for (size_t i = 1; i < deadlines_.size(); i++) {
+    EXPECT_GE(deadlines_[i] - deadlines_[i - 1], 2u * 1000 * 1000);
+  }
+}
+
+TEST_F(PreciseRepeatingTimerTest, cancel_periodic_task) {
+  MessageLoopThread message_loop_thread("test_thread");
+  message_loop_thread.StartUp();
+  auto future = promise_.get_future();
+  const size_t num_tasks = 5;
+
+  timer_.SchedulePeriodic(
+      message_loop_thread.GetWeakPtr(), FROM_HERE,
+      base::BindRepeating(&PreciseRepeatingTimerTest::RecordDeadline,
+                          base::Unretained(this), num_tasks, 0),
+      std::chrono::milliseconds(1));
+  future.wait();
+  timer_.CancelAndWait();
+  size_t count = deadlines_.size();
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_error_ms));
+  EXPECT_EQ(count, deadlines_.size());
+}
+
+TEST_F(PreciseRepeatingTimerTest, cancel_from_task) {
+  MessageLoopThread message_loop_thread("test_thread");
+  message_loop_thread.StartUp();
+  auto future = promise_.get_future();
+
+  timer_.SchedulePeriodic(
+      message_loop_thread.GetWeakPtr(), FROM_HERE,
+      base::BindRepeating(&PreciseRepeatingTimerTest::CancelFromTask,
+                          base::Unretained(this)),
+      std::chrono::milliseconds(1));
+  future.wait();
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_error_ms));
+  EXPECT_EQ(counter_, 1);
+  EXPECT_FALSE(timer_.IsScheduled());
+}
+
+// Verify that deleting the timer without cancelling it will cancel the task
+TEST_F(PreciseRepeatingTimerTest, delete_without_cancel) {
+  MessageLoopThread message_loop_thread("test_thread");
+  message_loop_thread.StartUp();
+  auto timer = std::make_unique<PreciseRepeatingTimer>();
+
+  timer->SchedulePeriodic(
+      message_loop_thread.GetWeakPtr(), FROM_HERE,
+      base::BindRepeating(&PreciseRepeatingTimerTest::ShouldNotHappen,
+                          base::Unretained(this)),
+      std::chrono::milliseconds(5));
+  timer.reset();
+  std::this_thread::sleep_for(std::chrono::milliseconds(delay_error_ms));
+}
@@ -35,6 +35,13 @@ uint64_t time_get_os_boottime_us() {
          ((uint64_t)ts_now.tv_nsec / 1000);
 }
 
+uint64_t time_get_os_monotonic_ns() {
+  struct timespec ts_now = {};
+  clock_gettime(CLOCK_MONOTONIC, &ts_now);
+
+  return ((uint64_t)ts_now.tv_sec * 1000000000L) + (uint64_t)ts_now.tv_nsec;
+}
+
 uint64_t time_gettimeofday_us() {
   struct timeval tv = {};
   gettimeofday(&tv, nullptr);
@@ -30,6 +30,11 @@ uint64_t time_get_os_boottime_ms();
 // Get the OS boot time in microseconds.
 uint64_t time_get_os_boottime_us();
 
+// Get the OS monotonic time in nanoseconds. Unlike the boot time it does not
+// advance while the system is suspended, and it is the clock timerfd deadlines
+// are expressed in.
+uint64_t time_get_os_monotonic_ns();
+
 // Get the current wall clock time in microseconds.
 uint64_t time_gettimeofday_us();
 
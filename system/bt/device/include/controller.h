@@ -97,6 +97,9 @@ const controller_t* controller_get_interface();
 
 const controller_t* controller_get_interface();
 
+// Dumps how long the controller took to start up, for the legacy stack
+void controller_debug_dump(int fd);
+
 const controller_t* controller_get_test_interface(
     const hci_t* hci_interface,
     const hci_packet_factory_t* packet_factory_interface,
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "btcore/include/device_features.h"
+#include "btcore/include/version.h"
+#include "types/raw_address.h"
+
+#define HCI_SUPPORTED_COMMANDS_ARRAY_SIZE 64
+#define MAX_FEATURES_CLASSIC_PAGE_COUNT 3
+#define BLE_SUPPORTED_STATES_SIZE 8
+#define MAX_LOCAL_SUPPORTED_CODECS_SIZE 8
+
+// Capabilities the controller reports when it starts up. They only change
+// with its firmware, so they are saved once read, and reused on later starts
+// for as long as the controller reports the same version and address.
+typedef struct {
+  bt_version_t bt_version;
+  RawAddress address;
+
+  uint16_t acl_data_size_classic;
+  uint16_t acl_buffer_count_classic;
+  uint8_t supported_commands[HCI_SUPPORTED_COMMANDS_ARRAY_SIZE];
+  bt_device_features_t features_classic[MAX_FEATURES_CLASSIC_PAGE_COUNT];
+  uint8_t last_features_classic_page_index;
+
+  uint16_t acl_data_size_ble;
+  uint8_t acl_buffer_count_ble;
+  uint8_t ble_white_list_size;
+  uint8_t ble_resolving_list_max_size;
+  uint8_t ble_supported_states[BLE_SUPPORTED_STATES_SIZE];
+  bt_device_features_t features_ble;
+  uint16_t ble_suggested_default_data_length;
+  uint16_t ble_supported_max_tx_octets;
+  uint16_t ble_supported_max_tx_time;
+  uint16_t ble_supported_max_rx_octets;
+  uint16_t ble_supported_max_rx_time;
+  uint16_t ble_maximum_advertising_data_length;
+  uint8_t ble_number_of_supported_advertising_sets;
+
+  uint8_t local_supported_codecs[MAX_LOCAL_SUPPORTED_CODECS_SIZE];
+  uint8_t number_of_local_supported_codecs;
+} controller_snapshot_t;
+
+// Loads the snapshot saved to |path| into |snapshot|. Returns false if there
+// is none, or if it was saved in another format.
+bool controller_snapshot_load(const char* path,
+                              controller_snapshot_t* snapshot);
+
+// Saves |snapshot| to |path|, replacing the previous one. Returns true on
+// success.
+bool controller_snapshot_save(const char* path,
+                              const controller_snapshot_t* snapshot);
+
+// Returns true if |snapshot| was taken from the controller reporting
+// |bt_version| and |address|.
+bool controller_snapshot_matches(const controller_snapshot_t* snapshot,
+                                 const bt_version_t* bt_version,
+                                 const RawAddress* address);
@@ -21,15 +21,23 @@
 #include "device/include/controller.h"
 
 #include <base/logging.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
 
 #include "bt_types.h"
 #include "btcore/include/event_mask.h"
 #include "btcore/include/module.h"
 #include "btcore/include/version.h"
+#include "common/time_util.h"
+#include "device/include/controller_snapshot.h"
 #include "hcimsgs.h"
 #include "main/shim/controller.h"
 #include "main/shim/shim.h"
 #include "osi/include/future.h"
+#include "osi/include/log.h"
+#include "osi/include/properties.h"
 #include "stack/include/btm_ble_api.h"
 
 const bt_event_mask_t BLE_EVENT_MASK = {{0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
@@ -47,11 +55,18 @@ const bt_event_mask_t CLASSIC_EVENT_MASK = {HCI_DUMO_EVENT_MASK_EXT};
 // TODO(zachoverflow): factor out into common module
 const uint8_t SCO_HOST_BUFFER_SIZE = 0xff;
 
-#define HCI_SUPPORTED_COMMANDS_ARRAY_SIZE 64
-#define MAX_FEATURES_CLASSIC_PAGE_COUNT 3
-#define BLE_SUPPORTED_STATES_SIZE 8
 #define BLE_SUPPORTED_FEATURES_SIZE 8
-#define MAX_LOCAL_SUPPORTED_CODECS_SIZE 8
+
+#if defined(OS_GENERIC)
+static const char* CONTROLLER_SNAPSHOT_PATH = "bt_controller_snapshot.conf";
+#else   // !defined(OS_GENERIC)
+static const char* CONTROLLER_SNAPSHOT_PATH =
+    "/data/misc/bluedroid/bt_controller_snapshot.conf";
+#endif  // defined(OS_GENERIC)
+
+// Set to false to read the capabilities of the controller on every start up
+static const char CONTROLLER_SNAPSHOT_PROPERTY[] =
+    "persist.bluetooth.controller_snapshot";
 
 static const hci_t* local_hci;
 static const hci_packet_factory_t* packet_factory;
@@ -89,54 +104,118 @@ static bool ble_supported;
 static bool simple_pairing_supported;
 static bool secure_connections_supported;
 
+// Start ups which reused a snapshot of the controller capabilities are warm,
+// the others cold
+static std::mutex start_up_stats_mutex;
+static struct {
+  uint64_t last_duration_us;
+  bool last_start_up_warm;
+  size_t warm_count;
+  uint64_t warm_total_us;
+  size_t cold_count;
+  uint64_t cold_total_us;
+} start_up_stats;
+
 #define AWAIT_COMMAND(command) \
   static_cast<BT_HDR*>(        \
       future_await(local_hci->transmit_command_futured(command)))
 
-// Module lifecycle functions
-
-static future_t* start_up(void) {
+// Commands sent with SEND_COMMAND don't wait for the previous ones to
+// complete: the controller executes them in order, and responses are awaited
+// with AWAIT_RESPONSE once a batch of independent commands is sent.
+#define SEND_COMMAND(command) local_hci->transmit_command_futured(command)
+#define AWAIT_RESPONSE(future) static_cast<BT_HDR*>(future_await(future))
+
+// Copies the capabilities read from the controller to |snapshot|
+static void take_snapshot(controller_snapshot_t* snapshot) {
+  snapshot->bt_version = bt_version;
+  snapshot->address = address;
+  snapshot->acl_data_size_classic = acl_data_size_classic;
+  snapshot->acl_buffer_count_classic = acl_buffer_count_classic;
+  memcpy(snapshot->supported_commands, supported_commands,
+         sizeof(supported_commands));
+  memcpy(snapshot->features_classic, features_classic,
+         sizeof(features_classic));
+  snapshot->last_features_classic_page_index = last_features_classic_page_index;
+  snapshot->acl_data_size_ble = acl_data_size_ble;
+  snapshot->acl_buffer_count_ble = acl_buffer_count_ble;
+  snapshot->ble_white_list_size = ble_white_list_size;
+  snapshot->ble_resolving_list_max_size = ble_resolving_list_max_size;
+  memcpy(snapshot->ble_supported_states, ble_supported_states,
+         sizeof(ble_supported_states));
+  snapshot->features_ble = features_ble;
+  snapshot->ble_suggested_default_data_length =
+      ble_suggested_default_data_length;
+  snapshot->ble_supported_max_tx_octets = ble_supported_max_tx_octets;
+  snapshot->ble_supported_max_tx_time = ble_supported_max_tx_time;
+  snapshot->ble_supported_max_rx_octets = ble_supported_max_rx_octets;
+  snapshot->ble_supported_max_rx_time = ble_supported_max_rx_time;
+  snapshot->ble_maximum_advertising_data_length =
+      ble_maxium_advertising_data_length;
+  snapshot->ble_number_of_supported_advertising_sets =
+      ble_number_of_supported_advertising_sets;
+  memcpy(snapshot->local_supported_codecs, local_supported_codecs,
+         sizeof(local_supported_codecs));
+  snapshot->number_of_local_supported_codecs = number_of_local_supported_codecs;
+}
+
+// Restores the capabilities saved in |snapshot|, instead of reading them
+static void restore_snapshot(const controller_snapshot_t& snapshot) {
+  acl_data_size_classic = snapshot.acl_data_size_classic;
+  acl_buffer_count_classic = snapshot.acl_buffer_count_classic;
+  memcpy(supported_commands, snapshot.supported_commands,
+         sizeof(supported_commands));
+  memcpy(features_classic, snapshot.features_classic,
+         sizeof(features_classic));
+  last_features_classic_page_index = snapshot.last_features_classic_page_index;
+  acl_data_size_ble = snapshot.acl_data_size_ble;
+  acl_buffer_count_ble = snapshot.acl_buffer_count_ble;
+  ble_white_list_size = snapshot.ble_white_list_size;
+  ble_resolving_list_max_size = snapshot.ble_resolving_list_max_size;
+  memcpy(ble_supported_states, snapshot.ble_supported_states,
+         sizeof(ble_supported_states));
+  features_ble = snapshot.features_ble;
+  ble_suggested_default_data_length =
+      snapshot.ble_suggested_default_data_length;
+  ble_supported_max_tx_octets = snapshot.ble_supported_max_tx_octets;
+  ble_supported_max_tx_time = snapshot.ble_supported_max_tx_time;
+  ble_supported_max_rx_octets = snapshot.ble_supported_max_rx_octets;
+  ble_supported_max_rx_time = snapshot.ble_supported_max_rx_time;
+  ble_maxium_advertising_data_length =
+      snapshot.ble_maximum_advertising_data_length;
+  ble_number_of_supported_advertising_sets =
+      snapshot.ble_number_of_supported_advertising_sets;
+  memcpy(local_supported_codecs, snapshot.local_supported_codecs,
+         sizeof(local_supported_codecs));
+  number_of_local_supported_codecs = snapshot.number_of_local_supported_codecs;
+}
+
+// Reads the capabilities of the controller, and tells it which of its features
+// the host supports as they are read, since that changes the features it
+// reports next.
+static void read_capabilities(void) {
   BT_HDR* response;
 
-  // Send the initial reset command
-  response = AWAIT_COMMAND(packet_factory->make_reset());
-  packet_parser->parse_generic_command_complete(response);
+  // Request the classic buffer size, the controller's supported commands and
+  // page 0 of the controller features first
+  uint8_t page_number = 0;
+  future_t* buffer_size_future =
+      SEND_COMMAND(packet_factory->make_read_buffer_size());
+  future_t* supported_commands_future =
+      SEND_COMMAND(packet_factory->make_read_local_supported_commands());
+  future_t* features_future = SEND_COMMAND(
+      packet_factory->make_read_local_extended_features(page_number));
 
-  // Request the classic buffer size next
-  response = AWAIT_COMMAND(packet_factory->make_read_buffer_size());
   packet_parser->parse_read_buffer_size_response(
-      response, &acl_data_size_classic, &acl_buffer_count_classic);
-
-  // Tell the controller about our buffer sizes and buffer counts next
-  // TODO(zachoverflow): factor this out. eww l2cap contamination. And why just
-  // a hardcoded 10?
-  response = AWAIT_COMMAND(packet_factory->make_host_buffer_size(
-      L2CAP_MTU_SIZE, SCO_HOST_BUFFER_SIZE, L2CAP_HOST_FC_ACL_BUFS, 10));
-
-  packet_parser->parse_generic_command_complete(response);
-
-  // Read the local version info off the controller next, including
-  // information such as manufacturer and supported HCI version
-  response = AWAIT_COMMAND(packet_factory->make_read_local_version_info());
-  packet_parser->parse_read_local_version_info_response(response, &bt_version);
-
-  // Read the bluetooth address off the controller next
-  response = AWAIT_COMMAND(packet_factory->make_read_bd_addr());
-  packet_parser->parse_read_bd_addr_response(response, &address);
-
-  // Request the controller's supported commands next
-  response =
-      AWAIT_COMMAND(packet_factory->make_read_local_supported_commands());
+      AWAIT_RESPONSE(buffer_size_future), &acl_data_size_classic,
+      &acl_buffer_count_classic);
   packet_parser->parse_read_local_supported_commands_response(
-      response, supported_commands, HCI_SUPPORTED_COMMANDS_ARRAY_SIZE);
-
-  // Read page 0 of the controller features next
-  uint8_t page_number = 0;
-  response = AWAIT_COMMAND(
-      packet_factory->make_read_local_extended_features(page_number));
+      AWAIT_RESPONSE(supported_commands_future), supported_commands,
+      HCI_SUPPORTED_COMMANDS_ARRAY_SIZE);
   packet_parser->parse_read_local_extended_features_response(
-      response, &page_number, &last_features_classic_page_index,
-      features_classic, MAX_FEATURES_CLASSIC_PAGE_COUNT);
+      AWAIT_RESPONSE(features_future), &page_number,
+      &last_features_classic_page_index, features_classic,
+      MAX_FEATURES_CLASSIC_PAGE_COUNT);
 
   CHECK(page_number == 0);
   page_number++;
@@ -145,31 +224,59 @@ static future_t* start_up(void) {
   // it told us it supports. We need to do this first before we request the
   // next page, because the controller's response for page 1 may be
   // dependent on what we configure from page 0
+  future_t* simple_pairing_future = NULL;
   simple_pairing_supported =
       HCI_SIMPLE_PAIRING_SUPPORTED(features_classic[0].as_array);
   if (simple_pairing_supported) {
-    response = AWAIT_COMMAND(
+    simple_pairing_future = SEND_COMMAND(
         packet_factory->make_write_simple_pairing_mode(HCI_SP_MODE_ENABLED));
-    packet_parser->parse_generic_command_complete(response);
   }
 
+  future_t* le_host_support_future = NULL;
   if (HCI_LE_SPT_SUPPORTED(features_classic[0].as_array)) {
     uint8_t simultaneous_le_host =
         HCI_SIMUL_LE_BREDR_SUPPORTED(features_classic[0].as_array)
             ? BTM_BLE_SIMULTANEOUS_HOST
             : 0;
-    response = AWAIT_COMMAND(packet_factory->make_ble_write_host_support(
-        BTM_BLE_HOST_SUPPORT, simultaneous_le_host));
-
-    packet_parser->parse_generic_command_complete(response);
+    le_host_support_future = SEND_COMMAND(
+        packet_factory->make_ble_write_host_support(BTM_BLE_HOST_SUPPORT,
+                                                    simultaneous_le_host));
 
     // If we modified the BT_HOST_SUPPORT, we will need ext. feat. page 1
     if (last_features_classic_page_index < 1)
       last_features_classic_page_index = 1;
   }
 
-  // Done telling the controller about what page 0 features we support
-  // Request the remaining feature pages
+  // Page 1 holds the host features, so the writes above have to complete
+  // before it is read, or a stale page would be used and saved in the snapshot
+  if (simple_pairing_future != NULL) {
+    packet_parser->parse_generic_command_complete(
+        AWAIT_RESPONSE(simple_pairing_future));
+  }
+  if (le_host_support_future != NULL) {
+    packet_parser->parse_generic_command_complete(
+        AWAIT_RESPONSE(le_host_support_future));
+  }
+
+  // Request the remaining feature pages, which don't depend on each other
+  future_t* page_futures[MAX_FEATURES_CLASSIC_PAGE_COUNT] = {};
+  uint8_t pages_requested = page_number;
+  while (pages_requested <= last_features_classic_page_index &&
+         pages_requested < MAX_FEATURES_CLASSIC_PAGE_COUNT) {
+    page_futures[pages_requested] = SEND_COMMAND(
+        packet_factory->make_read_local_extended_features(pages_requested));
+    pages_requested++;
+  }
+
+  for (uint8_t page = page_number; page < pages_requested; page++) {
+    packet_parser->parse_read_local_extended_features_response(
+        AWAIT_RESPONSE(page_futures[page]), &page_number,
+        &last_features_classic_page_index, features_classic,
+        MAX_FEATURES_CLASSIC_PAGE_COUNT);
+  }
+
+  // In case a page reported more pages than page 0 did
+  page_number = pages_requested;
   while (page_number <= last_features_classic_page_index &&
          page_number < MAX_FEATURES_CLASSIC_PAGE_COUNT) {
     response = AWAIT_COMMAND(
@@ -181,103 +288,242 @@ static future_t* start_up(void) {
     page_number++;
   }
 
+  // Secure connections support is only known from page 2, so page 1 is read
+  // again once the host support write completed, to pick up the host bit
+  future_t* secure_connections_future = NULL;
 #if (SC_MODE_INCLUDED == TRUE)
   secure_connections_supported =
       HCI_SC_CTRLR_SUPPORTED(features_classic[2].as_array);
   if (secure_connections_supported) {
-    response = AWAIT_COMMAND(
-        packet_factory->make_write_secure_connections_host_support(
+    secure_connections_future =
+        SEND_COMMAND(packet_factory->make_write_secure_connections_host_support(
             HCI_SC_MODE_ENABLED));
-    packet_parser->parse_generic_command_complete(response);
   }
 #endif
 
+  // Read local supported codecs
+  future_t* codecs_future = NULL;
+  if (HCI_READ_LOCAL_CODECS_SUPPORTED(supported_commands)) {
+    codecs_future =
+        SEND_COMMAND(packet_factory->make_read_local_supported_codecs());
+  }
+
   ble_supported = last_features_classic_page_index >= 1 &&
                   HCI_LE_HOST_SUPPORTED(features_classic[1].as_array);
   if (ble_supported) {
-    // Request the ble white list size next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_white_list_size());
-    packet_parser->parse_ble_read_white_list_size_response(
-        response, &ble_white_list_size);
+    // Request the ble white list size, buffer size, supported states and
+    // supported features next
+    future_t* white_list_size_future =
+        SEND_COMMAND(packet_factory->make_ble_read_white_list_size());
+    future_t* ble_buffer_size_future =
+        SEND_COMMAND(packet_factory->make_ble_read_buffer_size());
+    future_t* supported_states_future =
+        SEND_COMMAND(packet_factory->make_ble_read_supported_states());
+    future_t* ble_features_future =
+        SEND_COMMAND(packet_factory->make_ble_read_local_supported_features());
 
-    // Request the ble buffer size next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_buffer_size());
+    packet_parser->parse_ble_read_white_list_size_response(
+        AWAIT_RESPONSE(white_list_size_future), &ble_white_list_size);
     packet_parser->parse_ble_read_buffer_size_response(
-        response, &acl_data_size_ble, &acl_buffer_count_ble);
+        AWAIT_RESPONSE(ble_buffer_size_future), &acl_data_size_ble,
+        &acl_buffer_count_ble);
+    packet_parser->parse_ble_read_supported_states_response(
+        AWAIT_RESPONSE(supported_states_future), ble_supported_states,
+        sizeof(ble_supported_states));
+    packet_parser->parse_ble_read_local_supported_features_response(
+        AWAIT_RESPONSE(ble_features_future), &features_ble);
 
     // Response of 0 indicates ble has the same buffer size as classic
     if (acl_data_size_ble == 0) acl_data_size_ble = acl_data_size_classic;
 
-    // Request the ble supported states next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_supported_states());
-    packet_parser->parse_ble_read_supported_states_response(
-        response, ble_supported_states, sizeof(ble_supported_states));
-
-    // Request the ble supported features next
-    response =
-        AWAIT_COMMAND(packet_factory->make_ble_read_local_supported_features());
-    packet_parser->parse_ble_read_local_supported_features_response(
-        response, &features_ble);
-
+    // Then the values which depend on the ble supported features
+    future_t* resolving_list_size_future = NULL;
     if (HCI_LE_ENHANCED_PRIVACY_SUPPORTED(features_ble.as_array)) {
-      response =
-          AWAIT_COMMAND(packet_factory->make_ble_read_resolving_list_size());
-      packet_parser->parse_ble_read_resolving_list_size_response(
-          response, &ble_resolving_list_max_size);
+      resolving_list_size_future =
+          SEND_COMMAND(packet_factory->make_ble_read_resolving_list_size());
     }
 
+    future_t* maximum_data_length_future = NULL;
+    future_t* default_data_length_future = NULL;
     if (HCI_LE_DATA_LEN_EXT_SUPPORTED(features_ble.as_array)) {
-      response =
-          AWAIT_COMMAND(packet_factory->make_ble_read_maximum_data_length());
-      packet_parser->parse_ble_read_maximum_data_length_response(
-          response, &ble_supported_max_tx_octets, &ble_supported_max_tx_time,
-          &ble_supported_max_rx_octets, &ble_supported_max_rx_time);
-
-      response = AWAIT_COMMAND(
+      maximum_data_length_future =
+          SEND_COMMAND(packet_factory->make_ble_read_maximum_data_length());
+      default_data_length_future = SEND_COMMAND(
           packet_factory->make_ble_read_suggested_default_data_length());
-      packet_parser->parse_ble_read_suggested_default_data_length_response(
-          response, &ble_suggested_default_data_length);
     }
 
+    future_t* advertising_data_length_future = NULL;
+    future_t* advertising_sets_future = NULL;
     if (HCI_LE_EXTENDED_ADVERTISING_SUPPORTED(features_ble.as_array)) {
-      response = AWAIT_COMMAND(
+      advertising_data_length_future = SEND_COMMAND(
           packet_factory->make_ble_read_maximum_advertising_data_length());
-      packet_parser->parse_ble_read_maximum_advertising_data_length(
-          response, &ble_maxium_advertising_data_length);
-
-      response = AWAIT_COMMAND(
+      advertising_sets_future = SEND_COMMAND(
           packet_factory->make_ble_read_number_of_supported_advertising_sets());
-      packet_parser->parse_ble_read_number_of_supported_advertising_sets(
-          response, &ble_number_of_supported_advertising_sets);
     } else {
       /* If LE Excended Advertising is not supported, use the default value */
       ble_maxium_advertising_data_length = 31;
     }
 
-    // Set the ble event mask next
-    response =
-        AWAIT_COMMAND(packet_factory->make_ble_set_event_mask(&BLE_EVENT_MASK));
-    packet_parser->parse_generic_command_complete(response);
+    if (resolving_list_size_future != NULL) {
+      packet_parser->parse_ble_read_resolving_list_size_response(
+          AWAIT_RESPONSE(resolving_list_size_future),
+          &ble_resolving_list_max_size);
+    }
+    if (maximum_data_length_future != NULL) {
+      packet_parser->parse_ble_read_maximum_data_length_response(
+          AWAIT_RESPONSE(maximum_data_length_future),
+          &ble_supported_max_tx_octets, &ble_supported_max_tx_time,
+          &ble_supported_max_rx_octets, &ble_supported_max_rx_time);
+      packet_parser->parse_ble_read_suggested_default_data_length_response(
+          AWAIT_RESPONSE(default_data_length_future),
+          &ble_suggested_default_data_length);
+    }
+    if (advertising_data_length_future != NULL) {
+      packet_parser->parse_ble_read_maximum_advertising_data_length(
+          AWAIT_RESPONSE(advertising_data_length_future),
+          &ble_maxium_advertising_data_length);
+      packet_parser->parse_ble_read_number_of_supported_advertising_sets(
+          AWAIT_RESPONSE(advertising_sets_future),
+          &ble_number_of_supported_advertising_sets);
+    }
+  }
+
+  if (secure_connections_future != NULL) {
+    packet_parser->parse_generic_command_complete(
+        AWAIT_RESPONSE(secure_connections_future));
+    page_number = 1;
+    response = AWAIT_COMMAND(
+        packet_factory->make_read_local_extended_features(page_number));
+    packet_parser->parse_read_local_extended_features_response(
+        response, &page_number, &last_features_classic_page_index,
+        features_classic, MAX_FEATURES_CLASSIC_PAGE_COUNT);
+  }
+  if (codecs_future != NULL) {
+    packet_parser->parse_read_local_supported_codecs_response(
+        AWAIT_RESPONSE(codecs_future), &number_of_local_supported_codecs,
+        local_supported_codecs);
   }
+}
 
+// Tells the controller which of its features the host supports, when its
+// capabilities were restored from a snapshot rather than read
+static void write_host_support(future_t** futures, size_t* count) {
+  simple_pairing_supported =
+      HCI_SIMPLE_PAIRING_SUPPORTED(features_classic[0].as_array);
   if (simple_pairing_supported) {
-    response =
-        AWAIT_COMMAND(packet_factory->make_set_event_mask(&CLASSIC_EVENT_MASK));
-    packet_parser->parse_generic_command_complete(response);
+    futures[(*count)++] = SEND_COMMAND(
+        packet_factory->make_write_simple_pairing_mode(HCI_SP_MODE_ENABLED));
   }
 
-  // read local supported codecs
-  if (HCI_READ_LOCAL_CODECS_SUPPORTED(supported_commands)) {
-    response =
-        AWAIT_COMMAND(packet_factory->make_read_local_supported_codecs());
-    packet_parser->parse_read_local_supported_codecs_response(
-        response, &number_of_local_supported_codecs, local_supported_codecs);
+  if (HCI_LE_SPT_SUPPORTED(features_classic[0].as_array)) {
+    uint8_t simultaneous_le_host =
+        HCI_SIMUL_LE_BREDR_SUPPORTED(features_classic[0].as_array)
+            ? BTM_BLE_SIMULTANEOUS_HOST
+            : 0;
+    futures[(*count)++] =
+        SEND_COMMAND(packet_factory->make_ble_write_host_support(
+            BTM_BLE_HOST_SUPPORT, simultaneous_le_host));
+  }
+
+#if (SC_MODE_INCLUDED == TRUE)
+  secure_connections_supported =
+      HCI_SC_CTRLR_SUPPORTED(features_classic[2].as_array);
+  if (secure_connections_supported) {
+    futures[(*count)++] =
+        SEND_COMMAND(packet_factory->make_write_secure_connections_host_support(
+            HCI_SC_MODE_ENABLED));
+  }
+#endif
+
+  ble_supported = last_features_classic_page_index >= 1 &&
+                  HCI_LE_HOST_SUPPORTED(features_classic[1].as_array);
+}
+
+// Module lifecycle functions
+
+static future_t* start_up(void) {
+  uint64_t start_time_us = bluetooth::common::time_get_os_boottime_us();
+
+  // Send the initial reset command
+  BT_HDR* response = AWAIT_COMMAND(packet_factory->make_reset());
+  packet_parser->parse_generic_command_complete(response);
+
+  // Tell the controller about our buffer sizes and buffer counts, and read
+  // the local version info and the bluetooth address, which identify the
+  // controller and its firmware
+  // TODO(zachoverflow): factor this out. eww l2cap contamination. And why just
+  // a hardcoded 10?
+  future_t* host_buffer_size_future =
+      SEND_COMMAND(packet_factory->make_host_buffer_size(
+          L2CAP_MTU_SIZE, SCO_HOST_BUFFER_SIZE, L2CAP_HOST_FC_ACL_BUFS, 10));
+  future_t* version_future =
+      SEND_COMMAND(packet_factory->make_read_local_version_info());
+  future_t* address_future = SEND_COMMAND(packet_factory->make_read_bd_addr());
+
+  packet_parser->parse_generic_command_complete(
+      AWAIT_RESPONSE(host_buffer_size_future));
+  packet_parser->parse_read_local_version_info_response(
+      AWAIT_RESPONSE(version_future), &bt_version);
+  packet_parser->parse_read_bd_addr_response(AWAIT_RESPONSE(address_future),
+                                             &address);
+
+  // The rest of what the controller reports can only change with its
+  // firmware: reuse what was read the last time this controller started
+  controller_snapshot_t snapshot;
+  bool warm_start_up =
+      osi_property_get_bool(CONTROLLER_SNAPSHOT_PROPERTY, true) &&
+      controller_snapshot_load(CONTROLLER_SNAPSHOT_PATH, &snapshot) &&
+      controller_snapshot_matches(&snapshot, &bt_version, &address);
+
+  future_t* futures[8];
+  size_t future_count = 0;
+  if (warm_start_up) {
+    restore_snapshot(snapshot);
+    write_host_support(futures, &future_count);
+  } else {
+    read_capabilities();
+  }
+
+  // Set the event masks last
+  if (ble_supported) {
+    futures[future_count++] =
+        SEND_COMMAND(packet_factory->make_ble_set_event_mask(&BLE_EVENT_MASK));
+  }
+  if (simple_pairing_supported) {
+    futures[future_count++] =
+        SEND_COMMAND(packet_factory->make_set_event_mask(&CLASSIC_EVENT_MASK));
+  }
+  for (size_t i = 0; i < future_count; i++) {
+    packet_parser->parse_generic_command_complete(AWAIT_RESPONSE(futures[i]));
   }
 
   if (!HCI_READ_ENCR_KEY_SIZE_SUPPORTED(supported_commands)) {
     LOG(FATAL) << " Controller must support Read Encryption Key Size command";
   }
 
+  if (!warm_start_up) {
+    take_snapshot(&snapshot);
+    if (!controller_snapshot_save(CONTROLLER_SNAPSHOT_PATH, &snapshot)) {
+      LOG_WARN("%s: unable to save the controller snapshot", __func__);
+    }
+  }
+
+  uint64_t duration_us =
+      bluetooth::common::time_get_os_boottime_us() - start_time_us;
+  std::unique_lock<std::mutex> lock(start_up_stats_mutex);
+  start_up_stats.last_duration_us = duration_us;
+  start_up_stats.last_start_up_warm = warm_start_up;
+  if (warm_start_up) {
+    start_up_stats.warm_count++;
+    start_up_stats.warm_total_us += duration_us;
+  } else {
+    start_up_stats.cold_count++;
+    start_up_stats.cold_total_us += duration_us;
+  }
+  lock.unlock();
+  LOG_INFO("%s: %s start up in %llu us", __func__,
+           warm_start_up ? "warm" : "cold", (unsigned long long)duration_us);
+
   readable = true;
   return future_new_immediate(FUTURE_SUCCESS);
 }
@@ -606,6 +852,32 @@ const controller_t* controller_get_interface() {
   }
 }
 
+void controller_debug_dump(int fd) {
+  dprintf(fd, "\nBluetooth Controller Start Up:\n");
+
+  std::lock_guard<std::mutex> lock(start_up_stats_mutex);
+  if (start_up_stats.warm_count + start_up_stats.cold_count == 0) {
+    dprintf(fd, "  None\n");
+    return;
+  }
+
+  dprintf(fd, "  Last start up : %s in %llu us\n",
+          start_up_stats.last_start_up_warm ? "warm" : "cold",
+          (unsigned long long)start_up_stats.last_duration_us);
+  dprintf(fd, "  Warm start ups (count/average us) : %zu / %llu\n",
+          start_up_stats.warm_count,
+          (unsigned long long)(start_up_stats.warm_count == 0
+                                   ? 0
+                                   : start_up_stats.warm_total_us /
+                                         start_up_stats.warm_count));
+  dprintf(fd, "  Cold start ups (count/average us) : %zu / %llu\n",
+          start_up_stats.cold_count,
+          (unsigned long long)(start_up_stats.cold_count == 0
+                                   ? 0
+                                   : start_up_stats.cold_total_us /
+                                         start_up_stats.cold_count));
+}
+
 const controller_t* controller_get_test_interface(
     const hci_t* hci_interface,
     const hci_packet_factory_t* packet_factory_interface,
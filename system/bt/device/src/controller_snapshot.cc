@@ -0,0 +1,243 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_controller_snapshot"
+
+#include "device/include/controller_snapshot.h"
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "osi/include/config.h"
+#include "osi/include/log.h"
+
+// Bumped whenever fields are added or change meaning, so that snapshots saved
+// by another version of the stack are read again from the controller
+static const int SNAPSHOT_FORMAT_VERSION = 1;
+
+static const char SNAPSHOT_SECTION[] = "Controller";
+
+static void set_uint(config_t* config, const char* key, uint64_t value) {
+  config_set_uint64(config, SNAPSHOT_SECTION, key, value);
+}
+
+// Reads an integer, which must fit in |*value|
+template <typename T>
+static bool get_uint(const config_t& config, const char* key, T* value) {
+  if (!config_has_key(config, SNAPSHOT_SECTION, key)) return false;
+
+  uint64_t read = config_get_uint64(config, SNAPSHOT_SECTION, key,
+                                    std::numeric_limits<uint64_t>::max());
+  if (read > std::numeric_limits<T>::max()) return false;
+  *value = static_cast<T>(read);
+  return true;
+}
+
+static void set_bytes(config_t* config, const char* key, const uint8_t* data,
+                      size_t size) {
+  config_set_string(config, SNAPSHOT_SECTION, key,
+                    base::HexEncode(data, size));
+}
+
+// Reads exactly |size| bytes
+static bool get_bytes(const config_t& config, const char* key, uint8_t* data,
+                      size_t size) {
+  const std::string* value =
+      config_get_string(config, SNAPSHOT_SECTION, key, nullptr);
+  std::vector<uint8_t> bytes;
+  if (value == nullptr || !base::HexStringToBytes(*value, &bytes) ||
+      bytes.size() != size) {
+    return false;
+  }
+  memcpy(data, bytes.data(), size);
+  return true;
+}
+
+bool controller_snapshot_load(const char* path,
+                              controller_snapshot_t* snapshot) {
+  CHECK(path != nullptr);
+  CHECK(snapshot != nullptr);
+
+  // Not an error: nothing was saved yet
+  if (access(path, F_OK) != 0) return false;
+
+  std::unique_ptr<config_t> config = config_new(path);
+  if (!config) return false;
+
+  if (config_get_int(*config, SNAPSHOT_SECTION, "FormatVersion", 0) !=
+      SNAPSHOT_FORMAT_VERSION) {
+    LOG_INFO("%s: ignoring snapshot saved in another format", __func__);
+    return false;
+  }
+
+  controller_snapshot_t loaded = {};
+  const std::string* address =
+      config_get_string(*config, SNAPSHOT_SECTION, "Address", nullptr);
+  bool parsed =
+      address != nullptr && RawAddress::FromString(*address, loaded.address);
+
+  bt_version_t* version = &loaded.bt_version;
+  parsed = parsed && get_uint(*config, "HciVersion", &version->hci_version) &&
+           get_uint(*config, "HciRevision", &version->hci_revision) &&
+           get_uint(*config, "LmpVersion", &version->lmp_version) &&
+           get_uint(*config, "Manufacturer", &version->manufacturer) &&
+           get_uint(*config, "LmpSubversion", &version->lmp_subversion);
+
+  parsed =
+      parsed &&
+      get_uint(*config, "AclDataSizeClassic", &loaded.acl_data_size_classic) &&
+      get_uint(*config, "AclBufferCountClassic",
+               &loaded.acl_buffer_count_classic) &&
+      get_bytes(*config, "SupportedCommands", loaded.supported_commands,
+                sizeof(loaded.supported_commands)) &&
+      get_bytes(*config, "FeaturesClassic",
+                loaded.features_classic[0].as_array,
+                sizeof(loaded.features_classic)) &&
+      get_uint(*config, "LastFeaturesClassicPageIndex",
+               &loaded.last_features_classic_page_index) &&
+      loaded.last_features_classic_page_index <
+          MAX_FEATURES_CLASSIC_PAGE_COUNT;
+
+  parsed =
+      parsed &&
+      get_uint(*config, "AclDataSizeBle", &loaded.acl_data_size_ble) &&
+      get_uint(*config, "AclBufferCountBle", &loaded.acl_buffer_count_ble) &&
+      get_uint(*config, "BleWhiteListSize", &loaded.ble_white_list_size) &&
+      get_uint(*config, "BleResolvingListMaxSize",
+               &loaded.ble_resolving_list_max_size) &&
+      get_bytes(*config, "BleSupportedStates", loaded.ble_supported_states,
+                sizeof(loaded.ble_supported_states)) &&
+      get_bytes(*config, "FeaturesBle", loaded.features_ble.as_array,
+                sizeof(loaded.features_ble.as_array)) &&
+      get_uint(*config, "BleSuggestedDefaultDataLength",
+               &loaded.ble_suggested_default_data_length) &&
+      get_uint(*config, "BleSupportedMaxTxOctets",
+               &loaded.ble_supported_max_tx_octets) &&
+      get_uint(*config, "BleSupportedMaxTxTime",
+               &loaded.ble_supported_max_tx_time) &&
+      get_uint(*config, "BleSupportedMaxRxOctets",
+               &loaded.ble_supported_max_rx_octets) &&
+      get_uint(*config, "BleSupportedMaxRxTime",
+               &loaded.ble_supported_max_rx_time) &&
+      get_uint(*config, "BleMaximumAdvertisingDataLength",
+               &loaded.ble_maximum_advertising_data_length) &&
+      get_uint(*config, "BleNumberOfSupportedAdvertisingSets",
+               &loaded.ble_number_of_supported_advertising_sets);
+
+  parsed = parsed &&
+           get_bytes(*config, "LocalSupportedCodecs",
+                     loaded.local_supported_codecs,
+                     sizeof(loaded.local_supported_codecs)) &&
+           get_uint(*config, "NumberOfLocalSupportedCodecs",
+                    &loaded.number_of_local_supported_codecs) &&
+           loaded.number_of_local_supported_codecs <=
+               MAX_LOCAL_SUPPORTED_CODECS_SIZE;
+
+  if (!parsed) {
+    LOG_WARN("%s: ignoring malformed snapshot %s", __func__, path);
+    return false;
+  }
+
+  *snapshot = loaded;
+  return true;
+}
+
+bool controller_snapshot_save(const char* path,
+                              const controller_snapshot_t* snapshot) {
+  CHECK(path != nullptr);
+  CHECK(snapshot != nullptr);
+
+  std::unique_ptr<config_t> config = config_new_empty();
+  config_set_int(config.get(), SNAPSHOT_SECTION, "FormatVersion",
+                 SNAPSHOT_FORMAT_VERSION);
+  config_set_string(config.get(), SNAPSHOT_SECTION, "Address",
+                    snapshot->address.ToString());
+
+  const bt_version_t& version = snapshot->bt_version;
+  set_uint(config.get(), "HciVersion", version.hci_version);
+  set_uint(config.get(), "HciRevision", version.hci_revision);
+  set_uint(config.get(), "LmpVersion", version.lmp_version);
+  set_uint(config.get(), "Manufacturer", version.manufacturer);
+  set_uint(config.get(), "LmpSubversion", version.lmp_subversion);
+
+  set_uint(config.get(), "AclDataSizeClassic",
+           snapshot->acl_data_size_classic);
+  set_uint(config.get(), "AclBufferCountClassic",
+           snapshot->acl_buffer_count_classic);
+  set_bytes(config.get(), "SupportedCommands", snapshot->supported_commands,
+            sizeof(snapshot->supported_commands));
+  set_bytes(config.get(), "FeaturesClassic",
+            snapshot->features_classic[0].as_array,
+            sizeof(snapshot->features_classic));
+  set_uint(config.get(), "LastFeaturesClassicPageIndex",
+           snapshot->last_features_classic_page_index);
+
+  set_uint(config.get(), "AclDataSizeBle", snapshot->acl_data_size_ble);
+  set_uint(config.get(), "AclBufferCountBle", snapshot->acl_buffer_count_ble);
+  set_uint(config.get(), "BleWhiteListSize", snapshot->ble_white_list_size);
+  set_uint(config.get(), "BleResolvingListMaxSize",
+           snapshot->ble_resolving_list_max_size);
+  set_bytes(config.get(), "BleSupportedStates", snapshot->ble_supported_states,
+            sizeof(snapshot->ble_supported_states));
+  set_bytes(config.get(), "FeaturesBle", snapshot->features_ble.as_array,
+            sizeof(snapshot->features_ble.as_array));
+  set_uint(config.get(), "BleSuggestedDefaultDataLength",
+           snapshot->ble_suggested_default_data_length);
+  set_uint(config.get(), "BleSupportedMaxTxOctets",
+           snapshot->ble_supported_max_tx_octets);
+  set_uint(config.get(), "BleSupportedMaxTxTime",
+           snapshot->ble_supported_max_tx_time);
+  set_uint(config.get(), "BleSupportedMaxRxOctets",
+           snapshot->ble_supported_max_rx_octets);
+  set_uint(config.get(), "BleSupportedMaxRxTime",
+           snapshot->ble_supported_max_rx_time);
+  set_uint(config.get(), "BleMaximumAdvertisingDataLength",
+           snapshot->ble_maximum_advertising_data_length);
+  set_uint(config.get(), "BleNumberOfSupportedAdvertisingSets",
+           snapshot->ble_number_of_supported_advertising_sets);
+
+  set_bytes(config.get(), "LocalSupportedCodecs",
+            snapshot->local_supported_codecs,
+            sizeof(snapshot->local_supported_codecs));
+  set_uint(config.get(), "NumberOfLocalSupportedCodecs",
+           snapshot->number_of_local_supported_codecs);
+
+  return config_save(*config, path);
+}
+
+bool controller_snapshot_matches(const controller_snapshot_t* snapshot,
+                                 const bt_version_t* bt_version,
+                                 const RawAddress* address) {
+  CHECK(snapshot != nullptr);
+  CHECK(bt_version != nullptr);
+  CHECK(address != nullptr);
+
+  const bt_version_t& saved = snapshot->bt_version;
+  return saved.hci_version == bt_version->hci_version &&
+         saved.hci_revision == bt_version->hci_revision &&
+         saved.lmp_version == bt_version->lmp_version &&
+         saved.manufacturer == bt_version->manufacturer &&
+         saved.lmp_subversion == bt_version->lmp_subversion &&
+         snapshot->address == *address;
+}
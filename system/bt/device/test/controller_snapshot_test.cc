@@ -0,0 +1,147 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "device/include/controller_snapshot.h"
+
+static const char SNAPSHOT_PATH[] = "/tmp/bt_controller_snapshot_test.conf";
+
+class ControllerSnapshotTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    unlink(SNAPSHOT_PATH);
+
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.bt_version.hci_version = 9;
+    snapshot.bt_version.hci_revision = 0x1234;
+    snapshot.bt_version.lmp_version = 9;
+    snapshot.bt_version.manufacturer = 0x000f;
+    snapshot.bt_version.lmp_subversion = 0x4321;
+    RawAddress::FromString("38:2c:4a:e6:67:89", snapshot.address);
+    snapshot.acl_data_size_classic = 1021;
+    snapshot.acl_buffer_count_classic = 8;
+    for (size_t i = 0; i < sizeof(snapshot.supported_commands); i++) {
+      snapshot.supported_commands[i] = i * 3;
+    }
+    snapshot.features_classic[0].as_array[0] = 0xff;
+    snapshot.features_classic[2].as_array[7] = 0x80;
+    snapshot.last_features_classic_page_index = 2;
+    snapshot.acl_data_size_ble = 251;
+    snapshot.acl_buffer_count_ble = 15;
+    snapshot.ble_white_list_size = 128;
+    snapshot.ble_resolving_list_max_size = 64;
+    snapshot.ble_supported_states[5] = 0x3f;
+    snapshot.features_ble.as_array[1] = 0x7a;
+    snapshot.ble_suggested_default_data_length = 27;
+    snapshot.ble_supported_max_tx_octets = 251;
+    snapshot.ble_supported_max_tx_time = 17040;
+    snapshot.ble_supported_max_rx_octets = 251;
+    snapshot.ble_supported_max_rx_time = 17040;
+    snapshot.ble_maximum_advertising_data_length = 1650;
+    snapshot.ble_number_of_supported_advertising_sets = 16;
+    snapshot.local_supported_codecs[0] = 0x02;
+    snapshot.local_supported_codecs[1] = 0x05;
+    snapshot.number_of_local_supported_codecs = 2;
+  }
+
+  void TearDown() override { unlink(SNAPSHOT_PATH); }
+
+  controller_snapshot_t snapshot;
+};
+
+TEST_F(ControllerSnapshotTest, test_load_missing) {
+  controller_snapshot_t loaded;
+  EXPECT_FALSE(controller_snapshot_load(SNAPSHOT_PATH, &loaded));
+}
+
+TEST_F(ControllerSnapshotTest, test_save_and_load) {
+  ASSERT_TRUE(controller_snapshot_save(SNAPSHOT_PATH, &snapshot));
+
+  controller_snapshot_t loaded;
+  memset(&loaded, 0xa5, sizeof(loaded));
+  ASSERT_TRUE(controller_snapshot_load(SNAPSHOT_PATH, &loaded));
+  EXPECT_TRUE(controller_snapshot_matches(&loaded, &snapshot.bt_version,
+                                          &snapshot.address));
+  EXPECT_EQ(snapshot.acl_data_size_classic, loaded.acl_data_size_classic);
+  EXPECT_EQ(0, memcmp(snapshot.supported_commands, loaded.supported_commands,
+                      sizeof(snapshot.supported_commands)));
+  EXPECT_EQ(0, memcmp(snapshot.features_classic, loaded.features_classic,
+                      sizeof(snapshot.features_classic)));
+  EXPECT_EQ(2, loaded.last_features_classic_page_index);
+  EXPECT_EQ(0, memcmp(snapshot.ble_supported_states,
+                      loaded.ble_supported_states,
+                      sizeof(snapshot.ble_supported_states)));
+  EXPECT_EQ(0, memcmp(&snapshot.features_ble, &loaded.features_ble,
+                      sizeof(snapshot.features_ble)));
+  EXPECT_EQ(17040, loaded.ble_supported_max_rx_time);
+  EXPECT_EQ(1650, loaded.ble_maximum_advertising_data_length);
+  EXPECT_EQ(16, loaded.ble_number_of_supported_advertising_sets);
+  EXPECT_EQ(2, loaded.number_of_local_supported_codecs);
+  EXPECT_EQ(0x05, loaded.local_supported_codecs[1]);
+}
+
+TEST_F(ControllerSnapshotTest, test_matches) {
+  bt_version_t version = snapshot.bt_version;
+  RawAddress address = snapshot.address;
+  EXPECT_TRUE(controller_snapshot_matches(&snapshot, &version, &address));
+
+  // New firmware
+  version.lmp_subversion++;
+  EXPECT_FALSE(controller_snapshot_matches(&snapshot, &version, &address));
+
+  // Another controller
+  version = snapshot.bt_version;
+  RawAddress::FromString("38:2c:4a:e6:67:8a", address);
+  EXPECT_FALSE(controller_snapshot_matches(&snapshot, &version, &address));
+}
+
+TEST_F(ControllerSnapshotTest, test_load_ignores_other_format) {
+  FILE* file = fopen(SNAPSHOT_PATH, "w");
+  ASSERT_TRUE(file != NULL);
+  fputs("[Controller]\nFormatVersion = 0\nAddress = 38:2c:4a:e6:67:89\n", file);
+  fclose(file);
+
+  controller_snapshot_t loaded;
+  EXPECT_FALSE(controller_snapshot_load(SNAPSHOT_PATH, &loaded));
+}
+
+TEST_F(ControllerSnapshotTest, test_load_ignores_malformed) {
+  ASSERT_TRUE(controller_snapshot_save(SNAPSHOT_PATH, &snapshot));
+
+  // Truncate the supported commands
+  FILE* file = fopen(SNAPSHOT_PATH, "a");
+  ASSERT_TRUE(file != NULL);
+  fputs("SupportedCommands = 0011\n", file);
+  fclose(file);
+
+  controller_snapshot_t loaded;
+  EXPECT_FALSE(controller_snapshot_load(SNAPSHOT_PATH, &loaded));
+}
+
+TEST_F(ControllerSnapshotTest, test_load_ignores_out_of_range_feature_page) {
+  snapshot.last_features_classic_page_index = MAX_FEATURES_CLASSIC_PAGE_COUNT;
+  ASSERT_TRUE(controller_snapshot_save(SNAPSHOT_PATH, &snapshot));
+
+  controller_snapshot_t loaded;
+  EXPECT_FALSE(controller_snapshot_load(SNAPSHOT_PATH, &loaded));
+}
@@ -137,6 +137,21 @@ g722_encode_state_t *g722_encode_init(g722_encode_state_t *s, unsigned int rate,
 int g722_encode_release(g722_encode_state_t *s);
 int g722_encode(g722_encode_state_t *s, uint8_t g722_data[], const int16_t amp[], int len);
 
+/*! Encode several independent streams of len samples each, such as the two
+    ears of one or more binaural hearing aid sets, in one interleaved pass.
+    The transmit QMF runs on whole blocks of samples, and the ADPCM stages of
+    the streams are interleaved sample by sample. The output of each stream
+    is bit exact with g722_encode() on the same state.
+    \param s The encoder states, one per stream.
+    \param g722_data The output buffers, one per stream.
+    \param amp The input buffers of len samples, one per stream.
+    \param streams The number of streams.
+    \param len The number of samples in each input buffer, which must be even.
+    \return The number of G.722 bytes produced for each stream, the same as
+            g722_encode() returns, or -1 if the streams are not all in the same
+            ITU test mode. */
+int g722_encode_multi(g722_encode_state_t *s[], uint8_t *g722_data[], const int16_t *amp[], int streams, int len);
+
 g722_decode_state_t *g722_decode_init(g722_decode_state_t *s, unsigned int rate, int options);
 int g722_decode_release(g722_decode_state_t *s);
 uint32_t g722_decode(g722_decode_state_t *s, int16_t amp[], const uint8_t g722_data[], int len, uint16_t aGain);
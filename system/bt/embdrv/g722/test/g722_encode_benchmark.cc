@@ -0,0 +1,182 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+// Benchmark of the G.722 encoding done for hearing aids, for one or more
+// binaural sets streaming at once.
+//
+// BM_G722EncodeReference encodes each ear on its own with g722_encode(), the
+// way the hearing aid stack used to. BM_G722EncodeMulti encodes all the ears
+// in one g722_encode_multi() call. Both encode one second of 16kHz audio per
+// ear and per iteration, in 10ms frames, and report the process CPU time
+// spent per second of audio. Before measuring, the output of
+// g722_encode_multi() is checked to be bit exact with g722_encode().
+
+#include <benchmark/benchmark.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "embdrv/g722/g722_enc_dec.h"
+
+namespace {
+
+constexpr int kSampleRate = 16000;
+// Samples in the 10ms frames the hearing aid stack encodes
+constexpr int kFrameSamples = 160;
+// Two ears for each of up to 8 binaural sets
+constexpr int kMaxEars = 16;
+
+int64_t now_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// One second of a distinct test signal per ear: a tone sweeping through the
+// band, with noise, and clipped half of the time to reach the saturation
+// paths of the encoder.
+std::vector<std::vector<int16_t>> make_signals(int ears) {
+  std::vector<std::vector<int16_t>> signals(ears);
+  uint32_t seed = 1;
+  for (int ear = 0; ear < ears; ear++) {
+    signals[ear].resize(kSampleRate);
+    double phase = 0;
+    for (int i = 0; i < kSampleRate; i++) {
+      phase += M_PI * (50.0 + 7950.0 * i / kSampleRate) / kSampleRate *
+               (1 + ear * 0.1);
+      seed = seed * 1103515245 + 12345;
+      double sample =
+          20000 * sin(phase) + (int16_t)(seed >> 16) / 8 * (ear % 3 + 1);
+      if ((i / 2000) % 2 == 1) sample *= 4;
+      if (sample > INT16_MAX) sample = INT16_MAX;
+      if (sample < INT16_MIN) sample = INT16_MIN;
+      signals[ear][i] = (int16_t)sample;
+    }
+  }
+  return signals;
+}
+
+class Encoders {
+ public:
+  explicit Encoders(int ears) : states_(ears) {
+    for (auto& state : states_) g722_encode_init(&state, 64000, G722_PACKED);
+  }
+
+  g722_encode_state_t* get(int ear) { return &states_[ear]; }
+
+ private:
+  std::vector<g722_encode_state_t> states_;
+};
+
+void encode_reference(Encoders* encoders,
+                      const std::vector<std::vector<int16_t>>& signals,
+                      int offset, std::vector<std::vector<uint8_t>>* out) {
+  for (size_t ear = 0; ear < signals.size(); ear++) {
+    g722_encode(encoders->get(ear), (*out)[ear].data() + offset / 2,
+                signals[ear].data() + offset, kFrameSamples);
+  }
+}
+
+void encode_multi(Encoders* encoders,
+                  const std::vector<std::vector<int16_t>>& signals, int offset,
+                  std::vector<std::vector<uint8_t>>* out) {
+  g722_encode_state_t* states[kMaxEars];
+  uint8_t* outputs[kMaxEars];
+  const int16_t* inputs[kMaxEars];
+  int ears = signals.size();
+  for (int ear = 0; ear < ears; ear++) {
+    states[ear] = encoders->get(ear);
+    outputs[ear] = (*out)[ear].data() + offset / 2;
+    inputs[ear] = signals[ear].data() + offset;
+  }
+  g722_encode_multi(states, outputs, inputs, ears, kFrameSamples);
+}
+
+using EncodeFunction = void (*)(Encoders*,
+                                const std::vector<std::vector<int16_t>>&, int,
+                                std::vector<std::vector<uint8_t>>*);
+
+void encode_second(EncodeFunction encode, Encoders* encoders,
+                   const std::vector<std::vector<int16_t>>& signals,
+                   std::vector<std::vector<uint8_t>>* out) {
+  for (int offset = 0; offset < kSampleRate; offset += kFrameSamples) {
+    encode(encoders, signals, offset, out);
+  }
+}
+
+bool is_bit_exact(const std::vector<std::vector<int16_t>>& signals) {
+  int ears = signals.size();
+  Encoders reference_encoders(ears);
+  Encoders multi_encoders(ears);
+  std::vector<std::vector<uint8_t>> reference(
+      ears, std::vector<uint8_t>(kSampleRate / 2));
+  std::vector<std::vector<uint8_t>> multi(
+      ears, std::vector<uint8_t>(kSampleRate / 2));
+
+  // Two seconds, so that the encoder states carry over
+  for (int i = 0; i < 2; i++) {
+    encode_second(encode_reference, &reference_encoders, signals, &reference);
+    encode_second(encode_multi, &multi_encoders, signals, &multi);
+    if (reference != multi) return false;
+  }
+  return memcmp(reference_encoders.get(0), multi_encoders.get(0),
+                sizeof(g722_encode_state_t)) == 0;
+}
+
+void RunEncode(benchmark::State& state, EncodeFunction encode) {
+  int ears = 2 * state.range(0);
+  std::vector<std::vector<int16_t>> signals = make_signals(ears);
+  if (!is_bit_exact(signals)) {
+    state.SkipWithError("g722_encode_multi() differs from g722_encode()");
+    return;
+  }
+
+  Encoders encoders(ears);
+  std::vector<std::vector<uint8_t>> out(ears,
+                                        std::vector<uint8_t>(kSampleRate / 2));
+  int64_t cpu_ns = 0;
+  for (auto _ : state) {
+    int64_t cpu_start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+    encode_second(encode, &encoders, signals, &out);
+    cpu_ns += now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+    benchmark::DoNotOptimize(out.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * ears * kSampleRate);
+  state.counters["cpu_us_per_audio_s"] =
+      benchmark::Counter(cpu_ns / 1000.0 / state.iterations());
+}
+
+// The argument is the number of binaural sets
+void BM_G722EncodeReference(benchmark::State& state) {
+  RunEncode(state, encode_reference);
+}
+BENCHMARK(BM_G722EncodeReference)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+void BM_G722EncodeMulti(benchmark::State& state) {
+  RunEncode(state, encode_multi);
+}
+BENCHMARK(BM_G722EncodeMulti)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+}  // namespace
+
+BENCHMARK_MAIN();
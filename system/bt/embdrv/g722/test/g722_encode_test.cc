@@ -0,0 +1,175 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "embdrv/g722/g722_enc_dec.h"
+
+namespace {
+
+constexpr int kSampleRate = 16000;
+// Samples in the 10ms frames the hearing aid stack encodes
+constexpr int kFrameSamples = 160;
+constexpr int kMaxEars = 4;
+
+// One second of a distinct test signal per ear: a tone sweeping through the
+// band, with noise, and clipped half of the time to reach the saturation
+// paths of the encoder.
+std::vector<std::vector<int16_t>> make_signals(int ears) {
+  std::vector<std::vector<int16_t>> signals(ears);
+  uint32_t seed = 1;
+  for (int ear = 0; ear < ears; ear++) {
+    signals[ear].resize(kSampleRate);
+    double phase = 0;
+    for (int i = 0; i < kSampleRate; i++) {
+      phase += M_PI * (50.0 + 7950.0 * i / kSampleRate) / kSampleRate *
+               (1 + ear * 0.1);
+      seed = seed * 1103515245 + 12345;
+      double sample =
+          20000 * sin(phase) + (int16_t)(seed >> 16) / 8 * (ear % 3 + 1);
+      if ((i / 2000) % 2 == 1) sample *= 4;
+      if (sample > INT16_MAX) sample = INT16_MAX;
+      if (sample < INT16_MIN) sample = INT16_MIN;
+      signals[ear][i] = (int16_t)sample;
+    }
+  }
+  return signals;
+}
+
+class G722EncodeMultiTest : public testing::TestWithParam<int> {
+ protected:
+  void SetUp() override {
+    ears_ = GetParam();
+    signals_ = make_signals(ears_);
+    reference_states_.resize(ears_);
+    multi_states_.resize(ears_);
+    for (int ear = 0; ear < ears_; ear++) {
+      g722_encode_init(&reference_states_[ear], 64000, G722_PACKED);
+      g722_encode_init(&multi_states_[ear], 64000, G722_PACKED);
+    }
+    reference_.assign(ears_, std::vector<uint8_t>(kSampleRate));
+    multi_.assign(ears_, std::vector<uint8_t>(kSampleRate));
+  }
+
+  // Encodes |len| samples at |offset| of every ear, with g722_encode() ear by
+  // ear and with one g722_encode_multi() call, and checks both return the
+  // same byte count.
+  void Encode(int offset, int len) {
+    g722_encode_state_t* states[kMaxEars];
+    uint8_t* outputs[kMaxEars];
+    const int16_t* inputs[kMaxEars];
+    int reference_bytes = 0;
+    for (int ear = 0; ear < ears_; ear++) {
+      reference_bytes = g722_encode(&reference_states_[ear],
+                                    reference_[ear].data() + offset / 2,
+                                    signals_[ear].data() + offset, len);
+      states[ear] = &multi_states_[ear];
+      outputs[ear] = multi_[ear].data() + offset / 2;
+      inputs[ear] = signals_[ear].data() + offset;
+    }
+    EXPECT_EQ(reference_bytes,
+              g722_encode_multi(states, outputs, inputs, ears_, len));
+  }
+
+  void ExpectBitExact() {
+    for (int ear = 0; ear < ears_; ear++) {
+      EXPECT_EQ(reference_[ear], multi_[ear]) << "ear " << ear;
+      EXPECT_EQ(0, memcmp(&reference_states_[ear], &multi_states_[ear],
+                          sizeof(g722_encode_state_t)))
+          << "ear " << ear;
+    }
+  }
+
+  int ears_;
+  std::vector<std::vector<int16_t>> signals_;
+  std::vector<g722_encode_state_t> reference_states_;
+  std::vector<g722_encode_state_t> multi_states_;
+  std::vector<std::vector<uint8_t>> reference_;
+  std::vector<std::vector<uint8_t>> multi_;
+};
+
+TEST_P(G722EncodeMultiTest, matches_g722_encode) {
+  // Two seconds, so that the encoder states carry over
+  for (int i = 0; i < 2; i++) {
+    for (int offset = 0; offset < kSampleRate; offset += kFrameSamples) {
+      Encode(offset, kFrameSamples);
+    }
+    ExpectBitExact();
+  }
+}
+
+TEST_P(G722EncodeMultiTest, matches_g722_encode_with_uneven_frames) {
+  // Frames that are not a multiple of the blocks the transmit QMF runs on
+  const int frame_lengths[] = {2, 34, 66, 98, 256, 4};
+  int offset = 0;
+  for (int i = 0; offset < kSampleRate; i++) {
+    int len = frame_lengths[i % 6];
+    if (offset + len > kSampleRate) len = kSampleRate - offset;
+    Encode(offset, len);
+    offset += len;
+  }
+  ExpectBitExact();
+}
+
+INSTANTIATE_TEST_CASE_P(Ears, G722EncodeMultiTest,
+                        testing::Range(1, kMaxEars + 1));
+
+TEST(G722EncodeMultiItuTest, itu_test_mode_matches_g722_encode) {
+  std::vector<std::vector<int16_t>> signals = make_signals(2);
+  g722_encode_state_t reference_states[2];
+  g722_encode_state_t multi_states[2];
+  std::vector<std::vector<uint8_t>> reference(
+      2, std::vector<uint8_t>(kSampleRate));
+  std::vector<std::vector<uint8_t>> multi(2,
+                                          std::vector<uint8_t>(kSampleRate));
+  g722_encode_state_t* states[2];
+  uint8_t* outputs[2];
+  const int16_t* inputs[2];
+  int reference_bytes = 0;
+  for (int ear = 0; ear < 2; ear++) {
+    g722_encode_init(&reference_states[ear], 64000, G722_PACKED);
+    g722_encode_init(&multi_states[ear], 64000, G722_PACKED);
+    reference_states[ear].itu_test_mode = true;
+    multi_states[ear].itu_test_mode = true;
+    reference_bytes =
+        g722_encode(&reference_states[ear], reference[ear].data(),
+                    signals[ear].data(), kFrameSamples);
+    states[ear] = &multi_states[ear];
+    outputs[ear] = multi[ear].data();
+    inputs[ear] = signals[ear].data();
+  }
+
+  // A code per sample, as g722_encode() returns
+  EXPECT_EQ(kFrameSamples, reference_bytes);
+  EXPECT_EQ(reference_bytes,
+            g722_encode_multi(states, outputs, inputs, 2, kFrameSamples));
+  EXPECT_EQ(reference, multi);
+  EXPECT_EQ(0, memcmp(reference_states, multi_states, sizeof(multi_states)));
+
+  // Streams in different modes cannot share a byte count
+  multi_states[1].itu_test_mode = false;
+  EXPECT_EQ(-1, g722_encode_multi(states, outputs, inputs, 2, kFrameSamples));
+}
+
+}  // namespace
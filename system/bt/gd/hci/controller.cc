@@ -60,8 +60,9 @@ struct Controller::impl {
     hci_->EnqueueCommand(ReadLocalExtendedFeaturesBuilder::Create(0x00),
                          handler->BindOnceOn(this, &Controller::impl::read_local_extended_features_complete_handler,
                                              std::move(features_promise)));
-    features_future.wait();
 
+    // Reads which don't depend on the supported commands are queued before waiting, so that the controller keeps
+    // executing commands while the extended feature pages are read
     hci_->EnqueueCommand(ReadBufferSizeBuilder::Create(),
                          handler->BindOnceOn(this, &Controller::impl::read_buffer_size_complete_handler));
 
@@ -74,6 +75,11 @@ struct Controller::impl {
     hci_->EnqueueCommand(LeReadSupportedStatesBuilder::Create(),
                          handler->BindOnceOn(this, &Controller::impl::le_read_supported_states_handler));
 
+    hci_->EnqueueCommand(LeGetVendorCapabilitiesBuilder::Create(),
+                         handler->BindOnceOn(this, &Controller::impl::le_get_vendor_capabilities_handler));
+
+    features_future.wait();
+
     if (is_supported(OpCode::LE_READ_MAXIMUM_DATA_LENGTH)) {
       hci_->EnqueueCommand(LeReadMaximumDataLengthBuilder::Create(),
                            handler->BindOnceOn(this, &Controller::impl::le_read_maximum_data_length_handler));
@@ -89,9 +95,6 @@ struct Controller::impl {
           handler->BindOnceOn(this, &Controller::impl::le_read_number_of_supported_advertising_sets_handler));
     }
 
-    hci_->EnqueueCommand(LeGetVendorCapabilitiesBuilder::Create(),
-                         handler->BindOnceOn(this, &Controller::impl::le_get_vendor_capabilities_handler));
-
     // We only need to synchronize the last read. Make BD_ADDR to be the last one.
     std::promise<void> promise;
     auto future = promise.get_future();
@@ -16,6 +16,9 @@
 
 #include "hci/hci_layer.h"
 
+#include <algorithm>
+#include <array>
+
 #include "common/bind.h"
 #include "os/alarm.h"
 #include "os/queue.h"
@@ -63,24 +66,12 @@ class CommandQueueEntry {
       : command(move(command_packet)), waiting_for_status_(true), on_status(move(on_status_function)) {}
 
   unique_ptr<CommandPacketBuilder> command;
+  OpCode op_code{OpCode::NONE};  // Known once the command is sent
   bool waiting_for_status_;
   ContextualOnceCallback<void(CommandStatusView)> on_status;
   ContextualOnceCallback<void(CommandCompleteView)> on_complete;
-
-  template <typename TView>
-  ContextualOnceCallback<void(TView)>* GetCallback() {
-    return nullptr;
-  }
-
-  template <>
-  ContextualOnceCallback<void(CommandStatusView)>* GetCallback<CommandStatusView>() {
-    return &on_status;
-  }
-
-  template <>
-  ContextualOnceCallback<void(CommandCompleteView)>* GetCallback<CommandCompleteView>() {
-    return &on_complete;
-  }
+  // Response received ahead of an older outstanding command, held until that one completes
+  unique_ptr<EventPacketView> response;
 };
 
 struct HciLayer::impl {
@@ -92,15 +83,15 @@ struct HciLayer::impl {
     incoming_acl_buffer_.Clear();
     delete hci_timeout_alarm_;
     command_queue_.clear();
+    sent_commands_.clear();
   }
 
   void drop(EventPacketView) {}
 
   void on_outbound_acl_ready() {
     auto packet = acl_queue_.GetDownEnd()->TryDequeue();
-    std::vector<uint8_t> bytes;
-    BitInserter bi(bytes);
-    packet->Serialize(bi);
+    std::vector<uint8_t> bytes(packet->size());
+    packet->SerializeTo(bytes.data(), bytes.size());
     hal_->sendAclData(bytes);
   }
 
@@ -130,80 +121,115 @@ struct HciLayer::impl {
     }
     bool is_status = logging_id == "status";
 
-    ASSERT_LOG(!command_queue_.empty(), "Unexpected %s event with OpCode 0x%02hx (%s)", logging_id.c_str(), op_code,
-               OpCodeText(op_code).c_str());
-    ASSERT_LOG(waiting_command_ == op_code, "Waiting for 0x%02hx (%s), got 0x%02hx (%s)", waiting_command_,
-               OpCodeText(waiting_command_).c_str(), op_code, OpCodeText(op_code).c_str());
-    ASSERT_LOG(command_queue_.front().waiting_for_status_ == is_status, "0x%02hx (%s) was not expecting %s event",
-               op_code, OpCodeText(op_code).c_str(), logging_id.c_str());
-
-    command_queue_.front().GetCallback<TResponse>()->Invoke(move(response_view));
-    command_queue_.pop_front();
-    waiting_command_ = OpCode::NONE;
-    hci_timeout_alarm_->Cancel();
+    // Match the oldest outstanding command with this opcode
+    auto entry = std::find_if(sent_commands_.begin(), sent_commands_.end(), [op_code](const CommandQueueEntry& sent) {
+      return sent.op_code == op_code && sent.response == nullptr;
+    });
+    ASSERT_LOG(entry != sent_commands_.end(), "Unexpected %s event with OpCode 0x%02hx (%s)", logging_id.c_str(),
+               op_code, OpCodeText(op_code).c_str());
+    ASSERT_LOG(entry->waiting_for_status_ == is_status, "0x%02hx (%s) was not expecting %s event", op_code,
+               OpCodeText(op_code).c_str(), logging_id.c_str());
+    entry->response = std::make_unique<EventPacketView>(event);
+    if (op_code == OpCode::RESET) {
+      reset_outstanding_ = false;
+    }
+
+    // Responses are delivered in the order the commands were sent, so callers can still rely on the last completion
+    // of a sequence meaning the whole sequence is done.
+    bool progressed = false;
+    while (!sent_commands_.empty() && sent_commands_.front().response != nullptr) {
+      CommandQueueEntry& done = sent_commands_.front();
+      if (done.waiting_for_status_) {
+        done.on_status.Invoke(CommandStatusView::Create(*done.response));
+      } else {
+        done.on_complete.Invoke(CommandCompleteView::Create(*done.response));
+      }
+      sent_commands_.pop_front();
+      progressed = true;
+    }
+    if (progressed) {
+      hci_timeout_alarm_->Cancel();
+      if (!sent_commands_.empty()) {
+        schedule_timeout(sent_commands_.front().op_code);
+      }
+    }
     send_next_command();
   }
 
   void send_next_command() {
-    if (command_credits_ == 0) {
-      return;
-    }
-    if (waiting_command_ != OpCode::NONE) {
-      return;
+    while (command_credits_ > 0 && !command_queue_.empty() && !reset_outstanding_) {
+      auto& command = command_queue_.front().command;
+      auto bytes = std::make_shared<std::vector<uint8_t>>(command->size());
+      command->SerializeTo(bytes->data(), bytes->size());
+
+      auto cmd_view = CommandPacketView::Create(bytes);
+      ASSERT(cmd_view.IsValid());
+      OpCode op_code = cmd_view.GetOpCode();
+      // Reset discards whatever the controller is working on, let everything in flight finish first
+      if (op_code == OpCode::RESET && !sent_commands_.empty()) {
+        return;
+      }
+
+      hal_->sendHciCommand(*bytes);
+      command_credits_--;
+      if (op_code == OpCode::RESET) {
+        reset_outstanding_ = true;
+      }
+
+      command_queue_.front().op_code = op_code;
+      command_queue_.front().command.reset();
+      sent_commands_.splice(sent_commands_.end(), command_queue_, command_queue_.begin());
+      if (sent_commands_.size() == 1) {
+        schedule_timeout(op_code);
+      }
     }
-    if (command_queue_.size() == 0) {
-      return;
-    }
-    std::shared_ptr<std::vector<uint8_t>> bytes = std::make_shared<std::vector<uint8_t>>();
-    BitInserter bi(*bytes);
-    command_queue_.front().command->Serialize(bi);
-    hal_->sendHciCommand(*bytes);
-
-    auto cmd_view = CommandPacketView::Create(bytes);
-    ASSERT(cmd_view.IsValid());
-    OpCode op_code = cmd_view.GetOpCode();
-    waiting_command_ = op_code;
-    command_credits_ = 0;  // Only allow one outstanding command
+  }
+
+  void schedule_timeout(OpCode op_code) {
     hci_timeout_alarm_->Schedule(BindOnce(&on_hci_timeout, op_code), kHciTimeoutMs);
   }
 
   void register_event(EventCode event, ContextualCallback<void(EventPacketView)> handler) {
-    ASSERT_LOG(event_handlers_.count(event) == 0, "Can not register a second handler for %02hhx (%s)", event,
+    auto& registered = event_handlers_[static_cast<uint8_t>(event)];
+    ASSERT_LOG(registered.IsEmpty(), "Can not register a second handler for %02hhx (%s)", event,
                EventCodeText(event).c_str());
-    event_handlers_[event] = handler;
+    registered = handler;
   }
 
   void unregister_event(EventCode event) {
-    event_handlers_.erase(event_handlers_.find(event));
+    event_handlers_[static_cast<uint8_t>(event)] = {};
   }
 
   void register_le_event(SubeventCode event, ContextualCallback<void(LeMetaEventView)> handler) {
-    ASSERT_LOG(subevent_handlers_.count(event) == 0, "Can not register a second handler for %02hhx (%s)", event,
+    auto& registered = subevent_handlers_[static_cast<uint8_t>(event)];
+    ASSERT_LOG(registered.IsEmpty(), "Can not register a second handler for %02hhx (%s)", event,
                SubeventCodeText(event).c_str());
-    subevent_handlers_[event] = handler;
+    registered = handler;
   }
 
   void unregister_le_event(SubeventCode event) {
-    subevent_handlers_.erase(subevent_handlers_.find(event));
+    subevent_handlers_[static_cast<uint8_t>(event)] = {};
   }
 
   void on_hci_event(EventPacketView event) {
     ASSERT(event.IsValid());
     EventCode event_code = event.GetEventCode();
-    if (event_handlers_.find(event_code) == event_handlers_.end()) {
+    auto& handler = event_handlers_[static_cast<uint8_t>(event_code)];
+    if (handler.IsEmpty()) {
       LOG_DEBUG("Dropping unregistered event of type 0x%02hhx (%s)", event_code, EventCodeText(event_code).c_str());
       return;
     }
-    event_handlers_[event_code].Invoke(event);
+    handler.Invoke(event);
   }
 
   void on_le_meta_event(EventPacketView event) {
     LeMetaEventView meta_event_view = LeMetaEventView::Create(event);
     ASSERT(meta_event_view.IsValid());
     SubeventCode subevent_code = meta_event_view.GetSubeventCode();
-    ASSERT_LOG(subevent_handlers_.find(subevent_code) != subevent_handlers_.end(),
-               "Unhandled le event of type 0x%02hhx (%s)", subevent_code, SubeventCodeText(subevent_code).c_str());
-    subevent_handlers_[subevent_code].Invoke(meta_event_view);
+    auto& handler = subevent_handlers_[static_cast<uint8_t>(subevent_code)];
+    ASSERT_LOG(!handler.IsEmpty(), "Unhandled le event of type 0x%02hhx (%s)", subevent_code,
+               SubeventCodeText(subevent_code).c_str());
+    handler.Invoke(meta_event_view);
   }
 
   hal::HciHal* hal_;
@@ -211,11 +237,14 @@ struct HciLayer::impl {
 
   // Command Handling
   std::list<CommandQueueEntry> command_queue_;
+  // Commands sent to the controller and waiting for a response, oldest first
+  std::list<CommandQueueEntry> sent_commands_;
 
-  std::map<EventCode, ContextualCallback<void(EventPacketView)>> event_handlers_;
-  std::map<SubeventCode, ContextualCallback<void(LeMetaEventView)>> subevent_handlers_;
-  OpCode waiting_command_{OpCode::NONE};
+  // Indexed by event and subevent code
+  std::array<ContextualCallback<void(EventPacketView)>, 256> event_handlers_{};
+  std::array<ContextualCallback<void(LeMetaEventView)>, 256> subevent_handlers_{};
   uint8_t command_credits_{1};  // Send reset first
+  bool reset_outstanding_{false};
   Alarm* hci_timeout_alarm_{nullptr};
 
   // Acl packets
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+
+#include "hal/hci_hal.h"
+#include "hci/controller.h"
+#include "hci/hci_layer.h"
+#include "module.h"
+#include "packet/raw_builder.h"
+
+using ::benchmark::State;
+using ::bluetooth::TestModuleRegistry;
+using ::bluetooth::hal::HciHal;
+using ::bluetooth::hal::HciHalCallbacks;
+using ::bluetooth::hal::HciPacket;
+using ::bluetooth::packet::BitInserter;
+using ::bluetooth::packet::kLittleEndian;
+using ::bluetooth::packet::PacketView;
+using namespace ::bluetooth::hci;
+
+namespace {
+
+// Answers the controller initialization sequence after a fixed latency per command, modelling the transport and
+// firmware turnaround seen with rootcanal or a real controller. Commands are answered in order.
+class FakeControllerHal : public HciHal {
+ public:
+  FakeControllerHal(uint8_t credits, std::chrono::microseconds latency) : credits_(credits), latency_(latency) {}
+
+  ~FakeControllerHal() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    cv_.notify_all();
+    responder_.join();
+  }
+
+  void registerIncomingPacketCallback(HciHalCallbacks* callbacks) override {
+    callbacks_ = callbacks;
+  }
+
+  void unregisterIncomingPacketCallback() override {
+    callbacks_ = nullptr;
+  }
+
+  void sendHciCommand(HciPacket command) override {
+    auto bytes = std::make_shared<std::vector<uint8_t>>(std::move(command));
+    CommandPacketView command_view = CommandPacketView::Create(PacketView<kLittleEndian>(bytes));
+    ASSERT(command_view.IsValid());
+    std::unique_ptr<CommandCompleteBuilder> response = CreateResponse(command_view);
+    if (response == nullptr) {
+      return;
+    }
+    HciPacket event;
+    BitInserter bi(event);
+    response->Serialize(bi);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto deadline = std::max(std::chrono::steady_clock::now() + latency_, last_deadline_);
+    last_deadline_ = deadline;
+    responses_.emplace(deadline, std::move(event));
+    cv_.notify_all();
+  }
+
+  void sendAclData(HciPacket data) override {}
+
+  void sendScoData(HciPacket data) override {}
+
+ protected:
+  void ListDependencies(::bluetooth::ModuleList* list) override {}
+  void Start() override {}
+  void Stop() override {}
+
+ private:
+  std::unique_ptr<CommandCompleteBuilder> CreateResponse(CommandPacketView command) {
+    ErrorCode success = ErrorCode::SUCCESS;
+    switch (command.GetOpCode()) {
+      case OpCode::RESET:
+        return ResetCompleteBuilder::Create(credits_, success);
+      case OpCode::SET_EVENT_MASK:
+        return SetEventMaskCompleteBuilder::Create(credits_, success);
+      case OpCode::READ_LOCAL_NAME:
+        return ReadLocalNameCompleteBuilder::Create(credits_, success, {'D', 'U', 'T', '\0'});
+      case OpCode::READ_LOCAL_VERSION_INFORMATION: {
+        LocalVersionInformation version;
+        version.hci_version_ = HciVersion::V_5_0;
+        version.lmp_version_ = LmpVersion::V_5_0;
+        return ReadLocalVersionInformationCompleteBuilder::Create(credits_, success, version);
+      }
+      case OpCode::READ_LOCAL_SUPPORTED_COMMANDS: {
+        std::array<uint8_t, 64> supported_commands{};
+        std::fill(supported_commands.begin(), supported_commands.begin() + 37, 0xff);
+        return ReadLocalSupportedCommandsCompleteBuilder::Create(credits_, success, supported_commands);
+      }
+      case OpCode::READ_LOCAL_SUPPORTED_FEATURES:
+        return ReadLocalSupportedFeaturesCompleteBuilder::Create(credits_, success, 0x875b1fd87e8fffff);
+      case OpCode::READ_LOCAL_EXTENDED_FEATURES: {
+        auto view = ReadLocalExtendedFeaturesView::Create(command);
+        ASSERT(view.IsValid());
+        return ReadLocalExtendedFeaturesCompleteBuilder::Create(credits_, success, view.GetPageNumber(), 0x02, 0);
+      }
+      case OpCode::READ_BUFFER_SIZE:
+        return ReadBufferSizeCompleteBuilder::Create(credits_, success, 1021, 60, 8, 8);
+      case OpCode::READ_BD_ADDR:
+        return ReadBdAddrCompleteBuilder::Create(credits_, success, Address::kAny);
+      case OpCode::LE_READ_BUFFER_SIZE_V1: {
+        LeBufferSize le_buffer_size;
+        le_buffer_size.le_data_packet_length_ = 251;
+        le_buffer_size.total_num_le_packets_ = 8;
+        return LeReadBufferSizeV1CompleteBuilder::Create(credits_, success, le_buffer_size);
+      }
+      case OpCode::LE_READ_LOCAL_SUPPORTED_FEATURES:
+        return LeReadLocalSupportedFeaturesCompleteBuilder::Create(credits_, success, 0x001f);
+      case OpCode::LE_READ_SUPPORTED_STATES:
+        return LeReadSupportedStatesCompleteBuilder::Create(credits_, success, 0x3ffffffffff);
+      case OpCode::LE_READ_MAXIMUM_DATA_LENGTH: {
+        LeMaximumDataLength le_maximum_data_length;
+        le_maximum_data_length.supported_max_tx_octets_ = 251;
+        le_maximum_data_length.supported_max_tx_time_ = 2120;
+        le_maximum_data_length.supported_max_rx_octets_ = 251;
+        le_maximum_data_length.supported_max_rx_time_ = 2120;
+        return LeReadMaximumDataLengthCompleteBuilder::Create(credits_, success, le_maximum_data_length);
+      }
+      case OpCode::LE_READ_MAXIMUM_ADVERTISING_DATA_LENGTH:
+        return LeReadMaximumAdvertisingDataLengthCompleteBuilder::Create(credits_, success, 1650);
+      case OpCode::LE_READ_NUMBER_OF_SUPPORTED_ADVERTISING_SETS:
+        return LeReadNumberOfSupportedAdvertisingSetsCompleteBuilder::Create(credits_, success, 16);
+      case OpCode::LE_GET_VENDOR_CAPABILITIES:
+        return LeGetVendorCapabilitiesCompleteBuilder::Create(credits_, success, {},
+                                                              std::make_unique<::bluetooth::packet::RawBuilder>());
+      default:
+        return nullptr;
+    }
+  }
+
+  void Respond() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+      if (responses_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      auto next = responses_.begin();
+      if (cv_.wait_until(lock, next->first) != std::cv_status::timeout) {
+        continue;
+      }
+      HciPacket event = std::move(next->second);
+      responses_.erase(next);
+      lock.unlock();
+      if (callbacks_ != nullptr) {
+        callbacks_->hciEventReceived(std::move(event));
+      }
+      lock.lock();
+    }
+  }
+
+  uint8_t credits_;
+  std::chrono::microseconds latency_;
+  HciHalCallbacks* callbacks_ = nullptr;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::multimap<std::chrono::steady_clock::time_point, HciPacket> responses_;
+  std::chrono::steady_clock::time_point last_deadline_;
+  bool running_ = true;
+  std::thread responder_{&FakeControllerHal::Respond, this};
+};
+
+class BM_HciLayer : public ::benchmark::Fixture {};
+
+// Time from starting the HCI layer to the Controller module having read all the controller properties
+BENCHMARK_DEFINE_F(BM_HciLayer, start_controller)(State& state) {
+  uint8_t credits = state.range(0);
+  auto latency = std::chrono::microseconds(state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto registry = std::make_unique<TestModuleRegistry>();
+    auto hal = new FakeControllerHal(credits, latency);
+    registry->InjectTestModule(&HciHal::Factory, hal);
+    state.ResumeTiming();
+
+    registry->Start<Controller>(&registry->GetTestThread());
+
+    state.PauseTiming();
+    registry->StopAll();
+    registry.reset();
+    state.ResumeTiming();
+  }
+}
+
+// {Num_HCI_Command_Packets, controller latency in us}
+BENCHMARK_REGISTER_F(BM_HciLayer, start_controller)
+    ->Args({1, 0})
+    ->Args({1, 500})
+    ->Args({4, 0})
+    ->Args({4, 500})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
@@ -311,6 +311,12 @@ class HciTest : public ::testing::Test {
     fake_registry_.StopAll();
   }
 
+  // Incoming events take two hops on the HCI handler before they are handled
+  void SyncHciHandler() {
+    ASSERT_TRUE(fake_registry_.SynchronizeModuleHandler(&HciLayer::Factory, kTimeout));
+    ASSERT_TRUE(fake_registry_.SynchronizeModuleHandler(&HciLayer::Factory, kTimeout));
+  }
+
   std::vector<uint8_t> GetPacketBytes(std::unique_ptr<packet::BasePacketBuilder> packet) {
     std::vector<uint8_t> bytes;
     BitInserter i(bytes);
@@ -496,6 +502,75 @@ TEST_F(HciTest, creditsTest) {
              .IsValid());
 }
 
+TEST_F(HciTest, pipelinedCommandsTest) {
+  ASSERT_EQ(0, hal->GetNumSentCommands());
+
+  // Hold the commands until the controller grants credits
+  uint8_t num_packets = 0;
+  hal->callbacks->hciEventReceived(GetPacketBytes(NoCommandCompleteBuilder::Create(num_packets)));
+  SyncHciHandler();
+  upper->SendHciCommandExpectingComplete(ReadLocalVersionInformationBuilder::Create());
+  upper->SendHciCommandExpectingComplete(ReadLocalSupportedCommandsBuilder::Create());
+  upper->SendHciCommandExpectingComplete(ReadLocalSupportedFeaturesBuilder::Create());
+  SyncHciHandler();
+  ASSERT_EQ(0, hal->GetNumSentCommands());
+
+  // Two credits let two commands out
+  num_packets = 2;
+  hal->callbacks->hciEventReceived(GetPacketBytes(NoCommandCompleteBuilder::Create(num_packets)));
+  SyncHciHandler();
+  ASSERT_EQ(2, hal->GetNumSentCommands());
+  ASSERT_TRUE(ReadLocalVersionInformationView::Create(CommandPacketView::Create(hal->GetSentCommand())).IsValid());
+  ASSERT_TRUE(ReadLocalSupportedCommandsView::Create(CommandPacketView::Create(hal->GetSentCommand())).IsValid());
+
+  // The second command completes first, it is held back until the first one completes
+  auto event_future = upper->GetReceivedEventFuture();
+  num_packets = 1;
+  ErrorCode error_code = ErrorCode::SUCCESS;
+  std::array<uint8_t, 64> supported_commands{};
+  hal->callbacks->hciEventReceived(
+      GetPacketBytes(ReadLocalSupportedCommandsCompleteBuilder::Create(num_packets, error_code, supported_commands)));
+  SyncHciHandler();
+  ASSERT_TRUE(fake_registry_.SynchronizeModuleHandler(&DependsOnHci::Factory, kTimeout));
+  ASSERT_EQ(event_future.wait_for(std::chrono::milliseconds(0)), std::future_status::timeout);
+
+  // The credit returned by that response sends the third command
+  ASSERT_EQ(1, hal->GetNumSentCommands());
+  ASSERT_TRUE(ReadLocalSupportedFeaturesView::Create(CommandPacketView::Create(hal->GetSentCommand())).IsValid());
+
+  LocalVersionInformation local_version_information;
+  local_version_information.hci_version_ = HciVersion::V_5_0;
+  local_version_information.hci_revision_ = 0x1234;
+  local_version_information.lmp_version_ = LmpVersion::V_4_2;
+  local_version_information.manufacturer_name_ = 0xBAD;
+  local_version_information.lmp_subversion_ = 0x5678;
+  hal->callbacks->hciEventReceived(GetPacketBytes(
+      ReadLocalVersionInformationCompleteBuilder::Create(num_packets, error_code, local_version_information)));
+  ASSERT_EQ(event_future.wait_for(kTimeout), std::future_status::ready);
+  SyncHciHandler();
+  ASSERT_TRUE(fake_registry_.SynchronizeModuleHandler(&DependsOnHci::Factory, kTimeout));
+
+  // Both completions are delivered, in the order the commands were sent
+  auto event = upper->GetReceivedEvent();
+  ASSERT_TRUE(
+      ReadLocalVersionInformationCompleteView::Create(CommandCompleteView::Create(EventPacketView::Create(event)))
+          .IsValid());
+  event = upper->GetReceivedEvent();
+  ASSERT_TRUE(
+      ReadLocalSupportedCommandsCompleteView::Create(CommandCompleteView::Create(EventPacketView::Create(event)))
+          .IsValid());
+
+  event_future = upper->GetReceivedEventFuture();
+  uint64_t lmp_features = 0x012345678abcdef;
+  hal->callbacks->hciEventReceived(
+      GetPacketBytes(ReadLocalSupportedFeaturesCompleteBuilder::Create(num_packets, error_code, lmp_features)));
+  ASSERT_EQ(event_future.wait_for(kTimeout), std::future_status::ready);
+  event = upper->GetReceivedEvent();
+  ASSERT_TRUE(
+      ReadLocalSupportedFeaturesCompleteView::Create(CommandCompleteView::Create(EventPacketView::Create(event)))
+          .IsValid());
+}
+
 TEST_F(HciTest, leSecurityInterfaceTest) {
   // Send LeRand to the controller
   auto command_future = hal->GetSentCommandFuture();
@@ -15,6 +15,12 @@
  */
 
 #include "module.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <set>
+#include <thread>
+
 #include "bluetooth/dumpmod.pb.h"
 
 using ::bluetooth::os::Handler;
@@ -24,6 +30,14 @@ namespace bluetooth {
 
 constexpr std::chrono::milliseconds kModuleStopTimeout = std::chrono::milliseconds(2000);
 
+namespace {
+
+std::chrono::microseconds ElapsedSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+}  // namespace
+
 ModuleFactory::ModuleFactory(std::function<Module*()> ctor) : ctor_(ctor) {
 }
 
@@ -55,19 +69,28 @@ Module* Module::GetDependency(const ModuleFactory* module) const {
 }
 
 Module* ModuleRegistry::Get(const ModuleFactory* module) const {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto instance = started_modules_.find(module);
   ASSERT(instance != started_modules_.end());
   return instance->second;
 }
 
 bool ModuleRegistry::IsStarted(const ModuleFactory* module) const {
+  std::lock_guard<std::mutex> lock(mutex_);
   return started_modules_.find(module) != started_modules_.end();
 }
 
 void ModuleRegistry::Start(ModuleList* modules, Thread* thread) {
+  std::vector<std::pair<const ModuleFactory*, Module*>> pending;
   for (auto it = modules->list_.begin(); it != modules->list_.end(); it++) {
-    Start(*it, thread);
+    Instantiate(*it, thread, &pending);
   }
+  StartPending(pending);
+}
+
+void ModuleRegistry::SetMaxParallelStarts(size_t count) {
+  ASSERT(count > 0);
+  max_parallel_starts_ = count;
 }
 
 void ModuleRegistry::set_registry_and_handler(Module* instance, Thread* thread) const {
@@ -76,21 +99,115 @@ void ModuleRegistry::set_registry_and_handler(Module* instance, Thread* thread)
 }
 
 Module* ModuleRegistry::Start(const ModuleFactory* module, Thread* thread) {
-  auto started_instance = started_modules_.find(module);
-  if (started_instance != started_modules_.end()) {
-    return started_instance->second;
+  ModuleList list;
+  list.list_.push_back(module);
+  Start(&list, thread);
+  return Get(module);
+}
+
+void ModuleRegistry::Instantiate(const ModuleFactory* module, Thread* thread,
+                                 std::vector<std::pair<const ModuleFactory*, Module*>>* pending) {
+  if (IsStarted(module)) {
+    return;
+  }
+  for (const auto& entry : *pending) {
+    if (entry.first == module) {
+      return;
+    }
   }
 
   Module* instance = module->ctor_();
   set_registry_and_handler(instance, thread);
 
   instance->ListDependencies(&instance->dependencies_);
-  Start(&instance->dependencies_, thread);
+  for (const ModuleFactory* dependency : instance->dependencies_.list_) {
+    Instantiate(dependency, thread, pending);
+  }
+  pending->emplace_back(module, instance);
+}
+
+void ModuleRegistry::StartPending(const std::vector<std::pair<const ModuleFactory*, Module*>>& pending) {
+  if (pending.empty()) {
+    return;
+  }
+
+  // Modules are started in the order of |pending| when they can't run concurrently, which is the order they were
+  // started in before modules could start concurrently
+  std::vector<size_t> waiting_for(pending.size(), 0);
+  std::vector<std::vector<size_t>> dependents(pending.size());
+  for (size_t i = 0; i < pending.size(); i++) {
+    for (const ModuleFactory* dependency : pending[i].second->dependencies_.list_) {
+      for (size_t j = 0; j < i; j++) {
+        if (pending[j].first == dependency) {
+          waiting_for[i]++;
+          dependents[j].push_back(i);
+          break;
+        }
+      }
+    }
+  }
 
-  instance->Start();
-  start_order_.push_back(module);
-  started_modules_[module] = instance;
-  return instance;
+  std::set<size_t> ready;
+  for (size_t i = 0; i < pending.size(); i++) {
+    if (waiting_for[i] == 0) {
+      ready.insert(i);
+    }
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_modules_.empty()) {
+      timings_.clear();
+    }
+  }
+
+  std::condition_variable changed;
+  size_t remaining = pending.size();
+  auto start_modules = [&]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      changed.wait(lock, [&]() { return remaining == 0 || !ready.empty(); });
+      if (remaining == 0) {
+        return;
+      }
+      size_t index = *ready.begin();
+      ready.erase(ready.begin());
+      lock.unlock();
+
+      const ModuleFactory* module = pending[index].first;
+      Module* instance = pending[index].second;
+      auto start_offset = ElapsedSince(start_time);
+      auto module_start_time = std::chrono::steady_clock::now();
+      instance->Start();
+      auto start_duration = ElapsedSince(module_start_time);
+      LOG_INFO("Started Module %s in %lld us", instance->ToString().c_str(),
+               static_cast<long long>(start_duration.count()));
+
+      lock.lock();
+      start_order_.push_back(module);
+      started_modules_[module] = instance;
+      timings_.push_back({module, {instance->ToString(), start_offset, start_duration, std::chrono::microseconds(0)}});
+      for (size_t dependent : dependents[index]) {
+        if (--waiting_for[dependent] == 0) {
+          ready.insert(dependent);
+        }
+      }
+      remaining--;
+      changed.notify_all();
+    }
+  };
+
+  // The calling thread starts modules too
+  size_t thread_count = std::min(max_parallel_starts_, pending.size());
+  std::vector<std::thread> helpers;
+  for (size_t i = 1; i < thread_count; i++) {
+    helpers.emplace_back(start_modules);
+  }
+  start_modules();
+  for (auto& helper : helpers) {
+    helper.join();
+  }
 }
 
 void ModuleRegistry::StopAll() {
@@ -104,21 +221,40 @@ void ModuleRegistry::StopAll() {
     instance->second->handler_->Clear();
     instance->second->handler_->WaitUntilStopped(kModuleStopTimeout);
     LOG_INFO("Stopping Module %s", instance->second->ToString().c_str());
+    auto stop_time = std::chrono::steady_clock::now();
     instance->second->Stop();
+    auto stop_duration = ElapsedSince(stop_time);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& timings : timings_) {
+      if (timings.first == *it) {
+        timings.second.stop_duration = stop_duration;
+      }
+    }
   }
-  for (auto it = start_order_.rbegin(); it != start_order_.rend(); it++) {
-    auto instance = started_modules_.find(*it);
-    ASSERT(instance != started_modules_.end());
-    delete instance->second->handler_;
-    delete instance->second;
-    started_modules_.erase(instance);
+  // Take the modules out under the lock, but destroy them without it: a module destructor may call back into the
+  // registry
+  std::vector<Module*> stopped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = start_order_.rbegin(); it != start_order_.rend(); it++) {
+      auto instance = started_modules_.find(*it);
+      ASSERT(instance != started_modules_.end());
+      stopped.push_back(instance->second);
+      started_modules_.erase(instance);
+    }
+
+    ASSERT(started_modules_.empty());
+    start_order_.clear();
   }
 
-  ASSERT(started_modules_.empty());
-  start_order_.clear();
+  for (Module* module : stopped) {
+    delete module->handler_;
+    delete module;
+  }
 }
 
 os::Handler* ModuleRegistry::GetModuleHandler(const ModuleFactory* module) const {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto started_instance = started_modules_.find(module);
   if (started_instance != started_modules_.end()) {
     return started_instance->second->GetHandler();
@@ -141,6 +277,16 @@ void ModuleDumper::DumpState() const {
     dump_state.mutable_data()->PackFrom(*message);
     dumpmod.mutable_module_dump_states()->insert({dump_state.name(), dump_state});
   }
+
+  std::lock_guard<std::mutex> lock(module_registry_.mutex_);
+  for (const auto& entry : module_registry_.timings_) {
+    const ModuleRegistry::ModuleTimings& timings = entry.second;
+    ModuleTimingsData* data = dumpmod.add_module_timings();
+    data->set_name(timings.name);
+    data->set_start_offset_us(timings.start_offset.count());
+    data->set_start_duration_us(timings.start_duration.count());
+    data->set_stop_duration_us(timings.stop_duration.count());
+  }
 }
 
 }  // namespace bluetooth
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+
+#include "common/bind.h"
+#include "module.h"
+#include "os/handler.h"
+#include "os/thread.h"
+
+using ::benchmark::State;
+using ::bluetooth::Module;
+using ::bluetooth::ModuleFactory;
+using ::bluetooth::ModuleList;
+using ::bluetooth::ModuleRegistry;
+using ::bluetooth::common::BindOnce;
+using ::bluetooth::os::Handler;
+using ::bluetooth::os::Thread;
+
+namespace {
+
+// Round trip of a command to the controller over the transport
+constexpr std::chrono::microseconds kCommandLatency = std::chrono::microseconds(250);
+
+// Answers commands one at a time, like the HCI layer sends them
+class FakeController {
+ public:
+  FakeController() : thread_("fake_controller", Thread::Priority::NORMAL), handler_(&thread_) {}
+
+  ~FakeController() {
+    handler_.Clear();
+  }
+
+  // Sends |count| commands back to back, and waits for the last one to complete
+  void SendCommands(int count) {
+    if (count == 0) {
+      return;
+    }
+    std::promise<void> promise;
+    auto future = promise.get_future();
+    for (int i = 0; i < count - 1; i++) {
+      handler_.Post(BindOnce([]() { std::this_thread::sleep_for(kCommandLatency); }));
+    }
+    handler_.Post(BindOnce(
+        [](std::promise<void> promise) {
+          std::this_thread::sleep_for(kCommandLatency);
+          promise.set_value();
+        },
+        std::move(promise)));
+    future.wait();
+  }
+
+ private:
+  Thread thread_;
+  Handler handler_;
+};
+
+FakeController* fake_controller = nullptr;
+
+// Stands for a module of the stack, which sends |Traits::kCommands| commands and spends |Traits::kLocalWorkUs|
+// on other work, such as reading files, when it starts
+template <class Traits, class... Dependencies>
+class StartupModule : public Module {
+ public:
+  static const ModuleFactory Factory;
+
+ protected:
+  void ListDependencies(ModuleList* list) override {
+    (list->add<Dependencies>(), ...);
+  }
+
+  void Start() override {
+    std::this_thread::sleep_for(std::chrono::microseconds(Traits::kLocalWorkUs));
+    fake_controller->SendCommands(Traits::kCommands);
+  }
+
+  void Stop() override {}
+
+  std::string ToString() const override {
+    return Traits::kName;
+  }
+};
+
+template <class Traits, class... Dependencies>
+const ModuleFactory StartupModule<Traits, Dependencies...>::Factory =
+    ModuleFactory([]() { return new StartupModule<Traits, Dependencies...>(); });
+
+#define STARTUP_TRAITS(name, commands, local_work_us) \
+  struct name##Traits {                                \
+    static constexpr const char* kName = #name;        \
+    static constexpr int kCommands = commands;         \
+    static constexpr int kLocalWorkUs = local_work_us; \
+  }
+
+// Commands sent and local work done by the modules of the stack when they start
+STARTUP_TRAITS(SnoopLogger, 0, 300);
+STARTUP_TRAITS(HciHal, 0, 200);
+STARTUP_TRAITS(HciLayer, 1, 0);
+STARTUP_TRAITS(Controller, 15, 0);
+STARTUP_TRAITS(Storage, 0, 2000);
+STARTUP_TRAITS(AclManager, 2, 0);
+STARTUP_TRAITS(LeAdvertisingManager, 2, 0);
+STARTUP_TRAITS(LeScanningManager, 3, 0);
+STARTUP_TRAITS(Scan, 2, 0);
+STARTUP_TRAITS(Page, 1, 0);
+STARTUP_TRAITS(Inquiry, 2, 0);
+STARTUP_TRAITS(Discoverability, 1, 0);
+STARTUP_TRAITS(L2capClassic, 0, 100);
+STARTUP_TRAITS(L2capLe, 0, 100);
+STARTUP_TRAITS(Security, 1, 1000);
+STARTUP_TRAITS(Dumpsys, 0, 100);
+
+using SnoopLogger = StartupModule<SnoopLoggerTraits>;
+using HciHal = StartupModule<HciHalTraits, SnoopLogger>;
+using HciLayer = StartupModule<HciLayerTraits, HciHal>;
+using Controller = StartupModule<ControllerTraits, HciLayer>;
+using Storage = StartupModule<StorageTraits>;
+using AclManager = StartupModule<AclManagerTraits, HciLayer, Controller>;
+using LeAdvertisingManager = StartupModule<LeAdvertisingManagerTraits, HciLayer, Controller>;
+using LeScanningManager = StartupModule<LeScanningManagerTraits, HciLayer, Controller>;
+using Scan = StartupModule<ScanTraits, HciLayer>;
+using Page = StartupModule<PageTraits, HciLayer>;
+using Inquiry = StartupModule<InquiryTraits, HciLayer>;
+using Discoverability = StartupModule<DiscoverabilityTraits, HciLayer, Scan>;
+using L2capClassic = StartupModule<L2capClassicTraits, AclManager>;
+using L2capLe = StartupModule<L2capLeTraits, AclManager>;
+using Security = StartupModule<SecurityTraits, L2capLe, L2capClassic, HciLayer, AclManager, Storage>;
+using Dumpsys = StartupModule<DumpsysTraits>;
+
+}  // namespace
+
+// Starts and stops a stack shaped like the one the shim starts. Argument is the number of modules allowed to start
+// at the same time.
+static void BM_StartStack(State& state) {
+  Thread stack_thread("stack_thread", Thread::Priority::NORMAL);
+  fake_controller = new FakeController();
+  ModuleList modules;
+  modules.add<Dumpsys>();
+  modules.add<LeAdvertisingManager>();
+  modules.add<LeScanningManager>();
+  modules.add<Discoverability>();
+  modules.add<Page>();
+  modules.add<Inquiry>();
+  modules.add<Security>();
+
+  for (auto _ : state) {
+    ModuleRegistry registry;
+    registry.SetMaxParallelStarts(state.range(0));
+    registry.Start(&modules, &stack_thread);
+    state.PauseTiming();
+    registry.StopAll();
+    state.ResumeTiming();
+  }
+
+  delete fake_controller;
+  fake_controller = nullptr;
+}
+BENCHMARK(BM_StartStack)
+    ->ArgName("max_parallel_starts")
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
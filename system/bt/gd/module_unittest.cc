@@ -22,6 +22,10 @@
 
 #include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 using ::bluetooth::os::Thread;
 
@@ -223,5 +227,212 @@ TEST_F(ModuleTest, shutdown_with_unhandled_callback) {
   registry_->StopAll();
 }
 
+// Each of the concurrent modules waits in Start() for the other one to be starting. Created for each test by
+// ModuleConcurrencyTest, so that nothing carries over when tests are repeated.
+struct ConcurrentStart {
+  std::promise<void> module_one_starting;
+  std::promise<void> module_two_starting;
+  std::vector<std::string> start_sequence;
+  std::mutex start_sequence_mutex;
+};
+
+ConcurrentStart* concurrent_start = nullptr;
+
+void record_start(const std::string& name) {
+  std::lock_guard<std::mutex> lock(concurrent_start->start_sequence_mutex);
+  concurrent_start->start_sequence.push_back(name);
+}
+
+class TestModuleConcurrentOne : public Module {
+ public:
+  static const ModuleFactory Factory;
+
+ protected:
+  void ListDependencies(ModuleList* list) override {}
+
+  void Start() override {
+    record_start(ToString());
+    concurrent_start->module_one_starting.set_value();
+    started_concurrently_ =
+        concurrent_start->module_two_starting.get_future().wait_for(std::chrono::milliseconds(200)) ==
+        std::future_status::ready;
+  }
+
+  void Stop() override {}
+
+  std::string ToString() const override {
+    return "TestModuleConcurrentOne";
+  }
+
+ public:
+  bool started_concurrently_ = false;
+};
+
+const ModuleFactory TestModuleConcurrentOne::Factory = ModuleFactory([]() {
+  return new TestModuleConcurrentOne();
+});
+
+class TestModuleConcurrentTwo : public Module {
+ public:
+  static const ModuleFactory Factory;
+
+ protected:
+  void ListDependencies(ModuleList* list) override {}
+
+  void Start() override {
+    record_start(ToString());
+    concurrent_start->module_two_starting.set_value();
+    started_concurrently_ =
+        concurrent_start->module_one_starting.get_future().wait_for(std::chrono::milliseconds(200)) ==
+        std::future_status::ready;
+  }
+
+  void Stop() override {}
+
+  std::string ToString() const override {
+    return "TestModuleConcurrentTwo";
+  }
+
+ public:
+  bool started_concurrently_ = false;
+};
+
+const ModuleFactory TestModuleConcurrentTwo::Factory = ModuleFactory([]() {
+  return new TestModuleConcurrentTwo();
+});
+
+class TestModuleDependsOnConcurrent : public Module {
+ public:
+  static const ModuleFactory Factory;
+
+ protected:
+  void ListDependencies(ModuleList* list) override {
+    list->add<TestModuleConcurrentOne>();
+    list->add<TestModuleConcurrentTwo>();
+  }
+
+  void Start() override {
+    record_start(ToString());
+    EXPECT_TRUE(GetModuleRegistry()->IsStarted<TestModuleConcurrentOne>());
+    EXPECT_TRUE(GetModuleRegistry()->IsStarted<TestModuleConcurrentTwo>());
+  }
+
+  void Stop() override {}
+
+  std::string ToString() const override {
+    return "TestModuleDependsOnConcurrent";
+  }
+};
+
+const ModuleFactory TestModuleDependsOnConcurrent::Factory = ModuleFactory([]() {
+  return new TestModuleDependsOnConcurrent();
+});
+
+class ModuleConcurrencyTest : public ModuleTest {
+ protected:
+  void SetUp() override {
+    ModuleTest::SetUp();
+    concurrent_start_ = std::make_unique<ConcurrentStart>();
+    concurrent_start = concurrent_start_.get();
+  }
+
+  void TearDown() override {
+    ModuleTest::TearDown();
+    concurrent_start = nullptr;
+    concurrent_start_.reset();
+  }
+
+  const std::vector<std::string>& start_sequence() const {
+    return concurrent_start_->start_sequence;
+  }
+
+  std::unique_ptr<ConcurrentStart> concurrent_start_;
+};
+
+class TimingsModuleRegistry : public ModuleRegistry {
+ public:
+  const std::vector<std::pair<const ModuleFactory*, ModuleTimings>>& GetTimings() const {
+    return timings_;
+  }
+};
+
+TEST_F(ModuleConcurrencyTest, independent_modules_start_concurrently) {
+  registry_->SetMaxParallelStarts(4);
+  ModuleList list;
+  list.add<TestModuleDependsOnConcurrent>();
+  registry_->Start(&list, thread_);
+
+  EXPECT_TRUE(registry_->IsStarted<TestModuleDependsOnConcurrent>());
+  EXPECT_TRUE(registry_->Start<TestModuleConcurrentOne>(thread_)->started_concurrently_);
+  EXPECT_TRUE(registry_->Start<TestModuleConcurrentTwo>(thread_)->started_concurrently_);
+  ASSERT_EQ(3u, start_sequence().size());
+  EXPECT_EQ("TestModuleDependsOnConcurrent", start_sequence()[2]);
+
+  registry_->StopAll();
+}
+
+TEST_F(ModuleConcurrencyTest, serial_start_by_default_keeps_dependency_order) {
+  ModuleList list;
+  list.add<TestModuleDependsOnConcurrent>();
+  registry_->Start(&list, thread_);
+
+  EXPECT_FALSE(registry_->Start<TestModuleConcurrentOne>(thread_)->started_concurrently_);
+  EXPECT_TRUE(registry_->Start<TestModuleConcurrentTwo>(thread_)->started_concurrently_);
+  std::vector<std::string> expected = {"TestModuleConcurrentOne", "TestModuleConcurrentTwo",
+                                       "TestModuleDependsOnConcurrent"};
+  EXPECT_EQ(expected, start_sequence());
+
+  registry_->StopAll();
+}
+
+// Queries the registry from its destructor, which StopAll() must run without holding its lock
+class TestModuleQueriesRegistryOnDestruction : public Module {
+ public:
+  static const ModuleFactory Factory;
+
+  ~TestModuleQueriesRegistryOnDestruction() {
+    EXPECT_FALSE(GetModuleRegistry()->IsStarted<TestModuleNoDependency>());
+  }
+
+ protected:
+  void ListDependencies(ModuleList* list) override {
+    list->add<TestModuleNoDependency>();
+  }
+
+  void Start() override {}
+
+  void Stop() override {}
+};
+
+const ModuleFactory TestModuleQueriesRegistryOnDestruction::Factory =
+    ModuleFactory([]() { return new TestModuleQueriesRegistryOnDestruction(); });
+
+TEST_F(ModuleTest, modules_are_destroyed_without_registry_lock) {
+  ModuleList list;
+  list.add<TestModuleQueriesRegistryOnDestruction>();
+  registry_->Start(&list, thread_);
+  EXPECT_TRUE(registry_->IsStarted<TestModuleQueriesRegistryOnDestruction>());
+
+  registry_->StopAll();
+  EXPECT_FALSE(registry_->IsStarted<TestModuleQueriesRegistryOnDestruction>());
+}
+
+TEST_F(ModuleTest, timings_are_recorded) {
+  TimingsModuleRegistry registry;
+  ModuleList list;
+  list.add<TestModuleTwoDependencies>();
+  registry.Start(&list, thread_);
+
+  ASSERT_EQ(4u, registry.GetTimings().size());
+  EXPECT_EQ(&TestModuleTwoDependencies::Factory, registry.GetTimings().back().first);
+  for (const auto& entry : registry.GetTimings()) {
+    EXPECT_EQ(std::chrono::microseconds(0), entry.second.stop_duration);
+  }
+
+  registry.StopAll();
+  // Kept until modules start again
+  EXPECT_EQ(4u, registry.GetTimings().size());
+}
+
 }  // namespace
 }  // namespace bluetooth
@@ -87,14 +87,12 @@ class Handler : public common::IPostableContext {
   friend class RepeatingAlarm;
 
  private:
-  inline bool was_cleared() const {
-    return tasks_ == nullptr;
-  };
-  std::queue<common::OnceClosure>* tasks_;
+  // Posted tasks, shared with a running batch so that it outlives the handler
+  struct TaskQueue;
+  bool was_cleared() const;
+  std::shared_ptr<TaskQueue> tasks_;
   Thread* thread_;
-  int fd_;
   Reactor::Reactable* reactable_;
-  mutable std::mutex mutex_;
   void handle_next_event();
 };
 
@@ -18,7 +18,10 @@
 
 #include <sys/eventfd.h>
 #include <unistd.h>
+#include <atomic>
 #include <cstring>
+#include <mutex>
+#include <thread>
 
 #include "common/bind.h"
 #include "common/callback.h"
@@ -26,58 +29,136 @@
 #include "os/reactor.h"
 #include "os/utils.h"
 
-#ifndef EFD_SEMAPHORE
-#define EFD_SEMAPHORE 1
-#endif
-
 namespace bluetooth {
 namespace os {
 using common::OnceClosure;
 
-Handler::Handler(Thread* thread)
-    : tasks_(new std::queue<OnceClosure>()), thread_(thread), fd_(eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK)) {
-  ASSERT(fd_ != -1);
-  reactable_ = thread_->GetReactor()->Register(fd_, common::Bind(&Handler::handle_next_event, common::Unretained(this)),
-                                               common::Closure());
+namespace {
+// Tasks run per wake up, before the other reactables of the thread get their turn
+constexpr int64_t kMaxTasksPerBatch = 32;
+}  // namespace
+
+// Intrusive multiple producer, single consumer queue of tasks. Post() never
+// blocks: it links a node and only writes the eventfd when the queue goes from
+// empty to non-empty, so a burst of tasks costs a single wake up.
+struct Handler::TaskQueue {
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    OnceClosure closure;
+  };
+
+  TaskQueue() : head_(&stub_), tail_(&stub_), fd_(eventfd(0, EFD_NONBLOCK)) {
+    ASSERT(fd_ != -1);
+  }
+
+  ~TaskQueue() {
+    while (Node* node = Pop()) {
+      delete node;
+    }
+    int close_status;
+    RUN_NO_INTR(close_status = close(fd_));
+    ASSERT(close_status != -1);
+  }
+
+  // From any thread
+  void Push(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // From the handler thread, with consumer_mutex_ held. Returns nullptr when
+  // the queue is empty, or when the next task is still being linked by Push()
+  Node* Pop() {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    Push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+  void Signal() {
+    auto write_result = eventfd_write(fd_, 1);
+    ASSERT(write_result != -1);
+  }
+
+  std::atomic<Node*> head_;
+  Node* tail_;
+  Node stub_;
+  int fd_;
+  // Tasks posted and not yet run. The eventfd is written when it leaves 0,
+  // or by a batch that leaves tasks behind.
+  std::atomic<int64_t> pending_{0};
+  // Post() calls under way, which Clear() waits for
+  std::atomic<int> posting_{0};
+  std::atomic<bool> cleared_{false};
+  // Held around Pop(), so that Clear() can drop the tasks from any thread
+  std::mutex consumer_mutex_;
+};
+
+Handler::Handler(Thread* thread) : tasks_(std::make_shared<TaskQueue>()), thread_(thread) {
+  reactable_ = thread_->GetReactor()->Register(
+      tasks_->fd_, common::Bind(&Handler::handle_next_event, common::Unretained(this)), common::Closure());
 }
 
 Handler::~Handler() {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    ASSERT_LOG(was_cleared(), "Handlers must be cleared before they are destroyed");
-  }
+  ASSERT_LOG(was_cleared(), "Handlers must be cleared before they are destroyed");
+}
 
-  int close_status;
-  RUN_NO_INTR(close_status = close(fd_));
-  ASSERT(close_status != -1);
+bool Handler::was_cleared() const {
+  return tasks_->cleared_.load();
 }
 
 void Handler::Post(OnceClosure closure) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (was_cleared()) {
-      LOG_WARN("Posting to a handler which has been cleared");
-      return;
-    }
-    tasks_->emplace(std::move(closure));
+  TaskQueue* tasks = tasks_.get();
+  tasks->posting_.fetch_add(1);
+  if (tasks->cleared_.load()) {
+    tasks->posting_.fetch_sub(1);
+    LOG_WARN("Posting to a handler which has been cleared");
+    return;
   }
-  uint64_t val = 1;
-  auto write_result = eventfd_write(fd_, val);
-  ASSERT(write_result != -1);
+  auto* node = new TaskQueue::Node();
+  node->closure = std::move(closure);
+  tasks->Push(node);
+  if (tasks->pending_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+    tasks->Signal();
+  }
+  tasks->posting_.fetch_sub(1, std::memory_order_release);
 }
 
 void Handler::Clear() {
-  std::queue<OnceClosure>* tmp = nullptr;
+  ASSERT_LOG(!tasks_->cleared_.exchange(true), "Handlers must only be cleared once");
+  while (tasks_->posting_.load() != 0) {
+    std::this_thread::yield();
+  }
   {
-    std::lock_guard<std::mutex> lock(mutex_);
-    ASSERT_LOG(!was_cleared(), "Handlers must only be cleared once");
-    std::swap(tasks_, tmp);
+    std::lock_guard<std::mutex> lock(tasks_->consumer_mutex_);
+    while (TaskQueue::Node* node = tasks_->Pop()) {
+      delete node;
+    }
   }
-  delete tmp;
 
   uint64_t val;
-  while (eventfd_read(fd_, &val) == 0) {
-  }
+  eventfd_read(tasks_->fd_, &val);
 
   thread_->GetReactor()->Unregister(reactable_);
   reactable_ = nullptr;
@@ -89,21 +170,38 @@ void Handler::WaitUntilStopped(std::chrono::milliseconds timeout) {
 }
 
 void Handler::handle_next_event() {
-  common::OnceClosure closure;
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    uint64_t val = 0;
-    auto read_result = eventfd_read(fd_, &val);
-
-    if (was_cleared()) {
-      return;
+  // A task may clear and delete the handler: only the queue is used after it runs
+  std::shared_ptr<TaskQueue> tasks = tasks_;
+  uint64_t val = 0;
+  auto read_result = eventfd_read(tasks->fd_, &val);
+  if (tasks->cleared_.load()) {
+    return;
+  }
+  ASSERT_LOG(read_result != -1, "eventfd read error %d %s", errno, strerror(errno));
+
+  int64_t num_run = 0;
+  while (num_run < kMaxTasksPerBatch) {
+    TaskQueue::Node* node;
+    {
+      std::lock_guard<std::mutex> lock(tasks->consumer_mutex_);
+      if (tasks->cleared_.load()) {
+        return;
+      }
+      node = tasks->Pop();
+    }
+    if (node == nullptr) {
+      break;
     }
-    ASSERT_LOG(read_result != -1, "eventfd read error %d %s", errno, strerror(errno));
+    OnceClosure closure = std::move(node->closure);
+    delete node;
+    num_run++;
+    std::move(closure).Run();
+  }
 
-    closure = std::move(tasks_->front());
-    tasks_->pop();
+  // Come back for the tasks left, once other reactables had their turn
+  if (tasks->pending_.fetch_sub(num_run, std::memory_order_acq_rel) != num_run) {
+    tasks->Signal();
   }
-  std::move(closure).Run();
 }
 
 }  // namespace os
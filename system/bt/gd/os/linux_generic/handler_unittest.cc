@@ -19,6 +19,7 @@
 #include <sys/eventfd.h>
 #include <future>
 #include <thread>
+#include <vector>
 
 #include "common/bind.h"
 #include "common/callback.h"
@@ -84,6 +85,57 @@ TEST_F(HandlerTest, post_task_cleared) {
   ASSERT_EQ(val, 1);
 }
 
+constexpr int kNumThreads = 4;
+constexpr int kTasksPerThread = 1000;
+
+TEST_F(HandlerTest, post_from_many_threads) {
+  std::vector<int> next_task(kNumThreads, 0);
+  int num_out_of_order = 0;
+  std::promise<void> all_ran;
+  auto future = all_ran.get_future();
+  int num_ran = 0;
+
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kNumThreads; thread++) {
+    threads.emplace_back([&, thread]() {
+      for (int task = 0; task < kTasksPerThread; task++) {
+        handler_->Post(common::BindOnce(
+            [](std::vector<int>* next_task, int* num_out_of_order, int* num_ran, std::promise<void>* all_ran,
+               int thread, int task) {
+              if ((*next_task)[thread]++ != task) {
+                (*num_out_of_order)++;
+              }
+              if (++(*num_ran) == kNumThreads * kTasksPerThread) {
+                all_ran->set_value();
+              }
+            },
+            common::Unretained(&next_task), common::Unretained(&num_out_of_order), common::Unretained(&num_ran),
+            common::Unretained(&all_ran), thread, task));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  future.wait();
+  ASSERT_EQ(num_out_of_order, 0);
+  handler_->Clear();
+}
+
+TEST_F(HandlerTest, clear_from_task) {
+  std::promise<void> cleared;
+  auto future = cleared.get_future();
+  handler_->Post(common::BindOnce(
+      [](Handler* handler, std::promise<void> cleared) {
+        handler->Clear();
+        cleared.set_value();
+      },
+      common::Unretained(handler_), std::move(cleared)));
+  handler_->Post(common::BindOnce([]() { ASSERT_TRUE(false); }));
+  future.wait();
+  handler_->WaitUntilStopped(std::chrono::milliseconds(200));
+}
+
 void check_int(std::unique_ptr<int> number, std::shared_ptr<int> to_change) {
   *to_change = *number;
 }
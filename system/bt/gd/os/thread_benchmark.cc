@@ -17,6 +17,7 @@
 #include <future>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include "benchmark/benchmark.h"
 
@@ -65,6 +66,7 @@ class BM_ReactorThread : public BM_ThreadPerformance {
     handler_ = std::make_unique<Handler>(thread_.get());
   }
   void TearDown(State& st) override {
+    handler_->Clear();
     handler_ = nullptr;
     thread_->Stop();
     thread_ = nullptr;
@@ -116,3 +118,29 @@ BENCHMARK_REGISTER_F(BM_ReactorThread, sequential_execution)
     ->Arg(100000)
     ->Iterations(1)
     ->UseRealTime();
+
+BENCHMARK_DEFINE_F(BM_ReactorThread, multiple_producers)(State& state) {
+  const int num_producers = state.range(0);
+  for (auto _ : state) {
+    num_messages_to_send_ = NUM_MESSAGES_TO_SEND;
+    counter_ = 0;
+    counter_promise_ = std::promise<void>();
+    std::future<void> counter_future = counter_promise_.get_future();
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < num_producers; producer++) {
+      producers.emplace_back([this, num_producers]() {
+        for (int i = 0; i < num_messages_to_send_ / num_producers; i++) {
+          handler_->Post(BindOnce(&BM_ReactorThread_multiple_producers_Benchmark::callback_batch,
+                                  bluetooth::common::Unretained(this)));
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+    counter_future.wait();
+  }
+  state.SetItemsProcessed(state.iterations() * NUM_MESSAGES_TO_SEND);
+};
+
+BENCHMARK_REGISTER_F(BM_ReactorThread, multiple_producers)->Arg(1)->Arg(2)->Arg(4)->Iterations(1)->UseRealTime();
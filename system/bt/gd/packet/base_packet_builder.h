@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "packet/bit_inserter.h"
+#include "packet/buffer_inserter.h"
 
 namespace bluetooth {
 namespace packet {
@@ -38,6 +39,12 @@ class BasePacketBuilder {
   // Write to the vector with the given iterator.
   virtual void Serialize(BitInserter& it) const = 0;
 
+  // Write the size() bytes of the packet to buffer, which holds length bytes.
+  void SerializeTo(uint8_t* buffer, size_t length) const {
+    BufferInserter it(buffer, length);
+    Serialize(it);
+  }
+
  protected:
   BasePacketBuilder() = default;
 };
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet/buffer_inserter.h"
+
+#include <cstring>
+
+#include "os/log.h"
+
+namespace bluetooth {
+namespace packet {
+
+BufferInserter::BufferInserter(uint8_t* buffer, size_t length)
+    : BitInserter(to_construct_bit_inserter_), buffer_(buffer), length_(length) {}
+
+void BufferInserter::insert_bits(uint8_t byte, size_t num_bits) {
+  size_t total_bits = num_bits + num_saved_bits_;
+  uint16_t new_value = static_cast<uint8_t>(saved_bits_) | (static_cast<uint16_t>(byte) << num_saved_bits_);
+  if (total_bits >= 8) {
+    ASSERT_LOG(index_ < length_, "Buffer of %zu bytes is full", length_);
+    uint8_t new_byte = static_cast<uint8_t>(new_value);
+    on_byte(new_byte);
+    buffer_[index_++] = new_byte;
+    total_bits -= 8;
+    new_value = new_value >> 8;
+  }
+  num_saved_bits_ = total_bits;
+  uint8_t mask = static_cast<uint8_t>(0xff) >> (8 - num_saved_bits_);
+  saved_bits_ = static_cast<uint8_t>(new_value) & mask;
+}
+
+void BufferInserter::insert_byte(uint8_t byte) {
+  if (num_saved_bits_ != 0) {
+    insert_bits(byte, 8);
+    return;
+  }
+  ASSERT_LOG(index_ < length_, "Buffer of %zu bytes is full", length_);
+  on_byte(byte);
+  buffer_[index_++] = byte;
+}
+
+void BufferInserter::insert_bytes(const uint8_t* bytes, size_t length) {
+  if (num_saved_bits_ != 0) {
+    for (size_t i = 0; i < length; i++) {
+      insert_bits(bytes[i], 8);
+    }
+    return;
+  }
+  ASSERT_LOG(length <= length_ - index_, "%zu bytes overflow the buffer of %zu bytes", length, length_);
+  on_bytes(bytes, length);
+  std::memcpy(buffer_ + index_, bytes, length);
+  index_ += length;
+}
+
+size_t BufferInserter::size() const {
+  return index_;
+}
+
+}  // namespace packet
+}  // namespace bluetooth
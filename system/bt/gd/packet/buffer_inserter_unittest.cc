@@ -0,0 +1,108 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "packet/buffer_inserter.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "os/log.h"
+#include "packet/raw_builder.h"
+
+using bluetooth::packet::BufferInserter;
+using std::vector;
+
+namespace bluetooth {
+namespace packet {
+
+TEST(BufferInserterTest, addMoreBits) {
+  std::vector<uint8_t> bytes(5);
+  BufferInserter it(bytes.data(), bytes.size());
+
+  for (size_t i = 0; i < 9; i++) {
+    it.insert_bits(static_cast<uint8_t>(i), i);
+  }
+  it.insert_bits(static_cast<uint8_t>(0b1010), 4);
+  std::vector<uint8_t> result = {0b00011101 /* 3 2 1 */, 0b00010101 /* 5 4 */, 0b11100011 /* 7 6 */, 0b10000000 /* 8 */,
+                                 0b10100000 /* filled with 1010 */};
+
+  ASSERT_EQ(result.size(), it.size());
+  ASSERT_EQ(result, bytes);
+}
+
+TEST(BufferInserterTest, insertBytesTest) {
+  std::vector<uint8_t> expected;
+  BitInserter bit_inserter(expected);
+  std::vector<uint8_t> bytes(5);
+  BufferInserter it(bytes.data(), bytes.size());
+  std::vector<uint8_t> octets = {0x01, 0x23, 0x45, 0x67};
+
+  // Aligned, then after a nibble
+  for (BitInserter* inserter : {&bit_inserter, static_cast<BitInserter*>(&it)}) {
+    inserter->insert_bytes(octets.data(), 2);
+    inserter->insert_bits(0x0a, 4);
+    inserter->insert_bytes(octets.data() + 2, 2);
+    inserter->insert_bits(0x0b, 4);
+  }
+
+  ASSERT_EQ(5u, it.size());
+  ASSERT_EQ(expected, bytes);
+}
+
+TEST(BufferInserterTest, observerTest) {
+  std::vector<uint8_t> bytes(5);
+  BufferInserter it(bytes.data(), bytes.size());
+  std::vector<uint8_t> copy;
+
+  it.RegisterObserver(ByteObserver([&copy](uint8_t byte) { copy.push_back(byte); }, []() { return 0; }));
+  std::vector<uint8_t> octets = {0x01, 0x23, 0x45, 0x67};
+  it.insert_bytes(octets.data(), octets.size());
+  it.UnregisterObserver();
+  it.insert_byte(0x89);
+
+  ASSERT_EQ(octets, copy);
+  ASSERT_EQ(std::vector<uint8_t>({0x01, 0x23, 0x45, 0x67, 0x89}), bytes);
+}
+
+TEST(BufferInserterTest, serializeToTest) {
+  RawBuilder builder;
+  builder.AddOctets1(0x01);
+  builder.AddOctets2(0x2345);
+  builder.AddOctets6(0x6789abcdef01);
+  builder.AddOctets({0x23, 0x45, 0x67});
+
+  std::vector<uint8_t> expected;
+  BitInserter bit_inserter(expected);
+  builder.Serialize(bit_inserter);
+
+  std::vector<uint8_t> bytes(builder.size());
+  builder.SerializeTo(bytes.data(), bytes.size());
+  ASSERT_EQ(expected, bytes);
+}
+
+TEST(BufferInserterTest, overflowDeathTest) {
+  std::vector<uint8_t> bytes(3);
+  BufferInserter it(bytes.data(), bytes.size());
+  std::vector<uint8_t> octets = {0x01, 0x23};
+
+  it.insert_bytes(octets.data(), octets.size());
+  ASSERT_DEATH(it.insert_bytes(octets.data(), octets.size()), "");
+  it.insert_byte(0x45);
+  ASSERT_DEATH(it.insert_byte(0x67), "");
+}
+
+}  // namespace packet
+}  // namespace bluetooth
@@ -43,10 +43,24 @@ void ByteInserter::on_byte(uint8_t byte) {
   }
 }
 
+void ByteInserter::on_bytes(const uint8_t* bytes, size_t length) {
+  if (registered_observers_.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < length; i++) {
+    on_byte(bytes[i]);
+  }
+}
+
 void ByteInserter::insert_byte(uint8_t byte) {
   on_byte(byte);
   std::back_insert_iterator<std::vector<uint8_t>>::operator=(byte);
 }
 
+void ByteInserter::insert_bytes(const uint8_t* bytes, size_t length) {
+  on_bytes(bytes, length);
+  container->insert(container->end(), bytes, bytes + length);
+}
+
 }  // namespace packet
 }  // namespace bluetooth
@@ -33,6 +33,9 @@ class ByteInserter : public std::back_insert_iterator<std::vector<uint8_t>> {
 
   virtual void insert_byte(uint8_t byte);
 
+  // Insert length bytes at once
+  virtual void insert_bytes(const uint8_t* bytes, size_t length);
+
   void RegisterObserver(const ByteObserver& observer);
 
   ByteObserver UnregisterObserver();
@@ -40,6 +43,8 @@ class ByteInserter : public std::back_insert_iterator<std::vector<uint8_t>> {
  protected:
   void on_byte(uint8_t);
 
+  void on_bytes(const uint8_t* bytes, size_t length);
+
  private:
   std::vector<ByteObserver> registered_observers_;
 };
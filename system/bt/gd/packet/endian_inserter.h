@@ -41,13 +41,15 @@ class EndianInserter {
   template <typename FixedWidthPODType, typename std::enable_if<std::is_pod<FixedWidthPODType>::value, int>::type = 0>
   void insert(FixedWidthPODType value, BitInserter& it) const {
     uint8_t* raw_bytes = (uint8_t*)&value;
+    if (little_endian == true) {
+      it.insert_bytes(raw_bytes, sizeof(FixedWidthPODType));
+      return;
+    }
+    uint8_t bytes[sizeof(FixedWidthPODType)];
     for (size_t i = 0; i < sizeof(FixedWidthPODType); i++) {
-      if (little_endian == true) {
-        it.insert_byte(raw_bytes[i]);
-      } else {
-        it.insert_byte(raw_bytes[sizeof(FixedWidthPODType) - i - 1]);
-      }
+      bytes[i] = raw_bytes[sizeof(FixedWidthPODType) - i - 1];
     }
+    it.insert_bytes(bytes, sizeof(FixedWidthPODType));
   }
 
   // Write num_bits bits using the iterator
@@ -56,13 +58,15 @@ class EndianInserter {
   void insert(FixedWidthIntegerType value, BitInserter& it, size_t num_bits) const {
     ASSERT(num_bits <= (sizeof(FixedWidthIntegerType) * 8));
 
+    uint8_t bytes[sizeof(FixedWidthIntegerType)];
     for (size_t i = 0; i < num_bits / 8; i++) {
       if (little_endian == true) {
-        it.insert_byte(static_cast<uint8_t>(value >> (i * 8)));
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
       } else {
-        it.insert_byte(static_cast<uint8_t>(value >> (((num_bits / 8) - i - 1) * 8)));
+        bytes[i] = static_cast<uint8_t>(value >> (((num_bits / 8) - i - 1) * 8));
       }
     }
+    it.insert_bytes(bytes, num_bits / 8);
     if (num_bits % 8) {
       it.insert_bits(static_cast<uint8_t>(value >> ((num_bits / 8) * 8)), num_bits % 8);
     }
@@ -81,6 +85,10 @@ class EndianInserter {
   void insert_vector(const std::vector<FixedWidthIntegerType>& vec, BitInserter& it) const {
     static_assert(std::is_pod<FixedWidthIntegerType>::value,
                   "EndianInserter::insert requires a vector with elements of a fixed-size.");
+    if constexpr (sizeof(FixedWidthIntegerType) == 1) {
+      it.insert_bytes(reinterpret_cast<const uint8_t*>(vec.data()), vec.size());
+      return;
+    }
     for (const auto& element : vec) {
       insert(element, it);
     }
@@ -16,18 +16,27 @@
 
 #include "packet/iterator.h"
 
+#include <algorithm>
+
 #include "os/log.h"
 
 namespace bluetooth {
 namespace packet {
 
 template <bool little_endian>
-Iterator<little_endian>::Iterator(std::forward_list<View> data, size_t offset) {
-  data_ = data;
+Iterator<little_endian>::Iterator(std::forward_list<View> data, size_t offset)
+    : Iterator(std::make_shared<const std::vector<View>>(data.begin(), data.end()), offset) {}
+
+template <bool little_endian>
+Iterator<little_endian>::Iterator(std::shared_ptr<const std::vector<View>> data, size_t offset) {
+  data_ = std::move(data);
+  contiguous_ = (data_->size() == 1 ? data_->front().data() : nullptr);
+  fragment_ = 0;
+  fragment_begin_ = 0;
   index_ = offset;
   begin_ = 0;
   end_ = 0;
-  for (auto& view : data) {
+  for (const auto& view : *data_) {
     end_ += view.size();
   }
 }
@@ -95,6 +104,9 @@ Iterator<little_endian>& Iterator<little_endian>::operator--() {
 template <bool little_endian>
 Iterator<little_endian>& Iterator<little_endian>::operator=(const Iterator<little_endian>& itr) {
   this->data_ = itr.data_;
+  this->contiguous_ = itr.contiguous_;
+  this->fragment_ = itr.fragment_;
+  this->fragment_begin_ = itr.fragment_begin_;
   this->begin_ = itr.begin_;
   this->end_ = itr.end_;
   this->index_ = itr.index_;
@@ -134,16 +146,57 @@ bool Iterator<little_endian>::operator>=(const Iterator<little_endian>& itr) con
 template <bool little_endian>
 uint8_t Iterator<little_endian>::operator*() const {
   ASSERT_LOG(index_ < end_ && !(begin_ > index_), "Index %zu out of bounds: [%zu,%zu)", index_, begin_, end_);
-  size_t index = index_;
+  if (contiguous_ != nullptr) {
+    return contiguous_[index_];
+  }
+  const uint8_t* byte = FindFragment(index_, 1);
+  ASSERT_LOG(byte != nullptr, "Out of fragments searching for index %zu", index_);
+  return *byte;
+}
 
-  for (auto view : data_) {
-    if (index < view.size()) {
-      return view[index];
+template <bool little_endian>
+const uint8_t* Iterator<little_endian>::FindFragment(size_t index, size_t length) const {
+  // Reads are mostly sequential: start from the fragment last read from
+  if (index < fragment_begin_) {
+    fragment_ = 0;
+    fragment_begin_ = 0;
+  }
+  while (fragment_ < data_->size()) {
+    const View& view = (*data_)[fragment_];
+    if (index - fragment_begin_ < view.size()) {
+      if (length > view.size() - (index - fragment_begin_)) {
+        return nullptr;
+      }
+      return view.data() + (index - fragment_begin_);
     }
-    index -= view.size();
+    fragment_begin_ += view.size();
+    fragment_++;
+  }
+  // Past the last fragment: start over next time
+  fragment_ = 0;
+  fragment_begin_ = 0;
+  return nullptr;
+}
+
+template <bool little_endian>
+void Iterator<little_endian>::CopyTo(uint8_t* destination, size_t length) {
+  ASSERT_LOG(index_ >= begin_ && index_ <= end_ && length <= end_ - index_, "%zu bytes at index %zu out of bounds: [%zu,%zu)",
+             length, index_, begin_, end_);
+  if (contiguous_ != nullptr) {
+    std::memcpy(destination, contiguous_ + index_, length);
+    index_ += length;
+    return;
+  }
+  while (length > 0) {
+    const uint8_t* source = FindFragment(index_, 1);
+    ASSERT_LOG(source != nullptr, "Out of fragments searching for index %zu", index_);
+    size_t available = (*data_)[fragment_].size() - (index_ - fragment_begin_);
+    size_t to_copy = std::min(length, available);
+    std::memcpy(destination, source, to_copy);
+    destination += to_copy;
+    index_ += to_copy;
+    length -= to_copy;
   }
-  ASSERT_LOG(false, "Out of fragments searching for index %zu", index_);
-  return 0;
 }
 
 template <bool little_endian>
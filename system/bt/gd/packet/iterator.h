@@ -17,8 +17,10 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <forward_list>
 #include <memory>
+#include <vector>
 
 #include "packet/view.h"
 
@@ -30,6 +32,7 @@ template <bool little_endian>
 class Iterator : public std::iterator<std::random_access_iterator_tag, uint8_t> {
  public:
   Iterator(std::forward_list<View> data, size_t offset);
+  Iterator(std::shared_ptr<const std::vector<View>> data, size_t offset);
   Iterator(const Iterator& itr) = default;
   virtual ~Iterator() = default;
 
@@ -67,9 +70,14 @@ class Iterator : public std::iterator<std::random_access_iterator_tag, uint8_t>
   template <typename FixedWidthPODType>
   FixedWidthPODType extract() {
     static_assert(std::is_pod<FixedWidthPODType>::value, "Iterator::extract requires a fixed-width type.");
+    const uint8_t* bytes = Contiguous(sizeof(FixedWidthPODType));
+    if (bytes != nullptr) {
+      index_ += sizeof(FixedWidthPODType);
+      return Load<FixedWidthPODType>(bytes);
+    }
+
     FixedWidthPODType extracted_value{};
     uint8_t* value_ptr = (uint8_t*)&extracted_value;
-
     for (size_t i = 0; i < sizeof(FixedWidthPODType); i++) {
       size_t index = (little_endian ? i : sizeof(FixedWidthPODType) - i - 1);
       value_ptr[index] = *((*this)++);
@@ -77,8 +85,47 @@ class Iterator : public std::iterator<std::random_access_iterator_tag, uint8_t>
     return extracted_value;
   }
 
+  // Read a FixedWidthPODType from contiguous bytes
+  template <typename FixedWidthPODType>
+  static FixedWidthPODType Load(const uint8_t* bytes) {
+    static_assert(std::is_pod<FixedWidthPODType>::value, "Iterator::Load requires a fixed-width type.");
+    FixedWidthPODType loaded_value{};
+    uint8_t* value_ptr = (uint8_t*)&loaded_value;
+    if (little_endian) {
+      std::memcpy(value_ptr, bytes, sizeof(FixedWidthPODType));
+    } else {
+      for (size_t i = 0; i < sizeof(FixedWidthPODType); i++) {
+        value_ptr[sizeof(FixedWidthPODType) - i - 1] = bytes[i];
+      }
+    }
+    return loaded_value;
+  }
+
+  // Copy the next length bytes to destination
+  void CopyTo(uint8_t* destination, size_t length);
+
  private:
-  std::forward_list<View> data_;
+  // Pointer to the next length bytes when they are in bounds and in a single
+  // fragment, nullptr otherwise. Bounds are checked once for all of them.
+  const uint8_t* Contiguous(size_t length) const {
+    if (index_ < begin_ || index_ > end_ || length > end_ - index_) {
+      return nullptr;
+    }
+    if (contiguous_ != nullptr) {
+      return contiguous_ + index_;
+    }
+    return FindFragment(index_, length);
+  }
+
+  const uint8_t* FindFragment(size_t index, size_t length) const;
+
+  // All fragments, shared between copies of the iterator
+  std::shared_ptr<const std::vector<View>> data_;
+  // The data when it is a single fragment
+  const uint8_t* contiguous_;
+  // The fragment last read from, and the index of its first byte
+  mutable size_t fragment_;
+  mutable size_t fragment_begin_;
   size_t index_;
   size_t begin_;
   size_t end_;
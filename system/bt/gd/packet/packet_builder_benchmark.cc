@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <memory>
+#include <vector>
+
+#include "hci/hci_packets.h"
+#include "l2cap/l2cap_packets.h"
+#include "packet/bit_inserter.h"
+#include "packet/raw_builder.h"
+
+using ::benchmark::State;
+
+namespace bluetooth {
+namespace packet {
+
+namespace {
+
+constexpr uint16_t kAttCid = 0x0004;
+constexpr uint8_t kAttHandleValueNotification = 0x1b;
+
+// An ATT Handle Value Notification in an L2CAP basic frame in an ACL packet,
+// as a GATT server sends them
+std::unique_ptr<BasePacketBuilder> AttNotification(const std::vector<uint8_t>& value) {
+  auto att = std::make_unique<RawBuilder>();
+  att->AddOctets1(kAttHandleValueNotification);
+  att->AddOctets2(0x002a);
+  att->AddOctets(value);
+  auto l2cap = l2cap::BasicFrameBuilder::Create(kAttCid, std::move(att));
+  return hci::AclPacketBuilder::Create(0x0040, hci::PacketBoundaryFlag::FIRST_NON_AUTOMATICALLY_FLUSHABLE,
+                                       hci::BroadcastFlag::POINT_TO_POINT, std::move(l2cap));
+}
+
+}  // namespace
+
+// Arguments are the size of the attribute value, and whether the packet is
+// written into a buffer of its size rather than appended to a vector
+void BM_BuildAttNotification(State& state) {
+  std::vector<uint8_t> value(state.range(0), 0xa5);
+  const bool preallocated = state.range(1);
+  size_t bytes_built = 0;
+  for (auto _ : state) {
+    auto packet = AttNotification(value);
+    if (preallocated) {
+      std::vector<uint8_t> bytes(packet->size());
+      packet->SerializeTo(bytes.data(), bytes.size());
+      bytes_built += bytes.size();
+      benchmark::DoNotOptimize(bytes.data());
+    } else {
+      std::vector<uint8_t> bytes;
+      BitInserter it(bytes);
+      packet->Serialize(it);
+      bytes_built += bytes.size();
+      benchmark::DoNotOptimize(bytes.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes_built);
+}
+BENCHMARK(BM_BuildAttNotification)
+    ->ArgNames({"value", "preallocated"})
+    ->Args({20, 0})
+    ->Args({20, 1})
+    ->Args({244, 0})
+    ->Args({244, 1});
+
+}  // namespace packet
+}  // namespace bluetooth
@@ -18,6 +18,8 @@
 
 #include <cstdint>
 #include <forward_list>
+#include <memory>
+#include <vector>
 
 #include "packet/iterator.h"
 #include "packet/view.h"
@@ -55,11 +57,28 @@ class PacketView {
  protected:
   void Append(PacketView to_add);
 
+  // Get the sizeof(FixedWidthPODType) bytes at index, read from the buffer
+  // directly when the packet is a single fragment
+  template <typename FixedWidthPODType>
+  FixedWidthPODType ExtractAt(size_t index) const {
+    if (fragments_->size() == 1 && index <= length_ && sizeof(FixedWidthPODType) <= length_ - index) {
+      return Iterator<little_endian>::template Load<FixedWidthPODType>(fragments_->front().data() + index);
+    }
+    return (begin() + index).template extract<FixedWidthPODType>();
+  }
+
  private:
-  std::forward_list<View> fragments_;
+  template <bool>
+  friend class PacketView;
+
+  PacketView(std::shared_ptr<const std::vector<View>> fragments, size_t length);
+
+  // Fragments are never modified once shared: copies of the view and its
+  // iterators share them
+  std::shared_ptr<const std::vector<View>> fragments_;
   size_t length_;
   PacketView<little_endian>() = delete;
-  std::forward_list<View> GetSubviewList(size_t begin, size_t end) const;
+  std::shared_ptr<const std::vector<View>> GetSubviewList(size_t begin, size_t end) const;
 };
 
 }  // namespace packet
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <forward_list>
+#include <memory>
+#include <vector>
+
+#include "hci/hci_packets.h"
+#include "l2cap/l2cap_packets.h"
+#include "packet/packet_view.h"
+
+using ::benchmark::State;
+
+namespace bluetooth {
+namespace packet {
+
+namespace {
+
+constexpr uint8_t kNumHandles = 4;
+constexpr uint16_t kL2capPayloadSize = 1017;
+
+// Number Of Completed Packets, the most frequent event during ACL traffic
+std::shared_ptr<std::vector<uint8_t>> NumberOfCompletedPacketsEvent() {
+  auto bytes = std::make_shared<std::vector<uint8_t>>();
+  bytes->push_back(static_cast<uint8_t>(hci::EventCode::NUMBER_OF_COMPLETED_PACKETS));
+  bytes->push_back(1 + 4 * kNumHandles);
+  bytes->push_back(kNumHandles);
+  for (uint8_t i = 0; i < kNumHandles; i++) {
+    bytes->insert(bytes->end(), {static_cast<uint8_t>(0x40 + i), 0x00, 0x01, 0x00});
+  }
+  return bytes;
+}
+
+// LE Connection Complete, a packet with many fixed fields
+std::shared_ptr<std::vector<uint8_t>> LeConnectionCompleteEvent() {
+  return std::make_shared<std::vector<uint8_t>>(std::vector<uint8_t>{
+      static_cast<uint8_t>(hci::EventCode::LE_META_EVENT),
+      19,
+      static_cast<uint8_t>(hci::SubeventCode::CONNECTION_COMPLETE),
+      0x00,  // status
+      0x40, 0x00,  // connection handle
+      0x00,  // role
+      0x01,  // peer address type
+      0x11, 0x22, 0x33, 0x44, 0x55, 0x66,  // peer address
+      0x18, 0x00,  // connection interval
+      0x00, 0x00,  // connection latency
+      0xf4, 0x01,  // supervision timeout
+      0x00,  // master clock accuracy
+  });
+}
+
+// L2CAP Connection Response, on the signalling channel
+std::shared_ptr<std::vector<uint8_t>> L2capConnectionResponse() {
+  return std::make_shared<std::vector<uint8_t>>(std::vector<uint8_t>{
+      0x0c, 0x00,  // basic frame size
+      0x01, 0x00,  // signalling channel
+      static_cast<uint8_t>(l2cap::CommandCode::CONNECTION_RESPONSE),
+      0x05,  // identifier
+      0x08, 0x00,  // control size
+      0x40, 0x00,  // destination cid
+      0x41, 0x00,  // source cid
+      0x00, 0x00,  // result
+      0x00, 0x00,  // status
+  });
+}
+
+// An ACL packet carrying a whole L2CAP basic frame, split in |num_fragments|
+// the way reassembled packets are
+PacketView<kLittleEndian> AclPacket(size_t num_fragments) {
+  std::vector<uint8_t> bytes = {0x40, 0x20, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00};
+  uint16_t l2cap_size = kL2capPayloadSize;
+  uint16_t acl_size = l2cap_size + 4;
+  bytes[2] = acl_size & 0xff;
+  bytes[3] = acl_size >> 8;
+  bytes[4] = l2cap_size & 0xff;
+  bytes[5] = l2cap_size >> 8;
+  bytes.resize(bytes.size() + l2cap_size, 0xa5);
+
+  std::forward_list<View> fragments;
+  auto it = fragments.before_begin();
+  size_t fragment_size = (bytes.size() + num_fragments - 1) / num_fragments;
+  for (size_t begin = 0; begin < bytes.size(); begin += fragment_size) {
+    size_t end = std::min(begin + fragment_size, bytes.size());
+    auto fragment = std::make_shared<std::vector<uint8_t>>(bytes.begin() + begin, bytes.begin() + end);
+    it = fragments.insert_after(it, View(fragment, 0, fragment->size()));
+  }
+  return PacketView<kLittleEndian>(fragments);
+}
+
+}  // namespace
+
+void BM_ParseHciEvent(State& state) {
+  auto bytes = NumberOfCompletedPacketsEvent();
+  for (auto _ : state) {
+    auto event = hci::EventPacketView::Create(PacketView<kLittleEndian>(bytes));
+    if (!event.IsValid() || event.GetEventCode() != hci::EventCode::NUMBER_OF_COMPLETED_PACKETS) {
+      state.SkipWithError("Invalid event");
+      break;
+    }
+    auto completed = hci::NumberOfCompletedPacketsView::Create(event);
+    if (!completed.IsValid()) {
+      state.SkipWithError("Invalid Number Of Completed Packets");
+      break;
+    }
+    uint32_t num_packets = 0;
+    for (const auto& entry : completed.GetCompletedPackets()) {
+      num_packets += entry.host_num_of_completed_packets_;
+    }
+    benchmark::DoNotOptimize(num_packets);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * bytes->size());
+}
+BENCHMARK(BM_ParseHciEvent);
+
+void BM_ParseLeConnectionComplete(State& state) {
+  auto bytes = LeConnectionCompleteEvent();
+  for (auto _ : state) {
+    auto event = hci::EventPacketView::Create(PacketView<kLittleEndian>(bytes));
+    auto le_meta_event = hci::LeMetaEventView::Create(event);
+    auto complete = hci::LeConnectionCompleteView::Create(le_meta_event);
+    if (!event.IsValid() || !le_meta_event.IsValid() || !complete.IsValid()) {
+      state.SkipWithError("Invalid LE Connection Complete");
+      break;
+    }
+    benchmark::DoNotOptimize(complete.GetStatus());
+    benchmark::DoNotOptimize(complete.GetConnectionHandle());
+    benchmark::DoNotOptimize(complete.GetRole());
+    benchmark::DoNotOptimize(complete.GetPeerAddressType());
+    benchmark::DoNotOptimize(complete.GetPeerAddress());
+    benchmark::DoNotOptimize(complete.GetConnInterval());
+    benchmark::DoNotOptimize(complete.GetConnLatency());
+    benchmark::DoNotOptimize(complete.GetSupervisionTimeout());
+    benchmark::DoNotOptimize(complete.GetMasterClockAccuracy());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * bytes->size());
+}
+BENCHMARK(BM_ParseLeConnectionComplete);
+
+void BM_ParseL2capConnectionResponse(State& state) {
+  auto bytes = L2capConnectionResponse();
+  for (auto _ : state) {
+    auto frame = l2cap::BasicFrameView::Create(PacketView<kLittleEndian>(bytes));
+    auto control_frame = l2cap::ControlFrameView::Create(frame);
+    if (!frame.IsValid() || !control_frame.IsValid()) {
+      state.SkipWithError("Invalid signalling frame");
+      break;
+    }
+    auto control = l2cap::ControlView::Create(control_frame.GetPayload());
+    auto response = l2cap::ConnectionResponseView::Create(control);
+    if (!control.IsValid() || !response.IsValid()) {
+      state.SkipWithError("Invalid Connection Response");
+      break;
+    }
+    benchmark::DoNotOptimize(response.GetIdentifier());
+    benchmark::DoNotOptimize(response.GetDestinationCid());
+    benchmark::DoNotOptimize(response.GetSourceCid());
+    benchmark::DoNotOptimize(response.GetResult());
+    benchmark::DoNotOptimize(response.GetStatus());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * bytes->size());
+}
+BENCHMARK(BM_ParseL2capConnectionResponse);
+
+// Argument is the number of fragments the ACL packet is made of
+void BM_ParseAclL2cap(State& state) {
+  auto packet = AclPacket(state.range(0));
+  for (auto _ : state) {
+    auto acl = hci::AclPacketView::Create(packet);
+    if (!acl.IsValid()) {
+      state.SkipWithError("Invalid ACL packet");
+      break;
+    }
+    benchmark::DoNotOptimize(acl.GetHandle());
+    benchmark::DoNotOptimize(acl.GetPacketBoundaryFlag());
+    auto frame = l2cap::BasicFrameView::Create(acl.GetPayload());
+    if (!frame.IsValid()) {
+      state.SkipWithError("Invalid L2CAP frame");
+      break;
+    }
+    benchmark::DoNotOptimize(frame.GetChannelId());
+    benchmark::DoNotOptimize(frame.GetPayload().size());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * packet.size());
+}
+BENCHMARK(BM_ParseAclL2cap)->Arg(1)->Arg(2)->Arg(4);
+
+// Arguments are the number of fragments, and whether the payload is copied
+// with CopyTo() rather than byte by byte
+void BM_CopyPayload(State& state) {
+  auto packet = AclPacket(state.range(0));
+  const bool bulk = state.range(1);
+  std::vector<uint8_t> payload(packet.size());
+  for (auto _ : state) {
+    auto it = packet.begin();
+    if (bulk) {
+      it.CopyTo(payload.data(), payload.size());
+    } else {
+      for (auto& byte : payload) {
+        byte = *it++;
+      }
+    }
+    benchmark::DoNotOptimize(payload.data());
+  }
+  state.SetBytesProcessed(state.iterations() * packet.size());
+}
+BENCHMARK(BM_CopyPayload)->ArgNames({"fragments", "bulk"})->Args({1, 0})->Args({1, 1})->Args({4, 0})->Args({4, 1});
+
+}  // namespace packet
+}  // namespace bluetooth
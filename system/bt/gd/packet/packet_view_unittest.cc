@@ -571,6 +571,33 @@ TEST_F(PacketViewMultiViewAppendTest, arrayOperatorTestAppend) {
   ASSERT_DEATH(multi_view[single_view.size()], "");
 }
 
+TEST_F(PacketViewMultiViewTest, extractAcrossFragmentsTest) {
+  auto single_itr = single_view.begin();
+  auto multi_itr = multi_view.begin();
+  // Fragments end at 3 and 13: values straddle both boundaries
+  ASSERT_EQ(single_itr.extract<uint16_t>(), multi_itr.extract<uint16_t>());
+  ASSERT_EQ(single_itr.extract<uint32_t>(), multi_itr.extract<uint32_t>());
+  ASSERT_EQ(single_itr.extract<uint64_t>(), multi_itr.extract<uint64_t>());
+  ASSERT_EQ(single_itr.extract<uint32_t>(), multi_itr.extract<uint32_t>());
+  // Going back to an earlier fragment
+  multi_itr -= 16;
+  single_itr -= 16;
+  ASSERT_EQ(single_itr.extract<uint32_t>(), multi_itr.extract<uint32_t>());
+}
+
+TEST_F(PacketViewMultiViewTest, copyToTest) {
+  vector<uint8_t> single_bytes(single_view.size() - 2);
+  vector<uint8_t> multi_bytes(multi_view.size() - 2);
+  auto single_itr = single_view.begin() + 1;
+  auto multi_itr = multi_view.begin() + 1;
+  single_itr.CopyTo(single_bytes.data(), single_bytes.size());
+  multi_itr.CopyTo(multi_bytes.data(), multi_bytes.size());
+  ASSERT_EQ(vector<uint8_t>(count_all.begin() + 1, count_all.end() - 1), single_bytes);
+  ASSERT_EQ(single_bytes, multi_bytes);
+  ASSERT_EQ(count_all.back(), *multi_itr);
+  ASSERT_DEATH(multi_itr.CopyTo(multi_bytes.data(), 2), "");
+}
+
 TEST(ViewTest, arrayOperatorTest) {
   View view_all(std::make_shared<const vector<uint8_t>>(count_all), 0, count_all.size());
   size_t past_end = view_all.size();
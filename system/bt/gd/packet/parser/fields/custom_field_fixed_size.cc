@@ -43,8 +43,9 @@ int CustomFieldFixedSize::GenBounds(std::ostream& s, Size start_offset, Size end
   return 0;  // num_leading_bits
 }
 
-void CustomFieldFixedSize::GenExtractor(std::ostream& s, int, bool) const {
-  s << "*" << GetName() << "_ptr = " << GetName() << "_it.extract<" << GetDataType() << ">();";
+void CustomFieldFixedSize::GenExtraction(std::ostream& s, int, const std::string& function,
+                                         const std::string& argument) const {
+  s << "*" << GetName() << "_ptr = " << function << "<" << GetDataType() << ">(" << argument << ");";
 }
 
 bool CustomFieldFixedSize::HasParameterValidator() const {
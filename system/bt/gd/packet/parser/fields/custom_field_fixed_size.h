@@ -31,8 +31,6 @@ class CustomFieldFixedSize : public ScalarField {
 
   virtual int GenBounds(std::ostream& s, Size start_offset, Size end_offset, Size size) const override;
 
-  virtual void GenExtractor(std::ostream& s, int num_leading_bits, bool for_struct) const override;
-
   virtual bool HasParameterValidator() const override;
 
   virtual void GenParameterValidator(std::ostream&) const override;
@@ -44,4 +42,8 @@ class CustomFieldFixedSize : public ScalarField {
   virtual void GenStringRepresentation(std::ostream& s, std::string accessor) const override;
 
   std::string type_name_;
+
+ protected:
+  virtual void GenExtraction(std::ostream& s, int num_leading_bits, const std::string& function,
+                             const std::string& argument) const override;
 };
@@ -65,12 +65,17 @@ int ScalarField::GenBounds(std::ostream& s, Size start_offset, Size end_offset,
 }
 
 void ScalarField::GenExtractor(std::ostream& s, int num_leading_bits, bool) const {
+  GenExtraction(s, num_leading_bits, GetName() + "_it.extract", "");
+}
+
+void ScalarField::GenExtraction(std::ostream& s, int num_leading_bits, const std::string& function,
+                                const std::string& argument) const {
   Size size = GetSize();
   // Extract the correct number of bytes. The return type could be different
   // from the extract type if an earlier field causes the beginning of the
   // current field to start in the middle of a byte.
   std::string extract_type = util::GetTypeForSize(size.bits() + num_leading_bits);
-  s << "auto extracted_value = " << GetName() << "_it.extract<" << extract_type << ">();";
+  s << "auto extracted_value = " << function << "<" << extract_type << ">(" << argument << ");";
 
   // Right shift the result to remove leading bits.
   if (num_leading_bits != 0) {
@@ -95,13 +100,36 @@ std::string ScalarField::GetGetterFunctionName() const {
 }
 
 void ScalarField::GenGetter(std::ostream& s, Size start_offset, Size end_offset) const {
+  // Fields at a fixed offset from begin() get it as a constant.
+  std::string offset_name = "k" + util::UnderscoreToCamelCase(GetName()) + "Offset";
+  bool fixed_offset = !start_offset.empty() && !start_offset.has_dynamic();
+  if (fixed_offset) {
+    s << "static constexpr size_t " << offset_name << " = " << start_offset.bits() / 8 << ";";
+  }
+
   s << GetDataType() << " " << GetGetterFunctionName() << "() const {";
   s << "ASSERT(was_validated_);";
-  s << "auto to_bound = begin();";
-  int num_leading_bits = GenBounds(s, start_offset, end_offset, GetSize());
+
+  // The view was validated: read the bytes at the field's index directly.
+  int num_leading_bits = 0;
+  std::string index_name = GetName() + "_index";
+  if (fixed_offset) {
+    num_leading_bits = start_offset.bits() % 8;
+    index_name = offset_name;
+  } else if (!start_offset.empty()) {
+    num_leading_bits = start_offset.bits() % 8;
+    s << "size_t " << index_name << " = (" << start_offset << ") / 8;";
+  } else if (!end_offset.empty()) {
+    num_leading_bits = GetShiftBits(end_offset.bits() + GetSize().bits());
+    Size byte_offset = Size(num_leading_bits + GetSize().bits()) + end_offset;
+    s << "size_t " << index_name << " = size() - (" << byte_offset << ") / 8;";
+  } else {
+    ERROR(this) << "Ambiguous offset for field.";
+  }
+
   s << GetDataType() << " " << GetName() << "_value{};";
   s << GetDataType() << "* " << GetName() << "_ptr = &" << GetName() << "_value;";
-  GenExtractor(s, num_leading_bits, false);
+  GenExtraction(s, num_leading_bits, "ExtractAt", index_name);
   s << "return " << GetName() << "_value;";
   s << "}";
 }
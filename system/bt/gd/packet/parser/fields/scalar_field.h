@@ -51,6 +51,11 @@ class ScalarField : public PacketField {
 
   virtual void GenStringRepresentation(std::ostream& s, std::string accessor) const override;
 
+ protected:
+  // Generate the extraction of the field value by calling function<Type>(argument).
+  virtual void GenExtraction(std::ostream& s, int num_leading_bits, const std::string& function,
+                             const std::string& argument) const;
+
  private:
   const int size_;
 };
@@ -192,14 +192,16 @@ void PacketDef::GenValidator(std::ostream& s) const {
     parent_size = parent_->GetSize(true);
   }
 
-  s << "auto it = begin() + (" << parent_size << ") / 8;";
+  // Walk the fields once with an index rather than an iterator.
+  s << "size_t end_index = size();";
+  s << "size_t index = (" << parent_size << ") / 8;";
 
   // Check if you can extract the static fields.
   // At this point you know you can use the size getters without crashing
   // as long as they follow the instruction that size fields cant come before
   // their corrisponding variable length field.
-  s << "it += " << ((bits_size + 7) / 8) << " /* Total size of the fixed fields */;";
-  s << "if (it > end()) return false;";
+  s << "index += " << ((bits_size + 7) / 8) << " /* Total size of the fixed fields */;";
+  s << "if (index > end_index) return false;";
 
   // For any variable length fields, use their size check.
   for (const auto& field : fields_) {
@@ -240,8 +242,8 @@ void PacketDef::GenValidator(std::ostream& s) const {
       s << "checksum.Initialize();";
       s << "for (uint8_t byte : checksum_view) { ";
       s << "checksum.AddByte(byte);}";
-      s << "if (checksum.GetChecksum() != (begin() + end_sum_index).extract<"
-        << util::GetTypeForSize(started_field->GetSize().bits()) << ">()) { return false; }";
+      s << "if (checksum.GetChecksum() != ExtractAt<"
+        << util::GetTypeForSize(started_field->GetSize().bits()) << ">(end_sum_index)) { return false; }";
 
       continue;
     }
@@ -274,12 +276,12 @@ void PacketDef::GenValidator(std::ostream& s) const {
       s << "(begin() + (" << offset << ") / 8);";
 
       s << "if (!" << custom_size_var << ".has_value()) { return false; }";
-      s << "it += *" << custom_size_var << ";";
-      s << "if (it > end()) return false;";
+      s << "index += *" << custom_size_var << ";";
+      s << "if (index > end_index) return false;";
       continue;
     } else {
-      s << "it += (" << field_size.dynamic_string() << ") / 8;";
-      s << "if (it > end()) return false;";
+      s << "index += (" << field_size.dynamic_string() << ") / 8;";
+      s << "if (index > end_index) return false;";
     }
   }
 
@@ -127,6 +127,36 @@ TEST(GeneratedPacketTest, testChild) {
   ASSERT_EQ(field_name, child_view.GetFieldName());
 }
 
+TEST(GeneratedPacketTest, testFixedOffsetFields) {
+  static_assert(ChildView::kFieldNameOffset == 2, "field_name follows the fixed and size fields");
+  static_assert(ChildWithSixBytesView::kChildSixBytesOffset == 8, "child_six_bytes follows the parent's fields");
+  static_assert(MiddleFourBitsView::kStraddleOffset == 0, "straddle starts in the first byte");
+
+  // Split the packet in the middle of each field read
+  std::forward_list<View> fragments;
+  auto fragment_it = fragments.before_begin();
+  for (size_t begin = 0; begin < child_with_six_bytes.size(); begin += 3) {
+    size_t end = std::min(begin + 3, child_with_six_bytes.size());
+    auto bytes =
+        std::make_shared<std::vector<uint8_t>>(child_with_six_bytes.begin() + begin, child_with_six_bytes.begin() + end);
+    fragment_it = fragments.insert_after(fragment_it, View(bytes, 0, bytes->size()));
+  }
+  PacketView<kLittleEndian> fragmented_view(fragments);
+  PacketView<kLittleEndian> contiguous_view(std::make_shared<std::vector<uint8_t>>(child_with_six_bytes));
+
+  SixBytes six_bytes_a{{0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6}};
+  SixBytes six_bytes_b{{0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6}};
+  for (auto packet_view : {fragmented_view, contiguous_view}) {
+    auto parent_view = ParentWithSixBytesView::Create(packet_view);
+    ASSERT_TRUE(parent_view.IsValid());
+    auto child_view = ChildWithSixBytesView::Create(parent_view);
+    ASSERT_TRUE(child_view.IsValid());
+    ASSERT_EQ(0x1234, child_view.GetTwoBytes());
+    ASSERT_EQ(six_bytes_a, child_view.GetSixBytes());
+    ASSERT_EQ(six_bytes_b, child_view.GetChildSixBytes());
+  }
+}
+
 TEST(GeneratedPacketTest, testValidateWayTooSmall) {
   std::vector<uint8_t> too_small_bytes = {0x34};
   auto too_small = std::make_shared<std::vector<uint8_t>>(too_small_bytes.begin(), too_small_bytes.end());
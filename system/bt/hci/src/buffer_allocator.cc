@@ -20,12 +20,13 @@
 
 #include "bt_common.h"
 #include "buffer_allocator.h"
+#include "osi/include/packet_allocator.h"
 
 static void* buffer_alloc(size_t size) {
   CHECK(size <= BT_DEFAULT_BUFFER_SIZE);
-  return osi_malloc(size);
+  return osi_pkt_alloc_from(size, __builtin_return_address(0));
 }
 
-static const allocator_t interface = {buffer_alloc, osi_free};
+static const allocator_t interface = {buffer_alloc, osi_pkt_free};
 
 const allocator_t* buffer_allocator_get_interface() { return &interface; }
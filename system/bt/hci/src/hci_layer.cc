@@ -41,7 +41,9 @@
 #include "buffer_allocator.h"
 #include "common/message_loop_thread.h"
 #include "common/metrics.h"
+#include "common/metrics_collector.h"
 #include "common/once_timer.h"
+#include "common/time_util.h"
 #include "hci_inject.h"
 #include "hci_internals.h"
 #include "hcidefs.h"
@@ -57,6 +59,7 @@
 #define BT_HCI_TIMEOUT_TAG_NUM 1010000
 
 using bluetooth::common::MessageLoopThread;
+using bluetooth::common::LatencyHistogram;
 using bluetooth::common::OnceTimer;
 
 extern void hci_initialize();
@@ -111,6 +114,13 @@ static int command_credits = 1;
 static std::mutex command_credits_mutex;
 static std::queue<base::Closure> command_queue;
 
+// From sending a command to the controller to its command complete or command
+// status event
+static LatencyHistogram hci_command_latency("bluetooth.hci.command_latency");
+// From an ACL packet being handed to the HCI layer to it being sent
+static LatencyHistogram acl_tx_queueing_delay(
+    "bluetooth.hci.acl_tx_queueing_delay");
+
 // Inbound-related
 static alarm_t* command_response_timer;
 static list_t* commands_pending_response;
@@ -136,7 +146,7 @@ static void startup_timer_expired(void* context);
 static void enqueue_command(waiting_command_t* wait_entry);
 static void event_command_ready(waiting_command_t* wait_entry);
 static void enqueue_packet(void* packet);
-static void event_packet_ready(void* packet);
+static void event_packet_ready(void* packet, uint64_t enqueue_time_us);
 static void command_timed_out(void* context);
 
 static void update_command_response_timer(void);
@@ -420,17 +430,23 @@ static void event_command_ready(waiting_command_t* wait_entry) {
 }
 
 static void enqueue_packet(void* packet) {
-  if (!hci_thread.DoInThread(FROM_HERE,
-                             base::Bind(&event_packet_ready, packet))) {
+  if (!hci_thread.DoInThread(
+          FROM_HERE,
+          base::Bind(&event_packet_ready, packet,
+                     bluetooth::common::time_get_os_boottime_us()))) {
     // HCI Layer was shut down or not running
     buffer_allocator->free(packet);
     return;
   }
 }
 
-static void event_packet_ready(void* pkt) {
+static void event_packet_ready(void* pkt, uint64_t enqueue_time_us) {
   // The queue may be the command queue or the packet queue, we don't care
   BT_HDR* packet = (BT_HDR*)pkt;
+  if ((packet->event & MSG_EVT_MASK) == MSG_STACK_TO_HC_HCI_ACL) {
+    acl_tx_queueing_delay.Record(bluetooth::common::time_get_os_boottime_us() -
+                                 enqueue_time_us);
+  }
   packet_fragmenter->fragment_and_dispatch(packet);
 }
 
@@ -758,6 +774,10 @@ static waiting_command_t* get_waiting_command(command_opcode_t opcode) {
 
     if (!wait_entry || wait_entry->opcode != opcode) continue;
 
+    hci_command_latency.Record(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wait_entry->timestamp)
+            .count());
     list_remove(commands_pending_response, wait_entry);
 
     return wait_entry;
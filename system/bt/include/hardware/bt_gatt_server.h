@@ -177,6 +177,12 @@ typedef struct {
       const RawAddress& bd_addr,
       base::Callback<void(uint8_t tx_phy, uint8_t rx_phy, uint8_t status)> cb);
 
+  /** Send the same value notification to several remote devices, the
+   *  result for each conn_id is reported through indication_sent_cb */
+  bt_status_t (*send_notification_multi)(int server_if, int attribute_handle,
+                                         std::vector<int> conn_ids,
+                                         std::vector<uint8_t> value);
+
 } btgatt_server_interface_t;
 
 __END_DECLS
@@ -821,6 +821,12 @@
 #define PORT_RX_BUF_CRITICAL_WM 15
 #endif
 
+/* The largest receive credit window, in number of buffers, granted to a port
+ * whose data is delivered by callback rather than queued. */
+#ifndef PORT_RX_BUF_MAX_WINDOW
+#define PORT_RX_BUF_MAX_WINDOW 32
+#endif
+
 /* The port transmit queue high watermark level, in bytes. */
 #ifndef PORT_TX_HIGH_WM
 #define PORT_TX_HIGH_WM (BTA_RFC_MTU_SIZE * PORT_TX_BUF_HIGH_WM)
@@ -0,0 +1,75 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sampling profiler of |osi_malloc| allocations, cheap enough to stay enabled
+// in production builds.
+//
+// Every thread counts down the bytes it allocates, and samples the allocation
+// which crosses a randomly drawn threshold, so that on average one sample is
+// taken every |interval| bytes. Only sampled allocations record their call
+// stack, and are aggregated by call site. Counts are scaled back to estimates
+// of all allocations, the way heap profilers do. Unlike the allocation
+// tracker, nothing is checked on the allocations themselves.
+
+#define ALLOCATION_SAMPLER_MAX_FRAMES 6
+
+// Mean number of bytes allocated between two samples, by default
+#define ALLOCATION_SAMPLER_DEFAULT_INTERVAL (512 * 1024)
+
+typedef struct {
+  // Return addresses, innermost first
+  const void* frames[ALLOCATION_SAMPLER_MAX_FRAMES];
+  size_t num_frames;
+  // Estimates for all allocations made from this call site
+  uint64_t allocated_count;
+  uint64_t allocated_bytes;
+  uint64_t live_count;
+  uint64_t live_bytes;
+} allocation_site_stats_t;
+
+// Sets the mean number of bytes allocated between two samples. 0 disables
+// sampling; allocations sampled before are still tracked until freed.
+void allocation_sampler_set_interval(size_t interval);
+
+// Notify the sampler of an allocation of |size| bytes at |ptr|, requested by
+// the code returning to |alloc_site|. If |ptr| is NULL, this function does
+// nothing.
+void allocation_sampler_notify_alloc(void* ptr, size_t size,
+                                     const void* alloc_site);
+
+// Notify the sampler that |ptr| is being freed. If |ptr| is NULL, this
+// function does nothing.
+void allocation_sampler_notify_free(void* ptr);
+
+// Fills |sites| with up to |max_sites| call sites, those with the most live
+// bytes first. Returns the number of sites filled.
+size_t allocation_sampler_get_sites(allocation_site_stats_t* sites,
+                                    size_t max_sites);
+
+// Forgets all samples. Don't call this in the normal course of operations.
+// Useful mostly for testing.
+void allocation_sampler_reset(void);
+
+// Dumps the call sites with the most live bytes to the |fd| file descriptor.
+void allocation_sampler_debug_dump(int fd);
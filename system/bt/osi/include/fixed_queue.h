@@ -81,6 +81,13 @@ bool fixed_queue_try_enqueue(fixed_queue_t* queue, void* data);
 // immediately. Otherwise, the next element in the queue is returned.
 void* fixed_queue_try_dequeue(fixed_queue_t* queue);
 
+// Dequeues up to |max_count| elements from |queue| into |data|, in queue
+// order, and returns how many were dequeued. This function will never block
+// the caller: it returns 0 if the queue is empty or NULL. |data| may not be
+// NULL and must have room for |max_count| elements.
+size_t fixed_queue_dequeue_n(fixed_queue_t* queue, void** data,
+                             size_t max_count);
+
 // Returns the first element from |queue|, if present, without dequeuing it.
 // This function will never block the caller. Returns NULL if there are no
 // elements in the queue or |queue| is NULL.
@@ -99,7 +106,9 @@ void* fixed_queue_try_peek_last(fixed_queue_t* queue);
 void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data);
 
 // Returns the iterateable list with all entries in the |queue|. This function
-// will never block the caller. |queue| may not be NULL.
+// will never block the caller. |queue| may not be NULL. The list is owned by
+// the queue and must not be modified. It reflects the queue at the time of
+// the call, and stays valid until this function is called again.
 //
 // NOTE: The return result of this function is not thread safe: the list could
 // be modified by another thread, and the result would be unpredictable.
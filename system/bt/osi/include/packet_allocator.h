@@ -0,0 +1,82 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocator for packet buffers (BT_HDR and their payload).
+//
+// Buffers are served from a few size classes, each carved out of a region
+// reserved once for the process. Every thread keeps a small cache of free
+// buffers per class, so allocating and freeing a buffer usually takes no
+// lock. Requests larger than the largest class, or made while a class is
+// exhausted, fall back to |osi_malloc|.
+//
+// Buffers are released with |osi_pkt_free| or |osi_free|, so they can be
+// passed down layers that free what they consume without those layers
+// knowing where the buffer came from. All functions are thread safe, and may
+// be called from thread_local destructors of exiting threads.
+
+// Statistics are gathered without stopping threads which allocate or free
+// buffers meanwhile, so they are exact only when the allocator is idle.
+typedef struct {
+  size_t buffer_size;
+  // Buffers taken from the reserved region so far
+  size_t buffer_count;
+  size_t in_use;
+  // High-water mark of |in_use|, counting the buffers threads keep cached
+  size_t max_in_use;
+  uint64_t total_allocations;
+  // Allocations served by |osi_malloc| because the class was exhausted
+  uint64_t total_fallbacks;
+} packet_allocator_stats_t;
+
+// Allocates a buffer of at least |size| bytes, attributed to the caller. The
+// content of the buffer is undefined. Never returns NULL.
+void* osi_pkt_alloc(size_t size);
+
+// Same as |osi_pkt_alloc|, attributing the buffer to |alloc_site| rather than
+// to the caller. Meant for allocators that forward to this one.
+void* osi_pkt_alloc_from(size_t size, const void* alloc_site);
+
+// Frees |ptr|, which may come from |osi_pkt_alloc| or |osi_malloc|. Safe to
+// call with NULL.
+void osi_pkt_free(void* ptr);
+
+// Returns |ptr| to its size class. Returns false if |ptr| was not allocated
+// from a size class. Called by |osi_free|.
+bool packet_allocator_release(void* ptr);
+
+// Returns the number of size classes.
+size_t packet_allocator_num_classes(void);
+
+// Fills |stats| with the current statistics of size class |index|, which
+// must be lower than |packet_allocator_num_classes|.
+void packet_allocator_get_stats(size_t index, packet_allocator_stats_t* stats);
+
+// Fills |stats| with the current statistics of the size class serving buffers
+// of |size| bytes, or with zeroes if no class does.
+void packet_allocator_get_stats_for_size(size_t size,
+                                         packet_allocator_stats_t* stats);
+
+// Dumps the statistics of every size class, and the buffers still in use
+// grouped by allocation site, to the |fd| file descriptor.
+void packet_allocator_debug_dump(int fd);
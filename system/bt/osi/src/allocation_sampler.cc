@@ -0,0 +1,372 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_allocation_sampler"
+
+#include "osi/include/allocation_sampler.h"
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <unwind.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Sampled allocations still live are looked up by pointer when freed. Each
+// pointer hashes to a bucket filling one cache line, so that freeing an
+// allocation which was not sampled costs a few loads and no lock. Samples
+// which find their bucket full are counted, but not tracked until freed.
+static const size_t LIVE_BUCKET_SIZE = 8;
+static const size_t LIVE_BUCKETS = 256;
+static const size_t LIVE_SLOTS = LIVE_BUCKET_SIZE * LIVE_BUCKETS;
+
+// Call sites seen once this many are tracked are aggregated under
+// |OTHER_SITES_KEY|, which has no frames
+static const size_t MAX_SITES = 512;
+static const uint64_t OTHER_SITES_KEY = 0;
+
+// Frames walked looking for the allocation site before giving up
+static const size_t MAX_UNWIND_FRAMES = 32;
+
+// Call sites listed by |allocation_sampler_debug_dump|
+static const size_t DUMP_SITES = 16;
+
+typedef struct {
+  const void* frames[ALLOCATION_SAMPLER_MAX_FRAMES];
+  size_t num_frames;
+  // Sums of the weights of the samples taken here, see |sample_weight|
+  double allocated_count;
+  double allocated_bytes;
+  double live_count;
+  double live_bytes;
+} site_t;
+
+typedef struct {
+  uint64_t site_key;
+  size_t size;
+  double weight;
+} live_sample_t;
+
+typedef struct {
+  int64_t bytes_until_sample;
+  uint64_t random_state;
+  // Value of |sampler_generation| when |bytes_until_sample| was drawn
+  uint32_t generation;
+} sampler_thread_t;
+
+static std::atomic<size_t> sample_interval(ALLOCATION_SAMPLER_DEFAULT_INTERVAL);
+// Bumped whenever the interval changes, so that threads draw a new distance
+static std::atomic<uint32_t> sampler_generation(1);
+
+static thread_local sampler_thread_t sampler_thread;
+
+// Guards everything below, and writes to |live_pointers|
+static std::mutex sampler_mutex;
+alignas(64) static std::atomic<void*> live_pointers[LIVE_SLOTS];
+static live_sample_t live_samples[LIVE_SLOTS];
+// Number of non-NULL |live_pointers|, read without the lock by frees
+static std::atomic<size_t> live_sample_count;
+static uint64_t total_samples;
+static uint64_t dropped_samples;
+
+// Allocated on first use and never freed: allocations can happen before
+// static constructors run, and after static destructors did.
+static std::unordered_map<uint64_t, site_t>& get_site_map(void) {
+  static std::unordered_map<uint64_t, site_t>* site_map =
+      new std::unordered_map<uint64_t, site_t>();
+  return *site_map;
+}
+
+static uint64_t next_random(sampler_thread_t* thread) {
+  // xorshift64*
+  uint64_t x = thread->random_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  thread->random_state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Draws the number of bytes to allocate before the next sample. Distances
+// follow an exponential distribution, so that every allocated byte has the
+// same chance to trigger a sample, whatever the size of the allocations.
+static int64_t next_sample_distance(sampler_thread_t* thread,
+                                    size_t interval) {
+  // Uniform in (0, 1]
+  double uniform =
+      ((next_random(thread) >> 11) + 1) * (1.0 / 9007199254740992.0);
+  return static_cast<int64_t>(-log(uniform) * interval) + 1;
+}
+
+// Returns the number of allocations a sample of |size| bytes stands for: the
+// inverse of the probability that such an allocation gets sampled.
+static double sample_weight(size_t size, size_t interval) {
+  return 1.0 / -expm1(-static_cast<double>(size) / interval);
+}
+
+static uint64_t estimate(double value) {
+  return value < 0.5 ? 0 : static_cast<uint64_t>(value + 0.5);
+}
+
+static size_t bucket_of(const void* ptr) {
+  uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr)) *
+                  0x9E3779B97F4A7C15ULL;
+  return (hash >> 32) % LIVE_BUCKETS;
+}
+
+typedef struct {
+  const void* alloc_site;
+  const void** frames;
+  size_t num_frames;
+  size_t num_walked;
+  bool found_site;
+} unwind_state_t;
+
+static _Unwind_Reason_Code unwind_frame(struct _Unwind_Context* context,
+                                        void* arg) {
+  unwind_state_t* state = static_cast<unwind_state_t*>(arg);
+  const void* pc = reinterpret_cast<const void*>(_Unwind_GetIP(context));
+  if (pc == NULL) return _URC_END_OF_STACK;
+
+  // Frames of the allocator itself are skipped
+  if (!state->found_site) {
+    if (pc != state->alloc_site) {
+      return ++state->num_walked < MAX_UNWIND_FRAMES ? _URC_NO_REASON
+                                                     : _URC_END_OF_STACK;
+    }
+    state->found_site = true;
+  }
+
+  state->frames[state->num_frames++] = pc;
+  return state->num_frames < ALLOCATION_SAMPLER_MAX_FRAMES ? _URC_NO_REASON
+                                                           : _URC_END_OF_STACK;
+}
+
+// Fills the frames of |site| with the call stack starting at |alloc_site|.
+// Only the allocation site itself is recorded if the stack can't be walked.
+static void capture_stack(const void* alloc_site, site_t* site) {
+  unwind_state_t state = {};
+  state.alloc_site = alloc_site;
+  state.frames = site->frames;
+  _Unwind_Backtrace(unwind_frame, &state);
+
+  if (state.found_site) {
+    site->num_frames = state.num_frames;
+  } else {
+    site->frames[0] = alloc_site;
+    site->num_frames = 1;
+  }
+}
+
+static uint64_t site_key(const site_t& site) {
+  uint64_t key = site.num_frames;
+  for (size_t i = 0; i < site.num_frames; i++) {
+    key = (key ^ reinterpret_cast<uintptr_t>(site.frames[i])) *
+          0x100000001B3ULL;
+  }
+  return key == OTHER_SITES_KEY ? key + 1 : key;
+}
+
+static void record_sample(void* ptr, size_t size, const void* alloc_site,
+                          size_t interval) {
+  // Walking the stack is the costly part, and is done without the lock
+  site_t sampled = {};
+  capture_stack(alloc_site, &sampled);
+  uint64_t key = site_key(sampled);
+  double weight = sample_weight(size, interval);
+
+  std::lock_guard<std::mutex> lock(sampler_mutex);
+  std::unordered_map<uint64_t, site_t>& site_map = get_site_map();
+  auto it = site_map.find(key);
+  if (it == site_map.end()) {
+    if (site_map.size() >= MAX_SITES) {
+      key = OTHER_SITES_KEY;
+      sampled.num_frames = 0;
+    }
+    it = site_map.emplace(key, sampled).first;
+  }
+
+  site_t* site = &it->second;
+  total_samples++;
+  site->allocated_count += weight;
+  site->allocated_bytes += weight * size;
+
+  size_t first = bucket_of(ptr) * LIVE_BUCKET_SIZE;
+  for (size_t slot = first; slot < first + LIVE_BUCKET_SIZE; slot++) {
+    if (live_pointers[slot].load(std::memory_order_relaxed) != NULL) continue;
+
+    live_samples[slot] = {key, size, weight};
+    site->live_count += weight;
+    site->live_bytes += weight * size;
+    live_pointers[slot].store(ptr, std::memory_order_relaxed);
+    live_sample_count.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  dropped_samples++;
+}
+
+static void forget_sample(size_t slot, void* ptr) {
+  std::lock_guard<std::mutex> lock(sampler_mutex);
+  // The sampler may have been reset since the slot was read
+  if (live_pointers[slot].load(std::memory_order_relaxed) != ptr) return;
+
+  live_pointers[slot].store(NULL, std::memory_order_relaxed);
+  live_sample_count.fetch_sub(1, std::memory_order_relaxed);
+
+  const live_sample_t& sample = live_samples[slot];
+  std::unordered_map<uint64_t, site_t>& site_map = get_site_map();
+  auto it = site_map.find(sample.site_key);
+  if (it == site_map.end()) return;
+  it->second.live_count -= sample.weight;
+  it->second.live_bytes -= sample.weight * sample.size;
+}
+
+void allocation_sampler_set_interval(size_t interval) {
+  sample_interval.store(interval, std::memory_order_relaxed);
+  sampler_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+void allocation_sampler_notify_alloc(void* ptr, size_t size,
+                                     const void* alloc_site) {
+  size_t interval = sample_interval.load(std::memory_order_relaxed);
+  if (ptr == NULL || interval == 0) return;
+
+  sampler_thread_t* thread = &sampler_thread;
+  uint32_t generation = sampler_generation.load(std::memory_order_relaxed);
+  if (thread->generation != generation) {
+    if (thread->random_state == 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      thread->random_state = (reinterpret_cast<uintptr_t>(thread) ^
+                              static_cast<uint64_t>(now.tv_nsec)) |
+                             1;
+    }
+    thread->bytes_until_sample = next_sample_distance(thread, interval);
+    thread->generation = generation;
+  }
+
+  thread->bytes_until_sample -= static_cast<int64_t>(size);
+  if (thread->bytes_until_sample > 0) return;
+
+  thread->bytes_until_sample = next_sample_distance(thread, interval);
+  record_sample(ptr, size, alloc_site, interval);
+}
+
+void allocation_sampler_notify_free(void* ptr) {
+  if (ptr == NULL || live_sample_count.load(std::memory_order_relaxed) == 0)
+    return;
+
+  // Only the thread freeing |ptr| can remove it, so a match read here can't
+  // go away before |forget_sample| takes the lock, short of a reset.
+  size_t first = bucket_of(ptr) * LIVE_BUCKET_SIZE;
+  for (size_t slot = first; slot < first + LIVE_BUCKET_SIZE; slot++) {
+    if (live_pointers[slot].load(std::memory_order_relaxed) == ptr) {
+      forget_sample(slot, ptr);
+      return;
+    }
+  }
+}
+
+size_t allocation_sampler_get_sites(allocation_site_stats_t* sites,
+                                    size_t max_sites) {
+  std::vector<site_t> sorted;
+  {
+    std::lock_guard<std::mutex> lock(sampler_mutex);
+    sorted.reserve(get_site_map().size());
+    for (const auto& entry : get_site_map()) sorted.push_back(entry.second);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const site_t& a, const site_t& b) {
+              return a.live_bytes > b.live_bytes;
+            });
+
+  size_t count = std::min(max_sites, sorted.size());
+  for (size_t i = 0; i < count; i++) {
+    const site_t& site = sorted[i];
+    allocation_site_stats_t* stats = &sites[i];
+    std::copy(site.frames, site.frames + site.num_frames, stats->frames);
+    stats->num_frames = site.num_frames;
+    stats->allocated_count = estimate(site.allocated_count);
+    stats->allocated_bytes = estimate(site.allocated_bytes);
+    stats->live_count = estimate(site.live_count);
+    stats->live_bytes = estimate(site.live_bytes);
+  }
+  return count;
+}
+
+void allocation_sampler_reset(void) {
+  std::lock_guard<std::mutex> lock(sampler_mutex);
+  get_site_map().clear();
+  for (size_t slot = 0; slot < LIVE_SLOTS; slot++) {
+    live_pointers[slot].store(NULL, std::memory_order_relaxed);
+  }
+  live_sample_count.store(0, std::memory_order_relaxed);
+  total_samples = 0;
+  dropped_samples = 0;
+}
+
+static void dump_frame(int fd, const void* frame) {
+  Dl_info info;
+  if (dladdr(frame, &info) != 0 && info.dli_fname != NULL) {
+    dprintf(fd, "      %s+%#zx\n", info.dli_fname,
+            static_cast<const uint8_t*>(frame) -
+                static_cast<const uint8_t*>(info.dli_fbase));
+  } else {
+    dprintf(fd, "      %p\n", frame);
+  }
+}
+
+void allocation_sampler_debug_dump(int fd) {
+  dprintf(fd, "\nBluetooth Sampled Allocations:\n");
+  size_t interval = sample_interval.load(std::memory_order_relaxed);
+  if (interval == 0) {
+    dprintf(fd, "  Sampling interval : disabled\n");
+  } else {
+    dprintf(fd, "  Sampling interval : %zu bytes\n", interval);
+  }
+
+  std::unique_lock<std::mutex> lock(sampler_mutex);
+  dprintf(fd, "  Samples taken/live/dropped : %llu / %zu / %llu\n",
+          (unsigned long long)total_samples,
+          live_sample_count.load(std::memory_order_relaxed),
+          (unsigned long long)dropped_samples);
+  lock.unlock();
+
+  allocation_site_stats_t sites[DUMP_SITES];
+  size_t count = allocation_sampler_get_sites(sites, DUMP_SITES);
+  if (count == 0) return;
+
+  dprintf(fd, "  Estimated live/allocated by call site:\n");
+  for (size_t i = 0; i < count; i++) {
+    const allocation_site_stats_t& site = sites[i];
+    dprintf(fd, "    %llu bytes in %llu / %llu bytes in %llu\n",
+            (unsigned long long)site.live_bytes,
+            (unsigned long long)site.live_count,
+            (unsigned long long)site.allocated_bytes,
+            (unsigned long long)site.allocated_count);
+    if (site.num_frames == 0) dprintf(fd, "      (other call sites)\n");
+    for (size_t frame = 0; frame < site.num_frames; frame++) {
+      dump_frame(fd, site.frames[frame]);
+    }
+  }
+}
@@ -26,9 +26,11 @@
 #include <mutex>
 #include <unordered_map>
 
+#include "osi/include/allocation_sampler.h"
 #include "osi/include/allocator.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "osi/include/packet_allocator.h"
 
 typedef struct {
   uint8_t allocator_id;
@@ -183,4 +185,8 @@ void osi_allocator_debug_dump(int fd) {
   dprintf(fd, "  Total allocated/free/used octets : %zu / %zu / %zu\n",
           alloc_total_size, free_total_size,
           alloc_total_size - free_total_size);
+  lock.unlock();
+
+  allocation_sampler_debug_dump(fd);
+  packet_allocator_debug_dump(fd);
 }
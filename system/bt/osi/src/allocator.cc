@@ -19,8 +19,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "osi/include/allocation_sampler.h"
 #include "osi/include/allocation_tracker.h"
 #include "osi/include/allocator.h"
+#include "osi/include/packet_allocator.h"
 
 static const allocator_id_t alloc_allocator_id = 42;
 
@@ -33,6 +35,8 @@ char* osi_strdup(const char* str) {
   char* new_string = static_cast<char*>(
       allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size));
   if (!new_string) return NULL;
+  allocation_sampler_notify_alloc(new_string, size,
+                                  __builtin_return_address(0));
 
   memcpy(new_string, str, size);
   return new_string;
@@ -49,6 +53,8 @@ char* osi_strndup(const char* str, size_t len) {
   char* new_string = static_cast<char*>(
       allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size + 1));
   if (!new_string) return NULL;
+  allocation_sampler_notify_alloc(new_string, size + 1,
+                                  __builtin_return_address(0));
 
   memcpy(new_string, str, size);
   new_string[size] = '\0';
@@ -59,17 +65,23 @@ void* osi_malloc(size_t size) {
   size_t real_size = allocation_tracker_resize_for_canary(size);
   void* ptr = malloc(real_size);
   CHECK(ptr);
-  return allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size);
+  ptr = allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size);
+  allocation_sampler_notify_alloc(ptr, size, __builtin_return_address(0));
+  return ptr;
 }
 
 void* osi_calloc(size_t size) {
   size_t real_size = allocation_tracker_resize_for_canary(size);
   void* ptr = calloc(1, real_size);
   CHECK(ptr);
-  return allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size);
+  ptr = allocation_tracker_notify_alloc(alloc_allocator_id, ptr, size);
+  allocation_sampler_notify_alloc(ptr, size, __builtin_return_address(0));
+  return ptr;
 }
 
 void osi_free(void* ptr) {
+  if (packet_allocator_release(ptr)) return;
+  allocation_sampler_notify_free(ptr);
   free(allocation_tracker_notify_free(alloc_allocator_id, ptr));
 }
 
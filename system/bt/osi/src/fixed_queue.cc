@@ -18,7 +18,10 @@
 
 #include <base/logging.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
+#include <condition_variable>
 #include <mutex>
 
 #include "osi/include/allocator.h"
@@ -26,37 +29,127 @@
 #include "osi/include/list.h"
 #include "osi/include/osi.h"
 #include "osi/include/reactor.h"
-#include "osi/include/semaphore.h"
 
+// Queued elements are kept in a ring of pointers rather than in a list, so
+// enqueueing does not allocate a node per element. The ring grows by doubling
+// until it can hold |capacity| elements and never shrinks.
+//
+// The dequeue fd is readable while the queue is not empty, and the enqueue fd
+// while it is not full. They are only written when the queue crosses one of
+// those boundaries, so a burst of elements costs one wake up of the reactor
+// rather than two eventfd syscalls per element.
 typedef struct fixed_queue_t {
-  list_t* list;
-  semaphore_t* enqueue_sem;
-  semaphore_t* dequeue_sem;
-  std::mutex* mutex;
+  void** ring;
+  size_t ring_size;
+  size_t head;
+  size_t length;
   size_t capacity;
 
+  std::mutex* mutex;
+  std::condition_variable* not_empty;
+  std::condition_variable* not_full;
+  int dequeue_fd;
+  int enqueue_fd;
+
+  // Returned by |fixed_queue_get_list|, rebuilt when the queue has changed
+  list_t* list;
+  bool list_stale;
+
   reactor_object_t* dequeue_object;
   fixed_queue_cb dequeue_ready;
   void* dequeue_context;
 } fixed_queue_t;
 
+static const size_t INITIAL_RING_SIZE = 16;
+
 static void internal_dequeue_ready(void* context);
 
+static void fd_set_ready(int fd) {
+  int ret = eventfd_write(fd, 1);
+  CHECK(ret == 0);
+}
+
+static void fd_clear_ready(int fd) {
+  eventfd_t value;
+  eventfd_read(fd, &value);
+}
+
+static bool is_full_locked(const fixed_queue_t* queue) {
+  return queue->length == queue->capacity;
+}
+
+static void* element_at_locked(const fixed_queue_t* queue, size_t index) {
+  return queue->ring[(queue->head + index) & (queue->ring_size - 1)];
+}
+
+// Makes room for one more element. The queue must not be full.
+static void grow_ring_locked(fixed_queue_t* queue) {
+  if (queue->length < queue->ring_size) return;
+
+  size_t ring_size =
+      queue->ring_size ? queue->ring_size * 2 : INITIAL_RING_SIZE;
+  void** ring = static_cast<void**>(osi_malloc(ring_size * sizeof(void*)));
+  for (size_t i = 0; i < queue->length; i++)
+    ring[i] = element_at_locked(queue, i);
+
+  osi_free(queue->ring);
+  queue->ring = ring;
+  queue->ring_size = ring_size;
+  queue->head = 0;
+}
+
+static void push_locked(fixed_queue_t* queue, void* data) {
+  grow_ring_locked(queue);
+  queue->ring[(queue->head + queue->length) & (queue->ring_size - 1)] = data;
+  queue->length++;
+  queue->list_stale = true;
+
+  if (queue->length == 1) fd_set_ready(queue->dequeue_fd);
+  if (is_full_locked(queue)) fd_clear_ready(queue->enqueue_fd);
+  queue->not_empty->notify_one();
+}
+
+// Called once an element left the queue, with |was_full| telling whether the
+// queue was full before.
+static void on_removed_locked(fixed_queue_t* queue, bool was_full) {
+  queue->list_stale = true;
+
+  if (queue->length == 0) fd_clear_ready(queue->dequeue_fd);
+  if (was_full) {
+    fd_set_ready(queue->enqueue_fd);
+    queue->not_full->notify_one();
+  }
+}
+
+static void* pop_locked(fixed_queue_t* queue) {
+  bool was_full = is_full_locked(queue);
+  void* data = queue->ring[queue->head];
+  queue->head = (queue->head + 1) & (queue->ring_size - 1);
+  queue->length--;
+  on_removed_locked(queue, was_full);
+  return data;
+}
+
 fixed_queue_t* fixed_queue_new(size_t capacity) {
   fixed_queue_t* ret =
       static_cast<fixed_queue_t*>(osi_calloc(sizeof(fixed_queue_t)));
 
   ret->mutex = new std::mutex;
+  ret->not_empty = new std::condition_variable;
+  ret->not_full = new std::condition_variable;
   ret->capacity = capacity;
+  ret->dequeue_fd = INVALID_FD;
+  ret->enqueue_fd = INVALID_FD;
 
   ret->list = list_new(NULL);
   if (!ret->list) goto error;
 
-  ret->enqueue_sem = semaphore_new(capacity);
-  if (!ret->enqueue_sem) goto error;
+  ret->dequeue_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (ret->dequeue_fd == INVALID_FD) goto error;
 
-  ret->dequeue_sem = semaphore_new(0);
-  if (!ret->dequeue_sem) goto error;
+  ret->enqueue_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (ret->enqueue_fd == INVALID_FD) goto error;
+  if (capacity > 0) fd_set_ready(ret->enqueue_fd);
 
   return ret;
 
@@ -71,13 +164,15 @@ void fixed_queue_free(fixed_queue_t* queue, fixed_queue_free_cb free_cb) {
   fixed_queue_unregister_dequeue(queue);
 
   if (free_cb)
-    for (const list_node_t* node = list_begin(queue->list);
-         node != list_end(queue->list); node = list_next(node))
-      free_cb(list_node(node));
+    for (size_t i = 0; i < queue->length; i++)
+      free_cb(element_at_locked(queue, i));
 
   list_free(queue->list);
-  semaphore_free(queue->enqueue_sem);
-  semaphore_free(queue->dequeue_sem);
+  osi_free(queue->ring);
+  if (queue->dequeue_fd != INVALID_FD) close(queue->dequeue_fd);
+  if (queue->enqueue_fd != INVALID_FD) close(queue->enqueue_fd);
+  delete queue->not_full;
+  delete queue->not_empty;
   delete queue->mutex;
   osi_free(queue);
 }
@@ -97,14 +192,14 @@ bool fixed_queue_is_empty(fixed_queue_t* queue) {
   if (queue == NULL) return true;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_is_empty(queue->list);
+  return queue->length == 0;
 }
 
 size_t fixed_queue_length(fixed_queue_t* queue) {
   if (queue == NULL) return 0;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_length(queue->list);
+  return queue->length;
 }
 
 size_t fixed_queue_capacity(fixed_queue_t* queue) {
@@ -117,94 +212,80 @@ void fixed_queue_enqueue(fixed_queue_t* queue, void* data) {
   CHECK(queue != NULL);
   CHECK(data != NULL);
 
-  semaphore_wait(queue->enqueue_sem);
-
-  {
-    std::lock_guard<std::mutex> lock(*queue->mutex);
-    list_append(queue->list, data);
-  }
-
-  semaphore_post(queue->dequeue_sem);
+  std::unique_lock<std::mutex> lock(*queue->mutex);
+  queue->not_full->wait(lock, [queue] { return !is_full_locked(queue); });
+  push_locked(queue, data);
 }
 
 void* fixed_queue_dequeue(fixed_queue_t* queue) {
   CHECK(queue != NULL);
 
-  semaphore_wait(queue->dequeue_sem);
-
-  void* ret = NULL;
-  {
-    std::lock_guard<std::mutex> lock(*queue->mutex);
-    ret = list_front(queue->list);
-    list_remove(queue->list, ret);
-  }
-
-  semaphore_post(queue->enqueue_sem);
-
-  return ret;
+  std::unique_lock<std::mutex> lock(*queue->mutex);
+  queue->not_empty->wait(lock, [queue] { return queue->length > 0; });
+  return pop_locked(queue);
 }
 
 bool fixed_queue_try_enqueue(fixed_queue_t* queue, void* data) {
   CHECK(queue != NULL);
   CHECK(data != NULL);
 
-  if (!semaphore_try_wait(queue->enqueue_sem)) return false;
-
-  {
-    std::lock_guard<std::mutex> lock(*queue->mutex);
-    list_append(queue->list, data);
-  }
+  std::lock_guard<std::mutex> lock(*queue->mutex);
+  if (is_full_locked(queue)) return false;
 
-  semaphore_post(queue->dequeue_sem);
+  push_locked(queue, data);
   return true;
 }
 
 void* fixed_queue_try_dequeue(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
 
-  if (!semaphore_try_wait(queue->dequeue_sem)) return NULL;
+  std::lock_guard<std::mutex> lock(*queue->mutex);
+  if (queue->length == 0) return NULL;
+
+  return pop_locked(queue);
+}
 
-  void* ret = NULL;
-  {
-    std::lock_guard<std::mutex> lock(*queue->mutex);
-    ret = list_front(queue->list);
-    list_remove(queue->list, ret);
-  }
+size_t fixed_queue_dequeue_n(fixed_queue_t* queue, void** data,
+                             size_t max_count) {
+  if (queue == NULL) return 0;
+  CHECK(data != NULL);
 
-  semaphore_post(queue->enqueue_sem);
+  std::lock_guard<std::mutex> lock(*queue->mutex);
+  size_t count = 0;
+  while (count < max_count && queue->length > 0)
+    data[count++] = pop_locked(queue);
 
-  return ret;
+  return count;
 }
 
 void* fixed_queue_try_peek_first(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_is_empty(queue->list) ? NULL : list_front(queue->list);
+  return queue->length == 0 ? NULL : element_at_locked(queue, 0);
 }
 
 void* fixed_queue_try_peek_last(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
-  return list_is_empty(queue->list) ? NULL : list_back(queue->list);
+  return queue->length == 0 ? NULL
+                            : element_at_locked(queue, queue->length - 1);
 }
 
 void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data) {
   if (queue == NULL) return NULL;
 
-  bool removed = false;
-  {
-    std::lock_guard<std::mutex> lock(*queue->mutex);
-    if (list_contains(queue->list, data) &&
-        semaphore_try_wait(queue->dequeue_sem)) {
-      removed = list_remove(queue->list, data);
-      CHECK(removed);
-    }
-  }
-
-  if (removed) {
-    semaphore_post(queue->enqueue_sem);
+  std::lock_guard<std::mutex> lock(*queue->mutex);
+  size_t mask = queue->ring_size - 1;
+  for (size_t i = 0; i < queue->length; i++) {
+    if (element_at_locked(queue, i) != data) continue;
+
+    bool was_full = is_full_locked(queue);
+    for (size_t j = i; j + 1 < queue->length; j++)
+      queue->ring[(queue->head + j) & mask] = element_at_locked(queue, j + 1);
+    queue->length--;
+    on_removed_locked(queue, was_full);
     return data;
   }
   return NULL;
@@ -216,17 +297,24 @@ list_t* fixed_queue_get_list(fixed_queue_t* queue) {
   // NOTE: Using the list in this way is not thread-safe.
   // Using this list in any context where threads can call other functions
   // to the queue can break our assumptions and the queue in general.
+  std::lock_guard<std::mutex> lock(*queue->mutex);
+  if (queue->list_stale) {
+    list_clear(queue->list);
+    for (size_t i = 0; i < queue->length; i++)
+      list_append(queue->list, element_at_locked(queue, i));
+    queue->list_stale = false;
+  }
   return queue->list;
 }
 
 int fixed_queue_get_dequeue_fd(const fixed_queue_t* queue) {
   CHECK(queue != NULL);
-  return semaphore_get_fd(queue->dequeue_sem);
+  return queue->dequeue_fd;
 }
 
 int fixed_queue_get_enqueue_fd(const fixed_queue_t* queue) {
   CHECK(queue != NULL);
-  return semaphore_get_fd(queue->enqueue_sem);
+  return queue->enqueue_fd;
 }
 
 void fixed_queue_register_dequeue(fixed_queue_t* queue, reactor_t* reactor,
@@ -0,0 +1,467 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_packet_allocator"
+
+#include "osi/include/packet_allocator.h"
+
+#include <base/logging.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+#include "osi/include/allocator.h"
+#include "osi/include/log.h"
+
+// Usable sizes of the classes. They follow the buffers the stack allocates
+// the most: HCI events and LE ACL packets, GATT notifications up to the
+// largest ATT MTU, L2CAP SDUs and BT_DEFAULT_BUFFER_SIZE for A2DP media.
+static const size_t CLASS_SIZES[] = {64, 128, 256, 512, 1024, 2048, 4160};
+static const size_t NUM_CLASSES = sizeof(CLASS_SIZES) / sizeof(CLASS_SIZES[0]);
+
+// Address space is reserved for this many buffers per class, but pages are
+// only touched once buffers are carved out of it.
+static const size_t BUFFERS_PER_CLASS = 1024;
+
+// Free buffers kept by each thread per class, and moved from or to the class
+// in batches of half that.
+static const size_t THREAD_CACHE_SIZE = 32;
+static const size_t THREAD_CACHE_BATCH = THREAD_CACHE_SIZE / 2;
+
+static const size_t BUFFER_ALIGNMENT = alignof(max_align_t);
+
+// Precedes every buffer
+typedef struct {
+  // Where the buffer was allocated, or NULL while it is free
+  std::atomic<const void*> alloc_site;
+} buffer_header_t;
+
+static const size_t HEADER_SIZE =
+    (sizeof(buffer_header_t) + BUFFER_ALIGNMENT - 1) & ~(BUFFER_ALIGNMENT - 1);
+
+// Free buffers are linked through their first bytes
+typedef struct free_buffer_t {
+  struct free_buffer_t* next;
+} free_buffer_t;
+
+typedef struct {
+  size_t stride;
+  uint8_t* base;
+  uint8_t* end;
+
+  std::mutex mutex;
+  free_buffer_t* free_list;
+  size_t free_count;
+  uint8_t* next_uncarved;
+  // Highest number of buffers handed to threads, cached ones included
+  size_t max_in_use;
+  // Allocations made by threads which have exited, or made without a cache
+  uint64_t retired_allocations;
+
+  std::atomic<uint64_t> total_fallbacks;
+} size_class_t;
+
+static size_class_t size_classes[NUM_CLASSES];
+
+// Bounds of the region all classes are carved from, NULL until the first
+// allocation. Only read to tell pool buffers apart from |osi_malloc| ones.
+static std::atomic<uint8_t*> arena_base;
+static std::atomic<uint8_t*> arena_end;
+
+typedef enum {
+  CACHE_UNREGISTERED = 0,
+  CACHE_REGISTERED,
+  // The thread is exiting and its buffers were returned to their class
+  CACHE_RETIRED,
+} thread_cache_state_t;
+
+// Free buffers owned by the current thread, and its share of the statistics.
+// The counters are only written by the owning thread, so that the fast path
+// takes neither a lock nor a locked instruction; statistics add them up over
+// all threads.
+//
+// The cache has no destructor, so it stays usable while other thread_local
+// objects are destroyed. Its buffers are returned to their class by the
+// destructor of |thread_cache_key|, which runs after those. Buffers allocated
+// or freed later by the exiting thread bypass the cache.
+struct thread_cache_t {
+  void* buffers[NUM_CLASSES][THREAD_CACHE_SIZE];
+  std::atomic<size_t> count[NUM_CLASSES];
+  std::atomic<uint64_t> allocations[NUM_CLASSES];
+
+  thread_cache_state_t state;
+  thread_cache_t* next;
+  thread_cache_t* prev;
+};
+
+static thread_local thread_cache_t thread_cache;
+static pthread_key_t thread_cache_key;
+
+// Caches of the running threads. Taken before the mutex of a class.
+static std::mutex registry_mutex;
+static thread_cache_t* registry;
+
+static void retire_thread_cache(void* arg);
+
+static bool arena_init(void) {
+  size_t arena_size = 0;
+  for (size_t i = 0; i < NUM_CLASSES; i++)
+    arena_size += (HEADER_SIZE + CLASS_SIZES[i]) * BUFFERS_PER_CLASS;
+
+  void* arena = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (arena == MAP_FAILED) {
+    LOG_ERROR("%s unable to reserve packet buffers: %s", __func__,
+              strerror(errno));
+    return false;
+  }
+
+  uint8_t* base = static_cast<uint8_t*>(arena);
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    size_class_t* size_class = &size_classes[i];
+    size_class->stride = HEADER_SIZE + CLASS_SIZES[i];
+    size_class->base = base;
+    size_class->end = base + size_class->stride * BUFFERS_PER_CLASS;
+    size_class->next_uncarved = base;
+    base = size_class->end;
+  }
+
+  int error = pthread_key_create(&thread_cache_key, retire_thread_cache);
+  if (error != 0) {
+    LOG_ERROR("%s unable to create the thread cache key: %s", __func__,
+              strerror(error));
+    munmap(arena, arena_size);
+    return false;
+  }
+
+  arena_end.store(base, std::memory_order_release);
+  arena_base.store(static_cast<uint8_t*>(arena), std::memory_order_release);
+  return true;
+}
+
+static bool arena_ready(void) {
+  static bool ready = arena_init();
+  return ready;
+}
+
+static size_class_t* class_for_size(size_t size) {
+  for (size_t i = 0; i < NUM_CLASSES; i++)
+    if (size <= CLASS_SIZES[i]) return &size_classes[i];
+  return NULL;
+}
+
+static size_class_t* class_for_buffer(const void* ptr) {
+  const uint8_t* p = static_cast<const uint8_t*>(ptr);
+  if (p < arena_base.load(std::memory_order_acquire) ||
+      p >= arena_end.load(std::memory_order_acquire))
+    return NULL;
+
+  for (size_t i = 0; i < NUM_CLASSES; i++)
+    if (p < size_classes[i].end) return &size_classes[i];
+  return NULL;
+}
+
+static buffer_header_t* header_of(void* ptr) {
+  return reinterpret_cast<buffer_header_t*>(static_cast<uint8_t*>(ptr) -
+                                            HEADER_SIZE);
+}
+
+static size_t carved_count_locked(const size_class_t* size_class) {
+  return (size_class->next_uncarved - size_class->base) / size_class->stride;
+}
+
+// Returns the cache of the current thread, or NULL once the thread started
+// exiting. Only called once the arena is ready.
+static thread_cache_t* get_thread_cache(void) {
+  thread_cache_t* cache = &thread_cache;
+  if (cache->state == CACHE_REGISTERED) return cache;
+  if (cache->state == CACHE_RETIRED) return NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    cache->next = registry;
+    cache->prev = NULL;
+    if (registry != NULL) registry->prev = cache;
+    registry = cache;
+    cache->state = CACHE_REGISTERED;
+  }
+  // Any non NULL value makes the key destructor run when the thread exits
+  pthread_setspecific(thread_cache_key, cache);
+  return cache;
+}
+
+// Takes one buffer of class |index| without going through a thread cache.
+// Returns NULL if the class is exhausted.
+static void* take_uncached(size_t index) {
+  size_class_t* size_class = &size_classes[index];
+  std::lock_guard<std::mutex> lock(size_class->mutex);
+  void* ptr = NULL;
+  if (size_class->free_list != NULL) {
+    free_buffer_t* buffer = size_class->free_list;
+    size_class->free_list = buffer->next;
+    size_class->free_count--;
+    ptr = buffer;
+  } else if (size_class->next_uncarved < size_class->end) {
+    uint8_t* header = size_class->next_uncarved;
+    size_class->next_uncarved += size_class->stride;
+    new (header) buffer_header_t{};
+    ptr = header + HEADER_SIZE;
+  } else {
+    return NULL;
+  }
+
+  size_class->retired_allocations++;
+  size_t in_use = carved_count_locked(size_class) - size_class->free_count;
+  if (in_use > size_class->max_in_use) size_class->max_in_use = in_use;
+  return ptr;
+}
+
+// Returns |ptr| to class |index| without going through a thread cache.
+static void release_uncached(size_t index, void* ptr) {
+  size_class_t* size_class = &size_classes[index];
+  std::lock_guard<std::mutex> lock(size_class->mutex);
+  free_buffer_t* buffer = static_cast<free_buffer_t*>(ptr);
+  buffer->next = size_class->free_list;
+  size_class->free_list = buffer;
+  size_class->free_count++;
+}
+
+// Moves up to THREAD_CACHE_BATCH free buffers of class |index| to |cache|,
+// carving new ones if needed. Returns false if the class is exhausted.
+static bool refill_cache(thread_cache_t* cache, size_t index) {
+  size_class_t* size_class = &size_classes[index];
+  void** buffers = cache->buffers[index];
+  size_t count = cache->count[index].load(std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(size_class->mutex);
+  while (count < THREAD_CACHE_BATCH && size_class->free_list != NULL) {
+    free_buffer_t* buffer = size_class->free_list;
+    size_class->free_list = buffer->next;
+    size_class->free_count--;
+    buffers[count++] = buffer;
+  }
+  while (count < THREAD_CACHE_BATCH &&
+         size_class->next_uncarved < size_class->end) {
+    uint8_t* header = size_class->next_uncarved;
+    size_class->next_uncarved += size_class->stride;
+    new (header) buffer_header_t{};
+    buffers[count++] = header + HEADER_SIZE;
+  }
+  cache->count[index].store(count, std::memory_order_relaxed);
+
+  size_t in_use = carved_count_locked(size_class) - size_class->free_count;
+  if (in_use > size_class->max_in_use) size_class->max_in_use = in_use;
+  return count > 0;
+}
+
+// Returns the |count| last buffers of |cache| for class |index| to the class.
+static void flush_cache(thread_cache_t* cache, size_t index, size_t count) {
+  size_class_t* size_class = &size_classes[index];
+  void** buffers = cache->buffers[index];
+  size_t cached = cache->count[index].load(std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(size_class->mutex);
+  for (size_t i = 0; i < count; i++) {
+    free_buffer_t* buffer = static_cast<free_buffer_t*>(buffers[--cached]);
+    buffer->next = size_class->free_list;
+    size_class->free_list = buffer;
+  }
+  size_class->free_count += count;
+  cache->count[index].store(cached, std::memory_order_relaxed);
+}
+
+// Destructor of |thread_cache_key|: returns the buffers of the exiting
+// thread's cache to their class and unregisters the cache.
+static void retire_thread_cache(void* arg) {
+  thread_cache_t* cache = static_cast<thread_cache_t*>(arg);
+  if (cache->state != CACHE_REGISTERED) return;
+
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    size_t cached = cache->count[i].load(std::memory_order_relaxed);
+    if (cached > 0) flush_cache(cache, i, cached);
+
+    std::lock_guard<std::mutex> class_lock(size_classes[i].mutex);
+    size_classes[i].retired_allocations +=
+        cache->allocations[i].load(std::memory_order_relaxed);
+    cache->allocations[i].store(0, std::memory_order_relaxed);
+  }
+
+  if (cache->prev != NULL) cache->prev->next = cache->next;
+  if (cache->next != NULL) cache->next->prev = cache->prev;
+  if (registry == cache) registry = cache->next;
+  cache->state = CACHE_RETIRED;
+}
+
+void* osi_pkt_alloc(size_t size) {
+  return osi_pkt_alloc_from(size, __builtin_return_address(0));
+}
+
+void* osi_pkt_alloc_from(size_t size, const void* alloc_site) {
+  size_class_t* size_class = class_for_size(size);
+  if (size_class == NULL || !arena_ready()) return osi_malloc(size);
+
+  size_t index = size_class - size_classes;
+  thread_cache_t* cache = get_thread_cache();
+  void* ptr;
+  if (cache == NULL) {
+    ptr = take_uncached(index);
+    if (ptr == NULL) {
+      size_class->total_fallbacks.fetch_add(1, std::memory_order_relaxed);
+      return osi_malloc(size);
+    }
+  } else {
+    size_t count = cache->count[index].load(std::memory_order_relaxed);
+    if (count == 0) {
+      if (!refill_cache(cache, index)) {
+        size_class->total_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return osi_malloc(size);
+      }
+      count = cache->count[index].load(std::memory_order_relaxed);
+    }
+
+    ptr = cache->buffers[index][--count];
+    cache->count[index].store(count, std::memory_order_relaxed);
+    cache->allocations[index].store(
+        cache->allocations[index].load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+  header_of(ptr)->alloc_site.store(alloc_site, std::memory_order_relaxed);
+  return ptr;
+}
+
+void osi_pkt_free(void* ptr) { osi_free(ptr); }
+
+bool packet_allocator_release(void* ptr) {
+  size_class_t* size_class = class_for_buffer(ptr);
+  if (size_class == NULL) return false;
+
+  uint8_t* p = static_cast<uint8_t*>(ptr);
+  CHECK((p - size_class->base) % size_class->stride == HEADER_SIZE);
+  const void* alloc_site = header_of(ptr)->alloc_site.exchange(
+      NULL, std::memory_order_relaxed);
+  CHECK(alloc_site != NULL);  // Must not be a double free
+
+  size_t index = size_class - size_classes;
+  thread_cache_t* cache = get_thread_cache();
+  if (cache == NULL) {
+    release_uncached(index, ptr);
+    return true;
+  }
+  if (cache->count[index].load(std::memory_order_relaxed) == THREAD_CACHE_SIZE)
+    flush_cache(cache, index, THREAD_CACHE_BATCH);
+  size_t count = cache->count[index].load(std::memory_order_relaxed);
+  cache->buffers[index][count] = ptr;
+  cache->count[index].store(count + 1, std::memory_order_relaxed);
+  return true;
+}
+
+size_t packet_allocator_num_classes(void) { return NUM_CLASSES; }
+
+void packet_allocator_get_stats(size_t index, packet_allocator_stats_t* stats) {
+  CHECK(index < NUM_CLASSES);
+  CHECK(stats != NULL);
+
+  size_class_t* size_class = &size_classes[index];
+  *stats = {};
+  stats->buffer_size = CLASS_SIZES[index];
+
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  size_t cached = 0;
+  for (thread_cache_t* cache = registry; cache != NULL; cache = cache->next) {
+    cached += cache->count[index].load(std::memory_order_relaxed);
+    stats->total_allocations +=
+        cache->allocations[index].load(std::memory_order_relaxed);
+  }
+
+  std::lock_guard<std::mutex> class_lock(size_class->mutex);
+  if (size_class->stride != 0) {
+    stats->buffer_count = carved_count_locked(size_class);
+    // Caches were read before the class was locked: a thread flushing in
+    // between would make the buffers count twice
+    size_t free_count = size_class->free_count + cached;
+    if (stats->buffer_count > free_count)
+      stats->in_use = stats->buffer_count - free_count;
+  }
+  stats->max_in_use = size_class->max_in_use;
+  stats->total_allocations += size_class->retired_allocations;
+  stats->total_fallbacks =
+      size_class->total_fallbacks.load(std::memory_order_relaxed);
+}
+
+void packet_allocator_get_stats_for_size(size_t size,
+                                         packet_allocator_stats_t* stats) {
+  CHECK(stats != NULL);
+
+  size_class_t* size_class = class_for_size(size);
+  if (size_class == NULL) {
+    *stats = {};
+    return;
+  }
+  packet_allocator_get_stats(size_class - size_classes, stats);
+}
+
+void packet_allocator_debug_dump(int fd) {
+  dprintf(fd, "\nBluetooth Packet Buffers:\n");
+  dprintf(fd, "  %6s %7s %7s %10s %12s %9s\n", "size", "carved", "in use",
+          "max in use", "allocations", "fallbacks");
+
+  std::unordered_map<const void*, size_t> in_use_by_site;
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    packet_allocator_stats_t stats;
+    packet_allocator_get_stats(i, &stats);
+    dprintf(fd, "  %6zu %7zu %7zu %10zu %12llu %9llu\n", stats.buffer_size,
+            stats.buffer_count, stats.in_use, stats.max_in_use,
+            (unsigned long long)stats.total_allocations,
+            (unsigned long long)stats.total_fallbacks);
+
+    // Buffers cached by threads are free, and have no allocation site
+    size_class_t* size_class = &size_classes[i];
+    std::lock_guard<std::mutex> lock(size_class->mutex);
+    for (uint8_t* header = size_class->base;
+         header < size_class->next_uncarved; header += size_class->stride) {
+      const void* alloc_site =
+          reinterpret_cast<buffer_header_t*>(header)->alloc_site.load(
+              std::memory_order_relaxed);
+      if (alloc_site != NULL) in_use_by_site[alloc_site]++;
+    }
+  }
+
+  if (in_use_by_site.empty()) return;
+
+  dprintf(fd, "  Buffers in use by allocation site:\n");
+  for (const auto& entry : in_use_by_site) {
+    Dl_info info;
+    if (dladdr(entry.first, &info) != 0 && info.dli_fname != NULL) {
+      dprintf(fd, "    %s+%#zx : %zu\n", info.dli_fname,
+              static_cast<const uint8_t*>(entry.first) -
+                  static_cast<const uint8_t*>(info.dli_fbase),
+              entry.second);
+    } else {
+      dprintf(fd, "    %p : %zu\n", entry.first, entry.second);
+    }
+  }
+}
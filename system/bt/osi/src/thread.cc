@@ -63,6 +63,8 @@ static void* run_thread(void* start_arg);
 static void work_queue_read_cb(void* context);
 
 static const size_t DEFAULT_WORK_QUEUE_CAPACITY = 128;
+// Work items run per wake up, before other reactor objects get their turn
+static const size_t WORK_QUEUE_BATCH_SIZE = 16;
 
 thread_t* thread_new_sized(const char* name, size_t work_queue_capacity) {
   CHECK(name != NULL);
@@ -244,7 +246,11 @@ static void work_queue_read_cb(void* context) {
   CHECK(context != NULL);
 
   fixed_queue_t* queue = (fixed_queue_t*)context;
-  work_item_t* item = static_cast<work_item_t*>(fixed_queue_dequeue(queue));
-  item->func(item->context);
-  osi_free(item);
+  void* items[WORK_QUEUE_BATCH_SIZE];
+  size_t count = fixed_queue_dequeue_n(queue, items, WORK_QUEUE_BATCH_SIZE);
+  for (size_t i = 0; i < count; i++) {
+    work_item_t* item = static_cast<work_item_t*>(items[i]);
+    item->func(item->context);
+    osi_free(item);
+  }
 }
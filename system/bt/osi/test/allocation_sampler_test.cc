@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "AllocationTestHarness.h"
+
+#include "osi/include/allocation_sampler.h"
+#include "osi/include/allocator.h"
+
+class AllocationSamplerTest : public AllocationTestHarness {
+ protected:
+  void SetUp() override {
+    AllocationTestHarness::SetUp();
+    allocation_sampler_reset();
+  }
+
+  void TearDown() override {
+    allocation_sampler_set_interval(ALLOCATION_SAMPLER_DEFAULT_INTERVAL);
+    allocation_sampler_reset();
+    AllocationTestHarness::TearDown();
+  }
+};
+
+// Distinct functions, so that their allocations have distinct call sites
+static void* __attribute__((noinline)) allocate_here(size_t size) {
+  void* ptr = osi_malloc(size);
+  asm volatile("" ::: "memory");
+  return ptr;
+}
+
+static void* __attribute__((noinline)) allocate_there(size_t size) {
+  void* ptr = osi_calloc(size);
+  asm volatile("" ::: "memory");
+  return ptr;
+}
+
+TEST_F(AllocationSamplerTest, test_free_null) {
+  allocation_sampler_notify_free(NULL);
+}
+
+TEST_F(AllocationSamplerTest, test_disabled_samples_nothing) {
+  allocation_sampler_set_interval(0);
+  void* ptr = allocate_here(1024 * 1024);
+  osi_free(ptr);
+
+  allocation_site_stats_t sites[4];
+  EXPECT_EQ(0u, allocation_sampler_get_sites(sites, 4));
+}
+
+TEST_F(AllocationSamplerTest, test_aggregates_by_call_site) {
+  // Allocations much larger than the interval are always sampled, with a
+  // weight of one
+  allocation_sampler_set_interval(1);
+
+  std::vector<void*> here;
+  std::vector<void*> there;
+  for (int i = 0; i < 10; i++) here.push_back(allocate_here(100));
+  for (int i = 0; i < 3; i++) there.push_back(allocate_there(50));
+  for (int i = 0; i < 4; i++) osi_free(here[i]);
+
+  allocation_site_stats_t sites[4];
+  ASSERT_EQ(2u, allocation_sampler_get_sites(sites, 4));
+
+  // Sorted by live bytes
+  EXPECT_EQ(6u, sites[0].live_count);
+  EXPECT_EQ(600u, sites[0].live_bytes);
+  EXPECT_EQ(10u, sites[0].allocated_count);
+  EXPECT_EQ(1000u, sites[0].allocated_bytes);
+  EXPECT_EQ(3u, sites[1].live_count);
+  EXPECT_EQ(150u, sites[1].allocated_bytes);
+  EXPECT_GE(sites[0].num_frames, 1u);
+  EXPECT_GE(sites[1].num_frames, 1u);
+  EXPECT_NE(sites[0].frames[0], sites[1].frames[0]);
+
+  for (size_t i = 4; i < here.size(); i++) osi_free(here[i]);
+  for (void* ptr : there) osi_free(ptr);
+
+  ASSERT_EQ(2u, allocation_sampler_get_sites(sites, 4));
+  EXPECT_EQ(0u, sites[0].live_bytes);
+  EXPECT_EQ(0u, sites[1].live_bytes);
+}
+
+TEST_F(AllocationSamplerTest, test_free_from_other_thread) {
+  allocation_sampler_set_interval(1);
+
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 64; i++) ptrs.push_back(allocate_here(100));
+  std::thread releaser([&ptrs]() {
+    for (void* ptr : ptrs) osi_free(ptr);
+  });
+  releaser.join();
+
+  allocation_site_stats_t sites[4];
+  ASSERT_EQ(1u, allocation_sampler_get_sites(sites, 4));
+  EXPECT_EQ(64u, sites[0].allocated_count);
+  EXPECT_EQ(0u, sites[0].live_count);
+}
+
+TEST_F(AllocationSamplerTest, test_estimates_are_close) {
+  const size_t kInterval = 4096;
+  const size_t kCount = 100000;
+  const size_t kSize = 64;
+  allocation_sampler_set_interval(kInterval);
+
+  // Around 1600 samples, estimates are within a few percent
+  for (size_t i = 0; i < kCount; i++) osi_free(allocate_here(kSize));
+
+  allocation_site_stats_t sites[4];
+  ASSERT_EQ(1u, allocation_sampler_get_sites(sites, 4));
+  EXPECT_NEAR(kCount * kSize, sites[0].allocated_bytes, kCount * kSize / 10);
+  EXPECT_NEAR(kCount, sites[0].allocated_count, kCount / 10);
+  EXPECT_EQ(0u, sites[0].live_bytes);
+}
+
+TEST_F(AllocationSamplerTest, test_debug_dump_lists_call_sites) {
+  allocation_sampler_set_interval(1);
+  void* ptr = allocate_here(100);
+
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  allocation_sampler_debug_dump(fileno(file));
+
+  char dump[4096] = {};
+  rewind(file);
+  fread(dump, 1, sizeof(dump) - 1, file);
+  fclose(file);
+  EXPECT_TRUE(strstr(dump, "Samples taken/live/dropped : 1 / 1 / 0") != NULL);
+  EXPECT_TRUE(strstr(dump, "100 bytes in 1 / 100 bytes in 1") != NULL);
+
+  osi_free(ptr);
+}
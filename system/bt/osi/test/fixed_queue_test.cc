@@ -230,6 +230,88 @@ TEST_F(FixedQueueTest, test_fixed_queue_enqueue_dequeue) {
   fixed_queue_free(queue, NULL);
 }
 
+TEST_F(FixedQueueTest, test_fixed_queue_dequeue_n) {
+  fixed_queue_t* queue = fixed_queue_new(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+  void* data[TEST_QUEUE_SIZE];
+
+  // Test dequeueing from a NULL queue and from an empty queue
+  EXPECT_EQ((size_t)0, fixed_queue_dequeue_n(NULL, data, TEST_QUEUE_SIZE));
+  EXPECT_EQ((size_t)0, fixed_queue_dequeue_n(queue, data, TEST_QUEUE_SIZE));
+
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING1);
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING2);
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING3);
+
+  // Test dequeueing fewer elements than queued
+  EXPECT_EQ((size_t)2, fixed_queue_dequeue_n(queue, data, 2));
+  EXPECT_EQ(DUMMY_DATA_STRING1, data[0]);
+  EXPECT_EQ(DUMMY_DATA_STRING2, data[1]);
+  EXPECT_EQ((size_t)1, fixed_queue_length(queue));
+
+  // Test dequeueing more elements than queued
+  EXPECT_EQ((size_t)1, fixed_queue_dequeue_n(queue, data, TEST_QUEUE_SIZE));
+  EXPECT_EQ(DUMMY_DATA_STRING3, data[0]);
+  EXPECT_TRUE(fixed_queue_is_empty(queue));
+
+  fixed_queue_free(queue, NULL);
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_order_across_growth) {
+  static const size_t NUM_ELEMENTS = 100;
+  fixed_queue_t* queue = fixed_queue_new(SIZE_MAX);
+  ASSERT_TRUE(queue != NULL);
+
+  // Keep the head of the queue moving while it grows, so that the elements
+  // wrap around the end of the storage
+  uintptr_t next_in = 1;
+  uintptr_t next_out = 1;
+  for (size_t i = 0; i < NUM_ELEMENTS; i++) {
+    fixed_queue_enqueue(queue, (void*)next_in++);
+    fixed_queue_enqueue(queue, (void*)next_in++);
+    EXPECT_EQ((void*)next_out++, fixed_queue_dequeue(queue));
+  }
+  EXPECT_EQ(NUM_ELEMENTS, fixed_queue_length(queue));
+  EXPECT_EQ((void*)next_out, fixed_queue_try_peek_first(queue));
+  EXPECT_EQ((void*)(next_in - 1), fixed_queue_try_peek_last(queue));
+
+  // Test removing an element from the middle of the queue
+  void* removed = (void*)(next_out + NUM_ELEMENTS / 2);
+  EXPECT_EQ(removed, fixed_queue_try_remove_from_queue(queue, removed));
+
+  while (!fixed_queue_is_empty(queue)) {
+    if ((void*)next_out == removed) next_out++;
+    EXPECT_EQ((void*)next_out++, fixed_queue_try_dequeue(queue));
+  }
+  EXPECT_EQ(next_in, next_out);
+
+  fixed_queue_free(queue, NULL);
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_get_list) {
+  fixed_queue_t* queue = fixed_queue_new(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+
+  EXPECT_TRUE(list_is_empty(fixed_queue_get_list(queue)));
+
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING1);
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING2);
+  list_t* list = fixed_queue_get_list(queue);
+  EXPECT_EQ((size_t)2, list_length(list));
+  EXPECT_EQ(DUMMY_DATA_STRING1, list_front(list));
+  EXPECT_EQ(DUMMY_DATA_STRING2, list_back(list));
+
+  // The list follows the queue
+  fixed_queue_dequeue(queue);
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING3);
+  list = fixed_queue_get_list(queue);
+  EXPECT_EQ((size_t)2, list_length(list));
+  EXPECT_EQ(DUMMY_DATA_STRING2, list_front(list));
+  EXPECT_EQ(DUMMY_DATA_STRING3, list_back(list));
+
+  fixed_queue_free(queue, NULL);
+}
+
 TEST_F(FixedQueueTest, test_fixed_queue_try_peek_first_last) {
   fixed_queue_t* queue = fixed_queue_new(TEST_QUEUE_SIZE);
   ASSERT_TRUE(queue != NULL);
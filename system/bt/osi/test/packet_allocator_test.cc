@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "AllocationTestHarness.h"
+
+#include "osi/include/allocator.h"
+#include "osi/include/packet_allocator.h"
+
+class PacketAllocatorTest : public AllocationTestHarness {};
+
+// Returns the statistics of the class serving buffers of |size| bytes
+static packet_allocator_stats_t stats_for_size(size_t size) {
+  packet_allocator_stats_t stats;
+  packet_allocator_get_stats_for_size(size, &stats);
+  return stats;
+}
+
+// Frees |buffer| and allocates and frees another one while the thread exits
+static void free_at_thread_exit(void* buffer) {
+  osi_pkt_free(buffer);
+  osi_pkt_free(osi_pkt_alloc(300));
+}
+
+struct ThreadExitFreer {
+  void* buffer = NULL;
+  ~ThreadExitFreer() { free_at_thread_exit(buffer); }
+};
+
+TEST_F(PacketAllocatorTest, test_free_null) { osi_pkt_free(NULL); }
+
+TEST_F(PacketAllocatorTest, test_classes_are_sorted) {
+  packet_allocator_stats_t previous = {};
+  for (size_t i = 0; i < packet_allocator_num_classes(); i++) {
+    packet_allocator_stats_t stats;
+    packet_allocator_get_stats(i, &stats);
+    EXPECT_GT(stats.buffer_size, previous.buffer_size);
+    previous = stats;
+  }
+}
+
+TEST_F(PacketAllocatorTest, test_alloc_from_class) {
+  packet_allocator_stats_t before = stats_for_size(600);
+
+  void* buffer = osi_pkt_alloc(600);
+  ASSERT_TRUE(buffer != NULL);
+  memset(buffer, 0x42, 600);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer) % alignof(max_align_t), 0u);
+
+  packet_allocator_stats_t after = stats_for_size(600);
+  EXPECT_GE(after.buffer_size, 600u);
+  EXPECT_EQ(after.total_allocations, before.total_allocations + 1);
+  EXPECT_EQ(after.in_use, before.in_use + 1);
+  EXPECT_GE(after.max_in_use, after.in_use);
+
+  osi_pkt_free(buffer);
+  EXPECT_EQ(stats_for_size(600).in_use, before.in_use);
+}
+
+TEST_F(PacketAllocatorTest, test_buffers_are_reused) {
+  void* first = osi_pkt_alloc(100);
+  osi_free(first);
+  void* second = osi_pkt_alloc(100);
+  EXPECT_EQ(first, second);
+  osi_pkt_free(second);
+}
+
+TEST_F(PacketAllocatorTest, test_large_alloc_falls_back) {
+  void* buffer = osi_pkt_alloc(64 * 1024);
+  ASSERT_TRUE(buffer != NULL);
+  memset(buffer, 0x42, 64 * 1024);
+  EXPECT_FALSE(packet_allocator_release(buffer));
+  osi_pkt_free(buffer);
+}
+
+TEST_F(PacketAllocatorTest, test_release_foreign_pointer) {
+  void* heap = osi_malloc(64);
+  EXPECT_FALSE(packet_allocator_release(heap));
+  osi_free(heap);
+}
+
+TEST_F(PacketAllocatorTest, test_exhausted_class_falls_back) {
+  packet_allocator_stats_t before = stats_for_size(40);
+
+  std::vector<void*> buffers;
+  while (stats_for_size(40).total_fallbacks == before.total_fallbacks) {
+    buffers.push_back(osi_pkt_alloc(40));
+    ASSERT_LT(buffers.size(), 100000u);
+  }
+  EXPECT_FALSE(packet_allocator_release(buffers.back()));
+
+  packet_allocator_stats_t exhausted = stats_for_size(40);
+  EXPECT_EQ(exhausted.in_use, exhausted.buffer_count);
+  EXPECT_EQ(exhausted.max_in_use, exhausted.buffer_count);
+
+  for (void* buffer : buffers) osi_pkt_free(buffer);
+  EXPECT_EQ(stats_for_size(40).in_use, before.in_use);
+}
+
+TEST_F(PacketAllocatorTest, test_free_from_other_thread) {
+  packet_allocator_stats_t before = stats_for_size(1000);
+
+  for (int round = 0; round < 100; round++) {
+    std::vector<void*> buffers;
+    for (int i = 0; i < 64; i++) buffers.push_back(osi_pkt_alloc(1000));
+    std::thread releaser([&buffers]() {
+      for (void* buffer : buffers) osi_pkt_free(buffer);
+    });
+    releaser.join();
+  }
+
+  packet_allocator_stats_t after = stats_for_size(1000);
+  EXPECT_EQ(after.in_use, before.in_use);
+  EXPECT_EQ(after.total_allocations, before.total_allocations + 6400);
+  EXPECT_EQ(after.total_fallbacks, before.total_fallbacks);
+  // Buffers freed by exited threads went back to the class
+  EXPECT_LE(after.buffer_count, before.buffer_count + 128);
+}
+
+TEST_F(PacketAllocatorTest, test_no_class_for_size) {
+  packet_allocator_stats_t stats = stats_for_size(64 * 1024);
+  EXPECT_EQ(stats.buffer_size, 0u);
+  EXPECT_EQ(stats.total_allocations, 0u);
+}
+
+TEST_F(PacketAllocatorTest, test_free_from_thread_local_destructor) {
+  packet_allocator_stats_t before = stats_for_size(300);
+
+  std::thread thread([]() {
+    static thread_local ThreadExitFreer freer;
+    freer.buffer = osi_pkt_alloc(300);
+  });
+  thread.join();
+
+  packet_allocator_stats_t after = stats_for_size(300);
+  EXPECT_EQ(after.in_use, before.in_use);
+  EXPECT_EQ(after.total_allocations, before.total_allocations + 2);
+}
+
+TEST_F(PacketAllocatorTest, test_free_after_thread_cache_is_retired) {
+  packet_allocator_stats_t before = stats_for_size(300);
+
+  // Created after the allocator's own key, so its destructor runs once the
+  // thread cache was flushed
+  pthread_key_t key;
+  ASSERT_EQ(pthread_key_create(&key, free_at_thread_exit), 0);
+  std::thread thread([key]() { pthread_setspecific(key, osi_pkt_alloc(300)); });
+  thread.join();
+  pthread_key_delete(key);
+
+  packet_allocator_stats_t after = stats_for_size(300);
+  EXPECT_EQ(after.in_use, before.in_use);
+  EXPECT_EQ(after.total_allocations, before.total_allocations + 2);
+}
+
+TEST_F(PacketAllocatorTest, test_debug_dump_attributes_buffers) {
+  void* buffer = osi_pkt_alloc(200);
+
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  packet_allocator_debug_dump(fileno(file));
+
+  char dump[4096] = {};
+  rewind(file);
+  fread(dump, 1, sizeof(dump) - 1, file);
+  fclose(file);
+  EXPECT_TRUE(strstr(dump, "Buffers in use by allocation site") != NULL);
+
+  osi_pkt_free(buffer);
+}
@@ -139,6 +139,7 @@ btgatt_server_interface_t fake_btgatts_iface = {
     FakeSendResponse,
     nullptr,  // set_phy
     nullptr,  // read_phy
+    nullptr,  // send_notification_multi
 };
 
 }  // namespace
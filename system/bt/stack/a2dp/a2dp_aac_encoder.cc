@@ -19,7 +19,6 @@
 #include "a2dp_aac_encoder.h"
 
 #include <inttypes.h>
-#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -27,6 +26,7 @@
 #include <base/logging.h>
 
 #include "a2dp_aac.h"
+#include "a2dp_media_clock.h"
 #include "bt_common.h"
 #include "common/time_util.h"
 #include "osi/include/log.h"
@@ -55,12 +55,6 @@ typedef struct {
   int max_encoded_buffer_bytes;  // Max encoded bytes per frame
 } tA2DP_AAC_ENCODER_PARAMS;
 
-typedef struct {
-  uint32_t counter;
-  uint32_t bytes_per_tick;              // pcm bytes read each media task tick
-  uint64_t last_frame_timestamp_100ns;  // values in 1/10 microseconds
-} tA2DP_AAC_FEEDING_STATE;
-
 typedef struct {
   uint64_t session_start_us;
 
@@ -89,12 +83,12 @@ typedef struct {
 
   tA2DP_FEEDING_PARAMS feeding_params;
   tA2DP_AAC_ENCODER_PARAMS aac_encoder_params;
-  tA2DP_AAC_FEEDING_STATE aac_feeding_state;
 
   a2dp_aac_encoder_stats_t stats;
 } tA2DP_AAC_ENCODER_CB;
 
-static uint32_t a2dp_aac_encoder_interval_ms = A2DP_AAC_ENCODER_INTERVAL_MS;
+static uint32_t a2dp_aac_encoder_interval_us =
+    A2DP_AAC_ENCODER_INTERVAL_MS * 1000;
 
 static tA2DP_AAC_ENCODER_CB a2dp_aac_encoder_cb;
 
@@ -466,41 +460,32 @@ void a2dp_aac_feeding_reset(void) {
   auto sample_rate = a2dp_aac_encoder_cb.feeding_params.sample_rate;
   if (frame_length == 0 || sample_rate == 0) {
     LOG_WARN("%s: AAC encoder is not configured", __func__);
-    a2dp_aac_encoder_interval_ms = A2DP_AAC_ENCODER_INTERVAL_MS;
+    a2dp_aac_encoder_interval_us = A2DP_AAC_ENCODER_INTERVAL_MS * 1000;
   } else {
     // PCM data size per AAC frame (bits)
     // = aac_encoder_params.frame_length * feeding_params.bits_per_sample
     //   * feeding_params.channel_count
     // = feeding_params.sample_rate * feeding_params.bits_per_sample
-    //   * feeding_params.channel_count * (T_interval_ms / 1000);
+    //   * feeding_params.channel_count * (T_interval_us / 1000000);
     // Here we use the nearest integer not greater than the value.
-    a2dp_aac_encoder_interval_ms = frame_length * 1000 / sample_rate;
-    if (a2dp_aac_encoder_interval_ms < A2DP_AAC_ENCODER_INTERVAL_MS)
-      a2dp_aac_encoder_interval_ms = A2DP_AAC_ENCODER_INTERVAL_MS;
+    a2dp_aac_encoder_interval_us =
+        static_cast<uint64_t>(frame_length) * 1000000 / sample_rate;
+    if (a2dp_aac_encoder_interval_us < A2DP_AAC_ENCODER_INTERVAL_MS * 1000)
+      a2dp_aac_encoder_interval_us = A2DP_AAC_ENCODER_INTERVAL_MS * 1000;
   }
 
-  /* By default, just clear the entire state */
-  memset(&a2dp_aac_encoder_cb.aac_feeding_state, 0,
-         sizeof(a2dp_aac_encoder_cb.aac_feeding_state));
-
-  a2dp_aac_encoder_cb.aac_feeding_state.bytes_per_tick =
-      (a2dp_aac_encoder_cb.feeding_params.sample_rate *
-       a2dp_aac_encoder_cb.feeding_params.bits_per_sample / 8 *
-       a2dp_aac_encoder_cb.feeding_params.channel_count *
-       a2dp_aac_encoder_interval_ms) /
-      1000;
+  A2DP_MediaClockReset(a2dp_aac_encoder_cb.feeding_params.sample_rate *
+                           a2dp_aac_encoder_cb.feeding_params.bits_per_sample /
+                           8 * a2dp_aac_encoder_cb.feeding_params.channel_count,
+                       a2dp_aac_encoder_interval_us);
 
-  LOG_INFO("%s: PCM bytes %u per tick %u ms", __func__,
-           a2dp_aac_encoder_cb.aac_feeding_state.bytes_per_tick,
-           a2dp_aac_encoder_interval_ms);
+  LOG_INFO("%s: PCM tick %u us", __func__, a2dp_aac_encoder_interval_us);
 }
 
-void a2dp_aac_feeding_flush(void) {
-  a2dp_aac_encoder_cb.aac_feeding_state.counter = 0;
-}
+void a2dp_aac_feeding_flush(void) { A2DP_MediaClockFlush(); }
 
 uint64_t a2dp_aac_get_encoder_interval_ms(void) {
-  return a2dp_aac_encoder_interval_ms;
+  return a2dp_aac_encoder_interval_us / 1000;
 }
 
 void a2dp_aac_send_frames(uint64_t timestamp_us) {
@@ -534,32 +519,13 @@ static void a2dp_aac_get_num_frame_iteration(uint8_t* num_of_iterations,
       a2dp_aac_encoder_cb.feeding_params.bits_per_sample / 8;
   LOG_VERBOSE("%s: pcm_bytes_per_frame %u", __func__, pcm_bytes_per_frame);
 
-  uint32_t hecto_ns_this_tick = a2dp_aac_encoder_interval_ms * 10000;
-  uint64_t* last_100ns =
-      &a2dp_aac_encoder_cb.aac_feeding_state.last_frame_timestamp_100ns;
-  uint64_t now_100ns = timestamp_us * 10;
-  if (*last_100ns != 0) {
-    hecto_ns_this_tick = (now_100ns - *last_100ns);
-  }
-  *last_100ns = now_100ns;
-
-  uint32_t bytes_this_tick =
-      a2dp_aac_encoder_cb.aac_feeding_state.bytes_per_tick *
-      hecto_ns_this_tick / (a2dp_aac_encoder_interval_ms * 10000);
-  a2dp_aac_encoder_cb.aac_feeding_state.counter += bytes_this_tick;
-  // Without this erratum, there was a three microseocnd shift per tick which
-  // would cause one frame mismatched after every 180 seconds
-  uint32_t erratum_100ns =
-      ceil(1.0f * bytes_this_tick * a2dp_aac_encoder_interval_ms * 10000 /
-           a2dp_aac_encoder_cb.aac_feeding_state.bytes_per_tick);
-  if (erratum_100ns < hecto_ns_this_tick) {
-    LOG_VERBOSE("%s: hecto_ns_this_tick=%d, bytes=%d, erratum_100ns=%d",
-                __func__, hecto_ns_this_tick, bytes_this_tick, erratum_100ns);
-    *last_100ns -= hecto_ns_this_tick - erratum_100ns;
+  uint32_t dropped_nof = 0;
+  result = A2DP_MediaClockGetFrames(timestamp_us, pcm_bytes_per_frame,
+                                    MAX_PCM_FRAME_NUM_PER_TICK, &dropped_nof);
+  if (dropped_nof > 0) {
+    LOG_WARN("%s: limiting frames to be sent from %d to %d", __func__,
+             result + dropped_nof, MAX_PCM_FRAME_NUM_PER_TICK);
   }
-
-  result = a2dp_aac_encoder_cb.aac_feeding_state.counter / pcm_bytes_per_frame;
-  a2dp_aac_encoder_cb.aac_feeding_state.counter -= result * pcm_bytes_per_frame;
   nof = result;
 
   LOG_VERBOSE("%s: effective num of frames %u, iterations %u", __func__, nof,
@@ -620,7 +586,7 @@ static void a2dp_aac_encode_frames(uint8_t nb_frame) {
   int written = 0;
 
   while (nb_frame) {
-    BT_HDR* p_buf = (BT_HDR*)osi_malloc(BT_DEFAULT_BUFFER_SIZE);
+    BT_HDR* p_buf = A2DP_MediaPacketAlloc();
     p_buf->offset = A2DP_AAC_OFFSET;
     p_buf->len = 0;
     p_buf->layer_specific = 0;
@@ -658,10 +624,10 @@ static void a2dp_aac_encode_frames(uint8_t nb_frame) {
         p_buf->layer_specific++;  // added a frame to the buffer
       } else {
         LOG_WARN("%s: underflow %d", __func__, nb_frame);
-        a2dp_aac_encoder_cb.aac_feeding_state.counter +=
-            nb_frame * p_encoder_params->frame_length *
-            p_feeding_params->channel_count *
-            p_feeding_params->bits_per_sample / 8;
+        A2DP_MediaClockUnderflow(
+            nb_frame, p_encoder_params->frame_length *
+                          p_feeding_params->channel_count *
+                          p_feeding_params->bits_per_sample / 8);
 
         // no more pcm to read
         nb_frame = 0;
@@ -32,7 +32,9 @@
 #include "a2dp_vendor_aptx_hd.h"
 #include "a2dp_vendor_ldac.h"
 #include "bta/av/bta_av_int.h"
+#include "osi/include/allocator.h"
 #include "osi/include/log.h"
+#include "osi/include/packet_allocator.h"
 #include "osi/include/properties.h"
 
 /* The Media Type offset within the codec info byte array */
@@ -1367,6 +1369,14 @@ const tA2DP_DECODER_INTERFACE* A2DP_GetDecoderInterface(
   return NULL;
 }
 
+BT_HDR* A2DP_MediaPacketAlloc(void) {
+  return (BT_HDR*)osi_pkt_alloc(BT_DEFAULT_BUFFER_SIZE);
+}
+
+void A2DP_GetMediaPacketStats(packet_allocator_stats_t* p_stats) {
+  packet_allocator_get_stats_for_size(BT_DEFAULT_BUFFER_SIZE, p_stats);
+}
+
 bool A2DP_AdjustCodec(uint8_t* p_codec_info) {
   tA2DP_CODEC_TYPE codec_type = A2DP_GetCodecType(p_codec_info);
 
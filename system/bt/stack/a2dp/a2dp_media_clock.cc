@@ -0,0 +1,188 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "a2dp_media_clock"
+
+#include "a2dp_media_clock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "osi/include/log.h"
+
+// Ticks further apart than this are treated as a stall: the PCM of the
+// extra time would be dropped anyway, and the cap keeps the credit
+// computation within 64 bits.
+#define A2DP_MEDIA_CLOCK_MAX_ELAPSED_US (1000 * 1000)
+
+// Proportional gain, in ppm per queued packet off the target
+#define A2DP_MEDIA_CLOCK_KP_PPM 50
+// Integral gain, in ppm per queued packet off the target and per tick
+#define A2DP_MEDIA_CLOCK_KI_PPM 5
+// Integral step when the audio HAL runs dry
+#define A2DP_MEDIA_CLOCK_UNDERFLOW_PPM 100
+// The integral decays by 1/2^N per tick while the queue is on target
+#define A2DP_MEDIA_CLOCK_LEAK_SHIFT 6
+
+// Credits are kept in units of 10^-12 byte: microseconds times bytes per
+// second times the corrected rate in ppm.
+static const uint64_t kCreditUnitsPerByte = 1000000ULL * 1000000ULL;
+
+typedef struct {
+  uint32_t pcm_bytes_per_second;
+  uint64_t interval_us;
+  uint64_t last_timestamp_us;
+  uint64_t residue;  // Fraction of a byte, in |kCreditUnitsPerByte|
+  uint64_t counter;  // Whole bytes credited but not taken yet
+  int32_t proportional_ppm;
+  int32_t integral_ppm;
+  tA2DP_MEDIA_CLOCK_STATS stats;
+} tA2DP_MEDIA_CLOCK_CB;
+
+static tA2DP_MEDIA_CLOCK_CB a2dp_media_clock_cb;
+
+static uint64_t a2dp_media_clock_bytes_per_interval(void) {
+  return a2dp_media_clock_cb.pcm_bytes_per_second *
+         a2dp_media_clock_cb.interval_us / 1000000;
+}
+
+static int32_t a2dp_media_clock_clamp_ppm(int32_t ppm) {
+  return std::max(std::min(ppm, A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM),
+                  -A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM);
+}
+
+// The proportional and integral terms are positive when the clock runs fast
+// and has to be slowed down.
+static void a2dp_media_clock_update_correction(void) {
+  int32_t correction = a2dp_media_clock_clamp_ppm(
+      a2dp_media_clock_cb.proportional_ppm + a2dp_media_clock_cb.integral_ppm);
+  a2dp_media_clock_cb.stats.correction_ppm = -correction;
+  a2dp_media_clock_cb.stats.min_correction_ppm =
+      std::min(a2dp_media_clock_cb.stats.min_correction_ppm, -correction);
+  a2dp_media_clock_cb.stats.max_correction_ppm =
+      std::max(a2dp_media_clock_cb.stats.max_correction_ppm, -correction);
+}
+
+void A2DP_MediaClockReset(uint32_t pcm_bytes_per_second,
+                          uint64_t interval_us) {
+  memset(&a2dp_media_clock_cb, 0, sizeof(a2dp_media_clock_cb));
+  a2dp_media_clock_cb.pcm_bytes_per_second = pcm_bytes_per_second;
+  a2dp_media_clock_cb.interval_us = interval_us;
+  a2dp_media_clock_cb.stats.pcm_bytes_per_second = pcm_bytes_per_second;
+
+  LOG_DEBUG("%s: PCM bytes per second %u, interval %llu us", __func__,
+            pcm_bytes_per_second, (unsigned long long)interval_us);
+}
+
+uint64_t A2DP_MediaClockGetIntervalUs(void) {
+  return a2dp_media_clock_cb.interval_us;
+}
+
+void A2DP_MediaClockFlush(void) {
+  a2dp_media_clock_cb.counter = 0;
+  a2dp_media_clock_cb.residue = 0;
+}
+
+uint32_t A2DP_MediaClockGetFrames(uint64_t timestamp_us,
+                                  uint32_t pcm_bytes_per_frame,
+                                  uint32_t max_frames,
+                                  uint32_t* p_dropped_frames) {
+  *p_dropped_frames = 0;
+  if (pcm_bytes_per_frame == 0) return 0;
+
+  uint64_t elapsed_us = a2dp_media_clock_cb.interval_us;
+  if (a2dp_media_clock_cb.last_timestamp_us != 0) {
+    elapsed_us = (timestamp_us > a2dp_media_clock_cb.last_timestamp_us)
+                     ? timestamp_us - a2dp_media_clock_cb.last_timestamp_us
+                     : 0;
+  }
+  a2dp_media_clock_cb.last_timestamp_us = timestamp_us;
+  elapsed_us = std::min<uint64_t>(elapsed_us, A2DP_MEDIA_CLOCK_MAX_ELAPSED_US);
+
+  uint64_t rate_ppm = 1000000 + a2dp_media_clock_cb.stats.correction_ppm;
+  uint64_t credit = elapsed_us * a2dp_media_clock_cb.pcm_bytes_per_second *
+                        rate_ppm +
+                    a2dp_media_clock_cb.residue;
+  uint64_t bytes = credit / kCreditUnitsPerByte;
+  a2dp_media_clock_cb.residue = credit % kCreditUnitsPerByte;
+  a2dp_media_clock_cb.counter += bytes;
+  a2dp_media_clock_cb.stats.total_ticks++;
+  a2dp_media_clock_cb.stats.total_credited_bytes += bytes;
+
+  uint64_t frames = a2dp_media_clock_cb.counter / pcm_bytes_per_frame;
+  if (frames > max_frames) {
+    *p_dropped_frames = frames - max_frames;
+    a2dp_media_clock_cb.stats.total_discarded_bytes +=
+        (frames - max_frames) * pcm_bytes_per_frame;
+    frames = max_frames;
+  }
+  a2dp_media_clock_cb.counter %= pcm_bytes_per_frame;
+  return frames;
+}
+
+void A2DP_MediaClockReturnFrames(uint32_t num_frames,
+                                 uint32_t pcm_bytes_per_frame) {
+  a2dp_media_clock_cb.counter += num_frames * pcm_bytes_per_frame;
+}
+
+void A2DP_MediaClockUnderflow(uint32_t num_frames,
+                              uint32_t pcm_bytes_per_frame) {
+  uint64_t bytes = std::min<uint64_t>(
+      a2dp_media_clock_cb.counter + num_frames * pcm_bytes_per_frame,
+      std::max<uint64_t>(a2dp_media_clock_bytes_per_interval(),
+                         pcm_bytes_per_frame));
+  a2dp_media_clock_cb.stats.total_underflow_bytes +=
+      num_frames * pcm_bytes_per_frame;
+  a2dp_media_clock_cb.counter = bytes;
+
+  a2dp_media_clock_cb.integral_ppm = a2dp_media_clock_clamp_ppm(
+      a2dp_media_clock_cb.integral_ppm + A2DP_MEDIA_CLOCK_UNDERFLOW_PPM);
+  a2dp_media_clock_update_correction();
+}
+
+void A2DP_MediaClockSetTransmitQueueLength(size_t transmit_queue_length) {
+  // Positive when PCM is consumed faster than the link drains it, negative
+  // when the link is left idle. The excess is bounded so that a single tick
+  // cannot saturate the correction.
+  int32_t excess =
+      std::min<size_t>(transmit_queue_length,
+                       A2DP_MEDIA_CLOCK_TARGET_QUEUE_LENGTH +
+                           A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM /
+                               A2DP_MEDIA_CLOCK_KP_PPM);
+  excess -= A2DP_MEDIA_CLOCK_TARGET_QUEUE_LENGTH;
+
+  a2dp_media_clock_cb.proportional_ppm = excess * A2DP_MEDIA_CLOCK_KP_PPM;
+  if (excess != 0) {
+    a2dp_media_clock_cb.integral_ppm = a2dp_media_clock_clamp_ppm(
+        a2dp_media_clock_cb.integral_ppm + excess * A2DP_MEDIA_CLOCK_KI_PPM);
+  } else {
+    // Round the decay away from zero so that the integral settles back to
+    // zero from either side
+    int32_t magnitude = std::abs(a2dp_media_clock_cb.integral_ppm);
+    int32_t decay = (magnitude + (1 << A2DP_MEDIA_CLOCK_LEAK_SHIFT) - 1) >>
+                    A2DP_MEDIA_CLOCK_LEAK_SHIFT;
+    a2dp_media_clock_cb.integral_ppm +=
+        (a2dp_media_clock_cb.integral_ppm > 0) ? -decay : decay;
+  }
+  a2dp_media_clock_update_correction();
+}
+
+void A2DP_MediaClockGetStats(tA2DP_MEDIA_CLOCK_STATS* p_stats) {
+  *p_stats = a2dp_media_clock_cb.stats;
+}
@@ -22,10 +22,10 @@
 #include "a2dp_sbc_encoder.h"
 
 #include <limits.h>
-#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "a2dp_media_clock.h"
 #include "a2dp_sbc.h"
 #include "a2dp_sbc_up_sample.h"
 #include "bt_common.h"
@@ -71,9 +71,6 @@ typedef struct {
   uint32_t aa_frame_counter;
   int32_t aa_feed_counter;
   int32_t aa_feed_residue;
-  uint32_t counter;
-  uint32_t bytes_per_tick;              // pcm bytes read each media task tick
-  uint64_t last_frame_timestamp_100ns;  // values in 1/10 microseconds
 } tA2DP_SBC_FEEDING_STATE;
 
 typedef struct {
@@ -378,19 +375,14 @@ void a2dp_sbc_feeding_reset(void) {
   memset(&a2dp_sbc_encoder_cb.feeding_state, 0,
          sizeof(a2dp_sbc_encoder_cb.feeding_state));
 
-  a2dp_sbc_encoder_cb.feeding_state.bytes_per_tick =
-      (a2dp_sbc_encoder_cb.feeding_params.sample_rate *
-       a2dp_sbc_encoder_cb.feeding_params.bits_per_sample / 8 *
-       a2dp_sbc_encoder_cb.feeding_params.channel_count *
-       A2DP_SBC_ENCODER_INTERVAL_MS) /
-      1000;
-
-  LOG_DEBUG("%s: PCM bytes per tick %u", __func__,
-            a2dp_sbc_encoder_cb.feeding_state.bytes_per_tick);
+  A2DP_MediaClockReset(a2dp_sbc_encoder_cb.feeding_params.sample_rate *
+                           a2dp_sbc_encoder_cb.feeding_params.bits_per_sample /
+                           8 * a2dp_sbc_encoder_cb.feeding_params.channel_count,
+                       A2DP_SBC_ENCODER_INTERVAL_MS * 1000);
 }
 
 void a2dp_sbc_feeding_flush(void) {
-  a2dp_sbc_encoder_cb.feeding_state.counter = 0;
+  A2DP_MediaClockFlush();
   a2dp_sbc_encoder_cb.feeding_state.aa_feed_residue = 0;
 }
 
@@ -423,6 +415,7 @@ static void a2dp_sbc_get_num_frame_iteration(uint8_t* num_of_iterations,
   uint8_t noi = 1;
 
   uint32_t projected_nof = 0;
+  uint32_t dropped_nof = 0;
   uint32_t pcm_bytes_per_frame =
       a2dp_sbc_encoder_cb.sbc_encoder_params.s16NumOfSubBands *
       a2dp_sbc_encoder_cb.sbc_encoder_params.s16NumOfBlocks *
@@ -430,45 +423,20 @@ static void a2dp_sbc_get_num_frame_iteration(uint8_t* num_of_iterations,
       a2dp_sbc_encoder_cb.feeding_params.bits_per_sample / 8;
   LOG_VERBOSE("%s: pcm_bytes_per_frame %u", __func__, pcm_bytes_per_frame);
 
-  uint32_t hecto_ns_this_tick = A2DP_SBC_ENCODER_INTERVAL_MS * 10000;
-  uint64_t* last_100ns =
-      &a2dp_sbc_encoder_cb.feeding_state.last_frame_timestamp_100ns;
-  uint64_t now_100ns = timestamp_us * 10;
-  if (*last_100ns != 0) {
-    hecto_ns_this_tick = (now_100ns - *last_100ns);
-  }
-  *last_100ns = now_100ns;
-
-  uint32_t bytes_this_tick = a2dp_sbc_encoder_cb.feeding_state.bytes_per_tick *
-                             hecto_ns_this_tick /
-                             (A2DP_SBC_ENCODER_INTERVAL_MS * 10000);
-  a2dp_sbc_encoder_cb.feeding_state.counter += bytes_this_tick;
-  // Without this erratum, there was a three microseocnd shift per tick which
-  // would cause one SBC frame mismatched after every 20 seconds
-  uint32_t erratum_100ns =
-      ceil(1.0f * A2DP_SBC_ENCODER_INTERVAL_MS * 10000 * bytes_this_tick /
-           a2dp_sbc_encoder_cb.feeding_state.bytes_per_tick);
-  if (erratum_100ns < hecto_ns_this_tick) {
-    LOG_VERBOSE("%s: hecto_ns_this_tick=%d, bytes=%d, erratum_100ns=%d",
-                __func__, hecto_ns_this_tick, bytes_this_tick, erratum_100ns);
-    *last_100ns -= hecto_ns_this_tick - erratum_100ns;
-  }
-
   /* Calculate the number of frames pending for this media tick */
   projected_nof =
-      a2dp_sbc_encoder_cb.feeding_state.counter / pcm_bytes_per_frame;
+      A2DP_MediaClockGetFrames(timestamp_us, pcm_bytes_per_frame,
+                               MAX_PCM_FRAME_NUM_PER_TICK, &dropped_nof);
   // Update the stats
-  a2dp_sbc_encoder_cb.stats.media_read_total_expected_frames += projected_nof;
+  a2dp_sbc_encoder_cb.stats.media_read_total_expected_frames +=
+      projected_nof + dropped_nof;
 
-  if (projected_nof > MAX_PCM_FRAME_NUM_PER_TICK) {
+  if (dropped_nof > 0) {
     LOG_WARN("%s: limiting frames to be sent from %d to %d", __func__,
-             projected_nof, MAX_PCM_FRAME_NUM_PER_TICK);
+             projected_nof + dropped_nof, MAX_PCM_FRAME_NUM_PER_TICK);
 
     // Update the stats
-    size_t delta = projected_nof - MAX_PCM_FRAME_NUM_PER_TICK;
-    a2dp_sbc_encoder_cb.stats.media_read_total_dropped_frames += delta;
-
-    projected_nof = MAX_PCM_FRAME_NUM_PER_TICK;
+    a2dp_sbc_encoder_cb.stats.media_read_total_dropped_frames += dropped_nof;
   }
 
   LOG_VERBOSE("%s: frames for available PCM data %u", __func__, projected_nof);
@@ -492,8 +460,10 @@ static void a2dp_sbc_get_num_frame_iteration(uint8_t* num_of_iterations,
           LOG_ERROR("%s: Audio Congestion (iterations:%d > max (%d))", __func__,
                     noi, A2DP_SBC_MAX_PCM_ITER_NUM_PER_TICK);
           noi = A2DP_SBC_MAX_PCM_ITER_NUM_PER_TICK;
-          a2dp_sbc_encoder_cb.feeding_state.counter =
-              noi * nof * pcm_bytes_per_frame;
+        } else {
+          // Frames that do not fill a packet are sent on the next tick
+          A2DP_MediaClockReturnFrames(projected_nof - noi * nof,
+                                      pcm_bytes_per_frame);
         }
         projected_nof = nof;
       } else {
@@ -505,21 +475,8 @@ static void a2dp_sbc_get_num_frame_iteration(uint8_t* num_of_iterations,
   } else {
     // For BR cases nof will be same as the value retrieved at projected_nof
     LOG_VERBOSE("%s: headset BR, number of frames %u", __func__, nof);
-    if (projected_nof > MAX_PCM_FRAME_NUM_PER_TICK) {
-      LOG_ERROR("%s: Audio Congestion (frames: %d > max (%d))", __func__,
-                projected_nof, MAX_PCM_FRAME_NUM_PER_TICK);
-
-      // Update the stats
-      size_t delta = projected_nof - MAX_PCM_FRAME_NUM_PER_TICK;
-      a2dp_sbc_encoder_cb.stats.media_read_total_dropped_frames += delta;
-
-      projected_nof = MAX_PCM_FRAME_NUM_PER_TICK;
-      a2dp_sbc_encoder_cb.feeding_state.counter =
-          noi * projected_nof * pcm_bytes_per_frame;
-    }
     nof = projected_nof;
   }
-  a2dp_sbc_encoder_cb.feeding_state.counter -= noi * nof * pcm_bytes_per_frame;
   LOG_VERBOSE("%s: effective num of frames %u, iterations %u", __func__, nof,
               noi);
 
@@ -536,7 +493,7 @@ static void a2dp_sbc_encode_frames(uint8_t nb_frame) {
   uint8_t last_frame_len = 0;
 
   while (nb_frame) {
-    BT_HDR* p_buf = (BT_HDR*)osi_malloc(A2DP_SBC_BUFFER_SIZE);
+    BT_HDR* p_buf = A2DP_MediaPacketAlloc();
     uint32_t bytes_read = 0;
 
     p_buf->offset = A2DP_SBC_OFFSET;
@@ -567,11 +524,12 @@ static void a2dp_sbc_encode_frames(uint8_t nb_frame) {
       } else {
         LOG_WARN("%s: underflow %d, %d", __func__, nb_frame,
                  a2dp_sbc_encoder_cb.feeding_state.aa_feed_residue);
-        a2dp_sbc_encoder_cb.feeding_state.counter +=
-            nb_frame * p_encoder_params->s16NumOfSubBands *
-            p_encoder_params->s16NumOfBlocks *
-            a2dp_sbc_encoder_cb.feeding_params.channel_count *
-            a2dp_sbc_encoder_cb.feeding_params.bits_per_sample / 8;
+        A2DP_MediaClockUnderflow(
+            nb_frame, p_encoder_params->s16NumOfSubBands *
+                          p_encoder_params->s16NumOfBlocks *
+                          a2dp_sbc_encoder_cb.feeding_params.channel_count *
+                          a2dp_sbc_encoder_cb.feeding_params.bits_per_sample /
+                          8);
         /* no more pcm to read */
         nb_frame = 0;
       }
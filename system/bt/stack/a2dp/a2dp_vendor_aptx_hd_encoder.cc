@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "a2dp_media_clock.h"
 #include "a2dp_vendor.h"
 #include "a2dp_vendor_aptx_hd.h"
 #include "bt_common.h"
@@ -64,6 +65,9 @@ static tAPTX_HD_ENCODER_SIZEOF_PARAMS aptx_hd_encoder_sizeof_params_func;
 
 #define A2DP_APTX_HD_MAX_PCM_BYTES_PER_READ 4096
 
+// Packets a single media tick may send to catch up after a late tick
+#define A2DP_APTX_HD_MAX_PACKETS_PER_TICK 2
+
 typedef struct {
   uint64_t sleep_time_ns;
   uint32_t pcm_reads;
@@ -80,6 +84,7 @@ typedef struct {
   size_t media_read_total_expected_read_bytes;
 
   size_t media_read_total_dropped_packets;
+  size_t media_read_total_dropped_bytes;
   size_t media_read_total_actual_reads_count;
   size_t media_read_total_actual_read_bytes;
 } a2dp_aptx_hd_encoder_stats_t;
@@ -344,23 +349,37 @@ static void aptx_hd_update_framing_params(
 }
 
 void a2dp_vendor_aptx_hd_feeding_reset(void) {
-  aptx_hd_init_framing_params(&a2dp_aptx_hd_encoder_cb.framing_params);
+  tAPTX_HD_FRAMING_PARAMS* framing_params =
+      &a2dp_aptx_hd_encoder_cb.framing_params;
+  const tA2DP_FEEDING_PARAMS& feeding_params =
+      a2dp_aptx_hd_encoder_cb.feeding_params;
+
+  aptx_hd_init_framing_params(framing_params);
+  aptx_hd_update_framing_params(framing_params);
+  A2DP_MediaClockReset(feeding_params.sample_rate *
+                           feeding_params.channel_count *
+                           feeding_params.bits_per_sample / 8,
+                       framing_params->sleep_time_ns / 1000);
 }
 
 void a2dp_vendor_aptx_hd_feeding_flush(void) {
   aptx_hd_init_framing_params(&a2dp_aptx_hd_encoder_cb.framing_params);
+  aptx_hd_update_framing_params(&a2dp_aptx_hd_encoder_cb.framing_params);
+  A2DP_MediaClockFlush();
 }
 
 uint64_t a2dp_vendor_aptx_hd_get_encoder_interval_ms(void) {
   return a2dp_aptx_hd_encoder_cb.framing_params.sleep_time_ns / (1000 * 1000);
 }
 
-void a2dp_vendor_aptx_hd_send_frames(uint64_t timestamp_us) {
+// Encodes and enqueues the packet described by the current framing
+// parameters. Returns false if the audio HAL had not enough PCM data.
+static bool a2dp_vendor_aptx_hd_send_packet(void) {
   tAPTX_HD_FRAMING_PARAMS* framing_params =
       &a2dp_aptx_hd_encoder_cb.framing_params;
 
   // Prepare the packet to send
-  BT_HDR* p_buf = (BT_HDR*)osi_malloc(BT_DEFAULT_BUFFER_SIZE);
+  BT_HDR* p_buf = A2DP_MediaPacketAlloc();
   p_buf->offset = A2DP_APTX_HD_OFFSET;
   p_buf->len = 0;
   p_buf->layer_specific = 0;
@@ -368,8 +387,6 @@ void a2dp_vendor_aptx_hd_send_frames(uint64_t timestamp_us) {
   uint8_t* encoded_ptr = (uint8_t*)(p_buf + 1);
   encoded_ptr += p_buf->offset;
 
-  aptx_hd_update_framing_params(framing_params);
-
   //
   // Read the PCM data and encode it
   //
@@ -396,7 +413,7 @@ void a2dp_vendor_aptx_hd_send_frames(uint64_t timestamp_us) {
              __func__, bytes_read, expected_read_bytes);
     a2dp_aptx_hd_encoder_cb.stats.media_read_total_dropped_packets++;
     osi_free(p_buf);
-    return;
+    return false;
   }
   a2dp_aptx_hd_encoder_cb.stats.media_read_total_actual_reads_count++;
 
@@ -430,6 +447,42 @@ void a2dp_vendor_aptx_hd_send_frames(uint64_t timestamp_us) {
     a2dp_aptx_hd_encoder_cb.stats.media_read_total_dropped_packets++;
     osi_free(p_buf);
   }
+
+  return true;
+}
+
+void a2dp_vendor_aptx_hd_send_frames(uint64_t timestamp_us) {
+  tAPTX_HD_FRAMING_PARAMS* framing_params =
+      &a2dp_aptx_hd_encoder_cb.framing_params;
+
+  // The media clock is read in PCM bytes, since the packets do not all carry
+  // the same amount of PCM: see aptx_hd_update_framing_params().
+  uint32_t dropped_bytes = 0;
+  uint32_t pcm_bytes = A2DP_MediaClockGetFrames(
+      timestamp_us, 1,
+      A2DP_APTX_HD_MAX_PACKETS_PER_TICK * A2DP_APTX_HD_MAX_PCM_BYTES_PER_READ,
+      &dropped_bytes);
+  if (dropped_bytes > 0) {
+    LOG_WARN("%s: limiting PCM bytes to be sent from %u to %u", __func__,
+             pcm_bytes + dropped_bytes, pcm_bytes);
+    a2dp_aptx_hd_encoder_cb.stats.media_read_total_dropped_bytes +=
+        dropped_bytes;
+  }
+
+  for (uint8_t packets = 0; packets < A2DP_APTX_HD_MAX_PACKETS_PER_TICK;
+       packets++) {
+    uint32_t packet_pcm_bytes =
+        framing_params->pcm_reads * framing_params->pcm_bytes_per_read;
+    if (pcm_bytes < packet_pcm_bytes) break;
+    pcm_bytes -= packet_pcm_bytes;
+
+    bool sent = a2dp_vendor_aptx_hd_send_packet();
+    // The PCM of a short read is consumed: nothing to carry over
+    if (!sent) A2DP_MediaClockUnderflow(0, packet_pcm_bytes);
+    aptx_hd_update_framing_params(framing_params);
+    if (!sent) break;
+  }
+  A2DP_MediaClockReturnFrames(pcm_bytes, 1);
 }
 
 static size_t aptx_hd_encode_24bit(tAPTX_HD_FRAMING_PARAMS* framing_params,
@@ -492,6 +545,10 @@ void A2dpCodecConfigAptxHd::debug_codec_dump(int fd) {
           stats->media_read_total_expected_packets,
           stats->media_read_total_dropped_packets);
 
+  dprintf(fd,
+          "  PCM bytes dropped by the media clock                    : %zu\n",
+          stats->media_read_total_dropped_bytes);
+
   dprintf(fd,
           "  PCM read counts (expected/actual)                       : %zu / "
           "%zu\n",
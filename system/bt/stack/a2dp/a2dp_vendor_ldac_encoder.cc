@@ -29,6 +29,7 @@
 
 #include <ldacBT.h>
 
+#include "a2dp_media_clock.h"
 #include "a2dp_vendor.h"
 #include "a2dp_vendor_ldac.h"
 #include "a2dp_vendor_ldac_abr.h"
@@ -123,12 +124,6 @@ typedef struct {
   LDACBT_SMPL_FMT_T pcm_fmt;
 } tA2DP_LDAC_ENCODER_PARAMS;
 
-typedef struct {
-  uint32_t counter;
-  uint32_t bytes_per_tick; /* pcm bytes read each media task tick */
-  uint64_t last_frame_us;
-} tA2DP_LDAC_FEEDING_STATE;
-
 typedef struct {
   uint64_t session_start_us;
 
@@ -163,7 +158,6 @@ typedef struct {
 
   tA2DP_FEEDING_PARAMS feeding_params;
   tA2DP_LDAC_ENCODER_PARAMS ldac_encoder_params;
-  tA2DP_LDAC_FEEDING_STATE ldac_feeding_state;
 
   a2dp_ldac_encoder_stats_t stats;
 } tA2DP_LDAC_ENCODER_CB;
@@ -512,25 +506,17 @@ void a2dp_vendor_ldac_encoder_cleanup(void) {
 }
 
 void a2dp_vendor_ldac_feeding_reset(void) {
-  /* By default, just clear the entire state */
-  memset(&a2dp_ldac_encoder_cb.ldac_feeding_state, 0,
-         sizeof(a2dp_ldac_encoder_cb.ldac_feeding_state));
-
-  a2dp_ldac_encoder_cb.ldac_feeding_state.bytes_per_tick =
-      (a2dp_ldac_encoder_cb.feeding_params.sample_rate *
-       a2dp_ldac_encoder_cb.feeding_params.bits_per_sample / 8 *
-       a2dp_ldac_encoder_cb.feeding_params.channel_count *
-       A2DP_LDAC_ENCODER_INTERVAL_MS) /
-      1000;
-
-  LOG_DEBUG("%s: PCM bytes per tick %u", __func__,
-            a2dp_ldac_encoder_cb.ldac_feeding_state.bytes_per_tick);
-}
+  const tA2DP_FEEDING_PARAMS& feeding_params =
+      a2dp_ldac_encoder_cb.feeding_params;
 
-void a2dp_vendor_ldac_feeding_flush(void) {
-  a2dp_ldac_encoder_cb.ldac_feeding_state.counter = 0;
+  A2DP_MediaClockReset(feeding_params.sample_rate *
+                           feeding_params.channel_count *
+                           feeding_params.bits_per_sample / 8,
+                       A2DP_LDAC_ENCODER_INTERVAL_MS * 1000);
 }
 
+void a2dp_vendor_ldac_feeding_flush(void) { A2DP_MediaClockFlush(); }
+
 uint64_t a2dp_vendor_ldac_get_encoder_interval_ms(void) {
   return A2DP_LDAC_ENCODER_INTERVAL_MS;
 }
@@ -579,21 +565,15 @@ static void a2dp_ldac_get_num_frame_iteration(uint8_t* num_of_iterations,
       a2dp_ldac_encoder_cb.feeding_params.bits_per_sample / 8;
   LOG_VERBOSE("%s: pcm_bytes_per_frame %u", __func__, pcm_bytes_per_frame);
 
-  uint32_t us_this_tick = A2DP_LDAC_ENCODER_INTERVAL_MS * 1000;
-  uint64_t now_us = timestamp_us;
-  if (a2dp_ldac_encoder_cb.ldac_feeding_state.last_frame_us != 0)
-    us_this_tick =
-        (now_us - a2dp_ldac_encoder_cb.ldac_feeding_state.last_frame_us);
-  a2dp_ldac_encoder_cb.ldac_feeding_state.last_frame_us = now_us;
-
-  a2dp_ldac_encoder_cb.ldac_feeding_state.counter +=
-      a2dp_ldac_encoder_cb.ldac_feeding_state.bytes_per_tick * us_this_tick /
-      (A2DP_LDAC_ENCODER_INTERVAL_MS * 1000);
-
-  result =
-      a2dp_ldac_encoder_cb.ldac_feeding_state.counter / pcm_bytes_per_frame;
-  a2dp_ldac_encoder_cb.ldac_feeding_state.counter -=
-      result * pcm_bytes_per_frame;
+  // Frames are counted per 128 samples, so high sample rates need more of
+  // them per tick than the other codecs
+  uint32_t dropped_nof = 0;
+  result = A2DP_MediaClockGetFrames(timestamp_us, pcm_bytes_per_frame,
+                                    UINT8_MAX, &dropped_nof);
+  if (dropped_nof > 0) {
+    LOG_WARN("%s: limiting frames to be sent from %d to %d", __func__,
+             result + dropped_nof, UINT8_MAX);
+  }
   nof = result;
 
   LOG_VERBOSE("%s: effective num of frames %u, iterations %u", __func__, nof,
@@ -633,7 +613,7 @@ static void a2dp_ldac_encode_frames(uint8_t nb_frame) {
 
   uint32_t bytes_read = 0;
   while (nb_frame) {
-    BT_HDR* p_buf = (BT_HDR*)osi_malloc(BT_DEFAULT_BUFFER_SIZE);
+    BT_HDR* p_buf = A2DP_MediaPacketAlloc();
     p_buf->offset = A2DP_LDAC_OFFSET;
     p_buf->len = 0;
     p_buf->layer_specific = 0;
@@ -676,10 +656,11 @@ static void a2dp_ldac_encode_frames(uint8_t nb_frame) {
         p_buf->layer_specific += out_frames;  // added a frame to the buffer
       } else {
         LOG_WARN("%s: underflow %d", __func__, nb_frame);
-        a2dp_ldac_encoder_cb.ldac_feeding_state.counter +=
-            nb_frame * LDACBT_ENC_LSU *
-            a2dp_ldac_encoder_cb.feeding_params.channel_count *
-            a2dp_ldac_encoder_cb.feeding_params.bits_per_sample / 8;
+        A2DP_MediaClockUnderflow(
+            nb_frame, LDACBT_ENC_LSU *
+                          a2dp_ldac_encoder_cb.feeding_params.channel_count *
+                          a2dp_ldac_encoder_cb.feeding_params.bits_per_sample /
+                          8);
 
         // no more pcm to read
         nb_frame = 0;
@@ -517,6 +517,27 @@ tBNEP_RESULT BNEP_Write(uint16_t handle, const RawAddress& p_dest_addr,
   return (BNEP_SUCCESS);
 }
 
+/*******************************************************************************
+ *
+ * Function         BNEP_IsTxQueueFull
+ *
+ * Description      This function checks whether data written to a BNEP
+ *                  connection now would be dropped because its transmit
+ *                  queue is full
+ *
+ * Parameters:      handle       - handle of the connection
+ *
+ * Returns:         true if the Tx Q is full, false otherwise or if the
+ *                  handle is not valid
+ *
+ ******************************************************************************/
+bool BNEP_IsTxQueueFull(uint16_t handle) {
+  if ((!handle) || (handle > BNEP_MAX_CONNECTIONS)) return false;
+
+  tBNEP_CONN* p_bcb = &(bnep_cb.bcb[handle - 1]);
+  return fixed_queue_length(p_bcb->xmit_q) >= BNEP_MAX_XMITQ_DEPTH;
+}
+
 /*******************************************************************************
  *
  * Function         BNEP_SetProtocolFilters
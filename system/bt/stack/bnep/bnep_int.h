@@ -101,6 +101,9 @@
 
 #define BNEP_MAX_RETRANSMITS 3
 
+/* Size of the protocol filter map, a bit for each of the 2^16 protocols */
+#define BNEP_PROT_FILTER_MAP_WORDS (0x10000 / 64)
+
 /* Define the BNEP Connection Control Block
 */
 typedef struct {
@@ -138,13 +141,15 @@ typedef struct {
   RawAddress sent_mcast_filter_start[BNEP_MAX_MULTI_FILTERS];
   RawAddress sent_mcast_filter_end[BNEP_MAX_MULTI_FILTERS];
 
+  /* The peer filters are compiled when they are set, so that checking a
+   * packet against them does not scan the ranges: a bit per protocol
+   * allowed, and the multicast ranges as 48 bit integers. */
   uint16_t rcvd_num_filters;
-  uint16_t rcvd_prot_filter_start[BNEP_MAX_PROT_FILTERS];
-  uint16_t rcvd_prot_filter_end[BNEP_MAX_PROT_FILTERS];
+  uint64_t* rcvd_prot_filter_map; /* BNEP_PROT_FILTER_MAP_WORDS, or NULL */
 
   uint16_t rcvd_mcast_filters;
-  RawAddress rcvd_mcast_filter_start[BNEP_MAX_MULTI_FILTERS];
-  RawAddress rcvd_mcast_filter_end[BNEP_MAX_MULTI_FILTERS];
+  uint64_t rcvd_mcast_filter_start[BNEP_MAX_MULTI_FILTERS];
+  uint64_t rcvd_mcast_filter_end[BNEP_MAX_MULTI_FILTERS];
 
   uint16_t bad_pkts_rcvd;
   uint8_t re_transmits;
@@ -215,6 +220,9 @@ extern void bnepu_process_peer_filter_set(tBNEP_CONN* p_bcb, uint8_t* p_filters,
 extern void bnepu_process_peer_filter_rsp(tBNEP_CONN* p_bcb, uint8_t* p_data);
 extern void bnepu_process_multicast_filter_rsp(tBNEP_CONN* p_bcb,
                                                uint8_t* p_data);
+extern void bnepu_process_peer_multicast_filter_set(tBNEP_CONN* p_bcb,
+                                                    uint8_t* p_filters,
+                                                    uint16_t len);
 extern void bnep_send_conn_req(tBNEP_CONN* p_bcb);
 extern void bnep_send_conn_responce(tBNEP_CONN* p_bcb, uint16_t resp_code);
 extern void bnep_process_setup_conn_req(tBNEP_CONN* p_bcb, uint8_t* p_setup,
@@ -226,6 +234,7 @@ extern uint8_t* bnep_process_control_packet(tBNEP_CONN* p_bcb, uint8_t* p,
 extern void bnep_sec_check_complete(const RawAddress* bd_addr,
                                     tBT_TRANSPORT trasnport, void* p_ref_data,
                                     uint8_t result);
+extern void bnepu_clear_peer_filters(tBNEP_CONN* p_bcb);
 extern tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
                                            const RawAddress& p_dest_addr,
                                            uint16_t protocol,
@@ -153,6 +153,40 @@ void bnepu_release_bcb(tBNEP_CONN* p_bcb) {
   }
   fixed_queue_free(p_bcb->xmit_q, NULL);
   p_bcb->xmit_q = NULL;
+
+  bnepu_clear_peer_filters(p_bcb);
+}
+
+/*******************************************************************************
+ *
+ * Function         bnepu_clear_peer_filters
+ *
+ * Description      This function drops the filters set by the peer, so that
+ *                  every packet passes
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void bnepu_clear_peer_filters(tBNEP_CONN* p_bcb) {
+  p_bcb->rcvd_num_filters = 0;
+  osi_free_and_reset((void**)&p_bcb->rcvd_prot_filter_map);
+  p_bcb->rcvd_mcast_filters = 0;
+}
+
+/*******************************************************************************
+ *
+ * Function         bnepu_addr_to_uint64
+ *
+ * Description      This function converts an Ethernet address in network
+ *                  order to an integer that compares in the same order
+ *
+ * Returns          the address as a 48 bit integer
+ *
+ ******************************************************************************/
+static uint64_t bnepu_addr_to_uint64(const uint8_t* p_addr) {
+  uint64_t addr = 0;
+  for (int xx = 0; xx < BD_ADDR_LEN; xx++) addr = (addr << 8) | p_addr[xx];
+  return addr;
 }
 
 /*******************************************************************************
@@ -937,13 +971,23 @@ void bnepu_process_peer_filter_set(tBNEP_CONN* p_bcb, uint8_t* p_filters,
   if (bnep_cb.p_filter_ind_cb)
     (*bnep_cb.p_filter_ind_cb)(p_bcb->handle, true, 0, len, p_filters);
 
+  /* Compile the ranges into the map checked for every packet written */
   p_bcb->rcvd_num_filters = num_filters;
+  if (num_filters == 0) {
+    osi_free_and_reset((void**)&p_bcb->rcvd_prot_filter_map);
+  } else {
+    if (p_bcb->rcvd_prot_filter_map == NULL)
+      p_bcb->rcvd_prot_filter_map = (uint64_t*)osi_malloc(
+          BNEP_PROT_FILTER_MAP_WORDS * sizeof(uint64_t));
+    memset(p_bcb->rcvd_prot_filter_map, 0,
+           BNEP_PROT_FILTER_MAP_WORDS * sizeof(uint64_t));
+  }
   for (xx = 0; xx < num_filters; xx++) {
     BE_STREAM_TO_UINT16(start, p_filters);
     BE_STREAM_TO_UINT16(end, p_filters);
 
-    p_bcb->rcvd_prot_filter_start[xx] = start;
-    p_bcb->rcvd_prot_filter_end[xx] = end;
+    for (uint32_t proto = start; proto <= end; proto++)
+      p_bcb->rcvd_prot_filter_map[proto >> 6] |= 1ULL << (proto & 63);
   }
 
   bnepu_send_peer_filter_rsp(p_bcb, resp_code);
@@ -1050,7 +1094,7 @@ void bnepu_process_peer_multicast_filter_set(tBNEP_CONN* p_bcb,
                                              uint8_t* p_filters, uint16_t len) {
   uint16_t resp_code = BNEP_FILTER_CRL_OK;
   uint16_t num_filters, xx;
-  uint8_t *p_temp_filters, null_bda[BD_ADDR_LEN] = {0, 0, 0, 0, 0, 0};
+  uint8_t* p_temp_filters;
 
   if ((p_bcb->con_state != BNEP_STATE_CONNECTED) &&
       (!(p_bcb->con_flags & BNEP_FLAGS_CONN_COMPLETED))) {
@@ -1091,17 +1135,15 @@ void bnepu_process_peer_multicast_filter_set(tBNEP_CONN* p_bcb,
 
   p_bcb->rcvd_mcast_filters = num_filters;
   for (xx = 0; xx < num_filters; xx++) {
-    memcpy(p_bcb->rcvd_mcast_filter_start[xx].address, p_filters, BD_ADDR_LEN);
-    memcpy(p_bcb->rcvd_mcast_filter_end[xx].address, p_filters + BD_ADDR_LEN,
-           BD_ADDR_LEN);
+    p_bcb->rcvd_mcast_filter_start[xx] = bnepu_addr_to_uint64(p_filters);
+    p_bcb->rcvd_mcast_filter_end[xx] =
+        bnepu_addr_to_uint64(p_filters + BD_ADDR_LEN);
     p_filters += (BD_ADDR_LEN * 2);
 
     /* Check if any of the ranges have all zeros as both starting and ending
      * addresses */
-    if ((memcmp(null_bda, p_bcb->rcvd_mcast_filter_start[xx].address,
-                BD_ADDR_LEN) == 0) &&
-        (memcmp(null_bda, p_bcb->rcvd_mcast_filter_end[xx].address,
-                BD_ADDR_LEN) == 0)) {
+    if (p_bcb->rcvd_mcast_filter_start[xx] == 0 &&
+        p_bcb->rcvd_mcast_filter_end[xx] == 0) {
       p_bcb->rcvd_mcast_filters = 0xFFFF;
       break;
     }
@@ -1261,7 +1303,7 @@ tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
                                     uint16_t protocol, bool fw_ext_present,
                                     uint8_t* p_data, uint16_t org_len) {
   if (p_bcb->rcvd_num_filters) {
-    uint16_t i, proto;
+    uint16_t proto;
 
     /* Findout the actual protocol to check for the filtering */
     proto = protocol;
@@ -1290,13 +1332,7 @@ tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
       BE_STREAM_TO_UINT16(proto, p_data);
     }
 
-    for (i = 0; i < p_bcb->rcvd_num_filters; i++) {
-      if ((p_bcb->rcvd_prot_filter_start[i] <= proto) &&
-          (proto <= p_bcb->rcvd_prot_filter_end[i]))
-        break;
-    }
-
-    if (i == p_bcb->rcvd_num_filters) {
+    if (!(p_bcb->rcvd_prot_filter_map[proto >> 6] & (1ULL << (proto & 63)))) {
       BNEP_TRACE_DEBUG("Ignoring protocol 0x%x in BNEP data write", proto);
       return BNEP_IGNORE_CMD;
     }
@@ -1309,11 +1345,10 @@ tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
     /* Check if every multicast should be filtered */
     if (p_bcb->rcvd_mcast_filters != 0xFFFF) {
       /* Check if the address is mentioned in the filter range */
+      uint64_t dest = bnepu_addr_to_uint64(p_dest_addr.address);
       for (i = 0; i < p_bcb->rcvd_mcast_filters; i++) {
-        if ((memcmp(p_bcb->rcvd_mcast_filter_start[i].address,
-                    p_dest_addr.address, BD_ADDR_LEN) <= 0) &&
-            (memcmp(p_bcb->rcvd_mcast_filter_end[i].address,
-                    p_dest_addr.address, BD_ADDR_LEN) >= 0))
+        if (p_bcb->rcvd_mcast_filter_start[i] <= dest &&
+            dest <= p_bcb->rcvd_mcast_filter_end[i])
           break;
       }
     }
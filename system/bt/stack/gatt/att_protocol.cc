@@ -24,6 +24,8 @@
 
 #include "bt_target.h"
 
+#include <algorithm>
+
 #include "gatt_int.h"
 #include "l2c_api.h"
 
@@ -401,6 +403,53 @@ tGATT_STATUS attp_send_sr_msg(tGATT_TCB& tcb, BT_HDR* p_msg) {
   return attp_send_msg_to_l2cap(tcb, p_msg);
 }
 
+/*******************************************************************************
+ *
+ * Function         attp_send_sr_msg_multi
+ *
+ * Description      This function sends one server message, typically a
+ *                  notification, to several clients. The PDU is encoded once
+ *                  by the caller; every link but the last gets a copy of the
+ *                  encoded bytes, truncated to its own ATT MTU, since L2CAP
+ *                  takes ownership of the buffer and writes its headers in
+ *                  place. The last link gets p_msg itself when it fits.
+ *
+ * Parameter        links: connection control blocks to send to.
+ *                  p_msg: encoded message, ownership is taken.
+ *
+ * Returns          The status of each link, in the order of links.
+ *
+ ******************************************************************************/
+std::vector<tGATT_STATUS> attp_send_sr_msg_multi(
+    const std::vector<tGATT_TCB*>& links, BT_HDR* p_msg) {
+  if (p_msg == NULL)
+    return std::vector<tGATT_STATUS>(links.size(), GATT_NO_RESOURCES);
+
+  std::vector<tGATT_STATUS> status(links.size());
+  const uint8_t* p_pdu = (uint8_t*)(p_msg + 1) + p_msg->offset;
+
+  for (size_t i = 0; i < links.size(); i++) {
+    tGATT_TCB& tcb = *links[i];
+    BT_HDR* p_buf;
+
+    if (i + 1 == links.size() && p_msg->len <= tcb.payload_size) {
+      p_buf = p_msg;
+      p_msg = NULL;
+    } else {
+      uint16_t len = std::min(p_msg->len, tcb.payload_size);
+      p_buf = (BT_HDR*)osi_malloc(sizeof(BT_HDR) + L2CAP_MIN_OFFSET + len);
+      p_buf->offset = L2CAP_MIN_OFFSET;
+      p_buf->len = len;
+      memcpy((uint8_t*)(p_buf + 1) + L2CAP_MIN_OFFSET, p_pdu, len);
+    }
+
+    status[i] = attp_send_sr_msg(tcb, p_buf);
+  }
+
+  osi_free(p_msg);
+  return status;
+}
+
 /*******************************************************************************
  *
  * Function         attp_cl_send_cmd
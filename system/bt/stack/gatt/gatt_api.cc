@@ -292,6 +292,7 @@ uint16_t GATTS_AddService(tGATT_IF gatt_if, btgatt_db_element_t* service,
   }
 
   gatt_update_last_srv_info();
+  gatts_index_add_service(rit);
 
   VLOG(1) << __func__ << ": allocated el s_hdl=" << loghex(elem.s_hdl)
           << ", e_hdl=" << loghex(elem.e_hdl) << ", type=" << loghex(elem.type)
@@ -389,6 +390,7 @@ void GATTS_StopService(uint16_t service_handle) {
     SDP_DeleteRecord(it->sdp_handle);
   }
 
+  gatts_index_remove_service(it);
   gatt_cb.srv_list_info->erase(it);
   gatt_update_last_srv_info();
 }
@@ -502,6 +504,93 @@ tGATT_STATUS GATTS_HandleValueNotification(uint16_t conn_id,
   return cmd_sent;
 }
 
+/*******************************************************************************
+ *
+ * Function         GATTS_HandleValueNotificationMulti
+ *
+ * Description      This function sends the same handle value notification to
+ *                  several clients of one application. The ATT PDU is built
+ *                  once and shared by all target links, each link receives
+ *                  the value truncated to its own ATT MTU.
+ *
+ * Parameter        gatt_if: application interface.
+ *                  conn_ids: connection identifiers of the subscribers.
+ *                  attr_handle: Attribute handle of this handle value
+ *                               notification.
+ *                  val_len: Length of the notified attribute value.
+ *                  p_val: Pointer to the notified attribute value data.
+ *
+ * Returns          The status of each entry of conn_ids, in the same order:
+ *                  GATT_SUCCESS or GATT_CONGESTED if sent, otherwise error
+ *                  code.
+ *
+ ******************************************************************************/
+std::vector<tGATT_STATUS> GATTS_HandleValueNotificationMulti(
+    tGATT_IF gatt_if, const std::vector<uint16_t>& conn_ids,
+    uint16_t attr_handle, uint16_t val_len, uint8_t* p_val) {
+  VLOG(1) << __func__ << ": gatt_if=" << +gatt_if
+          << " num_conn=" << conn_ids.size();
+
+  if (gatt_get_regcb(gatt_if) == NULL) {
+    LOG(ERROR) << __func__ << ": Unknown gatt_if: " << +gatt_if;
+    return std::vector<tGATT_STATUS>(conn_ids.size(), GATT_ILLEGAL_PARAMETER);
+  }
+
+  if (!GATT_HANDLE_IS_VALID(attr_handle) || val_len > GATT_MAX_ATTR_LEN) {
+    return std::vector<tGATT_STATUS>(conn_ids.size(), GATT_ILLEGAL_PARAMETER);
+  }
+
+  std::vector<tGATT_STATUS> status(conn_ids.size(),
+                                   (tGATT_STATUS)GATT_INVALID_CONN_ID);
+  std::vector<tGATT_TCB*> links;
+  /* position in links of each connected tcb, -1 if not notified */
+  std::vector<int> link_pos(GATT_MAX_PHY_CHANNEL, -1);
+  tGATT_TCB* p_widest = NULL;
+
+  for (uint16_t conn_id : conn_ids) {
+    uint8_t tcb_idx = GATT_GET_TCB_IDX(conn_id);
+    tGATT_TCB* p_tcb = gatt_get_tcb_by_idx(tcb_idx);
+
+    if (GATT_GET_GATT_IF(conn_id) != gatt_if || p_tcb == NULL) {
+      LOG(ERROR) << __func__ << ": Unknown conn_id: " << conn_id;
+      continue;
+    }
+
+    /* notify each link once, whatever the number of ids naming it */
+    if (link_pos[tcb_idx] >= 0) continue;
+    link_pos[tcb_idx] = links.size();
+
+    links.push_back(p_tcb);
+    if (p_widest == NULL || p_tcb->payload_size > p_widest->payload_size)
+      p_widest = p_tcb;
+  }
+
+  if (links.empty()) return status;
+
+  tGATT_SR_MSG gatt_sr_msg;
+  gatt_sr_msg.attr_value.handle = attr_handle;
+  gatt_sr_msg.attr_value.len = val_len;
+  memcpy(gatt_sr_msg.attr_value.value, p_val, val_len);
+  gatt_sr_msg.attr_value.auth_req = GATT_AUTH_REQ_NONE;
+
+  /* Encode for the widest link, the others get a truncated copy */
+  BT_HDR* p_buf =
+      attp_build_sr_msg(*p_widest, GATT_HANDLE_VALUE_NOTIF, &gatt_sr_msg);
+  std::vector<tGATT_STATUS> sent = attp_send_sr_msg_multi(links, p_buf);
+
+  /* every id naming a notified link gets the status of that link */
+  for (size_t i = 0; i < conn_ids.size(); i++) {
+    uint16_t conn_id = conn_ids[i];
+    uint8_t tcb_idx = GATT_GET_TCB_IDX(conn_id);
+    if (GATT_GET_GATT_IF(conn_id) != gatt_if ||
+        tcb_idx >= GATT_MAX_PHY_CHANNEL || link_pos[tcb_idx] < 0)
+      continue;
+    status[i] = sent[link_pos[tcb_idx]];
+  }
+
+  return status;
+}
+
 /*******************************************************************************
  *
  * Function         GATTS_SendRsp
@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "btm_int.h"
 #include "gatt_int.h"
 #include "l2c_api.h"
@@ -237,10 +238,10 @@ static tGATT_STATUS read_attr_value(tGATT_ATTR& attr16, uint16_t offset,
  *
  * Function         gatts_db_read_attr_value_by_type
  *
- * Description      Query attribute value by attribute type.
+ * Description      Query attribute value by attribute type, across all the
+ *                  started services.
  *
- * Parameter        p_db: pointer to the attribute database.
- *                  p_rsp: Read By type response data.
+ * Parameter        p_rsp: Read By type response data.
  *                  s_handle: starting handle of the range we are looking for.
  *                  e_handle: ending handle of the range we are looking for.
  *                  type: Attribute type.
@@ -252,49 +253,48 @@ static tGATT_STATUS read_attr_value(tGATT_ATTR& attr16, uint16_t offset,
  *
  ******************************************************************************/
 tGATT_STATUS gatts_db_read_attr_value_by_type(
-    tGATT_TCB& tcb, tGATT_SVC_DB* p_db, uint8_t op_code, BT_HDR* p_rsp,
-    uint16_t s_handle, uint16_t e_handle, const Uuid& type, uint16_t* p_len,
+    tGATT_TCB& tcb, uint8_t op_code, BT_HDR* p_rsp, uint16_t s_handle,
+    uint16_t e_handle, const Uuid& type, uint16_t* p_len,
     tGATT_SEC_FLAG sec_flag, uint8_t key_size, uint32_t trans_id,
     uint16_t* p_cur_handle) {
   tGATT_STATUS status = GATT_NOT_FOUND;
   uint16_t len = 0;
   uint8_t* p = (uint8_t*)(p_rsp + 1) + p_rsp->len + L2CAP_MIN_OFFSET;
 
-  if (p_db) {
-    for (tGATT_ATTR& attr : p_db->attr_list) {
-      if (attr.handle >= s_handle && type == attr.uuid) {
-        if (*p_len <= 2) {
-          status = GATT_NO_RESOURCES;
-          break;
-        }
+  auto range = gatts_find_handles_by_type(type, s_handle, e_handle);
+  for (auto it = range.first; it != range.second; it++) {
+    tGATT_ATTR& attr = *gatt_cb.attr_index->attr_by_handle[*it];
 
-        UINT16_TO_STREAM(p, attr.handle);
+    if (*p_len <= 2) {
+      status = GATT_NO_RESOURCES;
+      break;
+    }
 
-        status = read_attr_value(attr, 0, &p, false, (uint16_t)(*p_len - 2),
-                                 &len, sec_flag, key_size);
+    UINT16_TO_STREAM(p, attr.handle);
 
-        if (status == GATT_PENDING) {
-          status = gatts_send_app_read_request(tcb, op_code, attr.handle, 0,
-                                               trans_id, attr.gatt_type);
+    status = read_attr_value(attr, 0, &p, false, (uint16_t)(*p_len - 2), &len,
+                             sec_flag, key_size);
 
-          /* one callback at a time */
-          break;
-        } else if (status == GATT_SUCCESS) {
-          if (p_rsp->offset == 0) p_rsp->offset = len + 2;
-
-          if (p_rsp->offset == len + 2) {
-            p_rsp->len += (len + 2);
-            *p_len -= (len + 2);
-          } else {
-            LOG(ERROR) << "format mismatch";
-            status = GATT_NO_RESOURCES;
-            break;
-          }
-        } else {
-          *p_cur_handle = attr.handle;
-          break;
-        }
+    if (status == GATT_PENDING) {
+      status = gatts_send_app_read_request(tcb, op_code, attr.handle, 0,
+                                           trans_id, attr.gatt_type);
+
+      /* one callback at a time */
+      break;
+    } else if (status == GATT_SUCCESS) {
+      if (p_rsp->offset == 0) p_rsp->offset = len + 2;
+
+      if (p_rsp->offset == len + 2) {
+        p_rsp->len += (len + 2);
+        *p_len -= (len + 2);
+      } else {
+        LOG(ERROR) << "format mismatch";
+        status = GATT_NO_RESOURCES;
+        break;
       }
+    } else {
+      *p_cur_handle = attr.handle;
+      break;
     }
   }
 
@@ -410,14 +410,145 @@ uint16_t gatts_add_char_descr(tGATT_SVC_DB& db, tGATT_PERM perm,
 /* Service Attribute Database Query Utility Functions */
 /******************************************************************************/
 tGATT_ATTR* find_attr_by_handle(tGATT_SVC_DB* p_db, uint16_t handle) {
-  if (!p_db) return nullptr;
+  if (!p_db || p_db->attr_list.empty()) return nullptr;
 
-  for (auto& attr : p_db->attr_list) {
-    if (attr.handle == handle) return &attr;
-    if (attr.handle > handle) return nullptr;
+  /* handles are allocated consecutively, see allocate_attr_in_db() */
+  uint16_t first_handle = p_db->attr_list.front().handle;
+  if (handle < first_handle) return nullptr;
+
+  size_t idx = handle - first_handle;
+  if (idx >= p_db->attr_list.size()) return nullptr;
+
+  return &p_db->attr_list[idx];
+}
+
+/**
+ * Add the handles of the started service |it| to the server wide attribute
+ * index. Only the handles of that service are touched, the others stay
+ * where they are.
+ */
+void gatts_index_add_service(std::list<tGATT_SRV_LIST_ELEM>::iterator it) {
+  tGATT_SR_ATTR_INDEX& index = *gatt_cb.attr_index;
+
+  if (index.srv_by_handle.size() <= it->e_hdl) {
+    index.attr_by_handle.resize(it->e_hdl + 1, nullptr);
+    index.srv_by_handle.resize(it->e_hdl + 1, gatt_cb.srv_list_info->end());
+  }
+
+  for (uint32_t hdl = it->s_hdl; hdl <= it->e_hdl; hdl++)
+    index.srv_by_handle[hdl] = it;
+
+  if (!it->p_db) return;
+
+  for (tGATT_ATTR& attr : it->p_db->attr_list) {
+    index.attr_by_handle[attr.handle] = &attr;
+    /* services mostly start in handle order, so this is usually an append */
+    std::vector<uint16_t>& handles = index.handles_by_type[attr.uuid];
+    handles.insert(
+        std::upper_bound(handles.begin(), handles.end(), attr.handle),
+        attr.handle);
   }
+}
 
-  return nullptr;
+/**
+ * Drop the handles of the started service |it| from the server wide
+ * attribute index. Must be called before |it| is erased.
+ */
+void gatts_index_remove_service(std::list<tGATT_SRV_LIST_ELEM>::iterator it) {
+  tGATT_SR_ATTR_INDEX& index = *gatt_cb.attr_index;
+  auto srv_end = gatt_cb.srv_list_info->end();
+
+  for (uint32_t hdl = it->s_hdl;
+       hdl <= it->e_hdl && hdl < index.srv_by_handle.size(); hdl++) {
+    index.srv_by_handle[hdl] = srv_end;
+    index.attr_by_handle[hdl] = nullptr;
+  }
+
+  /* don't keep room for handles past the last service */
+  size_t size = index.srv_by_handle.size();
+  while (size > 0 && index.srv_by_handle[size - 1] == srv_end) size--;
+  index.srv_by_handle.resize(size);
+  index.attr_by_handle.resize(size);
+
+  if (!it->p_db) return;
+
+  for (tGATT_ATTR& attr : it->p_db->attr_list) {
+    auto map_it = index.handles_by_type.find(attr.uuid);
+    if (map_it == index.handles_by_type.end()) continue;
+
+    std::vector<uint16_t>& handles = map_it->second;
+    auto hdl_it = std::lower_bound(handles.begin(), handles.end(), attr.handle);
+    if (hdl_it != handles.end() && *hdl_it == attr.handle)
+      handles.erase(hdl_it);
+    if (handles.empty()) index.handles_by_type.erase(map_it);
+  }
+}
+
+/**
+ * Rebuild the server wide attribute index from the list of started services.
+ * Starting and stopping a service update the index in place, see
+ * gatts_index_add_service().
+ */
+void gatts_rebuild_attr_index(void) {
+  tGATT_SR_ATTR_INDEX& index = *gatt_cb.attr_index;
+
+  index.attr_by_handle.clear();
+  index.srv_by_handle.clear();
+  index.handles_by_type.clear();
+
+  for (auto it = gatt_cb.srv_list_info->begin();
+       it != gatt_cb.srv_list_info->end(); it++)
+    gatts_index_add_service(it);
+
+  VLOG(1) << __func__ << ": handles=" << index.srv_by_handle.size()
+          << ", types=" << index.handles_by_type.size();
+}
+
+/** Find an attribute of any started service by its handle. */
+tGATT_ATTR* gatts_find_attr_by_handle(uint16_t handle) {
+  const tGATT_SR_ATTR_INDEX& index = *gatt_cb.attr_index;
+  if (handle >= index.attr_by_handle.size()) return nullptr;
+
+  return index.attr_by_handle[handle];
+}
+
+/**
+ * Find the first started service which ends at or after |handle|, so that
+ * services overlapping a handle range can be walked in order from there.
+ * Returns srv_list_info->end() if there is none.
+ */
+std::list<tGATT_SRV_LIST_ELEM>::iterator gatts_find_first_srv_from_handle(
+    uint16_t handle) {
+  const tGATT_SR_ATTR_INDEX& index = *gatt_cb.attr_index;
+  auto srv_end = gatt_cb.srv_list_info->end();
+
+  /* skip the unassigned handles between services, if any */
+  for (size_t hdl = handle; hdl < index.srv_by_handle.size(); hdl++) {
+    if (index.srv_by_handle[hdl] != srv_end) return index.srv_by_handle[hdl];
+  }
+  return srv_end;
+}
+
+/**
+ * Returns the ascending range of handles in [s_handle, e_handle] whose
+ * attribute type is |type|.
+ */
+std::pair<std::vector<uint16_t>::const_iterator,
+          std::vector<uint16_t>::const_iterator>
+gatts_find_handles_by_type(const Uuid& type, uint16_t s_handle,
+                           uint16_t e_handle) {
+  static const std::vector<uint16_t> kEmpty;
+
+  if (s_handle > e_handle) return std::make_pair(kEmpty.end(), kEmpty.end());
+
+  auto map_it = gatt_cb.attr_index->handles_by_type.find(type);
+  const std::vector<uint16_t>& handles =
+      (map_it == gatt_cb.attr_index->handles_by_type.end()) ? kEmpty
+                                                           : map_it->second;
+
+  return std::make_pair(
+      std::lower_bound(handles.begin(), handles.end(), s_handle),
+      std::upper_bound(handles.begin(), handles.end(), e_handle));
 }
 
 /*******************************************************************************
@@ -29,7 +29,10 @@
 #include <base/strings/stringprintf.h>
 #include <string.h>
 #include <list>
+#include <map>
+#include <queue>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #define GATT_CREATE_CONN_ID(tcb_idx, gatt_if) \
@@ -263,6 +266,18 @@ typedef struct {
   bool is_primary;
 } tGATT_SRV_LIST_ELEM;
 
+/* Handle-indexed view of all started services. Attributes of a service occupy
+ * consecutive handles, so a flat table indexed by handle resolves both the
+ * attribute and its owning service in O(1). |handles_by_type| keeps the
+ * handles of each attribute type in ascending order, so type based requests
+ * only visit matching attributes. Starting or stopping a service only updates
+ * the handles of that service. */
+typedef struct {
+  std::vector<tGATT_ATTR*> attr_by_handle;
+  std::vector<std::list<tGATT_SRV_LIST_ELEM>::iterator> srv_by_handle;
+  std::map<bluetooth::Uuid, std::vector<uint16_t>> handles_by_type;
+} tGATT_SR_ATTR_INDEX;
+
 typedef struct {
   std::queue<tGATT_CLCB*> pending_enc_clcb; /* pending encryption channel q */
   tGATT_SEC_ACTION sec_act;
@@ -363,6 +378,7 @@ typedef struct {
   tGATT_IF gatt_if;
   std::list<tGATT_HDL_LIST_ELEM>* hdl_list_info;
   std::list<tGATT_SRV_LIST_ELEM>* srv_list_info;
+  tGATT_SR_ATTR_INDEX* attr_index;
 
   fixed_queue_t* srv_chg_clt_q; /* service change clients queue */
   tGATT_REG cl_rcb[GATT_MAX_APPS];
@@ -424,6 +440,8 @@ extern tGATT_STATUS attp_send_cl_msg(tGATT_TCB& tcb, tGATT_CLCB* p_clcb,
 extern BT_HDR* attp_build_sr_msg(tGATT_TCB& tcb, uint8_t op_code,
                                  tGATT_SR_MSG* p_msg);
 extern tGATT_STATUS attp_send_sr_msg(tGATT_TCB& tcb, BT_HDR* p_msg);
+extern std::vector<tGATT_STATUS> attp_send_sr_msg_multi(
+    const std::vector<tGATT_TCB*>& links, BT_HDR* p_msg);
 extern tGATT_STATUS attp_send_msg_to_l2cap(tGATT_TCB& tcb, BT_HDR* p_toL2CAP);
 
 /* utility functions */
@@ -557,10 +575,10 @@ extern uint16_t gatts_add_characteristic(tGATT_SVC_DB& db, tGATT_PERM perm,
 extern uint16_t gatts_add_char_descr(tGATT_SVC_DB& db, tGATT_PERM perm,
                                      const bluetooth::Uuid& dscp_uuid);
 extern tGATT_STATUS gatts_db_read_attr_value_by_type(
-    tGATT_TCB& tcb, tGATT_SVC_DB* p_db, uint8_t op_code, BT_HDR* p_rsp,
-    uint16_t s_handle, uint16_t e_handle, const bluetooth::Uuid& type,
-    uint16_t* p_len, tGATT_SEC_FLAG sec_flag, uint8_t key_size,
-    uint32_t trans_id, uint16_t* p_cur_handle);
+    tGATT_TCB& tcb, uint8_t op_code, BT_HDR* p_rsp, uint16_t s_handle,
+    uint16_t e_handle, const bluetooth::Uuid& type, uint16_t* p_len,
+    tGATT_SEC_FLAG sec_flag, uint8_t key_size, uint32_t trans_id,
+    uint16_t* p_cur_handle);
 extern tGATT_STATUS gatts_read_attr_value_by_handle(
     tGATT_TCB& tcb, tGATT_SVC_DB* p_db, uint8_t op_code, uint16_t handle,
     uint16_t offset, uint8_t* p_value, uint16_t* p_len, uint16_t mtu,
@@ -573,5 +591,18 @@ extern tGATT_STATUS gatts_read_attr_perm_check(tGATT_SVC_DB* p_db, bool is_long,
                                                tGATT_SEC_FLAG sec_flag,
                                                uint8_t key_size);
 extern bluetooth::Uuid* gatts_get_service_uuid(tGATT_SVC_DB* p_db);
+extern tGATT_ATTR* find_attr_by_handle(tGATT_SVC_DB* p_db, uint16_t handle);
+extern void gatts_index_add_service(
+    std::list<tGATT_SRV_LIST_ELEM>::iterator it);
+extern void gatts_index_remove_service(
+    std::list<tGATT_SRV_LIST_ELEM>::iterator it);
+extern void gatts_rebuild_attr_index(void);
+extern tGATT_ATTR* gatts_find_attr_by_handle(uint16_t handle);
+extern std::list<tGATT_SRV_LIST_ELEM>::iterator
+gatts_find_first_srv_from_handle(uint16_t handle);
+extern std::pair<std::vector<uint16_t>::const_iterator,
+                 std::vector<uint16_t>::const_iterator>
+gatts_find_handles_by_type(const bluetooth::Uuid& type, uint16_t s_handle,
+                           uint16_t e_handle);
 
 #endif
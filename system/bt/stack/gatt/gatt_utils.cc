@@ -656,21 +656,16 @@ void gatt_ind_ack_timeout(void* data) {
  *
  * Description      Search for a service that owns a specific handle.
  *
- * Returns          GATT_MAX_SR_PROFILES if not found. Otherwise the index of
- *                  the service.
+ * Returns          srv_list_info->end() if not found. Otherwise the iterator
+ *                  of the service.
  *
  ******************************************************************************/
 std::list<tGATT_SRV_LIST_ELEM>::iterator gatt_sr_find_i_rcb_by_handle(
     uint16_t handle) {
-  auto it = gatt_cb.srv_list_info->begin();
+  const tGATT_SR_ATTR_INDEX& index = *gatt_cb.attr_index;
+  if (handle >= index.srv_by_handle.size()) return gatt_cb.srv_list_info->end();
 
-  for (; it != gatt_cb.srv_list_info->end(); it++) {
-    if (it->s_hdl <= handle && it->e_hdl >= handle) {
-      return it;
-    }
-  }
-
-  return it;
+  return index.srv_by_handle[handle];
 }
 
 /*******************************************************************************
@@ -34,6 +34,7 @@
 #include "a2dp_api.h"
 #include "audio_a2dp_hw/include/audio_a2dp_hw.h"
 #include "avdt_api.h"
+#include "osi/include/packet_allocator.h"
 
 class tBT_A2DP_OFFLOAD;
 
@@ -694,6 +695,15 @@ bool A2DP_BuildCodecHeader(const uint8_t* p_codec_info, BT_HDR* p_buf,
 const tA2DP_ENCODER_INTERFACE* A2DP_GetEncoderInterface(
     const uint8_t* p_codec_info);
 
+// Allocates the buffer for an encoded media packet, |BT_DEFAULT_BUFFER_SIZE|
+// bytes including the |BT_HDR|. Buffers are taken from the packet allocator,
+// and are released with |osi_free| by the layer that consumes the packet.
+BT_HDR* A2DP_MediaPacketAlloc(void);
+
+// Gets the statistics of the packet allocator class media packets are taken
+// from. The class is shared with other packets of the same size.
+void A2DP_GetMediaPacketStats(packet_allocator_stats_t* p_stats);
+
 // Gets the A2DP decoder interface that can be used to decode received A2DP
 // packets - see |tA2DP_DECODER_INTERFACE|.
 // |p_codec_info| contains the codec information.
@@ -0,0 +1,102 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+//
+// A2DP Source media clock
+//
+// Paces the PCM data the A2DP encoders read from the audio HAL. Every media
+// tick credits the PCM that played out since the previous tick. The credit
+// is computed with integer arithmetic that carries the remainder over, so no
+// rounding error accumulates however irregular the ticks are.
+//
+// The credit is scaled by a small rate correction, the output of a PI loop
+// that locks the encoding rate to the rate at which the link drains: the
+// transmit queue only empties as the controller reports completed packets, so
+// a queue that stays above its target means PCM is consumed faster than the
+// peer plays it out, and a queue that runs empty means it is consumed slower.
+// The loop also backs off when the audio HAL runs dry.
+//
+// There is a single clock, shared by the encoder that is in use. All
+// functions must be called on the A2DP Source thread.
+//
+
+#ifndef A2DP_MEDIA_CLOCK_H
+#define A2DP_MEDIA_CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Transmit queue length the rate correction steers towards
+#define A2DP_MEDIA_CLOCK_TARGET_QUEUE_LENGTH 2
+
+// Bound of the rate correction, in parts per million
+#define A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM 1000
+
+typedef struct {
+  uint32_t pcm_bytes_per_second;  // Nominal PCM rate
+  int32_t correction_ppm;         // Current rate correction
+  int32_t min_correction_ppm;     // Lowest correction since the last reset
+  int32_t max_correction_ppm;     // Highest correction since the last reset
+  uint64_t total_ticks;
+  uint64_t total_credited_bytes;
+  // PCM the HAL could not provide, carried over to the next tick
+  uint64_t total_underflow_bytes;
+  // Credit above what a single tick may encode, dropped after a stall
+  uint64_t total_discarded_bytes;
+} tA2DP_MEDIA_CLOCK_STATS;
+
+// Resets the media clock for a PCM feeding of |pcm_bytes_per_second|. The
+// first tick credits |interval_us| worth of PCM. Called when the encoder
+// feeding is reset.
+void A2DP_MediaClockReset(uint32_t pcm_bytes_per_second, uint64_t interval_us);
+
+// Gets the media tick period the clock was reset with, in microseconds. The
+// media tick timer must be armed with this period rather than a rounded one.
+uint64_t A2DP_MediaClockGetIntervalUs(void);
+
+// Drops the PCM credited but not encoded yet.
+void A2DP_MediaClockFlush(void);
+
+// Advances the media clock to |timestamp_us| and takes the whole frames of
+// |pcm_bytes_per_frame| bytes that are due, at most |max_frames|. Frames above
+// the limit are dropped and their number is stored in |p_dropped_frames|.
+// Returns the number of frames to encode.
+uint32_t A2DP_MediaClockGetFrames(uint64_t timestamp_us,
+                                  uint32_t pcm_bytes_per_frame,
+                                  uint32_t max_frames,
+                                  uint32_t* p_dropped_frames);
+
+// Gives back |num_frames| frames taken by |A2DP_MediaClockGetFrames| that were
+// not encoded, so that they are due again on the next tick.
+void A2DP_MediaClockReturnFrames(uint32_t num_frames,
+                                 uint32_t pcm_bytes_per_frame);
+
+// Same as |A2DP_MediaClockReturnFrames| for frames that were not encoded
+// because the audio HAL had no PCM data for them. Also slows the clock down.
+// At most one tick worth of PCM is carried over.
+void A2DP_MediaClockUnderflow(uint32_t num_frames,
+                              uint32_t pcm_bytes_per_frame);
+
+// Feeds the length of the transmit queue at the start of a media tick into
+// the rate correction.
+void A2DP_MediaClockSetTransmitQueueLength(size_t transmit_queue_length);
+
+// Gets the statistics of the media clock.
+void A2DP_MediaClockGetStats(tA2DP_MEDIA_CLOCK_STATS* p_stats);
+
+#endif  // A2DP_MEDIA_CLOCK_H
@@ -340,6 +340,22 @@ extern tBNEP_RESULT BNEP_Write(uint16_t handle, const RawAddress& p_dest_addr,
                                const RawAddress* p_src_addr,
                                bool fw_ext_present);
 
+/*******************************************************************************
+ *
+ * Function         BNEP_IsTxQueueFull
+ *
+ * Description      This function checks whether data written to a BNEP
+ *                  connection now would be dropped because its transmit
+ *                  queue is full
+ *
+ * Parameters:      handle       - handle of the connection
+ *
+ * Returns:         true if the Tx Q is full, false otherwise or if the
+ *                  handle is not valid
+ *
+ ******************************************************************************/
+extern bool BNEP_IsTxQueueFull(uint16_t handle);
+
 /*******************************************************************************
  *
  * Function         BNEP_SetProtocolFilters
@@ -22,6 +22,8 @@
 #include "btm_ble_api.h"
 #include "gattdefs.h"
 
+#include <vector>
+
 /*****************************************************************************
  *  Constants
  ****************************************************************************/
@@ -772,6 +774,29 @@ extern tGATT_STATUS GATTS_HandleValueNotification(uint16_t conn_id,
                                                   uint16_t val_len,
                                                   uint8_t* p_val);
 
+/*******************************************************************************
+ *
+ * Function         GATTS_HandleValueNotificationMulti
+ *
+ * Description      This function sends the same handle value notification to
+ *                  several clients of one application, encoding it once.
+ *
+ * Parameter        gatt_if: application interface.
+ *                  conn_ids: connection identifiers of the subscribers.
+ *                  attr_handle: Attribute handle of this handle value
+ *                               notification.
+ *                  val_len: Length of the notified attribute value.
+ *                  p_val: Pointer to the notified attribute value data.
+ *
+ * Returns          The status of each entry of conn_ids, in the same order:
+ *                  GATT_SUCCESS or GATT_CONGESTED if sent, otherwise error
+ *                  code.
+ *
+ ******************************************************************************/
+extern std::vector<tGATT_STATUS> GATTS_HandleValueNotificationMulti(
+    tGATT_IF gatt_if, const std::vector<uint16_t>& conn_ids,
+    uint16_t attr_handle, uint16_t val_len, uint8_t* p_val);
+
 /*******************************************************************************
  *
  * Function         GATTS_SendRsp
@@ -354,6 +354,22 @@ extern tPAN_RESULT PAN_WriteBuf(uint16_t handle, const RawAddress& dst,
                                 const RawAddress& src, uint16_t protocol,
                                 BT_HDR* p_buf, bool ext);
 
+/*******************************************************************************
+ *
+ * Function         PAN_IsTxQueueFull
+ *
+ * Description      This function checks whether a unicast buffer written with
+ *                  PAN_WriteBuf on the connection would be dropped because the
+ *                  transmit queue of the connection is full. The application
+ *                  can then hold on to the buffer until the queue drains.
+ *
+ * Parameters:      handle   - handle for the connection
+ *
+ * Returns          true if the transmit queue is full, false otherwise
+ *
+ ******************************************************************************/
+extern bool PAN_IsTxQueueFull(uint16_t handle);
+
 /*******************************************************************************
  *
  * Function         PAN_SetProtocolFilters
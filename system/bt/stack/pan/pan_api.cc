@@ -579,6 +579,43 @@ tPAN_RESULT PAN_WriteBuf(uint16_t handle, const RawAddress& dst,
   return PAN_SUCCESS;
 }
 
+/*******************************************************************************
+ *
+ * Function         PAN_IsTxQueueFull
+ *
+ * Description      This function checks whether a unicast buffer written with
+ *                  PAN_WriteBuf on the connection would be dropped because the
+ *                  transmit queue of the connection is full. The application
+ *                  can then hold on to the buffer until the queue drains.
+ *
+ * Parameters:      handle   - handle for the connection
+ *
+ * Returns          true if the transmit queue is full, false otherwise
+ *
+ ******************************************************************************/
+bool PAN_IsTxQueueFull(uint16_t handle) {
+  tPAN_CONN* pcb = NULL;
+
+  if (pan_cb.role == PAN_ROLE_INACTIVE || (!(pan_cb.num_conns))) return false;
+
+  /* PAN_WriteBuf sends on the PANU connection whatever the handle */
+  if (pan_cb.active_role == PAN_ROLE_CLIENT) {
+    for (uint16_t i = 0; i < MAX_PAN_CONNS; i++) {
+      if (pan_cb.pcb[i].con_state == PAN_STATE_CONNECTED &&
+          pan_cb.pcb[i].src_uuid == UUID_SERVCLASS_PANU) {
+        pcb = &pan_cb.pcb[i];
+        break;
+      }
+    }
+  } else {
+    pcb = pan_get_pcb_by_handle(handle);
+  }
+
+  if (!pcb || pcb->con_state != PAN_STATE_CONNECTED) return false;
+
+  return BNEP_IsTxQueueFull(pcb->handle);
+}
+
 /*******************************************************************************
  *
  * Function         PAN_SetProtocolFilters
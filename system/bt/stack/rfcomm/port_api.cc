@@ -26,6 +26,8 @@
 
 #include <base/logging.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <algorithm>
 
 #include "osi/include/log.h"
 #include "osi/include/mutex.h"
@@ -632,6 +634,9 @@ int PORT_FlowControl_MaxCredit(uint16_t handle, bool enable) {
   if (p_port->rfc.p_mcb->flow == PORT_FC_CREDIT) {
     if (!p_port->rx.user_fc) {
       port_flow_control_peer(p_port, true, p_port->credit_rx);
+    } else {
+      /* the user does not keep up, a larger window would not help */
+      port_rx_window_reset(p_port);
     }
   } else {
     old_fc = p_port->local_ctrl.fc;
@@ -906,9 +911,7 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
 
   mutex_global_unlock();
 
-  // int max_read = length < p_port->peer_mtu ? length : p_port->peer_mtu;
-
-  // max_read = available < max_read ? available : max_read;
+  if (p_port->peer_mtu < length) length = p_port->peer_mtu;
 
   while (available) {
     /* if we're over buffer high water mark, we're done */
@@ -923,41 +926,80 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
       break;
     }
 
-    /* continue with rfcomm data write */
-    p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
-    p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
-    p_buf->layer_specific = handle;
+    /* A server port which isn't open drops whatever it is given: leave the
+     * data in the socket rather than read it */
+    if (p_port->is_server && (p_port->rfc.state != RFC_STATE_OPENED)) {
+      rc = PORT_CLOSED;
+      break;
+    }
 
-    if (p_port->peer_mtu < length) length = p_port->peer_mtu;
-    if (available < (int)length) length = (uint16_t)available;
-    p_buf->len = length;
-    p_buf->event = BT_EVT_TO_BTU_SP_DATA;
+    /* Read no more than the tx queue can take: the rest of the data stays in
+     * the socket, and the application is held back until the peer returns
+     * credits and the queue drains. The batch stays below the critical water
+     * mark, so port_write() takes all of it */
+    int num_bufs = PORT_TX_BUF_HIGH_WM + 1 -
+                   (int)fixed_queue_length(p_port->tx.queue);
+    int max_bytes = PORT_TX_HIGH_WM - (int)p_port->tx.queue_size;
+    BT_HDR* bufs[PORT_TX_BUF_HIGH_WM + 1];
+    struct iovec iov[PORT_TX_BUF_HIGH_WM + 1];
+    int count = 0;
+    int read_len = 0;
+    while (count < num_bufs && read_len < available && read_len <= max_bytes) {
+      /* continue with rfcomm data write */
+      p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+      p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
+      p_buf->layer_specific = handle;
+      p_buf->len = (uint16_t)std::min<int>(length, available - read_len);
+      p_buf->event = BT_EVT_TO_BTU_SP_DATA;
+
+      iov[count].iov_base = (uint8_t*)(p_buf + 1) + p_buf->offset;
+      iov[count].iov_len = p_buf->len;
+      bufs[count++] = p_buf;
+      read_len += p_buf->len;
+    }
 
-    // memcpy ((uint8_t *)(p_buf + 1) + p_buf->offset, p_data, length);
-    // if(recv(fd, (uint8_t *)(p_buf + 1) + p_buf->offset, (int)length, 0) !=
-    // (int)length)
-    if (!p_port->p_data_co_callback(handle,
-                                    (uint8_t*)(p_buf + 1) + p_buf->offset,
-                                    length, DATA_CO_CALLBACK_TYPE_OUTGOING)) {
+    if (!p_port->p_data_co_callback(handle, (uint8_t*)iov, count,
+                                    DATA_CO_CALLBACK_TYPE_OUTGOING_IOV)) {
       error(
-          "p_data_co_callback DATA_CO_CALLBACK_TYPE_OUTGOING failed, length:%d",
-          length);
+          "p_data_co_callback DATA_CO_CALLBACK_TYPE_OUTGOING_IOV failed, "
+          "length:%d",
+          read_len);
+      for (int i = 0; i < count; i++) osi_free(bufs[i]);
       return (PORT_UNKNOWN_ERROR);
     }
 
-    RFCOMM_TRACE_EVENT("PORT_WriteData %d bytes", length);
+    RFCOMM_TRACE_EVENT("PORT_WriteData %d bytes in %d buffers", read_len,
+                       count);
 
-    rc = port_write(p_port, p_buf);
+    int i;
+    uint16_t buf_len = 0;
+    for (i = 0; i < count; i++) {
+      buf_len = bufs[i]->len;
+      rc = port_write(p_port, bufs[i]);
 
-    /* If queue went below the threashold need to send flow control */
-    event |= port_flow_control_user(p_port);
+      /* If queue went below the threashold need to send flow control */
+      event |= port_flow_control_user(p_port);
 
-    if (rc == PORT_SUCCESS) event |= PORT_EV_TXCHAR;
+      if (rc == PORT_SUCCESS) event |= PORT_EV_TXCHAR;
 
-    if ((rc != PORT_SUCCESS) && (rc != PORT_CMD_PENDING)) break;
+      if ((rc != PORT_SUCCESS) && (rc != PORT_CMD_PENDING)) break;
 
-    *p_len += length;
-    available -= (int)length;
+      *p_len += buf_len;
+      available -= (int)buf_len;
+    }
+    if (i < count) {
+      /* Neither a closed port nor a full queue is expected here, see above.
+       * The data of this batch was already read from the socket: report the
+       * bytes lost with bufs[i], freed by port_write(), and the rest */
+      int dropped = buf_len;
+      for (i++; i < count; i++) {
+        dropped += bufs[i]->len;
+        osi_free(bufs[i]);
+      }
+      RFCOMM_TRACE_ERROR("PORT_WriteDataCO rc:%d, %d bytes dropped", rc,
+                         dropped);
+      break;
+    }
   }
   if (!available && (rc != PORT_CMD_PENDING) && (rc != PORT_TX_QUEUE_DISABLED))
     event |= PORT_EV_TXEMPTY;
@@ -0,0 +1,228 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Adaptive receive credit window for credit based flow control
+ *
+ *  The peer may only send as many frames as it holds credits, and credits are
+ *  handed back once the port is down to credit_rx_low of them. When the peer
+ *  spends those faster than new credits reach it, it sits idle for the rest
+ *  of the credit round trip. The window is sized from the rate at which the
+ *  port consumes frames and from the measured round trip, so that the credits
+ *  left at the low watermark cover a round trip.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "bt_target.h"
+#include "osi/include/fixed_queue.h"
+#include "port_int.h"
+
+/* Shortest consumption rate sample, in microseconds */
+#define PORT_RX_WINDOW_SAMPLE_US 20000
+
+/* Longest credit round trip taken as such, in microseconds */
+#define PORT_RX_WINDOW_MAX_RTT_US 500000
+
+/*******************************************************************************
+ *
+ * Function         port_rx_window_ceiling
+ *
+ * Description      Largest window the port may grant. Queued frames count
+ *                  against the window until read, so a port without a data
+ *                  callback stays under its overrun level.
+ *
+ ******************************************************************************/
+static uint16_t port_rx_window_ceiling(tPORT* p_port) {
+  uint16_t ceiling;
+
+  if (p_port->p_data_callback || p_port->p_data_co_callback) {
+    ceiling = PORT_RX_BUF_MAX_WINDOW;
+  } else {
+    ceiling = (p_port->rx_buf_critical > 0) ? p_port->rx_buf_critical - 1 : 0;
+  }
+  if (ceiling < p_port->rx_window.default_max)
+    ceiling = p_port->rx_window.default_max;
+  return ceiling;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_rx_window_init
+ *
+ * Description      Start the window from the credit watermarks selected for
+ *                  the MTU.
+ *
+ ******************************************************************************/
+void port_rx_window_init(tPORT* p_port) {
+  tPORT_RX_WINDOW* p_win = &p_port->rx_window;
+
+  memset(p_win, 0, sizeof(*p_win));
+  p_win->default_max = p_port->credit_rx_max;
+  p_win->default_low = p_port->credit_rx_low;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_rx_window_reset
+ *
+ * Description      Go back to the default window, as the consumer rather
+ *                  than the credit round trip limits the flow. The measured
+ *                  round trip is kept.
+ *
+ ******************************************************************************/
+void port_rx_window_reset(tPORT* p_port) {
+  tPORT_RX_WINDOW* p_win = &p_port->rx_window;
+
+  p_port->credit_rx_max = p_win->default_max;
+  p_port->credit_rx_low = p_win->default_low;
+  p_win->sample_start_us = 0;
+  p_win->sample_count = 0;
+  p_win->rate_fps = 0;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_rx_window_frame_received
+ *
+ * Description      Called for each data frame received from the peer. The
+ *                  first frame past those the peer could send on earlier
+ *                  credits closes a round trip sample.
+ *
+ ******************************************************************************/
+void port_rx_window_frame_received(tPORT* p_port, uint64_t now_us) {
+  tPORT_RX_WINDOW* p_win = &p_port->rx_window;
+  uint32_t gap_us =
+      (p_win->last_rx_us != 0) ? (uint32_t)(now_us - p_win->last_rx_us) : 0;
+
+  if (p_win->rtt_pending) {
+    if (p_win->rtt_owed > 0) {
+      p_win->rtt_owed--;
+    } else {
+      p_win->rtt_pending = false;
+
+      /* Only when the peer ran out of credits and waited for these, leaving
+       * the link idle, does the frame not also wait behind others queued on
+       * the link and the sample give the round trip. A much longer sample
+       * means the peer had nothing to send for a while. */
+      uint64_t sample = now_us - p_win->grant_us;
+      if (p_win->last_gap_us != 0 && gap_us > 2 * p_win->last_gap_us &&
+          sample <= PORT_RX_WINDOW_MAX_RTT_US &&
+          (p_win->rtt_us == 0 || sample <= 4 * (uint64_t)p_win->rtt_us)) {
+        p_win->rtt_us = (p_win->rtt_us == 0)
+                            ? (uint32_t)sample
+                            : (3 * p_win->rtt_us + (uint32_t)sample) / 4;
+      }
+    }
+  }
+
+  p_win->last_gap_us = gap_us;
+  p_win->last_rx_us = now_us;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_rx_window_credits_granted
+ *
+ * Description      Called before credits are sent to the peer, while
+ *                  credit_rx still holds the credits granted earlier. Starts
+ *                  a round trip sample unless one is in progress.
+ *
+ ******************************************************************************/
+void port_rx_window_credits_granted(tPORT* p_port, uint64_t now_us) {
+  tPORT_RX_WINDOW* p_win = &p_port->rx_window;
+
+  if (p_win->rtt_pending) return;
+
+  /* Frames already queued have used their credits */
+  size_t queued = fixed_queue_length(p_port->rx.queue);
+  p_win->rtt_owed =
+      (p_port->credit_rx > queued) ? (uint16_t)(p_port->credit_rx - queued) : 0;
+  p_win->grant_us = now_us;
+  p_win->rtt_pending = true;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_rx_window_frames_consumed
+ *
+ * Description      Called when |count| frames were delivered to or read by
+ *                  the user. Once per round trip, resizes the window from the
+ *                  consumption rate.
+ *
+ ******************************************************************************/
+void port_rx_window_frames_consumed(tPORT* p_port, uint16_t count,
+                                    uint64_t now_us) {
+  tPORT_RX_WINDOW* p_win = &p_port->rx_window;
+
+  /* The first delivery opens the sample: it may hold frames received before */
+  if (p_win->sample_start_us == 0) {
+    p_win->sample_start_us = now_us;
+    p_win->sample_count = 0;
+    return;
+  }
+
+  p_win->sample_count += count;
+  uint64_t elapsed_us = now_us - p_win->sample_start_us;
+  if (p_win->rtt_us == 0 || elapsed_us < p_win->rtt_us ||
+      elapsed_us < PORT_RX_WINDOW_SAMPLE_US)
+    return;
+
+  uint32_t rate_fps = (uint32_t)(p_win->sample_count * 1000000ULL / elapsed_us);
+  p_win->rate_fps =
+      (p_win->rate_fps == 0) ? rate_fps : (p_win->rate_fps + rate_fps) / 2;
+  p_win->sample_start_us = now_us;
+  p_win->sample_count = 0;
+
+  /* Credits left at the low watermark must last a round trip, and are
+   * handed back in batches of the default size */
+  uint64_t in_flight =
+      ((uint64_t)p_win->rate_fps * p_win->rtt_us + 999999) / 1000000;
+  uint16_t batch = p_win->default_max - p_win->default_low;
+  uint16_t ceiling = port_rx_window_ceiling(p_port);
+  uint64_t window = in_flight + batch;
+  if (window > ceiling) window = ceiling;
+
+  if (window <= p_win->default_max) {
+    p_port->credit_rx_max = p_win->default_max;
+    p_port->credit_rx_low = p_win->default_low;
+  } else {
+    p_port->credit_rx_max = (uint16_t)window;
+    p_port->credit_rx_low = (uint16_t)(window - batch);
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         port_rx_credits_due
+ *
+ * Description      Credits to hand back to the peer: none until the port is
+ *                  down to the low watermark, so that they go in batches,
+ *                  or while the user holds the flow.
+ *
+ * Returns          Number of credits to send, 0 if none
+ *
+ ******************************************************************************/
+uint8_t port_rx_credits_due(tPORT* p_port) {
+  if (p_port->credit_rx > p_port->credit_rx_low || p_port->rx.user_fc ||
+      p_port->credit_rx_max <= p_port->credit_rx)
+    return 0;
+  return (uint8_t)(p_port->credit_rx_max - p_port->credit_rx);
+}
@@ -118,6 +118,28 @@ typedef struct {
   alarm_t* port_timer;
 } tRFC_PORT;
 
+/*
+ * Receive credit window of a port using credit based flow control. The window
+ * grows past its default size when the peer runs out of credits before new
+ * ones reach it, see port_credit.cc.
+*/
+typedef struct {
+  uint16_t default_max; /* credit_rx_max selected for the MTU */
+  uint16_t default_low; /* credit_rx_low selected for the MTU */
+
+  uint64_t sample_start_us; /* Start of the consumption rate sample */
+  uint16_t sample_count;    /* Frames consumed since sample_start_us */
+  uint32_t rate_fps;        /* Smoothed consumption rate, frames per second */
+
+  uint64_t last_rx_us;  /* When the last frame was received */
+  uint32_t last_gap_us; /* Time between the last two frames received */
+
+  bool rtt_pending;  /* Waiting for the first frame sent on new credits */
+  uint16_t rtt_owed; /* Frames the peer could send on earlier credits */
+  uint64_t grant_us; /* When the credits being timed were granted */
+  uint32_t rtt_us;   /* Credit round trip, 0 until measured */
+} tPORT_RX_WINDOW;
+
 /*
  * Define control block containing information about PORT connection
 */
@@ -183,6 +205,7 @@ typedef struct {
       credit_rx_max; /* Max number of credits we will allow this guy to sent */
   uint16_t credit_rx_low;   /* Number of credits when we send credit update */
   uint16_t rx_buf_critical; /* port receive queue critical watermark level */
+  tPORT_RX_WINDOW rx_window; /* Adaptive rx credit window */
   bool keep_port_handle;    /* true if port is not deallocated when closing */
   /* it is set to true for server when allocating port */
   uint16_t keep_mtu; /* Max MTU that port can receive by server */
@@ -211,6 +234,17 @@ extern uint32_t port_get_signal_changes(tPORT* p_port, uint8_t old_signals,
 extern uint32_t port_flow_control_user(tPORT* p_port);
 extern void port_flow_control_peer(tPORT* p_port, bool enable, uint16_t count);
 
+/*
+ * Functions provided by the port_credit.cc
+*/
+extern void port_rx_window_init(tPORT* p_port);
+extern void port_rx_window_reset(tPORT* p_port);
+extern void port_rx_window_frame_received(tPORT* p_port, uint64_t now_us);
+extern void port_rx_window_frames_consumed(tPORT* p_port, uint16_t count,
+                                           uint64_t now_us);
+extern void port_rx_window_credits_granted(tPORT* p_port, uint64_t now_us);
+extern uint8_t port_rx_credits_due(tPORT* p_port);
+
 /*
  * Functions provided by the port_rfc.cc
 */
@@ -25,6 +25,7 @@
 #include <base/logging.h>
 #include <string.h>
 
+#include "common/time_util.h"
 #include "osi/include/mutex.h"
 #include "osi/include/osi.h"
 
@@ -767,6 +768,10 @@ void PORT_DataInd(tRFC_MCB* p_mcb, uint8_t dlci, BT_HDR* p_buf) {
     osi_free(p_buf);
     return;
   }
+  if (p_mcb->flow == PORT_FC_CREDIT) {
+    port_rx_window_frame_received(
+        p_port, bluetooth::common::time_get_os_boottime_us());
+  }
   /* If client registered callout callback with flow control we can just deliver
    * receive data */
   if (p_port->p_data_co_callback) {
@@ -24,6 +24,7 @@
 #include <base/logging.h>
 #include <string.h>
 
+#include "common/time_util.h"
 #include "osi/include/mutex.h"
 
 #include "bt_common.h"
@@ -189,6 +190,7 @@ void port_select_mtu(tPORT* p_port) {
   RFCOMM_TRACE_DEBUG(
       "%s: credit_rx_max %d, credit_rx_low %d, rx_buf_critical %d", __func__,
       p_port->credit_rx_max, p_port->credit_rx_low, p_port->rx_buf_critical);
+  port_rx_window_init(p_port);
 }
 
 /*******************************************************************************
@@ -457,20 +459,23 @@ void port_flow_control_peer(tPORT* p_port, bool enable, uint16_t count) {
   if (p_port->rfc.p_mcb->flow == PORT_FC_CREDIT) {
     /* if want to enable flow from peer */
     if (enable) {
+      uint64_t now_us = bluetooth::common::time_get_os_boottime_us();
+
       /* update rx credits */
       if (count > p_port->credit_rx) {
         p_port->credit_rx = 0;
       } else {
         p_port->credit_rx -= count;
       }
+      port_rx_window_frames_consumed(p_port, count, now_us);
 
       /* If credit count is less than low credit watermark, and user */
       /* did not force flow control, send a credit update */
       /* There might be a special case when we just adjusted rx_max */
-      if ((p_port->credit_rx <= p_port->credit_rx_low) && !p_port->rx.user_fc &&
-          (p_port->credit_rx_max > p_port->credit_rx)) {
-        rfc_send_credit(p_port->rfc.p_mcb, p_port->dlci,
-                        (uint8_t)(p_port->credit_rx_max - p_port->credit_rx));
+      uint8_t credits = port_rx_credits_due(p_port);
+      if (credits != 0) {
+        port_rx_window_credits_granted(p_port, now_us);
+        rfc_send_credit(p_port->rfc.p_mcb, p_port->dlci, credits);
 
         p_port->credit_rx = p_port->credit_rx_max;
 
@@ -482,6 +487,8 @@ void port_flow_control_peer(tPORT* p_port, bool enable, uint16_t count) {
       /* if client registered data callback, just do what they want */
       if (p_port->p_data_callback || p_port->p_data_co_callback) {
         p_port->rx.peer_fc = true;
+        /* the user does not keep up, a larger window would not help */
+        port_rx_window_reset(p_port);
       }
       /* if queue count reached credit rx max, set peer fc */
       else if (fixed_queue_length(p_port->rx.queue) >= p_port->credit_rx_max) {
@@ -28,6 +28,7 @@
 #include "bt_utils.h"
 #include "btm_api.h"
 #include "btm_int.h"
+#include "common/time_util.h"
 #include "osi/include/osi.h"
 #include "port_api.h"
 #include "port_int.h"
@@ -441,6 +442,8 @@ void rfc_port_sm_opened(tPORT* p_port, uint16_t event, void* p_data) {
           (((BT_HDR*)p_data)->len < p_port->peer_mtu) &&
           (!p_port->rx.user_fc) &&
           (p_port->credit_rx_max > p_port->credit_rx)) {
+        port_rx_window_credits_granted(
+            p_port, bluetooth::common::time_get_os_boottime_us());
         ((BT_HDR*)p_data)->layer_specific =
             (uint8_t)(p_port->credit_rx_max - p_port->credit_rx);
         p_port->credit_rx = p_port->credit_rx_max;
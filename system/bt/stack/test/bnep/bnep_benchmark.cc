@@ -0,0 +1,173 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "device/include/controller.h"
+#include "stack/bnep/bnep_int.h"
+#include "stack/include/bnep_api.h"
+#include "stack/include/l2c_api.h"
+
+using ::benchmark::State;
+
+tBNEP_CB bnep_cb;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+const RawAddress kLocalAddr({0x00, 0x1a, 0x7d, 0x00, 0x00, 0x01});
+const RawAddress kPeerAddr({0x00, 0x1a, 0x7d, 0x00, 0x00, 0x02});
+const RawAddress kMulticastAddr({0x33, 0x33, 0x00, 0x00, 0x00, 0x01});
+
+constexpr uint16_t kFrameLen = 1500;
+constexpr size_t kFramesPerIteration = 64;
+constexpr uint16_t kProtocols[] = {0x0800 /* IPv4 */, 0x86dd /* IPv6 */,
+                                   0x0806 /* ARP */};
+
+// Buffers written to L2CAP are kept for the next iteration
+std::vector<BT_HDR*> l2cap_written;
+
+const RawAddress* get_address(void) { return &kLocalAddr; }
+
+}  // namespace
+
+// Only the packets written to L2CAP are exercised by this benchmark
+uint8_t L2CA_DataWrite(uint16_t cid, BT_HDR* p_data) {
+  l2cap_written.push_back(p_data);
+  return L2CAP_DW_SUCCESS;
+}
+
+uint16_t L2CA_ConnectReq(uint16_t psm, const RawAddress& p_bd_addr) {
+  return 0;
+}
+
+bool L2CA_DisconnectReq(uint16_t cid) { return true; }
+
+void L2CA_Deregister(uint16_t psm) {}
+
+tBTM_STATUS btm_sec_mx_access_request(const RawAddress& bd_addr, uint16_t psm,
+                                      bool is_originator,
+                                      uint32_t mx_proto_id,
+                                      uint32_t mx_chan_id,
+                                      tBTM_SEC_CALLBACK* p_callback,
+                                      void* p_ref_data) {
+  return BTM_SUCCESS;
+}
+
+const controller_t* controller_get_interface() {
+  static controller_t controller = [] {
+    controller_t interface = {};
+    interface.get_address = get_address;
+    return interface;
+  }();
+  return &controller;
+}
+
+tBNEP_RESULT bnep_register_with_l2cap(void) { return BNEP_SUCCESS; }
+void bnep_conn_timer_timeout(void* data) {}
+void bnep_connected(tBNEP_CONN* p_bcb) {}
+
+namespace {
+
+// A connection whose peer, when |filters| is set, restricts the protocols
+// and multicast addresses it takes to as many ranges as BNEP allows. The
+// frames written fall in the last ranges, the worst case of a range scan.
+tBNEP_CONN* OpenConnection(bool filters) {
+  tBNEP_CONN* p_bcb = bnepu_allocate_bcb(kPeerAddr);
+  p_bcb->con_state = BNEP_STATE_CONNECTED;
+  p_bcb->l2cap_cid = 0x0040;
+  if (!filters) return p_bcb;
+
+  uint8_t prot_filters[BNEP_MAX_PROT_FILTERS * 4];
+  uint8_t* p = prot_filters;
+  for (int i = 0; i < BNEP_MAX_PROT_FILTERS - 2; i++) {
+    UINT16_TO_BE_STREAM(p, 0x0100 + i);
+    UINT16_TO_BE_STREAM(p, 0x0100 + i);
+  }
+  UINT16_TO_BE_STREAM(p, 0x0800);
+  UINT16_TO_BE_STREAM(p, 0x0806);
+  UINT16_TO_BE_STREAM(p, 0x86dd);
+  UINT16_TO_BE_STREAM(p, 0x86dd);
+  bnepu_process_peer_filter_set(p_bcb, prot_filters, sizeof(prot_filters));
+
+  uint8_t mcast_filters[BNEP_MAX_MULTI_FILTERS * 2 * BD_ADDR_LEN] = {};
+  for (int i = 0; i < BNEP_MAX_MULTI_FILTERS; i++) {
+    uint8_t* p_range = &mcast_filters[i * 2 * BD_ADDR_LEN];
+    memcpy(p_range, kMulticastAddr.address, BD_ADDR_LEN);
+    memcpy(p_range + BD_ADDR_LEN, kMulticastAddr.address, BD_ADDR_LEN);
+    p_range[BD_ADDR_LEN - 1] = p_range[2 * BD_ADDR_LEN - 1] =
+        BNEP_MAX_MULTI_FILTERS - i;
+  }
+  bnepu_process_peer_multicast_filter_set(p_bcb, mcast_filters,
+                                          sizeof(mcast_filters));
+
+  // Drop the filter responses
+  for (BT_HDR* p_buf : l2cap_written) osi_free(p_buf);
+  l2cap_written.clear();
+  return p_bcb;
+}
+
+BT_HDR* TakeBuffer() {
+  BT_HDR* p_buf;
+  if (l2cap_written.empty()) {
+    p_buf = (BT_HDR*)osi_malloc(BNEP_BUF_SIZE);
+  } else {
+    p_buf = l2cap_written.back();
+    l2cap_written.pop_back();
+  }
+  p_buf->offset = BNEP_MINIMUM_OFFSET;
+  p_buf->len = kFrameLen;
+  return p_buf;
+}
+
+// The argument is whether the peer has set filters
+void BM_BnepWriteBuf(State& state) {
+  const bool filters = state.range(0);
+  tBNEP_CONN* p_bcb = OpenConnection(filters);
+
+  for (auto _ : state) {
+    for (size_t i = 0; i < kFramesPerIteration; i++) {
+      // One frame in four is multicast, most go to the peer itself
+      const RawAddress& dest_addr = (i % 4 == 3) ? kMulticastAddr : kPeerAddr;
+      BNEP_WriteBuf(p_bcb->handle, dest_addr, TakeBuffer(), kProtocols[i % 3],
+                    &kLocalAddr, false);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kFramesPerIteration);
+
+  bnepu_release_bcb(p_bcb);
+  for (BT_HDR* p_buf : l2cap_written) osi_free(p_buf);
+  l2cap_written.clear();
+}
+
+BENCHMARK(BM_BnepWriteBuf)->ArgNames({"filters"})->Arg(0)->Arg(1);
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
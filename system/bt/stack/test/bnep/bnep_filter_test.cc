@@ -0,0 +1,300 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utility>
+#include <vector>
+
+#include "device/include/controller.h"
+#include "stack/bnep/bnep_int.h"
+#include "stack/include/bnep_api.h"
+#include "stack/include/l2c_api.h"
+
+tBNEP_CB bnep_cb;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+const RawAddress kLocalAddr({0x00, 0x1a, 0x7d, 0x00, 0x00, 0x01});
+const RawAddress kPeerAddr({0x00, 0x1a, 0x7d, 0x00, 0x00, 0x02});
+
+// Filter responses written to L2CAP: {message type, response code}
+std::vector<std::pair<uint8_t, uint16_t>> filter_responses;
+
+const RawAddress* get_address(void) { return &kLocalAddr; }
+
+}  // namespace
+
+uint8_t L2CA_DataWrite(uint16_t cid, BT_HDR* p_data) {
+  uint8_t* p = (uint8_t*)(p_data + 1) + p_data->offset;
+  uint8_t frame_type, msg_type;
+  uint16_t response;
+  STREAM_TO_UINT8(frame_type, p);
+  STREAM_TO_UINT8(msg_type, p);
+  BE_STREAM_TO_UINT16(response, p);
+  EXPECT_EQ(BNEP_FRAME_CONTROL, frame_type);
+  filter_responses.emplace_back(msg_type, response);
+  osi_free(p_data);
+  return L2CAP_DW_SUCCESS;
+}
+
+uint16_t L2CA_ConnectReq(uint16_t psm, const RawAddress& p_bd_addr) {
+  return 0;
+}
+
+bool L2CA_DisconnectReq(uint16_t cid) { return true; }
+
+tBTM_STATUS btm_sec_mx_access_request(const RawAddress& bd_addr, uint16_t psm,
+                                      bool is_originator,
+                                      uint32_t mx_proto_id,
+                                      uint32_t mx_chan_id,
+                                      tBTM_SEC_CALLBACK* p_callback,
+                                      void* p_ref_data) {
+  return BTM_SUCCESS;
+}
+
+const controller_t* controller_get_interface() {
+  static controller_t controller = [] {
+    controller_t interface = {};
+    interface.get_address = get_address;
+    return interface;
+  }();
+  return &controller;
+}
+
+void bnep_conn_timer_timeout(void* data) {}
+void bnep_connected(tBNEP_CONN* p_bcb) {}
+
+namespace {
+
+constexpr uint16_t kIpv4 = 0x0800;
+constexpr uint16_t kArp = 0x0806;
+constexpr uint16_t kIpv6 = 0x86dd;
+
+RawAddress Multicast(uint8_t b3, uint8_t b4, uint8_t b5) {
+  return RawAddress({0x33, 0x33, 0x00, b3, b4, b5});
+}
+
+class BnepFilterTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    filter_responses.clear();
+    p_bcb_ = bnepu_allocate_bcb(kPeerAddr);
+    ASSERT_NE(nullptr, p_bcb_);
+    p_bcb_->con_state = BNEP_STATE_CONNECTED;
+    p_bcb_->l2cap_cid = 0x0040;
+  }
+
+  void TearDown() override { bnepu_release_bcb(p_bcb_); }
+
+  // Sets the protocol ranges {start, end} as the peer would
+  void SetProtocolFilters(
+      const std::vector<std::pair<uint16_t, uint16_t>>& ranges) {
+    std::vector<uint8_t> filters(ranges.size() * 4);
+    uint8_t* p = filters.data();
+    for (const auto& range : ranges) {
+      UINT16_TO_BE_STREAM(p, range.first);
+      UINT16_TO_BE_STREAM(p, range.second);
+    }
+    bnepu_process_peer_filter_set(p_bcb_, filters.data(), filters.size());
+  }
+
+  // Sets the multicast ranges {start, end} as the peer would
+  void SetMulticastFilters(
+      const std::vector<std::pair<RawAddress, RawAddress>>& ranges) {
+    std::vector<uint8_t> filters(ranges.size() * 2 * BD_ADDR_LEN);
+    uint8_t* p = filters.data();
+    for (const auto& range : ranges) {
+      memcpy(p, range.first.address, BD_ADDR_LEN);
+      memcpy(p + BD_ADDR_LEN, range.second.address, BD_ADDR_LEN);
+      p += 2 * BD_ADDR_LEN;
+    }
+    bnepu_process_peer_multicast_filter_set(p_bcb_, filters.data(),
+                                            filters.size());
+  }
+
+  uint16_t LastResponse(uint8_t msg_type) {
+    EXPECT_FALSE(filter_responses.empty());
+    if (filter_responses.empty()) return 0xFFFF;
+    EXPECT_EQ(msg_type, filter_responses.back().first);
+    return filter_responses.back().second;
+  }
+
+  bool ProtocolAllowed(uint16_t protocol) {
+    return bnep_is_packet_allowed(p_bcb_, kPeerAddr, protocol, false, nullptr,
+                                  0) == BNEP_SUCCESS;
+  }
+
+  bool AddressAllowed(const RawAddress& dest_addr) {
+    return bnep_is_packet_allowed(p_bcb_, dest_addr, kIpv6, false, nullptr,
+                                  0) == BNEP_SUCCESS;
+  }
+
+  tBNEP_CONN* p_bcb_;
+};
+
+TEST_F(BnepFilterTest, no_filters_allow_everything) {
+  EXPECT_TRUE(ProtocolAllowed(0x0000));
+  EXPECT_TRUE(ProtocolAllowed(kIpv4));
+  EXPECT_TRUE(ProtocolAllowed(0xFFFF));
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, 0x00, 0x01)));
+  EXPECT_EQ(nullptr, p_bcb_->rcvd_prot_filter_map);
+}
+
+TEST_F(BnepFilterTest, protocol_range_edges) {
+  SetProtocolFilters({{kIpv4, kArp}, {0x0000, 0x0000}, {0xFFFF, 0xFFFF}});
+  EXPECT_EQ(BNEP_FILTER_CRL_OK,
+            LastResponse(BNEP_FILTER_NET_TYPE_RESPONSE_MSG));
+
+  EXPECT_FALSE(ProtocolAllowed(kIpv4 - 1));
+  EXPECT_TRUE(ProtocolAllowed(kIpv4));
+  EXPECT_TRUE(ProtocolAllowed(kArp));
+  EXPECT_FALSE(ProtocolAllowed(kArp + 1));
+
+  // Single protocol ranges at both ends of the map
+  EXPECT_TRUE(ProtocolAllowed(0x0000));
+  EXPECT_FALSE(ProtocolAllowed(0x0001));
+  EXPECT_FALSE(ProtocolAllowed(0xFFFE));
+  EXPECT_TRUE(ProtocolAllowed(0xFFFF));
+  EXPECT_FALSE(ProtocolAllowed(kIpv6));
+}
+
+TEST_F(BnepFilterTest, protocol_range_across_words) {
+  SetProtocolFilters({{0x003F, 0x0040}});
+  EXPECT_FALSE(ProtocolAllowed(0x003E));
+  EXPECT_TRUE(ProtocolAllowed(0x003F));
+  EXPECT_TRUE(ProtocolAllowed(0x0040));
+  EXPECT_FALSE(ProtocolAllowed(0x0041));
+}
+
+TEST_F(BnepFilterTest, overlapping_protocol_ranges) {
+  SetProtocolFilters({{0x0800, 0x0900}, {0x0850, 0x0A00}, {0x0880, 0x0890}});
+  EXPECT_EQ(BNEP_FILTER_CRL_OK,
+            LastResponse(BNEP_FILTER_NET_TYPE_RESPONSE_MSG));
+
+  EXPECT_FALSE(ProtocolAllowed(0x07FF));
+  EXPECT_TRUE(ProtocolAllowed(0x0800));
+  EXPECT_TRUE(ProtocolAllowed(0x0885));
+  EXPECT_TRUE(ProtocolAllowed(0x0901));
+  EXPECT_TRUE(ProtocolAllowed(0x0A00));
+  EXPECT_FALSE(ProtocolAllowed(0x0A01));
+}
+
+TEST_F(BnepFilterTest, new_protocol_filters_replace_the_old_ones) {
+  SetProtocolFilters({{kIpv4, kIpv4}});
+  SetProtocolFilters({{kIpv6, kIpv6}});
+  EXPECT_FALSE(ProtocolAllowed(kIpv4));
+  EXPECT_TRUE(ProtocolAllowed(kIpv6));
+
+  // An empty set drops the filters and their map
+  SetProtocolFilters({});
+  EXPECT_TRUE(ProtocolAllowed(kIpv4));
+  EXPECT_EQ(nullptr, p_bcb_->rcvd_prot_filter_map);
+}
+
+TEST_F(BnepFilterTest, max_protocol_filters) {
+  std::vector<std::pair<uint16_t, uint16_t>> ranges;
+  for (uint16_t i = 0; i < BNEP_MAX_PROT_FILTERS; i++) {
+    ranges.emplace_back(0x1000 + 2 * i, 0x1000 + 2 * i);
+  }
+  SetProtocolFilters(ranges);
+  EXPECT_EQ(BNEP_FILTER_CRL_OK,
+            LastResponse(BNEP_FILTER_NET_TYPE_RESPONSE_MSG));
+  EXPECT_EQ(BNEP_MAX_PROT_FILTERS, p_bcb_->rcvd_num_filters);
+  for (uint16_t i = 0; i < BNEP_MAX_PROT_FILTERS; i++) {
+    EXPECT_TRUE(ProtocolAllowed(0x1000 + 2 * i));
+    EXPECT_FALSE(ProtocolAllowed(0x1000 + 2 * i + 1));
+  }
+
+  // One range too many is refused, and the filters in place are kept
+  ranges.emplace_back(kIpv4, kIpv4);
+  SetProtocolFilters(ranges);
+  EXPECT_EQ(BNEP_FILTER_CRL_MAX_REACHED,
+            LastResponse(BNEP_FILTER_NET_TYPE_RESPONSE_MSG));
+  EXPECT_EQ(BNEP_MAX_PROT_FILTERS, p_bcb_->rcvd_num_filters);
+  EXPECT_TRUE(ProtocolAllowed(0x1000));
+  EXPECT_FALSE(ProtocolAllowed(kIpv4));
+}
+
+TEST_F(BnepFilterTest, reversed_protocol_range_is_refused) {
+  SetProtocolFilters({{kIpv4, kIpv4}});
+  SetProtocolFilters({{kArp, kIpv4}});
+  EXPECT_EQ(BNEP_FILTER_CRL_BAD_RANGE,
+            LastResponse(BNEP_FILTER_NET_TYPE_RESPONSE_MSG));
+  EXPECT_TRUE(ProtocolAllowed(kIpv4));
+  EXPECT_FALSE(ProtocolAllowed(kArp));
+}
+
+TEST_F(BnepFilterTest, multicast_range_edges) {
+  // The range crosses a byte boundary of the address
+  SetMulticastFilters(
+      {{Multicast(0x00, 0x00, 0xFF), Multicast(0x00, 0x01, 0x00)}});
+  EXPECT_EQ(BNEP_FILTER_CRL_OK,
+            LastResponse(BNEP_FILTER_MULTI_ADDR_RESPONSE_MSG));
+
+  EXPECT_FALSE(AddressAllowed(Multicast(0x00, 0x00, 0xFE)));
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, 0x00, 0xFF)));
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, 0x01, 0x00)));
+  EXPECT_FALSE(AddressAllowed(Multicast(0x00, 0x01, 0x01)));
+  // The most significant byte weighs the most
+  EXPECT_FALSE(AddressAllowed(Multicast(0x01, 0x00, 0xFF)));
+
+  // Unicast addresses are not filtered
+  EXPECT_TRUE(AddressAllowed(kPeerAddr));
+}
+
+TEST_F(BnepFilterTest, overlapping_multicast_ranges) {
+  SetMulticastFilters(
+      {{Multicast(0x00, 0x00, 0x10), Multicast(0x00, 0x00, 0x20)},
+       {Multicast(0x00, 0x00, 0x18), Multicast(0x00, 0x00, 0x30)}});
+  EXPECT_FALSE(AddressAllowed(Multicast(0x00, 0x00, 0x0F)));
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, 0x00, 0x10)));
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, 0x00, 0x1C)));
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, 0x00, 0x30)));
+  EXPECT_FALSE(AddressAllowed(Multicast(0x00, 0x00, 0x31)));
+}
+
+TEST_F(BnepFilterTest, max_multicast_filters) {
+  std::vector<std::pair<RawAddress, RawAddress>> ranges;
+  for (uint8_t i = 0; i < BNEP_MAX_MULTI_FILTERS; i++) {
+    ranges.emplace_back(Multicast(0x00, i, 0x00), Multicast(0x00, i, 0x00));
+  }
+  SetMulticastFilters(ranges);
+  EXPECT_EQ(BNEP_FILTER_CRL_OK,
+            LastResponse(BNEP_FILTER_MULTI_ADDR_RESPONSE_MSG));
+  EXPECT_EQ(BNEP_MAX_MULTI_FILTERS, p_bcb_->rcvd_mcast_filters);
+  EXPECT_TRUE(AddressAllowed(Multicast(0x00, BNEP_MAX_MULTI_FILTERS - 1, 0)));
+  EXPECT_FALSE(AddressAllowed(Multicast(0x00, BNEP_MAX_MULTI_FILTERS, 0)));
+
+  // One range too many is refused, and the filters in place are kept
+  ranges.emplace_back(Multicast(0x01, 0x00, 0x00), Multicast(0x01, 0x00, 0x00));
+  SetMulticastFilters(ranges);
+  EXPECT_EQ(BNEP_FILTER_CRL_MAX_REACHED,
+            LastResponse(BNEP_FILTER_MULTI_ADDR_RESPONSE_MSG));
+  EXPECT_EQ(BNEP_MAX_MULTI_FILTERS, p_bcb_->rcvd_mcast_filters);
+  EXPECT_FALSE(AddressAllowed(Multicast(0x01, 0x00, 0x00)));
+}
+
+TEST_F(BnepFilterTest, null_multicast_range_filters_every_multicast) {
+  SetMulticastFilters({{RawAddress::kEmpty, RawAddress::kEmpty}});
+  EXPECT_FALSE(AddressAllowed(Multicast(0x00, 0x00, 0x01)));
+  EXPECT_FALSE(AddressAllowed(RawAddress::kAny));
+  EXPECT_TRUE(AddressAllowed(kPeerAddr));
+}
+
+}  // namespace
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "stack/gatt/gatt_int.h"
+#include "stack/include/l2c_api.h"
+
+using ::benchmark::State;
+using bluetooth::Uuid;
+
+// L2CAP consumes the buffers the way the real channel would, by taking
+// ownership and releasing them once written.
+uint16_t L2CA_SendFixedChnlData(uint16_t fixed_cid, const RawAddress& rem_bda,
+                                BT_HDR* p_buf) {
+  osi_free(p_buf);
+  return L2CAP_DW_SUCCESS;
+}
+
+uint8_t L2CA_DataWrite(uint16_t cid, BT_HDR* p_data) {
+  osi_free(p_data);
+  return L2CAP_DW_SUCCESS;
+}
+
+// The client side of att_protocol.cc is not exercised by this benchmark.
+void gatt_cmd_enq(tGATT_TCB& tcb, tGATT_CLCB* p_clcb, bool to_send,
+                  uint8_t op_code, BT_HDR* p_buf) {}
+
+void gatt_start_rsp_timer(tGATT_CLCB* p_clcb) {}
+
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst, const Uuid& uuid) {
+  return 0;
+}
+
+namespace {
+
+constexpr uint16_t kValueHandle = 0x0030;
+
+class BM_GattNotification : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    ::benchmark::Fixture::SetUp(st);
+    clients_ = std::vector<tGATT_TCB>(st.range(0));
+    links_.clear();
+    for (size_t i = 0; i < clients_.size(); i++) {
+      tGATT_TCB& tcb = clients_[i];
+      tcb.att_lcid = L2CAP_ATT_CID;
+      tcb.payload_size = GATT_MAX_MTU_SIZE;
+      tcb.peer_bda = RawAddress({0xc0, 0xde, 0xc0, 0xde, 0x00, (uint8_t)i});
+      links_.push_back(&tcb);
+    }
+
+    msg_.attr_value.handle = kValueHandle;
+    msg_.attr_value.len = st.range(1);
+    msg_.attr_value.auth_req = GATT_AUTH_REQ_NONE;
+    for (int i = 0; i < msg_.attr_value.len; i++) msg_.attr_value.value[i] = i;
+  }
+
+  void TearDown(State& st) override {
+    // One iteration is one sample of a 100 Hz sensor broadcast
+    st.SetItemsProcessed(st.iterations() * links_.size());
+    st.SetBytesProcessed(st.iterations() * links_.size() *
+                         msg_.attr_value.len);
+    ::benchmark::Fixture::TearDown(st);
+  }
+
+  std::vector<tGATT_TCB> clients_;
+  std::vector<tGATT_TCB*> links_;
+  tGATT_SR_MSG msg_;
+};
+
+// Previous behaviour, one PDU encoded per subscriber
+BENCHMARK_DEFINE_F(BM_GattNotification, notify_per_link)(State& st) {
+  for (auto _ : st) {
+    for (tGATT_TCB* p_tcb : links_) {
+      BT_HDR* p_buf =
+          attp_build_sr_msg(*p_tcb, GATT_HANDLE_VALUE_NOTIF, &msg_);
+      benchmark::DoNotOptimize(attp_send_sr_msg(*p_tcb, p_buf));
+    }
+  }
+}
+
+BENCHMARK_DEFINE_F(BM_GattNotification, notify_multicast)(State& st) {
+  for (auto _ : st) {
+    BT_HDR* p_buf =
+        attp_build_sr_msg(*links_[0], GATT_HANDLE_VALUE_NOTIF, &msg_);
+    benchmark::DoNotOptimize(attp_send_sr_msg_multi(links_, p_buf));
+  }
+}
+
+// {subscribers, value length}
+BENCHMARK_REGISTER_F(BM_GattNotification, notify_per_link)
+    ->Args({1, 20})
+    ->Args({32, 20})
+    ->Args({32, 244});
+BENCHMARK_REGISTER_F(BM_GattNotification, notify_multicast)
+    ->Args({1, 20})
+    ->Args({32, 20})
+    ->Args({32, 244});
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+#include "device/include/controller.h"
+#include "stack/gatt/connection_manager.h"
+#include "stack/gatt/gatt_int.h"
+#include "stack/include/gatt_api.h"
+#include "stack/include/l2c_api.h"
+
+using bluetooth::Uuid;
+
+tGATT_CB gatt_cb;
+
+namespace {
+
+constexpr tGATT_IF kGattIf = 1;
+constexpr uint16_t kValueHandle = 0x0030;
+
+// ATT PDUs written to L2CAP, by peer
+std::map<RawAddress, std::vector<std::vector<uint8_t>>> sent_pdus;
+
+// Peers whose L2CAP channel reports congestion or a write failure
+RawAddress congested_bda = RawAddress::kEmpty;
+RawAddress failed_bda = RawAddress::kEmpty;
+
+void record_pdu(const RawAddress& bda, BT_HDR* p_buf) {
+  const uint8_t* p_pdu = (uint8_t*)(p_buf + 1) + p_buf->offset;
+  sent_pdus[bda].emplace_back(p_pdu, p_pdu + p_buf->len);
+  osi_free(p_buf);
+}
+
+uint8_t write_result(const RawAddress& bda) {
+  if (bda == congested_bda) return L2CAP_DW_CONGESTED;
+  if (bda == failed_bda) return L2CAP_DW_FAILED;
+  return L2CAP_DW_SUCCESS;
+}
+
+}  // namespace
+
+uint16_t L2CA_SendFixedChnlData(uint16_t fixed_cid, const RawAddress& rem_bda,
+                                BT_HDR* p_buf) {
+  record_pdu(rem_bda, p_buf);
+  return write_result(rem_bda);
+}
+
+uint8_t L2CA_DataWrite(uint16_t cid, BT_HDR* p_data) {
+  for (const tGATT_TCB& tcb : gatt_cb.tcb) {
+    if (tcb.in_use && tcb.att_lcid == cid) record_pdu(tcb.peer_bda, p_data);
+  }
+  return L2CAP_DW_SUCCESS;
+}
+
+tGATT_TCB* gatt_get_tcb_by_idx(uint8_t tcb_idx) {
+  if (tcb_idx < GATT_MAX_PHY_CHANNEL && gatt_cb.tcb[tcb_idx].in_use)
+    return &gatt_cb.tcb[tcb_idx];
+  return NULL;
+}
+
+tGATT_REG* gatt_get_regcb(tGATT_IF gatt_if) {
+  if (gatt_if < 1 || gatt_if > GATT_MAX_APPS) return NULL;
+  tGATT_REG* p_reg = &gatt_cb.cl_rcb[gatt_if - 1];
+  return p_reg->in_use ? p_reg : NULL;
+}
+
+// Not used by notifications, but referenced by gatt_api.cc and
+// att_protocol.cc
+void gatt_cmd_enq(tGATT_TCB& tcb, tGATT_CLCB* p_clcb, bool to_send,
+                  uint8_t op_code, BT_HDR* p_buf) {}
+void gatt_start_rsp_timer(tGATT_CLCB* p_clcb) {}
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst, const Uuid& uuid) {
+  return 0;
+}
+void alarm_cancel(alarm_t* alarm) {}
+tGATT_CLCB* gatt_clcb_alloc(uint16_t conn_id) { return NULL; }
+void gatt_clcb_dealloc(tGATT_CLCB* p_clcb) {}
+bool SDP_DeleteRecord(uint32_t handle) { return true; }
+bool gatt_act_connect(tGATT_REG* p_reg, const RawAddress& bd_addr,
+                      tBT_TRANSPORT transport, int8_t initiating_phys) {
+  return false;
+}
+bool gatt_cancel_open(tGATT_IF gatt_if, const RawAddress& bda) { return false; }
+tGATT_CH_STATE gatt_get_ch_state(tGATT_TCB* p_tcb) { return GATT_CH_CLOSE; }
+void gatt_init_srv_chg(void) {}
+void gatt_proc_srv_chg(void) {}
+void gatt_act_discovery(tGATT_CLCB* p_clcb) {}
+bool L2CA_SetIdleTimeout(uint16_t cid, uint16_t timeout, bool is_global) {
+  return true;
+}
+uint32_t gatt_add_sdp_record(const Uuid& uuid, uint16_t start_hdl,
+                             uint16_t end_hdl) {
+  return 0;
+}
+void gatt_add_pending_ind(tGATT_TCB* p_tcb, tGATT_VALUE* p_ind) {}
+uint16_t gatts_add_char_descr(tGATT_SVC_DB& db, tGATT_PERM perm,
+                              const Uuid& dscp_uuid) {
+  return 0;
+}
+tGATT_TCB* gatt_find_tcb_by_addr(const RawAddress& bda,
+                                 tBT_TRANSPORT transport) {
+  return NULL;
+}
+void gatt_start_conf_timer(tGATT_TCB* p_tcb) {}
+void gatts_init_service_db(tGATT_SVC_DB& db, const Uuid& service_uuid,
+                           bool is_pri, uint16_t s_hdl, uint16_t num_handle) {}
+bool gatt_is_clcb_allocated(uint16_t conn_id) { return false; }
+Uuid* gatts_get_service_uuid(tGATT_SVC_DB* p_db) { return NULL; }
+tGATT_STATUS gatt_sr_process_app_rsp(tGATT_TCB& tcb, tGATT_IF gatt_if,
+                                     uint32_t trans_id, uint8_t op_code,
+                                     tGATT_STATUS status, tGATTS_RSP* p_msg) {
+  return GATT_SUCCESS;
+}
+bool L2CA_SetFixedChannelTout(const RawAddress& rem_bda, uint16_t fixed_cid,
+                              uint16_t idle_tout) {
+  return true;
+}
+const controller_t* controller_get_interface() { return NULL; }
+uint16_t gatts_add_characteristic(tGATT_SVC_DB& db, tGATT_PERM perm,
+                                  tGATT_CHAR_PROP property,
+                                  const Uuid& char_uuid) {
+  return 0;
+}
+void gatts_index_add_service(std::list<tGATT_SRV_LIST_ELEM>::iterator it) {}
+void gatts_index_remove_service(std::list<tGATT_SRV_LIST_ELEM>::iterator it) {
+}
+bool gatt_security_check_start(tGATT_CLCB* p_clcb) { return false; }
+uint16_t gatts_add_included_service(tGATT_SVC_DB& db, uint16_t s_handle,
+                                    uint16_t e_handle, const Uuid& service) {
+  return 0;
+}
+bool L2CA_SetIdleTimeoutByBdAddr(const RawAddress& bd_addr, uint16_t timeout,
+                                 tBT_TRANSPORT transport) {
+  return true;
+}
+bool gatt_find_the_connected_bda(uint8_t start_idx, RawAddress& bda,
+                                 uint8_t* p_found_idx,
+                                 tBT_TRANSPORT* p_transport) {
+  return false;
+}
+bool gatt_auto_connect_dev_remove(tGATT_IF gatt_if, const RawAddress& bd_addr) {
+  return false;
+}
+void gatt_send_queue_write_cancel(tGATT_TCB& tcb, tGATT_CLCB* p_clcb,
+                                  tGATT_EXEC_FLAG flag) {}
+std::list<tGATT_SRV_LIST_ELEM>::iterator gatt_sr_find_i_rcb_by_handle(
+    uint16_t handle) {
+  return gatt_cb.srv_list_info->end();
+}
+void gatt_update_app_use_link_flag(tGATT_IF gatt_if, tGATT_TCB* p_tcb,
+                                   bool is_add, bool check_acl_link) {}
+std::list<tGATT_HDL_LIST_ELEM>::iterator gatt_find_hdl_buffer_by_app_id(
+    const Uuid& app_uuid128, Uuid* p_svc_uuid, uint16_t start_handle) {
+  return gatt_cb.hdl_list_info->end();
+}
+tGATT_HDL_LIST_ELEM* gatt_find_hdl_buffer_by_handle(uint16_t handle) {
+  return NULL;
+}
+void gatt_free_srvc_db_buffer_app_id(const Uuid& app_id) {}
+bool BTM_BackgroundConnectAddressKnown(const RawAddress& address) {
+  return false;
+}
+namespace connection_manager {
+void on_app_deregistered(tAPP_ID app_id) {}
+bool remove_unconditional(const RawAddress& address) { return false; }
+bool background_connect_add(tAPP_ID app_id, const RawAddress& address) {
+  return false;
+}
+}  // namespace connection_manager
+
+class GattNotificationMultiTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    gatt_cb.cl_rcb[kGattIf - 1].in_use = true;
+    sent_pdus.clear();
+    congested_bda = RawAddress::kEmpty;
+    failed_bda = RawAddress::kEmpty;
+
+    value_.resize(GATT_MAX_MTU_SIZE);
+    for (size_t i = 0; i < value_.size(); i++) value_[i] = i;
+  }
+
+  void TearDown() override {
+    for (tGATT_TCB& tcb : gatt_cb.tcb) tcb.in_use = false;
+    gatt_cb.cl_rcb[kGattIf - 1].in_use = false;
+  }
+
+  // Connect a client with an ATT MTU of |payload_size| and return its conn_id
+  uint16_t AddLink(uint8_t tcb_idx, uint16_t payload_size) {
+    tGATT_TCB& tcb = gatt_cb.tcb[tcb_idx];
+    tcb.in_use = true;
+    tcb.tcb_idx = tcb_idx;
+    tcb.att_lcid = L2CAP_ATT_CID;
+    tcb.payload_size = payload_size;
+    tcb.peer_bda = RawAddress({0xc0, 0xde, 0xc0, 0xde, 0x00, tcb_idx});
+    return GATT_CREATE_CONN_ID(tcb_idx, kGattIf);
+  }
+
+  // Expected notification PDU for a link with an ATT MTU of |payload_size|
+  std::vector<uint8_t> NotificationPdu(uint16_t val_len,
+                                       uint16_t payload_size) {
+    std::vector<uint8_t> pdu = {GATT_HANDLE_VALUE_NOTIF, kValueHandle & 0xff,
+                                kValueHandle >> 8};
+    uint16_t len = std::min<uint16_t>(val_len, payload_size - pdu.size());
+    pdu.insert(pdu.end(), value_.begin(), value_.begin() + len);
+    return pdu;
+  }
+
+  std::vector<uint8_t> value_;
+};
+
+TEST_F(GattNotificationMultiTest, value_is_truncated_to_each_link_mtu) {
+  const uint16_t mtus[] = {GATT_DEF_BLE_MTU_SIZE, 100, GATT_MAX_MTU_SIZE, 64};
+  std::vector<uint16_t> conn_ids;
+  for (uint8_t i = 0; i < 4; i++) conn_ids.push_back(AddLink(i, mtus[i]));
+
+  const uint16_t val_len = 200;
+  EXPECT_EQ(std::vector<tGATT_STATUS>(4, GATT_SUCCESS),
+            GATTS_HandleValueNotificationMulti(kGattIf, conn_ids, kValueHandle,
+                                               val_len, value_.data()));
+
+  for (uint8_t i = 0; i < 4; i++) {
+    const tGATT_TCB& tcb = gatt_cb.tcb[i];
+    ASSERT_EQ(1u, sent_pdus[tcb.peer_bda].size());
+    EXPECT_EQ(NotificationPdu(val_len, mtus[i]), sent_pdus[tcb.peer_bda][0]);
+  }
+}
+
+TEST_F(GattNotificationMultiTest, duplicate_conn_ids_are_notified_once) {
+  uint16_t first = AddLink(0, GATT_DEF_BLE_MTU_SIZE);
+  uint16_t second = AddLink(1, GATT_DEF_BLE_MTU_SIZE);
+  const std::vector<uint16_t> conn_ids = {first, second, first, first, second};
+
+  const uint16_t val_len = 10;
+  EXPECT_EQ(std::vector<tGATT_STATUS>(5, GATT_SUCCESS),
+            GATTS_HandleValueNotificationMulti(kGattIf, conn_ids, kValueHandle,
+                                               val_len, value_.data()));
+
+  EXPECT_EQ(2u, sent_pdus.size());
+  for (uint8_t i = 0; i < 2; i++) {
+    const tGATT_TCB& tcb = gatt_cb.tcb[i];
+    ASSERT_EQ(1u, sent_pdus[tcb.peer_bda].size());
+    EXPECT_EQ(NotificationPdu(val_len, GATT_DEF_BLE_MTU_SIZE),
+              sent_pdus[tcb.peer_bda][0]);
+  }
+}
+
+TEST_F(GattNotificationMultiTest, unknown_conn_ids_are_reported) {
+  uint16_t conn_id = AddLink(0, GATT_DEF_BLE_MTU_SIZE);
+  const std::vector<uint16_t> conn_ids = {GATT_CREATE_CONN_ID(1, kGattIf),
+                                         conn_id,
+                                         GATT_CREATE_CONN_ID(0, kGattIf + 1)};
+
+  // Only the unknown ids are reported as failed
+  const std::vector<tGATT_STATUS> expected = {
+      (tGATT_STATUS)GATT_INVALID_CONN_ID, GATT_SUCCESS,
+      (tGATT_STATUS)GATT_INVALID_CONN_ID};
+  EXPECT_EQ(expected,
+            GATTS_HandleValueNotificationMulti(kGattIf, conn_ids, kValueHandle,
+                                               10, value_.data()));
+
+  // The valid connection is still notified
+  EXPECT_EQ(1u, sent_pdus.size());
+  EXPECT_EQ(1u, sent_pdus[gatt_cb.tcb[0].peer_bda].size());
+}
+
+TEST_F(GattNotificationMultiTest, status_is_reported_per_link) {
+  uint16_t first = AddLink(0, GATT_DEF_BLE_MTU_SIZE);
+  uint16_t second = AddLink(1, GATT_DEF_BLE_MTU_SIZE);
+  uint16_t third = AddLink(2, GATT_DEF_BLE_MTU_SIZE);
+  congested_bda = gatt_cb.tcb[1].peer_bda;
+  failed_bda = gatt_cb.tcb[2].peer_bda;
+  const std::vector<uint16_t> conn_ids = {first, second, third, second};
+
+  const std::vector<tGATT_STATUS> expected = {
+      GATT_SUCCESS, GATT_CONGESTED, GATT_INTERNAL_ERROR, GATT_CONGESTED};
+  EXPECT_EQ(expected,
+            GATTS_HandleValueNotificationMulti(kGattIf, conn_ids, kValueHandle,
+                                               10, value_.data()));
+}
+
+TEST_F(GattNotificationMultiTest, invalid_value_fails_every_conn_id) {
+  const std::vector<uint16_t> conn_ids = {AddLink(0, GATT_DEF_BLE_MTU_SIZE),
+                                         AddLink(1, GATT_DEF_BLE_MTU_SIZE)};
+
+  EXPECT_EQ(std::vector<tGATT_STATUS>(2, GATT_ILLEGAL_PARAMETER),
+            GATTS_HandleValueNotificationMulti(kGattIf, conn_ids, 0, 10,
+                                               value_.data()));
+  EXPECT_TRUE(sent_pdus.empty());
+}
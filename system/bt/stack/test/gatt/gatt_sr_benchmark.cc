@@ -0,0 +1,236 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <list>
+#include <random>
+#include <vector>
+
+#include "stack/gatt/gatt_int.h"
+#include "stack/include/l2c_api.h"
+
+using ::benchmark::State;
+using bluetooth::Uuid;
+
+tGATT_CB gatt_cb;
+
+// Minimal implementation of the GATT server helpers used by gatt_db.cc, the
+// application side of the server is not exercised by this benchmark.
+std::list<tGATT_SRV_LIST_ELEM>::iterator gatt_sr_find_i_rcb_by_handle(
+    uint16_t handle) {
+  if (handle >= gatt_cb.attr_index->srv_by_handle.size())
+    return gatt_cb.srv_list_info->end();
+  return gatt_cb.attr_index->srv_by_handle[handle];
+}
+
+uint32_t gatt_sr_enqueue_cmd(tGATT_TCB& tcb, uint8_t op_code,
+                             uint16_t handle) {
+  return ++tcb.trans_id;
+}
+
+void gatt_sr_update_cback_cnt(tGATT_TCB& tcb, tGATT_IF gatt_if, bool is_inc,
+                              bool is_reset_first) {}
+
+void gatt_sr_send_req_callback(uint16_t conn_id, uint32_t trans_id,
+                               uint8_t op_code, tGATTS_DATA* p_data) {}
+
+uint8_t gatt_build_uuid_to_stream_len(const Uuid& uuid) {
+  size_t len = uuid.GetShortestRepresentationSize();
+  return len == Uuid::kNumBytes32 ? Uuid::kNumBytes128 : len;
+}
+
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst, const Uuid& uuid) {
+  uint8_t* p = *p_dst;
+  size_t len = gatt_build_uuid_to_stream_len(uuid);
+  if (len == Uuid::kNumBytes16) {
+    UINT16_TO_STREAM(p, uuid.As16Bit());
+  } else {
+    ARRAY_TO_STREAM(p, uuid.To128BitLE(), (int)Uuid::kNumBytes128);
+  }
+  *p_dst = p;
+  return len;
+}
+
+namespace {
+
+constexpr int kCharsPerService = 10;
+// service declaration + (declaration, value, CCC) per characteristic
+constexpr int kHandlesPerService = 1 + kCharsPerService * 3;
+constexpr uint16_t kPayloadSize = 247;
+
+Uuid VendorUuid(uint16_t seed) {
+  Uuid::UUID128Bit uuid = {0x6e, 0x40, 0x00, 0x00, 0xb5, 0xa3, 0xf3, 0x93,
+                           0xe0, 0xa9, 0xe5, 0x0e, 0x24, 0xdc, 0xca, 0x9e};
+  uuid[2] = seed >> 8;
+  uuid[3] = seed & 0xff;
+  return Uuid::From128BitBE(uuid);
+}
+
+class BM_GattServerDb : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    ::benchmark::Fixture::SetUp(st);
+    gatt_cb = tGATT_CB();
+    gatt_cb.srv_list_info = new std::list<tGATT_SRV_LIST_ELEM>();
+    gatt_cb.attr_index = new tGATT_SR_ATTR_INDEX();
+
+    int num_attrs = st.range(0);
+    uint16_t s_hdl = GATT_APP_START_HANDLE;
+    for (int svc = 0; svc * kHandlesPerService < num_attrs; svc++) {
+      dbs_.emplace_back();
+      tGATT_SVC_DB& db = dbs_.back();
+      gatts_init_service_db(db, VendorUuid(svc), true, s_hdl,
+                            kHandlesPerService);
+      for (int c = 0; c < kCharsPerService; c++) {
+        uint16_t value_hdl = gatts_add_characteristic(
+            db, GATT_PERM_READ | GATT_PERM_WRITE,
+            GATT_CHAR_PROP_BIT_READ | GATT_CHAR_PROP_BIT_NOTIFY,
+            VendorUuid(0x1000 + c));
+        gatts_add_char_descr(db, GATT_PERM_READ | GATT_PERM_WRITE,
+                             Uuid::From16Bit(GATT_UUID_CHAR_CLIENT_CONFIG));
+        value_handles_.push_back(value_hdl);
+        decl_handles_.push_back(value_hdl - 1);
+      }
+
+      tGATT_SRV_LIST_ELEM elem = {};
+      elem.p_db = &db;
+      elem.s_hdl = s_hdl;
+      elem.e_hdl = s_hdl + kHandlesPerService - 1;
+      elem.type = GATT_UUID_PRI_SERVICE;
+      elem.is_primary = true;
+      gatt_cb.srv_list_info->push_back(elem);
+      s_hdl += kHandlesPerService;
+    }
+    gatts_rebuild_attr_index();
+
+    clients_ = std::vector<tGATT_TCB>(st.range(1));
+    for (size_t i = 0; i < clients_.size(); i++) {
+      clients_[i].tcb_idx = i;
+      clients_[i].payload_size = kPayloadSize;
+    }
+  }
+
+  void TearDown(State& st) override {
+    clients_.clear();
+    decl_handles_.clear();
+    value_handles_.clear();
+    delete gatt_cb.attr_index;
+    delete gatt_cb.srv_list_info;
+    dbs_.clear();
+    ::benchmark::Fixture::TearDown(st);
+  }
+
+  std::list<tGATT_SVC_DB> dbs_;
+  std::vector<uint16_t> decl_handles_;
+  std::vector<uint16_t> value_handles_;
+  std::vector<tGATT_TCB> clients_;
+  uint8_t rsp_buf_[sizeof(BT_HDR) + L2CAP_MIN_OFFSET + kPayloadSize];
+};
+
+// Every client reads random characteristic declarations, as done by the Read
+// Request handler.
+BENCHMARK_DEFINE_F(BM_GattServerDb, read_by_handle)(State& st) {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<size_t> pick(0, decl_handles_.size() - 1);
+  uint8_t value[GATT_MAX_ATTR_LEN];
+  for (auto _ : st) {
+    for (tGATT_TCB& tcb : clients_) {
+      uint16_t handle = decl_handles_[pick(rng)];
+      if (!gatts_find_attr_by_handle(handle)) st.SkipWithError("not found");
+      auto it = gatt_sr_find_i_rcb_by_handle(handle);
+      uint16_t len = 0;
+      gatts_read_attr_value_by_handle(tcb, it->p_db, GATT_REQ_READ, handle, 0,
+                                      value, &len, kPayloadSize - 1, 0, 0, 0);
+    }
+  }
+  st.SetItemsProcessed(st.iterations() * clients_.size());
+}
+
+// Every client runs a full "Discover All Characteristics" procedure, paging
+// through the database with Read By Type requests.
+BENCHMARK_DEFINE_F(BM_GattServerDb, discover_characteristics)(State& st) {
+  const Uuid char_decl = Uuid::From16Bit(GATT_UUID_CHAR_DECLARE);
+  int64_t requests = 0;
+  for (auto _ : st) {
+    for (tGATT_TCB& tcb : clients_) {
+      uint16_t s_hdl = 0x0001;
+      while (true) {
+        BT_HDR* p_rsp = (BT_HDR*)rsp_buf_;
+        memset(p_rsp, 0, sizeof(BT_HDR));
+        p_rsp->len = 2;
+        uint16_t buf_len = tcb.payload_size - 2;
+        uint16_t err_hdl = 0;
+        tGATT_STATUS status = gatts_db_read_attr_value_by_type(
+            tcb, GATT_REQ_READ_BY_TYPE, p_rsp, s_hdl, 0xFFFF, char_decl,
+            &buf_len, 0, 0, 0, &err_hdl);
+        requests++;
+        if (status != GATT_SUCCESS && status != GATT_NO_RESOURCES) break;
+
+        /* resume after the last handle of this response */
+        uint8_t* p = rsp_buf_ + sizeof(BT_HDR) + L2CAP_MIN_OFFSET +
+                     p_rsp->len - p_rsp->offset;
+        uint16_t last_hdl;
+        STREAM_TO_UINT16(last_hdl, p);
+        s_hdl = last_hdl + 1;
+      }
+    }
+  }
+  st.SetItemsProcessed(requests);
+}
+
+// Primary service discovery, as done by Read By Group Type requests.
+BENCHMARK_DEFINE_F(BM_GattServerDb, discover_primary_services)(State& st) {
+  const Uuid pri_svc = Uuid::From16Bit(GATT_UUID_PRI_SERVICE);
+  for (auto _ : st) {
+    for (size_t i = 0; i < clients_.size(); i++) {
+      auto range = gatts_find_handles_by_type(pri_svc, 0x0001, 0xFFFF);
+      for (auto it = range.first; it != range.second; it++) {
+        benchmark::DoNotOptimize(gatt_sr_find_i_rcb_by_handle(*it)->e_hdl);
+      }
+    }
+  }
+  st.SetItemsProcessed(st.iterations() * clients_.size());
+}
+
+}  // namespace
+
+// Args: {number of attributes, number of clients}
+BENCHMARK_REGISTER_F(BM_GattServerDb, read_by_handle)
+    ->Args({100, 1})
+    ->Args({1000, 1})
+    ->Args({1000, 8})
+    ->Args({1000, 32});
+BENCHMARK_REGISTER_F(BM_GattServerDb, discover_characteristics)
+    ->Args({100, 1})
+    ->Args({1000, 1})
+    ->Args({1000, 8})
+    ->Args({1000, 32});
+BENCHMARK_REGISTER_F(BM_GattServerDb, discover_primary_services)
+    ->Args({1000, 1})
+    ->Args({1000, 32});
+
+int main(int argc, char** argv) {
+  // Disable LOG() output from libchrome
+  logging::LoggingSettings log_settings;
+  log_settings.logging_dest = logging::LoggingDestination::LOG_NONE;
+  CHECK(logging::InitLogging(log_settings)) << "Failed to set up logging";
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,598 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <list>
+#include <vector>
+
+#include "stack/gatt/gatt_int.h"
+#include "stack/include/l2c_api.h"
+
+using bluetooth::Uuid;
+
+tGATT_CB gatt_cb;
+
+namespace {
+
+using Pdu = std::vector<uint8_t>;
+
+// Application request passed up by the server
+struct AppRequest {
+  uint16_t conn_id;
+  tGATTS_REQ_TYPE type;
+  uint16_t handle;
+};
+
+// ATT PDUs sent to the client, error responses included
+std::vector<Pdu> sent_pdus;
+std::vector<AppRequest> app_requests;
+
+}  // namespace
+
+// Minimal implementation of the GATT helpers used by gatt_sr.cc and
+// gatt_db.cc. Responses are recorded as they would go over the air.
+tGATT_STATUS attp_send_sr_msg(tGATT_TCB& tcb, BT_HDR* p_msg) {
+  const uint8_t* p = (uint8_t*)(p_msg + 1) + L2CAP_MIN_OFFSET;
+  sent_pdus.emplace_back(p, p + p_msg->len);
+  osi_free(p_msg);
+  return GATT_SUCCESS;
+}
+
+tGATT_STATUS gatt_send_error_rsp(tGATT_TCB& tcb, uint8_t err_code,
+                                 uint8_t op_code, uint16_t handle, bool deq) {
+  sent_pdus.push_back({GATT_RSP_ERROR, op_code, (uint8_t)(handle & 0xff),
+                       (uint8_t)(handle >> 8), err_code});
+  return GATT_SUCCESS;
+}
+
+void gatt_sr_send_req_callback(uint16_t conn_id, uint32_t trans_id,
+                               tGATTS_REQ_TYPE type, tGATTS_DATA* p_data) {
+  uint16_t handle = type == GATTS_REQ_TYPE_CONF ? p_data->handle
+                                                : p_data->read_req.handle;
+  if (type == GATTS_REQ_TYPE_WRITE_CHARACTERISTIC ||
+      type == GATTS_REQ_TYPE_WRITE_DESCRIPTOR)
+    handle = p_data->write_req.handle;
+  app_requests.push_back({conn_id, type, handle});
+}
+
+std::list<tGATT_SRV_LIST_ELEM>::iterator gatt_sr_find_i_rcb_by_handle(
+    uint16_t handle) {
+  if (handle >= gatt_cb.attr_index->srv_by_handle.size())
+    return gatt_cb.srv_list_info->end();
+  return gatt_cb.attr_index->srv_by_handle[handle];
+}
+
+void gatt_sr_get_sec_info(const RawAddress& rem_bda, tBT_TRANSPORT transport,
+                          uint8_t* p_sec_flag, uint8_t* p_key_size) {
+  *p_sec_flag = 0;
+  *p_key_size = 0;
+}
+
+uint8_t gatt_build_uuid_to_stream_len(const Uuid& uuid) {
+  size_t len = uuid.GetShortestRepresentationSize();
+  return len == Uuid::kNumBytes32 ? Uuid::kNumBytes128 : len;
+}
+
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst, const Uuid& uuid) {
+  uint8_t* p = *p_dst;
+  size_t len = gatt_build_uuid_to_stream_len(uuid);
+  if (len == Uuid::kNumBytes16) {
+    UINT16_TO_STREAM(p, uuid.As16Bit());
+  } else {
+    ARRAY_TO_STREAM(p, uuid.To128BitLE(), (int)Uuid::kNumBytes128);
+  }
+  *p_dst = p;
+  return len;
+}
+
+bool gatt_parse_uuid_from_cmd(Uuid* p_uuid, uint16_t uuid_size,
+                              uint8_t** p_data) {
+  if (uuid_size == Uuid::kNumBytes16) {
+    uint16_t uuid16;
+    STREAM_TO_UINT16(uuid16, *p_data);
+    *p_uuid = Uuid::From16Bit(uuid16);
+    return true;
+  }
+  if (uuid_size == Uuid::kNumBytes128) {
+    *p_uuid = Uuid::From128BitLE(*p_data);
+    *p_data += Uuid::kNumBytes128;
+    return true;
+  }
+  return false;
+}
+
+// Not reached by the requests under test
+void alarm_cancel(alarm_t* alarm) {}
+tGATT_STATUS GATTS_HandleValueIndication(uint16_t conn_id, uint16_t attr_handle,
+                                         uint16_t val_len, uint8_t* p_val) {
+  return GATT_SUCCESS;
+}
+tGATTS_SRV_CHG* gatt_is_bda_in_the_srv_chg_clt_list(const RawAddress& bda) {
+  return NULL;
+}
+void l2cble_set_fixed_channel_tx_data_length(const RawAddress& remote_bda,
+                                             uint16_t fix_cid,
+                                             uint16_t tx_mtu) {}
+BT_HDR* attp_build_sr_msg(tGATT_TCB& tcb, uint8_t op_code,
+                          tGATT_SR_MSG* p_msg) {
+  return NULL;
+}
+void gatt_sr_reset_cback_cnt(tGATT_TCB& tcb) {}
+void gatt_sr_update_cback_cnt(tGATT_TCB& tcb, tGATT_IF gatt_if, bool is_inc,
+                              bool is_reset_first) {}
+bool gatt_sr_is_cback_cnt_zero(tGATT_TCB& tcb) { return true; }
+void gatt_sr_update_prep_cnt(tGATT_TCB& tcb, tGATT_IF gatt_if, bool is_inc,
+                             bool is_reset_first) {}
+bool gatt_sr_is_prep_cnt_zero(tGATT_TCB& tcb) { return true; }
+void gatt_sr_copy_prep_cnt_to_cback_cnt(tGATT_TCB& tcb) {}
+void gatt_start_conf_timer(tGATT_TCB* p_tcb) {}
+
+namespace {
+
+constexpr uint16_t kPayloadSize = GATT_DEF_BLE_MTU_SIZE;
+constexpr uint8_t kTcbIdx = 0;
+constexpr tGATT_CHAR_PROP kProperties =
+    GATT_CHAR_PROP_BIT_READ | GATT_CHAR_PROP_BIT_WRITE |
+    GATT_CHAR_PROP_BIT_NOTIFY;
+
+// A service of the test database: its declaration, and one characteristic
+// declaration, value and optional Client Characteristic Configuration
+struct Service {
+  tGATT_IF gatt_if;
+  bool is_primary;
+  Uuid uuid;
+  uint16_t s_hdl;
+  Uuid char_uuid;
+  bool has_ccc;
+
+  uint16_t e_hdl() const { return s_hdl + (has_ccc ? 3 : 2); }
+};
+
+Uuid VendorUuid(uint8_t seed) {
+  Uuid::UUID128Bit uuid = {0x6e, 0x40, 0x00, 0x00, 0xb5, 0xa3, 0xf3, 0x93,
+                           0xe0, 0xa9, 0xe5, 0x0e, 0x24, 0xdc, 0xca, seed};
+  return Uuid::From128BitBE(uuid);
+}
+
+// Handles 0x0014-0x001f and 0x0027-0x002f are not assigned
+const Service kBattery = {1,      true,
+                          Uuid::From16Bit(0x180f),
+                          0x0010, Uuid::From16Bit(0x2a19),
+                          true};
+const Service kVendor = {2, true, VendorUuid(1), 0x0020, VendorUuid(2), true};
+const Service kSecondary = {3,      false,
+                            Uuid::From16Bit(0x181c),
+                            0x0024, Uuid::From16Bit(0x2a05),
+                            false};
+const Service kDeviceInfo = {4,      true,
+                             Uuid::From16Bit(0x180a),
+                             0x0030, Uuid::From16Bit(0x2a29),
+                             true};
+
+Pdu Handle(uint16_t handle) {
+  return {(uint8_t)(handle & 0xff), (uint8_t)(handle >> 8)};
+}
+
+Pdu Concat(std::initializer_list<Pdu> parts) {
+  Pdu pdu;
+  for (const Pdu& part : parts) pdu.insert(pdu.end(), part.begin(), part.end());
+  return pdu;
+}
+
+Pdu Uuid16(uint16_t uuid) { return Handle(uuid); }
+
+Pdu Uuid128(const Uuid& uuid) {
+  Uuid::UUID128Bit le = uuid.To128BitLE();
+  return Pdu(le.begin(), le.end());
+}
+
+Pdu Error(uint8_t op_code, uint16_t handle, uint8_t reason) {
+  return Concat({{GATT_RSP_ERROR, op_code}, Handle(handle), {reason}});
+}
+
+class GattServerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    gatt_cb = tGATT_CB();
+    gatt_cb.srv_list_info = new std::list<tGATT_SRV_LIST_ELEM>();
+    gatt_cb.attr_index = new tGATT_SR_ATTR_INDEX();
+
+    tcb_.in_use = true;
+    tcb_.tcb_idx = kTcbIdx;
+    tcb_.att_lcid = L2CAP_ATT_CID;
+    tcb_.payload_size = kPayloadSize;
+
+    sent_pdus.clear();
+    app_requests.clear();
+
+    // Started out of handle order, as applications may do
+    Start(kVendor);
+    Start(kDeviceInfo);
+    Start(kBattery);
+    Start(kSecondary);
+  }
+
+  void TearDown() override {
+    gatt_dequeue_sr_cmd(tcb_);
+    delete gatt_cb.attr_index;
+    delete gatt_cb.srv_list_info;
+    dbs_.clear();
+  }
+
+  // Does what GATTS_AddService() does with the handle range of |service|
+  void Start(const Service& service) {
+    dbs_.emplace_back();
+    tGATT_SVC_DB& db = dbs_.back();
+    gatts_init_service_db(db, service.uuid, service.is_primary, service.s_hdl,
+                          service.e_hdl() - service.s_hdl + 1);
+    gatts_add_characteristic(db, GATT_PERM_READ | GATT_PERM_WRITE, kProperties,
+                             service.char_uuid);
+    if (service.has_ccc)
+      gatts_add_char_descr(db, GATT_PERM_READ | GATT_PERM_WRITE,
+                           Uuid::From16Bit(GATT_UUID_CHAR_CLIENT_CONFIG));
+
+    auto it = gatt_cb.srv_list_info->begin();
+    while (it != gatt_cb.srv_list_info->end() && it->s_hdl < service.s_hdl)
+      it++;
+    it = gatt_cb.srv_list_info->emplace(it);
+    it->gatt_if = service.gatt_if;
+    it->s_hdl = service.s_hdl;
+    it->e_hdl = service.e_hdl();
+    it->p_db = &db;
+    it->is_primary = service.is_primary;
+    it->type =
+        service.is_primary ? GATT_UUID_PRI_SERVICE : GATT_UUID_SEC_SERVICE;
+    gatts_index_add_service(it);
+  }
+
+  // Does what GATTS_StopService() does
+  void Stop(const Service& service) {
+    auto it = gatt_sr_find_i_rcb_by_handle(service.s_hdl);
+    ASSERT_NE(it, gatt_cb.srv_list_info->end());
+    gatts_index_remove_service(it);
+    gatt_cb.srv_list_info->erase(it);
+  }
+
+  // Hands |pdu| to the server, one request at a time
+  void Request(Pdu pdu) {
+    gatt_dequeue_sr_cmd(tcb_);
+    sent_pdus.clear();
+    app_requests.clear();
+    gatt_server_handle_client_req(tcb_, pdu[0], pdu.size() - 1,
+                                  pdu.data() + 1);
+  }
+
+  Pdu Response() {
+    EXPECT_EQ(1u, sent_pdus.size());
+    return sent_pdus.empty() ? Pdu() : sent_pdus.back();
+  }
+
+  uint16_t ConnId(const Service& service) {
+    return GATT_CREATE_CONN_ID(kTcbIdx, service.gatt_if);
+  }
+
+  void ExpectIndexIsRebuilt() {
+    tGATT_SR_ATTR_INDEX incremental = *gatt_cb.attr_index;
+    gatts_rebuild_attr_index();
+    EXPECT_EQ(gatt_cb.attr_index->attr_by_handle, incremental.attr_by_handle);
+    EXPECT_TRUE(gatt_cb.attr_index->srv_by_handle ==
+                incremental.srv_by_handle);
+    EXPECT_EQ(gatt_cb.attr_index->handles_by_type,
+              incremental.handles_by_type);
+  }
+
+  std::list<tGATT_SVC_DB> dbs_;
+  tGATT_TCB tcb_;
+};
+
+TEST_F(GattServerTest, primary_service_discovery_walks_every_service) {
+  Pdu request = {GATT_REQ_READ_BY_GRP_TYPE, 0x01, 0x00, 0xff, 0xff, 0x00, 0x28};
+
+  // A response only holds services whose UUIDs have the same size
+  Request(request);
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_GRP_TYPE, 6},
+                    Handle(0x0010),
+                    Handle(0x0013),
+                    Uuid16(0x180f)}),
+            Response());
+
+  // Continuing from the gap after the first service
+  request[1] = 0x14;
+  Request(request);
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_GRP_TYPE, 20},
+                    Handle(0x0020),
+                    Handle(0x0023),
+                    Uuid128(kVendor.uuid)}),
+            Response());
+
+  // The secondary service is skipped
+  request[1] = 0x24;
+  Request(request);
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_GRP_TYPE, 6},
+                    Handle(0x0030),
+                    Handle(0x0033),
+                    Uuid16(0x180a)}),
+            Response());
+
+  request[1] = 0x34;
+  Request(request);
+  EXPECT_EQ(Error(GATT_REQ_READ_BY_GRP_TYPE, 0x0034, GATT_NOT_FOUND),
+            Response());
+}
+
+TEST_F(GattServerTest, primary_service_discovery_range_edges) {
+  // A range holding only the service declaration finds the service
+  Request({GATT_REQ_READ_BY_GRP_TYPE, 0x30, 0x00, 0x30, 0x00, 0x00, 0x28});
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_GRP_TYPE, 6},
+                    Handle(0x0030),
+                    Handle(0x0033),
+                    Uuid16(0x180a)}),
+            Response());
+
+  // Ending right before a declaration, or starting right after it, does not
+  Request({GATT_REQ_READ_BY_GRP_TYPE, 0x11, 0x00, 0x1f, 0x00, 0x00, 0x28});
+  EXPECT_EQ(Error(GATT_REQ_READ_BY_GRP_TYPE, 0x0011, GATT_NOT_FOUND),
+            Response());
+  Request({GATT_REQ_READ_BY_GRP_TYPE, 0x31, 0x00, 0xff, 0xff, 0x00, 0x28});
+  EXPECT_EQ(Error(GATT_REQ_READ_BY_GRP_TYPE, 0x0031, GATT_NOT_FOUND),
+            Response());
+
+  Request({GATT_REQ_READ_BY_GRP_TYPE, 0x00, 0x00, 0xff, 0xff, 0x00, 0x28});
+  EXPECT_EQ(Error(GATT_REQ_READ_BY_GRP_TYPE, 0x0000, GATT_INVALID_HANDLE),
+            Response());
+}
+
+TEST_F(GattServerTest, find_primary_service_by_uuid) {
+  Request(Concat({{GATT_REQ_FIND_TYPE_VALUE, 0x01, 0x00, 0xff, 0xff},
+                  Uuid16(GATT_UUID_PRI_SERVICE),
+                  Uuid128(kVendor.uuid)}));
+  EXPECT_EQ(
+      Concat({{GATT_RSP_FIND_TYPE_VALUE}, Handle(0x0020), Handle(0x0023)}),
+      Response());
+
+  // Secondary services are not primary services
+  Request(Concat({{GATT_REQ_FIND_TYPE_VALUE, 0x01, 0x00, 0xff, 0xff},
+                  Uuid16(GATT_UUID_PRI_SERVICE),
+                  Uuid16(0x181c)}));
+  EXPECT_EQ(Error(GATT_REQ_FIND_TYPE_VALUE, 0x0001, GATT_NOT_FOUND),
+            Response());
+}
+
+TEST_F(GattServerTest, find_info_reports_one_attribute_per_service) {
+  Request({GATT_REQ_FIND_INFO, 0x01, 0x00, 0xff, 0xff});
+  EXPECT_EQ(Concat({{GATT_RSP_FIND_INFO, GATT_INFO_TYPE_PAIR_16},
+                    Handle(0x0010),
+                    Uuid16(GATT_UUID_PRI_SERVICE),
+                    Handle(0x0020),
+                    Uuid16(GATT_UUID_PRI_SERVICE),
+                    Handle(0x0024),
+                    Uuid16(GATT_UUID_SEC_SERVICE),
+                    Handle(0x0030),
+                    Uuid16(GATT_UUID_PRI_SERVICE)}),
+            Response());
+}
+
+// Find Information used to walk every started service. Starting from the
+// service holding the start handle must not lose any service after it.
+TEST_F(GattServerTest, find_info_from_a_handle_gap) {
+  Request({GATT_REQ_FIND_INFO, 0x14, 0x00, 0xff, 0xff});
+  EXPECT_EQ(Concat({{GATT_RSP_FIND_INFO, GATT_INFO_TYPE_PAIR_16},
+                    Handle(0x0020),
+                    Uuid16(GATT_UUID_PRI_SERVICE),
+                    Handle(0x0024),
+                    Uuid16(GATT_UUID_SEC_SERVICE),
+                    Handle(0x0030),
+                    Uuid16(GATT_UUID_PRI_SERVICE)}),
+            Response());
+
+  Request({GATT_REQ_FIND_INFO, 0x27, 0x00, 0x2f, 0x00});
+  EXPECT_EQ(Error(GATT_REQ_FIND_INFO, 0x0027, GATT_NOT_FOUND), Response());
+
+  Request({GATT_REQ_FIND_INFO, 0x34, 0x00, 0xff, 0xff});
+  EXPECT_EQ(Error(GATT_REQ_FIND_INFO, 0x0034, GATT_NOT_FOUND), Response());
+}
+
+TEST_F(GattServerTest, find_info_range_edges) {
+  // Starting inside a service, ending on its last handle
+  Request({GATT_REQ_FIND_INFO, 0x12, 0x00, 0x13, 0x00});
+  EXPECT_EQ(Concat({{GATT_RSP_FIND_INFO, GATT_INFO_TYPE_PAIR_16},
+                    Handle(0x0012),
+                    Uuid16(0x2a19)}),
+            Response());
+
+  // The first attribute sets the format, services after it in another
+  // format are left for the next request
+  Request({GATT_REQ_FIND_INFO, 0x22, 0x00, 0xff, 0xff});
+  EXPECT_EQ(Concat({{GATT_RSP_FIND_INFO, GATT_INFO_TYPE_PAIR_128},
+                    Handle(0x0022),
+                    Uuid128(kVendor.char_uuid)}),
+            Response());
+
+  // Adjacent services: the range ends on the first handle of the next one
+  Request({GATT_REQ_FIND_INFO, 0x23, 0x00, 0x24, 0x00});
+  EXPECT_EQ(Concat({{GATT_RSP_FIND_INFO, GATT_INFO_TYPE_PAIR_16},
+                    Handle(0x0023),
+                    Uuid16(GATT_UUID_CHAR_CLIENT_CONFIG),
+                    Handle(0x0024),
+                    Uuid16(GATT_UUID_SEC_SERVICE)}),
+            Response());
+
+  Request({GATT_REQ_FIND_INFO, 0x13, 0x00, 0x12, 0x00});
+  EXPECT_EQ(Error(GATT_REQ_FIND_INFO, 0x0013, GATT_INVALID_HANDLE),
+            Response());
+}
+
+TEST_F(GattServerTest, read_by_type_discovers_characteristics) {
+  // Declarations of 16-bit characteristics are 5 bytes, the 128-bit one in
+  // between ends the response
+  Request({GATT_REQ_READ_BY_TYPE, 0x01, 0x00, 0xff, 0xff, 0x03, 0x28});
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_TYPE, 7},
+                    Handle(0x0011),
+                    {kProperties},
+                    Handle(0x0012),
+                    Uuid16(0x2a19)}),
+            Response());
+
+  Request({GATT_REQ_READ_BY_TYPE, 0x13, 0x00, 0xff, 0xff, 0x03, 0x28});
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_TYPE, 21},
+                    Handle(0x0021),
+                    {kProperties},
+                    Handle(0x0022),
+                    Uuid128(kVendor.char_uuid)}),
+            Response());
+
+  Request({GATT_REQ_READ_BY_TYPE, 0x22, 0x00, 0xff, 0xff, 0x03, 0x28});
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_TYPE, 7},
+                    Handle(0x0025),
+                    {kProperties},
+                    Handle(0x0026),
+                    Uuid16(0x2a05),
+                    Handle(0x0031),
+                    {kProperties},
+                    Handle(0x0032),
+                    Uuid16(0x2a29)}),
+            Response());
+}
+
+TEST_F(GattServerTest, read_by_type_range_edges) {
+  // Bounded by the end handle, even in the middle of the services
+  Request({GATT_REQ_READ_BY_TYPE, 0x22, 0x00, 0x30, 0x00, 0x03, 0x28});
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_TYPE, 7},
+                    Handle(0x0025),
+                    {kProperties},
+                    Handle(0x0026),
+                    Uuid16(0x2a05)}),
+            Response());
+
+  Request({GATT_REQ_READ_BY_TYPE, 0x26, 0x00, 0x30, 0x00, 0x03, 0x28});
+  EXPECT_EQ(Error(GATT_REQ_READ_BY_TYPE, 0x0026, GATT_NOT_FOUND), Response());
+}
+
+TEST_F(GattServerTest, read_by_type_of_a_value_asks_its_application) {
+  Request({GATT_REQ_READ_BY_TYPE, 0x01, 0x00, 0xff, 0xff, 0x29, 0x2a});
+  EXPECT_TRUE(sent_pdus.empty());
+  ASSERT_EQ(1u, app_requests.size());
+  EXPECT_EQ(ConnId(kDeviceInfo), app_requests[0].conn_id);
+  EXPECT_EQ(GATTS_REQ_TYPE_READ_CHARACTERISTIC, app_requests[0].type);
+  EXPECT_EQ(0x0032, app_requests[0].handle);
+}
+
+TEST_F(GattServerTest, attribute_requests_reach_the_owning_application) {
+  Request({GATT_REQ_READ, 0x22, 0x00});
+  EXPECT_TRUE(sent_pdus.empty());
+  ASSERT_EQ(1u, app_requests.size());
+  EXPECT_EQ(ConnId(kVendor), app_requests[0].conn_id);
+  EXPECT_EQ(GATTS_REQ_TYPE_READ_CHARACTERISTIC, app_requests[0].type);
+  EXPECT_EQ(0x0022, app_requests[0].handle);
+
+  Request({GATT_REQ_READ, 0x13, 0x00});
+  ASSERT_EQ(1u, app_requests.size());
+  EXPECT_EQ(ConnId(kBattery), app_requests[0].conn_id);
+  EXPECT_EQ(GATTS_REQ_TYPE_READ_DESCRIPTOR, app_requests[0].type);
+
+  Request({GATT_REQ_WRITE, 0x26, 0x00, 0x01});
+  ASSERT_EQ(1u, app_requests.size());
+  EXPECT_EQ(ConnId(kSecondary), app_requests[0].conn_id);
+  EXPECT_EQ(GATTS_REQ_TYPE_WRITE_CHARACTERISTIC, app_requests[0].type);
+  EXPECT_EQ(0x0026, app_requests[0].handle);
+
+  // Declarations are read by the server itself
+  Request({GATT_REQ_READ, 0x30, 0x00});
+  EXPECT_TRUE(app_requests.empty());
+  EXPECT_EQ(Concat({{GATT_RSP_READ}, Uuid16(0x180a)}), Response());
+}
+
+TEST_F(GattServerTest, attribute_requests_on_unassigned_handles) {
+  for (uint16_t handle : {0x0001, 0x000f, 0x0014, 0x001f, 0x0027, 0x0034}) {
+    Request(Concat({{GATT_REQ_READ}, Handle(handle)}));
+    EXPECT_EQ(Error(GATT_REQ_READ, handle, GATT_INVALID_HANDLE), Response());
+    EXPECT_TRUE(app_requests.empty());
+  }
+
+  // Commands are not answered
+  Request({GATT_CMD_WRITE, 0x15, 0x00, 0x01});
+  EXPECT_TRUE(sent_pdus.empty());
+  EXPECT_TRUE(app_requests.empty());
+}
+
+TEST_F(GattServerTest, value_conf_reaches_the_application_that_indicated) {
+  tcb_.indicate_handle = 0x0022;
+  Request({GATT_HANDLE_VALUE_CONF});
+  EXPECT_TRUE(sent_pdus.empty());
+  ASSERT_EQ(1u, app_requests.size());
+  EXPECT_EQ(ConnId(kVendor), app_requests[0].conn_id);
+  EXPECT_EQ(GATTS_REQ_TYPE_CONF, app_requests[0].type);
+  EXPECT_EQ(0x0022, app_requests[0].handle);
+  EXPECT_EQ(0, tcb_.indicate_handle);
+
+  // Unexpected confirmation
+  Request({GATT_HANDLE_VALUE_CONF});
+  EXPECT_TRUE(app_requests.empty());
+}
+
+TEST_F(GattServerTest, stopped_services_are_not_found) {
+  tcb_.indicate_handle = 0x0022;
+  Stop(kVendor);
+
+  Request({GATT_HANDLE_VALUE_CONF});
+  EXPECT_TRUE(app_requests.empty());
+
+  Request({GATT_REQ_READ, 0x22, 0x00});
+  EXPECT_EQ(Error(GATT_REQ_READ, 0x0022, GATT_INVALID_HANDLE), Response());
+
+  // The secondary service is still reached through the freed range
+  Request({GATT_REQ_FIND_INFO, 0x14, 0x00, 0xff, 0xff});
+  EXPECT_EQ(Concat({{GATT_RSP_FIND_INFO, GATT_INFO_TYPE_PAIR_16},
+                    Handle(0x0024),
+                    Uuid16(GATT_UUID_SEC_SERVICE),
+                    Handle(0x0030),
+                    Uuid16(GATT_UUID_PRI_SERVICE)}),
+            Response());
+
+  Request({GATT_REQ_READ_BY_GRP_TYPE, 0x14, 0x00, 0xff, 0xff, 0x00, 0x28});
+  EXPECT_EQ(Concat({{GATT_RSP_READ_BY_GRP_TYPE, 6},
+                    Handle(0x0030),
+                    Handle(0x0033),
+                    Uuid16(0x180a)}),
+            Response());
+
+  // The last service going away leaves no handle behind it
+  Stop(kDeviceInfo);
+  EXPECT_EQ(kSecondary.e_hdl() + 1u,
+            gatt_cb.attr_index->srv_by_handle.size());
+  Request({GATT_REQ_READ_BY_TYPE, 0x22, 0x00, 0xff, 0xff, 0x29, 0x2a});
+  EXPECT_EQ(Error(GATT_REQ_READ_BY_TYPE, 0x0022, GATT_NOT_FOUND), Response());
+}
+
+TEST_F(GattServerTest, index_updates_match_a_rebuild) {
+  ExpectIndexIsRebuilt();
+
+  Stop(kSecondary);
+  ExpectIndexIsRebuilt();
+  Stop(kDeviceInfo);
+  ExpectIndexIsRebuilt();
+  Start(kSecondary);
+  ExpectIndexIsRebuilt();
+  Stop(kBattery);
+  Stop(kVendor);
+  Stop(kSecondary);
+  ExpectIndexIsRebuilt();
+  EXPECT_TRUE(gatt_cb.attr_index->srv_by_handle.empty());
+  EXPECT_TRUE(gatt_cb.attr_index->handles_by_type.empty());
+}
+
+}  // namespace
@@ -0,0 +1,194 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "bt_target.h"
+#include "port_int.h"
+
+namespace {
+
+constexpr uint16_t kDefaultMax = 10;
+constexpr uint16_t kDefaultLow = 4;
+// Credits handed back at once with the default window
+constexpr uint16_t kBatch = kDefaultMax - kDefaultLow;
+// Time between the frames of a burst from the peer
+constexpr uint64_t kFrameGapUs = 1000;
+
+int data_callback(uint16_t port_handle, void* p_data, uint16_t len) {
+  return 0;
+}
+
+class PortCreditTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    memset(&port_, 0, sizeof(port_));
+    port_.rx.queue = fixed_queue_new(SIZE_MAX);
+    port_.credit_rx_max = kDefaultMax;
+    port_.credit_rx_low = kDefaultLow;
+    port_.rx_buf_critical = 2 * PORT_RX_BUF_MAX_WINDOW;
+    port_.p_data_callback = data_callback;
+    port_rx_window_init(&port_);
+  }
+
+  void TearDown() override { fixed_queue_free(port_.rx.queue, nullptr); }
+
+  // The peer sends a burst on the credits it holds, runs out, and sends
+  // again |rtt_us| after new credits are granted.
+  void MeasureRoundTrip(uint64_t rtt_us) {
+    for (int i = 0; i < 4; i++) {
+      now_us_ += kFrameGapUs;
+      port_rx_window_frame_received(&port_, now_us_);
+    }
+    port_.credit_rx = 0;
+    port_rx_window_credits_granted(&port_, now_us_);
+    now_us_ += rtt_us;
+    port_rx_window_frame_received(&port_, now_us_);
+  }
+
+  // The user consumes a frame every |period_us| for |duration_us|
+  void Consume(uint64_t period_us, uint64_t duration_us) {
+    uint64_t end_us = now_us_ + duration_us;
+    port_rx_window_frames_consumed(&port_, 1, now_us_);
+    while (now_us_ < end_us) {
+      now_us_ += period_us;
+      port_rx_window_frames_consumed(&port_, 1, now_us_);
+    }
+  }
+
+  tPORT port_;
+  uint64_t now_us_ = 1000000;
+};
+
+TEST_F(PortCreditTest, round_trip_is_measured_after_an_idle_gap) {
+  MeasureRoundTrip(20000);
+  EXPECT_EQ(20000u, port_.rx_window.rtt_us);
+}
+
+TEST_F(PortCreditTest, round_trip_skips_frames_sent_on_earlier_credits) {
+  for (int i = 0; i < 4; i++) {
+    now_us_ += kFrameGapUs;
+    port_rx_window_frame_received(&port_, now_us_);
+  }
+  // The peer still holds two credits when new ones are granted
+  port_.credit_rx = 2;
+  port_rx_window_credits_granted(&port_, now_us_);
+  for (int i = 0; i < 2; i++) {
+    now_us_ += kFrameGapUs;
+    port_rx_window_frame_received(&port_, now_us_);
+  }
+  EXPECT_EQ(0u, port_.rx_window.rtt_us);
+
+  now_us_ += 20000;
+  port_rx_window_frame_received(&port_, now_us_);
+  EXPECT_EQ(20000u + 2 * kFrameGapUs, port_.rx_window.rtt_us);
+}
+
+TEST_F(PortCreditTest, window_stays_default_until_round_trip_is_known) {
+  Consume(1000, 100000);
+  EXPECT_EQ(kDefaultMax, port_.credit_rx_max);
+  EXPECT_EQ(kDefaultLow, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, window_covers_consumption_over_a_round_trip) {
+  MeasureRoundTrip(20000);
+  // 1000 frames per second over 20ms: 20 frames in flight
+  Consume(1000, 40000);
+  EXPECT_EQ(20 + kBatch, port_.credit_rx_max);
+  EXPECT_EQ(20, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, window_grows_with_consumption_rate) {
+  MeasureRoundTrip(20000);
+  Consume(2000, 40000);
+  uint16_t slow_max = port_.credit_rx_max;
+
+  // The rate is smoothed, so give it a few samples to settle
+  Consume(1000, 200000);
+  EXPECT_GT(port_.credit_rx_max, slow_max);
+  EXPECT_EQ(20 + kBatch, port_.credit_rx_max);
+  EXPECT_EQ(port_.credit_rx_max - kBatch, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, window_grows_with_round_trip) {
+  MeasureRoundTrip(20000);
+  Consume(2000, 40000);
+  uint16_t short_max = port_.credit_rx_max;
+  EXPECT_EQ(10 + kBatch, short_max);
+
+  // A longer round trip is averaged in. The rate sample spanning the
+  // measurement is low, so give the rate a few samples to settle.
+  MeasureRoundTrip(44000);
+  EXPECT_EQ(26000u, port_.rx_window.rtt_us);
+  Consume(2000, 300000);
+  EXPECT_GT(port_.credit_rx_max, short_max);
+  EXPECT_EQ(13 + kBatch, port_.credit_rx_max);
+}
+
+TEST_F(PortCreditTest, window_is_clamped_to_max_window_with_data_callback) {
+  MeasureRoundTrip(100000);
+  Consume(1000, 200000);
+  EXPECT_EQ(PORT_RX_BUF_MAX_WINDOW, port_.credit_rx_max);
+  EXPECT_EQ(PORT_RX_BUF_MAX_WINDOW - kBatch, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, window_is_clamped_below_rx_buf_critical) {
+  // Without a data callback, frames wait in the queue until read
+  port_.p_data_callback = nullptr;
+  port_.rx_buf_critical = 15;
+  MeasureRoundTrip(20000);
+  Consume(1000, 40000);
+  EXPECT_EQ(14, port_.credit_rx_max);
+  EXPECT_EQ(14 - kBatch, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, window_falls_back_to_default_for_slow_consumer) {
+  MeasureRoundTrip(20000);
+  Consume(1000, 40000);
+  EXPECT_GT(port_.credit_rx_max, kDefaultMax);
+
+  // 50 frames per second over 20ms leave the default window enough
+  Consume(20000, 400000);
+  EXPECT_EQ(kDefaultMax, port_.credit_rx_max);
+  EXPECT_EQ(kDefaultLow, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, window_falls_back_to_default_below_rx_buf_critical) {
+  // A critical level under the default window does not shrink it
+  port_.p_data_callback = nullptr;
+  port_.rx_buf_critical = kDefaultMax / 2;
+  MeasureRoundTrip(20000);
+  Consume(1000, 40000);
+  EXPECT_EQ(kDefaultMax, port_.credit_rx_max);
+  EXPECT_EQ(kDefaultLow, port_.credit_rx_low);
+}
+
+TEST_F(PortCreditTest, reset_restores_default_window_and_keeps_round_trip) {
+  MeasureRoundTrip(20000);
+  Consume(1000, 40000);
+  EXPECT_GT(port_.credit_rx_max, kDefaultMax);
+
+  port_rx_window_reset(&port_);
+  EXPECT_EQ(kDefaultMax, port_.credit_rx_max);
+  EXPECT_EQ(kDefaultLow, port_.credit_rx_low);
+  EXPECT_EQ(20000u, port_.rx_window.rtt_us);
+}
+
+}  // namespace
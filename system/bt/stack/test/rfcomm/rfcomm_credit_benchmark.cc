@@ -0,0 +1,217 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <vector>
+
+#include "osi/include/fixed_queue.h"
+#include "stack/rfcomm/port_int.h"
+
+using ::benchmark::State;
+
+namespace {
+
+// A multiplexer carrying an SPP bulk transfer and HFP AT commands from the
+// peer, both over socket style ports that take every frame as it arrives.
+// The link is simulated: the peer hands every frame it holds credits for to
+// its controller, which sends them in turn at the link rate, and frames and
+// credits reach the other side after the link latency.
+constexpr uint64_t kLinkBitsPerSecond = 1400000;  // 2 Mbps EDR, 2-DH5
+constexpr uint16_t kSppFrameSize = 990;
+constexpr uint16_t kAtFrameSize = 24;
+constexpr uint64_t kAtIntervalUs = 50000;
+constexpr uint16_t kFrameOverhead = 9;  // RFCOMM and L2CAP headers
+constexpr uint64_t kSimulatedUsPerIteration = 1000000;
+
+enum PortIndex { kSpp, kAt, kNumPorts };
+
+int DataCoCallback(uint16_t port_handle, uint8_t* p_buf, uint16_t len,
+                   int type) {
+  return true;
+}
+
+struct Event {
+  uint64_t time_us;
+  enum { kFrameArrived, kCreditsArrived, kAtCommand, kLinkFree } type;
+  int port;
+  uint16_t credits;
+  uint64_t queued_us;
+
+  bool operator>(const Event& other) const { return time_us > other.time_us; }
+};
+
+struct Frame {
+  int port;
+  uint16_t len;
+  uint64_t queued_us;
+};
+
+class Multiplexer {
+ public:
+  Multiplexer(bool adaptive, uint64_t latency_us)
+      : adaptive_(adaptive), latency_us_(latency_us) {
+    for (tPORT& port : ports_) {
+      memset(&port, 0, sizeof(port));
+      port.rx.queue = fixed_queue_new(SIZE_MAX);
+      port.p_data_co_callback = DataCoCallback;
+      port.credit_rx_max = PORT_RX_BUF_HIGH_WM;
+      port.credit_rx_low = PORT_RX_BUF_LOW_WM;
+      port.rx_buf_critical = PORT_RX_BUF_CRITICAL_WM;
+      port.credit_rx = std::min<uint16_t>(port.credit_rx_max, RFCOMM_K_MAX);
+      port_rx_window_init(&port);
+      peer_credits_[&port - ports_] = port.credit_rx;
+    }
+    events_.push({kAtIntervalUs, Event::kAtCommand, kAt, 0, 0});
+  }
+
+  ~Multiplexer() {
+    for (tPORT& port : ports_) fixed_queue_free(port.rx.queue, nullptr);
+  }
+
+  void Run(uint64_t duration_us) {
+    uint64_t end_us = now_us_ + duration_us;
+    while (!events_.empty() && events_.top().time_us <= end_us) {
+      Event event = events_.top();
+      events_.pop();
+      now_us_ = event.time_us;
+      switch (event.type) {
+        case Event::kFrameArrived:
+          FrameArrived(event.port, event.queued_us);
+          break;
+        case Event::kCreditsArrived:
+          peer_credits_[event.port] += event.credits;
+          PeerSend();
+          break;
+        case Event::kAtCommand:
+          at_pending_++;
+          events_.push(
+              {now_us_ + kAtIntervalUs, Event::kAtCommand, kAt, 0, 0});
+          PeerSend();
+          break;
+        case Event::kLinkFree:
+          link_busy_ = false;
+          Transmit();
+          break;
+      }
+    }
+    now_us_ = end_us;
+  }
+
+  uint64_t spp_bytes = 0;
+  uint64_t at_frames = 0;
+  uint64_t at_latency_us = 0;
+  uint64_t at_max_latency_us = 0;
+  uint64_t credit_frames = 0;
+
+ private:
+  // The peer queues whatever its credits allow: SPP has data at all times
+  void PeerSend() {
+    while (at_pending_ > 0 && peer_credits_[kAt] > 0) {
+      at_pending_--;
+      peer_credits_[kAt]--;
+      controller_.push_back({kAt, kAtFrameSize, now_us_});
+    }
+    while (peer_credits_[kSpp] > 0) {
+      peer_credits_[kSpp]--;
+      controller_.push_back({kSpp, kSppFrameSize, now_us_});
+    }
+    Transmit();
+  }
+
+  void Transmit() {
+    if (link_busy_ || controller_.empty()) return;
+    Frame frame = controller_.front();
+    controller_.pop_front();
+    uint64_t air_us =
+        (frame.len + kFrameOverhead) * 8 * 1000000ULL / kLinkBitsPerSecond;
+    link_busy_ = true;
+    events_.push({now_us_ + air_us, Event::kLinkFree, 0, 0, 0});
+    events_.push({now_us_ + air_us + latency_us_, Event::kFrameArrived,
+                  frame.port, 0, frame.queued_us});
+    if (frame.port == kSpp) spp_bytes += frame.len;
+  }
+
+  // What PORT_DataInd() and port_flow_control_peer() do for a port with a
+  // data callback
+  void FrameArrived(int index, uint64_t queued_us) {
+    tPORT* p_port = &ports_[index];
+    if (adaptive_) port_rx_window_frame_received(p_port, now_us_);
+    if (index == kAt) {
+      uint64_t latency_us = now_us_ - queued_us;
+      at_frames++;
+      at_latency_us += latency_us;
+      at_max_latency_us = std::max(at_max_latency_us, latency_us);
+    }
+
+    if (p_port->credit_rx > 0) p_port->credit_rx--;
+    if (adaptive_) port_rx_window_frames_consumed(p_port, 1, now_us_);
+    uint8_t credits = port_rx_credits_due(p_port);
+    if (credits == 0) return;
+    if (adaptive_) port_rx_window_credits_granted(p_port, now_us_);
+    p_port->credit_rx = p_port->credit_rx_max;
+    credit_frames++;
+    events_.push(
+        {now_us_ + latency_us_, Event::kCreditsArrived, index, credits, 0});
+  }
+
+  const bool adaptive_;
+  const uint64_t latency_us_;
+  uint64_t now_us_ = 0;
+  tPORT ports_[kNumPorts];
+  uint16_t peer_credits_[kNumPorts];
+  uint32_t at_pending_ = 0;
+  std::deque<Frame> controller_;
+  bool link_busy_ = false;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+};
+
+// Arguments are whether the credit window adapts, 0 keeping it at its
+// default size, and the one way link latency in milliseconds. Each iteration
+// simulates one second of traffic.
+void BM_RfcommSppWithAt(State& state) {
+  const bool adaptive = state.range(0);
+  const uint64_t latency_us = state.range(1) * 1000;
+  Multiplexer mux(adaptive, latency_us);
+
+  for (auto _ : state) {
+    mux.Run(kSimulatedUsPerIteration);
+  }
+
+  double seconds = (double)state.iterations();
+  state.counters["spp_kbps"] = mux.spp_bytes * 8 / seconds / 1000;
+  state.counters["at_avg_ms"] =
+      mux.at_frames ? (double)mux.at_latency_us / mux.at_frames / 1000 : 0;
+  state.counters["at_max_ms"] = (double)mux.at_max_latency_us / 1000;
+  state.counters["credits_per_s"] = mux.credit_frames / seconds;
+}
+
+BENCHMARK(BM_RfcommSppWithAt)
+    ->ArgNames({"adaptive", "latency_ms"})
+    ->Args({0, 5})
+    ->Args({1, 5})
+    ->Args({0, 20})
+    ->Args({1, 20})
+    ->Args({0, 40})
+    ->Args({1, 40});
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -26,6 +26,7 @@
 #include "stack/include/a2dp_aac.h"
 #include "stack/include/a2dp_api.h"
 #include "stack/include/a2dp_codec_api.h"
+#include "stack/include/a2dp_media_clock.h"
 #include "stack/include/a2dp_sbc.h"
 #include "stack/include/a2dp_vendor.h"
 
@@ -990,3 +991,144 @@ TEST_F(A2dpCodecConfigTest, init) {
       codecs.orderedSinkCodecs();
   EXPECT_FALSE(orderedSinkCodecs.empty());
 }
+
+TEST_F(StackA2dpTest, test_a2dp_media_clock_exact_credit) {
+  const uint32_t pcm_bytes_per_second = 44100 * 2 * 2;
+  const uint32_t pcm_bytes_per_frame = 128 * 2 * 2;
+  uint64_t timestamp_us = 1000000;
+  uint64_t total_frames = 0;
+  uint32_t dropped_frames = 0;
+
+  A2DP_MediaClockReset(pcm_bytes_per_second, 20000);
+
+  // The first tick credits one interval
+  total_frames += A2DP_MediaClockGetFrames(timestamp_us, pcm_bytes_per_frame,
+                                           UINT8_MAX, &dropped_frames);
+  EXPECT_EQ(dropped_frames, 0u);
+
+  // Irregular ticks credit exactly the PCM played out over the whole period
+  for (int i = 0; i < 1000; i++) {
+    timestamp_us += (i % 2 == 0) ? 19123 : 20877;
+    total_frames += A2DP_MediaClockGetFrames(timestamp_us, pcm_bytes_per_frame,
+                                             UINT8_MAX, &dropped_frames);
+    EXPECT_EQ(dropped_frames, 0u);
+  }
+
+  tA2DP_MEDIA_CLOCK_STATS stats;
+  A2DP_MediaClockGetStats(&stats);
+  // One interval for the first tick, then 1000 ticks of 20ms on average
+  const uint64_t expected_bytes =
+      pcm_bytes_per_second / 50 + pcm_bytes_per_second * 20ULL;
+  EXPECT_EQ(stats.total_ticks, 1001u);
+  EXPECT_EQ(stats.total_credited_bytes, expected_bytes);
+  EXPECT_EQ(total_frames, expected_bytes / pcm_bytes_per_frame);
+  EXPECT_EQ(stats.correction_ppm, 0);
+}
+
+TEST_F(StackA2dpTest, test_a2dp_media_clock_discard_after_stall) {
+  const uint32_t pcm_bytes_per_frame = 128 * 2 * 2;
+  uint32_t dropped_frames = 0;
+
+  A2DP_MediaClockReset(48000 * 2 * 2, 10000);
+  A2DP_MediaClockGetFrames(1000000, pcm_bytes_per_frame, UINT8_MAX,
+                           &dropped_frames);
+  A2DP_MediaClockFlush();
+
+  // 100ms worth of PCM is due, but a tick encodes at most 4 frames
+  EXPECT_EQ(A2DP_MediaClockGetFrames(1100000, pcm_bytes_per_frame, 4,
+                                     &dropped_frames),
+            4u);
+  EXPECT_EQ(dropped_frames, 19200u / pcm_bytes_per_frame - 4);
+
+  tA2DP_MEDIA_CLOCK_STATS stats;
+  A2DP_MediaClockGetStats(&stats);
+  EXPECT_EQ(stats.total_discarded_bytes, dropped_frames * pcm_bytes_per_frame);
+
+  // The frames returned unencoded are due on the next tick, with the
+  // fraction of a frame left over
+  A2DP_MediaClockReturnFrames(2, pcm_bytes_per_frame);
+  EXPECT_EQ(A2DP_MediaClockGetFrames(1110000, pcm_bytes_per_frame, UINT8_MAX,
+                                     &dropped_frames),
+            (19200u % pcm_bytes_per_frame + 1920 + 2 * pcm_bytes_per_frame) /
+                pcm_bytes_per_frame);
+}
+
+TEST_F(StackA2dpTest, test_a2dp_media_clock_underflow) {
+  const uint32_t pcm_bytes_per_second = 44100 * 2 * 2;
+  const uint32_t pcm_bytes_per_frame = 128 * 2 * 2;
+  const uint32_t bytes_per_interval = pcm_bytes_per_second / 50;
+  uint32_t dropped_frames = 0;
+
+  A2DP_MediaClockReset(pcm_bytes_per_second, 20000);
+  uint32_t frames = A2DP_MediaClockGetFrames(
+      1000000, pcm_bytes_per_frame, UINT8_MAX, &dropped_frames);
+  EXPECT_EQ(frames, bytes_per_interval / pcm_bytes_per_frame);
+
+  // Repeated underflows carry over at most one interval, and slow down the
+  // clock
+  A2DP_MediaClockUnderflow(frames, pcm_bytes_per_frame);
+  A2DP_MediaClockUnderflow(frames, pcm_bytes_per_frame);
+  tA2DP_MEDIA_CLOCK_STATS stats;
+  A2DP_MediaClockGetStats(&stats);
+  EXPECT_EQ(stats.total_underflow_bytes, 2u * frames * pcm_bytes_per_frame);
+  EXPECT_LT(stats.correction_ppm, 0);
+
+  // The next tick encodes the interval carried over along with its own
+  frames = A2DP_MediaClockGetFrames(1020000, pcm_bytes_per_frame, UINT8_MAX,
+                                    &dropped_frames);
+  EXPECT_EQ(frames, 2 * bytes_per_interval / pcm_bytes_per_frame);
+}
+
+TEST_F(StackA2dpTest, test_a2dp_media_clock_rate_correction) {
+  A2DP_MediaClockReset(48000 * 2 * 2, 10000);
+  tA2DP_MEDIA_CLOCK_STATS stats;
+
+  // A queue on target does not correct the rate
+  A2DP_MediaClockSetTransmitQueueLength(A2DP_MEDIA_CLOCK_TARGET_QUEUE_LENGTH);
+  A2DP_MediaClockGetStats(&stats);
+  EXPECT_EQ(stats.correction_ppm, 0);
+
+  // A queue that builds up slows the clock down, within bounds
+  int32_t correction_ppm = 0;
+  for (int i = 0; i < 1000; i++) {
+    A2DP_MediaClockSetTransmitQueueLength(
+        A2DP_MEDIA_CLOCK_TARGET_QUEUE_LENGTH + 4);
+    A2DP_MediaClockGetStats(&stats);
+    EXPECT_LE(stats.correction_ppm, correction_ppm);
+    correction_ppm = stats.correction_ppm;
+  }
+  EXPECT_EQ(stats.correction_ppm, -A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM);
+
+  // A queue that stays empty speeds the clock up, within the same bounds
+  for (int i = 0; i < 1000; i++) {
+    A2DP_MediaClockSetTransmitQueueLength(0);
+    A2DP_MediaClockGetStats(&stats);
+    EXPECT_GE(stats.correction_ppm, correction_ppm);
+    correction_ppm = stats.correction_ppm;
+  }
+  EXPECT_EQ(stats.correction_ppm, A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM);
+
+  // A sped up clock credits more PCM than the nominal rate
+  uint32_t dropped_frames = 0;
+  A2DP_MediaClockGetFrames(1000000, 1, UINT32_MAX, &dropped_frames);
+  uint64_t expected_bytes =
+      48000ull * 2 * 2 * (1000000 + A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM) /
+      1000000;
+  EXPECT_EQ(A2DP_MediaClockGetFrames(2000000, 1, UINT32_MAX, &dropped_frames),
+            expected_bytes);
+
+  // The correction settles back to zero once the queue is on target
+  for (int i = 0; i < 1000; i++) {
+    A2DP_MediaClockSetTransmitQueueLength(A2DP_MEDIA_CLOCK_TARGET_QUEUE_LENGTH);
+  }
+  A2DP_MediaClockGetStats(&stats);
+  EXPECT_EQ(stats.correction_ppm, 0);
+  EXPECT_EQ(stats.min_correction_ppm, -A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM);
+  EXPECT_EQ(stats.max_correction_ppm, A2DP_MEDIA_CLOCK_MAX_CORRECTION_PPM);
+}
+
+TEST_F(StackA2dpTest, test_a2dp_media_clock_interval) {
+  // The period is kept to the microsecond, not rounded to milliseconds
+  A2DP_MediaClockReset(44100 * 2 * 2, 23219);
+  EXPECT_EQ(A2DP_MediaClockGetIntervalUs(), 23219u);
+}
@@ -10,15 +10,24 @@ known_tests=(
   net_test_bluetooth
   net_test_btcore
   net_test_bta
+  net_test_bta_gatt_queue
   net_test_btif
+  net_test_btif_pan
   net_test_btif_profile_queue
+  net_test_btif_sock_thread
+  net_test_btif_sock_util
   net_test_device
+  net_test_g722_encode
   net_test_hci
   net_test_stack
   net_test_stack_multi_adv
   net_test_stack_ad_parser
+  net_test_stack_bnep
+  net_test_stack_gatt_notification
+  net_test_stack_gatt_server
   net_test_stack_smp
   net_test_types
+  net_test_udrv_uipc
   net_test_btu_message_loop
   net_test_osi
   net_test_performance
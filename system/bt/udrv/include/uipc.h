@@ -18,8 +18,11 @@
 #ifndef UIPC_H
 #define UIPC_H
 
+#include <atomic>
 #include <mutex>
 
+#include "audio_a2dp_hw/include/audio_a2dp_hw_pcm_ring.h"
+
 #define UIPC_CH_ID_AV_CTRL 0
 #define UIPC_CH_ID_AV_AUDIO 1
 #define UIPC_CH_NUM 2
@@ -28,6 +31,9 @@
 
 #define DEFAULT_READ_POLL_TMO_MS 100
 
+/* The audio HAL sends its hello right after connecting */
+#define UIPC_PCM_RING_HANDSHAKE_TMO_MS 100
+
 typedef uint8_t tUIPC_CH_ID;
 
 /* Events generated */
@@ -47,7 +53,25 @@ typedef enum {
 #define UIPC_REG_CBACK 2
 #define UIPC_REG_REMOVE_ACTIVE_READSET 3
 #define UIPC_SET_READ_POLL_TMO 4
+#define UIPC_SET_PCM_RING_MODE 5
+#define UIPC_REQ_GET_STATS 6
 
+/* Parameter of UIPC_SET_PCM_RING_MODE. Unless it is off, a new connection
+   is reported once the peer's hello was answered. A peer that sends anything
+   else first, or nothing for UIPC_PCM_RING_HANDSHAKE_TMO_MS, keeps using the
+   plain socket. */
+typedef enum {
+  UIPC_PCM_RING_OFF = 0,     /* plain socket, no handshake on connect */
+  UIPC_PCM_RING_DECLINE = 1, /* answer the handshake, keep the socket */
+  UIPC_PCM_RING_ACCEPT = 2   /* read PCM from the ring offered by the HAL */
+} tUIPC_PCM_RING_MODE;
+
+/* Called from the read task with the UIPC state mutex held.
+   UIPC_RX_DATA_READY_EVT is raised when data arrives, and again for as long
+   as the callback takes some of it off the socket and more is queued. A
+   callback that leaves the data untouched is not called again until more
+   arrives, so it must either read or UIPC_REG_REMOVE_ACTIVE_READSET the
+   channel and read it from elsewhere. */
 typedef void(tUIPC_RCV_CBACK)(
     tUIPC_CH_ID ch_id,
     tUIPC_EVENT event); /* points to BT_HDR which describes event type and
@@ -57,12 +81,41 @@ typedef void(tUIPC_RCV_CBACK)(
 
 const char* dump_uipc_event(tUIPC_EVENT event);
 
+/* Per channel counters, parameter of UIPC_REQ_GET_STATS */
+typedef struct {
+  uint64_t wakeups;  /* read task and UIPC_Read() wakeups on the channel */
+  uint64_t reads;    /* UIPC_Read() calls */
+  uint64_t rx_bytes; /* bytes returned by UIPC_Read() */
+  uint64_t stalls;   /* times UIPC_Read() had to wait for data */
+  uint64_t timeouts; /* UIPC_Read() calls that came back short */
+} tUIPC_CHAN_STATS;
+
 typedef struct {
   int srvfd;
   int fd;
   int read_poll_tmo_ms;
   int task_evt_flags; /* event flags pending to be processed in read task */
   tUIPC_RCV_CBACK* cback;
+  tUIPC_PCM_RING_MODE pcm_ring_mode;
+  /* connection waiting for the peer's hello, and until when it waits. The
+     read task runs the handshake on it without holding the state mutex. */
+  int pending_fd;
+  uint64_t pending_deadline_ms;
+  tA2DP_PCM_RING pcm_ring; /* attached when the peer writes to shared memory */
+  /* held by UIPC_Read() while it reads from pcm_ring, instead of the state
+     mutex; taken after the state mutex by anything replacing pcm_ring */
+  std::mutex pcm_ring_mutex;
+  bool fd_active; /* fd is watched by the read task */
+
+  /* tUIPC_CHAN_STATS counters. UIPC_Read() updates them without holding the
+     mutex, so they are only ever accessed with relaxed atomics */
+  struct {
+    std::atomic<uint64_t> wakeups;
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> rx_bytes;
+    std::atomic<uint64_t> stalls;
+    std::atomic<uint64_t> timeouts;
+  } stats;
 } tUIPC_CHAN;
 
 struct tUIPC_STATE {
@@ -70,10 +123,8 @@ struct tUIPC_STATE {
   int running;
   std::recursive_mutex mutex;
 
-  fd_set active_set;
-  fd_set read_set;
-  int max_fd;
-  int signal_fds[2];
+  int epoll_fd;
+  int wakeup_fd; /* eventfd used to interrupt the read task */
 
   tUIPC_CHAN ch[UIPC_CH_NUM];
 };
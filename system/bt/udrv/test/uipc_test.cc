@@ -0,0 +1,395 @@
+/******************************************************************************
+ *
+ *  Copyright 2020 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "audio_a2dp_hw/include/audio_a2dp_hw_pcm_ring.h"
+#include "internal_include/bt_trace.h"
+#include "osi/include/osi.h"
+#include "osi/include/socket_utils/sockets.h"
+#include "stack/include/bt_types.h"
+#include "udrv/include/uipc.h"
+#include "utils/include/bt_utils.h"
+
+uint8_t appl_trace_level = BT_TRACE_LEVEL_NONE;
+uint8_t btif_trace_level = BT_TRACE_LEVEL_NONE;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void raise_priority_a2dp(tHIGH_PRIORITY_TASK high_task) {}
+
+namespace {
+
+constexpr auto kEventTimeout = std::chrono::seconds(2);
+
+#if defined(OS_GENERIC)
+constexpr int kNamespace = ANDROID_SOCKET_NAMESPACE_FILESYSTEM;
+#else
+constexpr int kNamespace = ANDROID_SOCKET_NAMESPACE_ABSTRACT;
+#endif
+
+// What the callback of a channel saw, and how it reads. UIPC callbacks take
+// no user data, so the test keeps it here.
+struct ChannelLog {
+  std::vector<tUIPC_EVENT> events;
+  std::vector<uint8_t> data;
+  // Set on UIPC_OPEN_EVT to read directly, as the A2DP data channel does
+  bool read_directly = false;
+  // Bytes read on each UIPC_RX_DATA_READY_EVT
+  size_t read_size = 64;
+  // Closes the channel on UIPC_RX_DATA_READY_EVT instead of reading it
+  bool close_on_data = false;
+};
+
+std::mutex log_mutex;
+std::condition_variable log_cv;
+ChannelLog logs[UIPC_CH_NUM];
+tUIPC_STATE* uipc = nullptr;
+
+void uipc_cback(tUIPC_CH_ID ch_id, tUIPC_EVENT event) {
+  bool read_directly;
+  size_t read_size;
+  bool close_on_data;
+  {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    read_directly = logs[ch_id].read_directly;
+    read_size = logs[ch_id].read_size;
+    close_on_data = logs[ch_id].close_on_data;
+  }
+
+  // Not under log_mutex: closing the channel calls back with UIPC_CLOSE_EVT
+  std::vector<uint8_t> buf;
+  if (event == UIPC_OPEN_EVT && read_directly)
+    UIPC_Ioctl(*uipc, ch_id, UIPC_REG_REMOVE_ACTIVE_READSET, nullptr);
+  if (event == UIPC_RX_DATA_READY_EVT && close_on_data) {
+    UIPC_Close(*uipc, ch_id);
+  } else if (event == UIPC_RX_DATA_READY_EVT) {
+    buf.resize(read_size);
+    buf.resize(UIPC_Read(*uipc, ch_id, nullptr, buf.data(), buf.size()));
+  }
+
+  std::unique_lock<std::mutex> lock(log_mutex);
+  logs[ch_id].data.insert(logs[ch_id].data.end(), buf.begin(), buf.end());
+  logs[ch_id].events.push_back(event);
+  log_cv.notify_all();
+}
+
+class UipcTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (auto& log : logs) log = ChannelLog();
+    uipc_state_ = UIPC_Init();
+    uipc = uipc_state_.get();
+  }
+
+  void TearDown() override {
+    UIPC_Close(*uipc, UIPC_CH_ID_ALL);
+    uipc = nullptr;
+    uipc_state_.reset();
+    for (int fd : client_fds_) close(fd);
+    for (const std::string& path : paths_) unlink(path.c_str());
+  }
+
+  // Opens |ch_id| with a read timeout of |read_tmo_ms|
+  void Open(tUIPC_CH_ID ch_id, int read_tmo_ms = 0) {
+    std::string path = "/tmp/uipc_test_" + std::to_string(getpid()) + "_" +
+                       std::to_string(ch_id);
+    unlink(path.c_str());
+    paths_.push_back(path);
+    ASSERT_TRUE(UIPC_Open(*uipc, ch_id, uipc_cback, path.c_str()));
+    UIPC_Ioctl(*uipc, ch_id, UIPC_SET_READ_POLL_TMO,
+               reinterpret_cast<void*>(read_tmo_ms));
+  }
+
+  void SetPcmRingMode(tUIPC_CH_ID ch_id, tUIPC_PCM_RING_MODE mode) {
+    UIPC_Ioctl(*uipc, ch_id, UIPC_SET_PCM_RING_MODE,
+               reinterpret_cast<void*>(mode));
+  }
+
+  // Connects to |ch_id| the way the audio HAL does
+  int Connect(tUIPC_CH_ID ch_id) {
+    int fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+    EXPECT_GE(fd, 0);
+    client_fds_.push_back(fd);
+    EXPECT_EQ(fd, osi_socket_local_client_connect(
+                      fd, paths_[PathIndex(ch_id)].c_str(), kNamespace,
+                      SOCK_STREAM));
+    return fd;
+  }
+
+  // Waits until the callback of |ch_id| saw |count| |event|
+  bool WaitForEvent(tUIPC_CH_ID ch_id, tUIPC_EVENT event, size_t count = 1) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    return log_cv.wait_for(lock, kEventTimeout, [&] {
+      size_t seen = 0;
+      for (tUIPC_EVENT e : logs[ch_id].events) seen += e == event;
+      return seen >= count;
+    });
+  }
+
+  // Waits until the callback of |ch_id| read |size| bytes
+  bool WaitForData(tUIPC_CH_ID ch_id, size_t size) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    return log_cv.wait_for(lock, kEventTimeout,
+                           [&] { return logs[ch_id].data.size() >= size; });
+  }
+
+  size_t EventCount(tUIPC_CH_ID ch_id, tUIPC_EVENT event) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    size_t seen = 0;
+    for (tUIPC_EVENT e : logs[ch_id].events) seen += e == event;
+    return seen;
+  }
+
+  void SetReadDirectly(tUIPC_CH_ID ch_id) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    logs[ch_id].read_directly = true;
+  }
+
+  void SetReadSize(tUIPC_CH_ID ch_id, size_t read_size) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    logs[ch_id].read_size = read_size;
+  }
+
+  void SetCloseOnData(tUIPC_CH_ID ch_id) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    logs[ch_id].close_on_data = true;
+  }
+
+  std::vector<uint8_t> Data(tUIPC_CH_ID ch_id) {
+    std::unique_lock<std::mutex> lock(log_mutex);
+    return logs[ch_id].data;
+  }
+
+  // Reads |len| bytes of |ch_id| the way the A2DP source does
+  std::vector<uint8_t> Read(tUIPC_CH_ID ch_id, size_t len) {
+    std::vector<uint8_t> buf(len);
+    buf.resize(UIPC_Read(*uipc, ch_id, nullptr, buf.data(), len));
+    return buf;
+  }
+
+ private:
+  size_t PathIndex(tUIPC_CH_ID ch_id) {
+    std::string suffix = "_" + std::to_string(ch_id);
+    for (size_t i = 0; i < paths_.size(); i++) {
+      if (paths_[i].size() >= suffix.size() &&
+          paths_[i].compare(paths_[i].size() - suffix.size(), suffix.size(),
+                            suffix) == 0)
+        return i;
+    }
+    ADD_FAILURE() << "channel " << (int)ch_id << " is not open";
+    return 0;
+  }
+
+  std::unique_ptr<tUIPC_STATE> uipc_state_;
+  std::vector<std::string> paths_;
+  std::vector<int> client_fds_;
+};
+
+std::vector<uint8_t> Pattern(size_t len, uint8_t seed) {
+  std::vector<uint8_t> data(len);
+  for (size_t i = 0; i < len; i++) data[i] = seed + i * 7;
+  return data;
+}
+
+TEST_F(UipcTest, partial_reads_are_notified_until_drained) {
+  Open(UIPC_CH_ID_AV_CTRL);
+  SetReadSize(UIPC_CH_ID_AV_CTRL, 16);
+
+  // A single edge for all of it
+  int fd = Connect(UIPC_CH_ID_AV_CTRL);
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_CTRL, UIPC_OPEN_EVT));
+  std::vector<uint8_t> data = Pattern(1000, 1);
+  ASSERT_EQ((ssize_t)data.size(), send(fd, data.data(), data.size(), 0));
+
+  ASSERT_TRUE(WaitForData(UIPC_CH_ID_AV_CTRL, data.size()));
+  EXPECT_EQ(data, Data(UIPC_CH_ID_AV_CTRL));
+  EXPECT_GE(EventCount(UIPC_CH_ID_AV_CTRL, UIPC_RX_DATA_READY_EVT),
+            data.size() / 16);
+}
+
+TEST_F(UipcTest, channels_are_notified_independently) {
+  Open(UIPC_CH_ID_AV_CTRL);
+  Open(UIPC_CH_ID_AV_AUDIO);
+  SetReadSize(UIPC_CH_ID_AV_CTRL, 10);
+  SetReadSize(UIPC_CH_ID_AV_AUDIO, 33);
+
+  int ctrl_fd = Connect(UIPC_CH_ID_AV_CTRL);
+  int audio_fd = Connect(UIPC_CH_ID_AV_AUDIO);
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_CTRL, UIPC_OPEN_EVT));
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+
+  std::vector<uint8_t> ctrl = Pattern(300, 2);
+  std::vector<uint8_t> audio = Pattern(700, 3);
+  for (size_t i = 0; i < 10; i++) {
+    ASSERT_EQ(30, send(ctrl_fd, ctrl.data() + i * 30, 30, 0));
+    ASSERT_EQ(70, send(audio_fd, audio.data() + i * 70, 70, 0));
+  }
+
+  ASSERT_TRUE(WaitForData(UIPC_CH_ID_AV_CTRL, ctrl.size()));
+  ASSERT_TRUE(WaitForData(UIPC_CH_ID_AV_AUDIO, audio.size()));
+  EXPECT_EQ(ctrl, Data(UIPC_CH_ID_AV_CTRL));
+  EXPECT_EQ(audio, Data(UIPC_CH_ID_AV_AUDIO));
+}
+
+TEST_F(UipcTest, peer_hangup_delivers_pending_data_before_closing) {
+  Open(UIPC_CH_ID_AV_CTRL);
+  SetReadSize(UIPC_CH_ID_AV_CTRL, 64);
+
+  // The peer is gone before the channel is opened. The data is not a
+  // multiple of the read size, so the last read runs into the hangup.
+  int fd = Connect(UIPC_CH_ID_AV_CTRL);
+  std::vector<uint8_t> data = Pattern(500, 4);
+  ASSERT_EQ((ssize_t)data.size(), send(fd, data.data(), data.size(), 0));
+  shutdown(fd, SHUT_WR);
+
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_CTRL, UIPC_CLOSE_EVT));
+  EXPECT_EQ(data, Data(UIPC_CH_ID_AV_CTRL));
+}
+
+TEST_F(UipcTest, close_with_data_pending_stops_notifications) {
+  Open(UIPC_CH_ID_AV_CTRL);
+  SetCloseOnData(UIPC_CH_ID_AV_CTRL);
+
+  int fd = Connect(UIPC_CH_ID_AV_CTRL);
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_CTRL, UIPC_OPEN_EVT));
+  std::vector<uint8_t> data = Pattern(500, 5);
+  ASSERT_EQ((ssize_t)data.size(), send(fd, data.data(), data.size(), 0));
+
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_CTRL, UIPC_CLOSE_EVT));
+  EXPECT_EQ(1u, EventCount(UIPC_CH_ID_AV_CTRL, UIPC_RX_DATA_READY_EVT));
+  EXPECT_EQ(0u, UIPC_Read(*uipc, UIPC_CH_ID_AV_CTRL, nullptr, data.data(),
+                          data.size()));
+}
+
+TEST_F(UipcTest, pcm_ring_hello_attaches_the_ring) {
+  Open(UIPC_CH_ID_AV_AUDIO, 1000);
+  SetPcmRingMode(UIPC_CH_ID_AV_AUDIO, UIPC_PCM_RING_ACCEPT);
+  SetReadDirectly(UIPC_CH_ID_AV_AUDIO);
+
+  tA2DP_PCM_RING ring;
+  a2dp_pcm_ring_init(&ring);
+  ASSERT_TRUE(a2dp_pcm_ring_create(&ring, 4096));
+  int fd = Connect(UIPC_CH_ID_AV_AUDIO);
+  ASSERT_TRUE(a2dp_pcm_ring_offer(fd, &ring, 1000));
+  EXPECT_TRUE(a2dp_pcm_ring_is_attached(&ring));
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+
+  std::vector<uint8_t> pcm(512);
+  for (size_t i = 0; i < pcm.size(); i++) pcm[i] = i;
+  ASSERT_EQ((ssize_t)pcm.size(),
+            a2dp_pcm_ring_write(&ring, pcm.data(), pcm.size(), 0, fd));
+  EXPECT_EQ(pcm, Read(UIPC_CH_ID_AV_AUDIO, pcm.size()));
+
+  a2dp_pcm_ring_destroy(&ring);
+}
+
+TEST_F(UipcTest, pcm_ring_hello_declined_keeps_the_socket) {
+  Open(UIPC_CH_ID_AV_AUDIO, 1000);
+  SetPcmRingMode(UIPC_CH_ID_AV_AUDIO, UIPC_PCM_RING_DECLINE);
+  SetReadDirectly(UIPC_CH_ID_AV_AUDIO);
+
+  tA2DP_PCM_RING ring;
+  a2dp_pcm_ring_init(&ring);
+  ASSERT_TRUE(a2dp_pcm_ring_create(&ring, 4096));
+  int fd = Connect(UIPC_CH_ID_AV_AUDIO);
+  ASSERT_TRUE(a2dp_pcm_ring_offer(fd, &ring, 1000));
+  EXPECT_FALSE(a2dp_pcm_ring_is_attached(&ring));
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+
+  std::vector<uint8_t> pcm(256, 0x5a);
+  ASSERT_EQ((ssize_t)pcm.size(), send(fd, pcm.data(), pcm.size(), 0));
+  EXPECT_EQ(pcm, Read(UIPC_CH_ID_AV_AUDIO, pcm.size()));
+}
+
+TEST_F(UipcTest, peer_sending_pcm_without_hello_uses_the_socket) {
+  Open(UIPC_CH_ID_AV_AUDIO, 1000);
+  SetPcmRingMode(UIPC_CH_ID_AV_AUDIO, UIPC_PCM_RING_ACCEPT);
+  SetReadDirectly(UIPC_CH_ID_AV_AUDIO);
+
+  // An older HAL writes PCM as soon as it is connected
+  int fd = Connect(UIPC_CH_ID_AV_AUDIO);
+  std::vector<uint8_t> pcm(256);
+  for (size_t i = 0; i < pcm.size(); i++) pcm[i] = 255 - i;
+  ASSERT_EQ((ssize_t)pcm.size(), send(fd, pcm.data(), pcm.size(), 0));
+
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+  EXPECT_EQ(0u, EventCount(UIPC_CH_ID_AV_AUDIO, UIPC_CLOSE_EVT));
+  EXPECT_EQ(pcm, Read(UIPC_CH_ID_AV_AUDIO, pcm.size()));
+}
+
+TEST_F(UipcTest, silent_peer_uses_the_socket_after_the_handshake_timeout) {
+  Open(UIPC_CH_ID_AV_AUDIO, 1000);
+  SetPcmRingMode(UIPC_CH_ID_AV_AUDIO, UIPC_PCM_RING_ACCEPT);
+  SetReadDirectly(UIPC_CH_ID_AV_AUDIO);
+
+  auto start = std::chrono::steady_clock::now();
+  int fd = Connect(UIPC_CH_ID_AV_AUDIO);
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+  // The deadline is kept in whole milliseconds
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(UIPC_PCM_RING_HANDSHAKE_TMO_MS - 1));
+
+  std::vector<uint8_t> pcm(128, 0xa5);
+  ASSERT_EQ((ssize_t)pcm.size(), send(fd, pcm.data(), pcm.size(), 0));
+  EXPECT_EQ(pcm, Read(UIPC_CH_ID_AV_AUDIO, pcm.size()));
+}
+
+TEST_F(UipcTest, silent_peer_does_not_hold_up_other_channels) {
+  Open(UIPC_CH_ID_AV_CTRL);
+  Open(UIPC_CH_ID_AV_AUDIO, 1000);
+  SetPcmRingMode(UIPC_CH_ID_AV_AUDIO, UIPC_PCM_RING_ACCEPT);
+  SetReadDirectly(UIPC_CH_ID_AV_AUDIO);
+
+  Connect(UIPC_CH_ID_AV_AUDIO);
+  int ctrl_fd = Connect(UIPC_CH_ID_AV_CTRL);
+  uint8_t cmd = 1;
+  ASSERT_EQ(1, send(ctrl_fd, &cmd, sizeof(cmd), 0));
+
+  // The control channel is served while the data channel waits for a hello
+  ASSERT_TRUE(WaitForData(UIPC_CH_ID_AV_CTRL, 1));
+  EXPECT_EQ(0u, EventCount(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+  EXPECT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+}
+
+TEST_F(UipcTest, peer_closing_before_the_hello_is_not_opened) {
+  Open(UIPC_CH_ID_AV_AUDIO, 1000);
+  SetPcmRingMode(UIPC_CH_ID_AV_AUDIO, UIPC_PCM_RING_ACCEPT);
+
+  int fd = Connect(UIPC_CH_ID_AV_AUDIO);
+  shutdown(fd, SHUT_WR);
+
+  // A later connection is still accepted
+  tA2DP_PCM_RING ring;
+  a2dp_pcm_ring_init(&ring);
+  int fd2 = Connect(UIPC_CH_ID_AV_AUDIO);
+  ASSERT_TRUE(a2dp_pcm_ring_offer(fd2, &ring, 1000));
+  ASSERT_TRUE(WaitForEvent(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+  EXPECT_EQ(1u, EventCount(UIPC_CH_ID_AV_AUDIO, UIPC_OPEN_EVT));
+}
+
+}  // namespace
@@ -30,13 +30,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/prctl.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 #include <mutex>
 #include <set>
@@ -55,18 +58,25 @@
 
 #define PCM_FILENAME "/data/test.pcm"
 
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-
 #define CASE_RETURN_STR(const) \
   case const:                  \
     return #const;
 
 #define UIPC_DISCONNECTED (-1)
 
-#define SAFE_FD_ISSET(fd, set) (((fd) == -1) ? false : FD_ISSET((fd), (set)))
-
 #define UIPC_FLUSH_BUFFER_SIZE 1024
 
+#define UIPC_MAX_EPOLL_EVENTS 8
+
+/* epoll tokens: channel fds are tagged with their fd and channel so events
+   that were queued for an fd closed in the meantime can be recognized */
+#define UIPC_EPOLL_TOKEN(fd, ch_id, is_srv) \
+  (((uint64_t)(uint32_t)(fd) << 32) | ((ch_id) << 1) | (is_srv))
+#define UIPC_EPOLL_TOKEN_FD(token) ((int)((token) >> 32))
+#define UIPC_EPOLL_TOKEN_CH(token) ((tUIPC_CH_ID)(((token)&0xff) >> 1))
+#define UIPC_EPOLL_TOKEN_IS_SRV(token) ((token)&1)
+#define UIPC_EPOLL_TOKEN_WAKEUP UINT64_MAX
+
 /*****************************************************************************
  *  Local type definitions
  *****************************************************************************/
@@ -100,12 +110,18 @@ const char* dump_uipc_event(tUIPC_EVENT event) {
   }
 }
 
+static uint64_t uipc_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 /*****************************************************************************
  *   socket helper functions
  ****************************************************************************/
 
 static inline int create_server_socket(const char* name) {
-  int s = socket(AF_LOCAL, SOCK_STREAM, 0);
+  int s = socket(AF_LOCAL, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   if (s < 0) return -1;
 
   BTIF_TRACE_EVENT("create_server_socket %s", name);
@@ -132,30 +148,20 @@ static inline int create_server_socket(const char* name) {
   return s;
 }
 
+/* returns -1 once the backlog of the non-blocking server socket is empty */
 static int accept_server_socket(int sfd) {
   struct sockaddr_un remote;
-  struct pollfd pfd;
   int fd;
   socklen_t len = sizeof(struct sockaddr_un);
 
   BTIF_TRACE_EVENT("accept fd %d", sfd);
 
-  /* make sure there is data to process */
-  pfd.fd = sfd;
-  pfd.events = POLLIN;
-
-  int poll_ret;
-  OSI_NO_INTR(poll_ret = poll(&pfd, 1, 0));
-  if (poll_ret == 0) {
-    BTIF_TRACE_WARNING("accept poll timeout");
-    return -1;
-  }
-
-  // BTIF_TRACE_EVENT("poll revents 0x%x", pfd.revents);
-
-  OSI_NO_INTR(fd = accept(sfd, (struct sockaddr*)&remote, &len));
+  OSI_NO_INTR(fd = accept4(sfd, (struct sockaddr*)&remote, &len,
+                           SOCK_CLOEXEC));
   if (fd == -1) {
-    BTIF_TRACE_ERROR("sock accept failed (%s)", strerror(errno));
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      BTIF_TRACE_ERROR("sock accept failed (%s)", strerror(errno));
+    }
     return -1;
   }
 
@@ -172,6 +178,30 @@ static int accept_server_socket(int sfd) {
   return fd;
 }
 
+/* readiness of channel sockets is edge triggered, the wakeup eventfd is not */
+static void uipc_watch_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, int fd,
+                                 bool is_srv) {
+  struct epoll_event event = {};
+  event.events = is_srv ? (EPOLLIN | EPOLLET)
+                        : (EPOLLIN | EPOLLRDHUP | EPOLLET);
+  event.data.u64 = UIPC_EPOLL_TOKEN(fd, ch_id, is_srv);
+  if (epoll_ctl(uipc.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    BTIF_TRACE_ERROR("epoll_ctl add fd %d failed (%s)", fd, strerror(errno));
+  }
+}
+
+static void uipc_unwatch_fd_locked(tUIPC_STATE& uipc, int fd) {
+  if (epoll_ctl(uipc.epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+    BTIF_TRACE_EVENT("epoll_ctl del fd %d failed (%s)", fd, strerror(errno));
+  }
+}
+
+static void uipc_deactivate_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
+  if (!uipc.ch[ch_id].fd_active) return;
+  uipc_unwatch_fd_locked(uipc, uipc.ch[ch_id].fd);
+  uipc.ch[ch_id].fd_active = false;
+}
+
 /*****************************************************************************
  *
  *   uipc helper functions
@@ -185,19 +215,28 @@ static int uipc_main_init(tUIPC_STATE& uipc) {
 
   uipc.tid = 0;
   uipc.running = 0;
-  memset(&uipc.active_set, 0, sizeof(uipc.active_set));
-  memset(&uipc.read_set, 0, sizeof(uipc.read_set));
-  uipc.max_fd = 0;
-  memset(&uipc.signal_fds, 0, sizeof(uipc.signal_fds));
-  memset(&uipc.ch, 0, sizeof(uipc.ch));
-
-  /* setup interrupt socket pair */
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, uipc.signal_fds) < 0) {
+
+  uipc.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (uipc.epoll_fd < 0) {
+    BTIF_TRACE_ERROR("epoll_create1 failed (%s)", strerror(errno));
+    uipc.wakeup_fd = -1;
+    return -1;
+  }
+
+  /* setup interrupt eventfd */
+  uipc.wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (uipc.wakeup_fd < 0) {
+    BTIF_TRACE_ERROR("eventfd failed (%s)", strerror(errno));
     return -1;
   }
 
-  FD_SET(uipc.signal_fds[0], &uipc.active_set);
-  uipc.max_fd = MAX(uipc.max_fd, uipc.signal_fds[0]);
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = UIPC_EPOLL_TOKEN_WAKEUP;
+  if (epoll_ctl(uipc.epoll_fd, EPOLL_CTL_ADD, uipc.wakeup_fd, &event) < 0) {
+    BTIF_TRACE_ERROR("epoll_ctl add wakeup fd failed (%s)", strerror(errno));
+    return -1;
+  }
 
   for (i = 0; i < UIPC_CH_NUM; i++) {
     tUIPC_CHAN* p = &uipc.ch[i];
@@ -205,6 +244,17 @@ static int uipc_main_init(tUIPC_STATE& uipc) {
     p->fd = UIPC_DISCONNECTED;
     p->task_evt_flags = 0;
     p->cback = NULL;
+    p->pcm_ring_mode = UIPC_PCM_RING_OFF;
+    p->pending_fd = UIPC_DISCONNECTED;
+    p->pending_deadline_ms = 0;
+    a2dp_pcm_ring_init(&p->pcm_ring);
+    p->read_poll_tmo_ms = 0;
+    p->fd_active = false;
+    p->stats.wakeups.store(0, std::memory_order_relaxed);
+    p->stats.reads.store(0, std::memory_order_relaxed);
+    p->stats.rx_bytes.store(0, std::memory_order_relaxed);
+    p->stats.stalls.store(0, std::memory_order_relaxed);
+    p->stats.timeouts.store(0, std::memory_order_relaxed);
   }
 
   return 0;
@@ -215,11 +265,13 @@ void uipc_main_cleanup(tUIPC_STATE& uipc) {
 
   BTIF_TRACE_EVENT("uipc_main_cleanup");
 
-  close(uipc.signal_fds[0]);
-  close(uipc.signal_fds[1]);
-
   /* close any open channels */
   for (i = 0; i < UIPC_CH_NUM; i++) uipc_close_ch_locked(uipc, i);
+
+  if (uipc.wakeup_fd >= 0) close(uipc.wakeup_fd);
+  if (uipc.epoll_fd >= 0) close(uipc.epoll_fd);
+  uipc.wakeup_fd = -1;
+  uipc.epoll_fd = -1;
 }
 
 /* check pending events in read task */
@@ -236,67 +288,208 @@ static void uipc_check_task_flags_locked(tUIPC_STATE& uipc) {
   }
 }
 
-static int uipc_check_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
-  if (ch_id >= UIPC_CH_NUM) return -1;
+/* unmaps the ring of a channel, once a UIPC_Read() waiting on it returned */
+static void uipc_pcm_ring_destroy_locked(tUIPC_CHAN* p) {
+  if (!a2dp_pcm_ring_is_attached(&p->pcm_ring)) return;
+
+  /* wake up the reader, the ring stays mapped until it let go of it */
+  a2dp_pcm_ring_close(&p->pcm_ring);
+  std::lock_guard<std::mutex> lock(p->pcm_ring_mutex);
+  a2dp_pcm_ring_destroy(&p->pcm_ring);
+}
+
+/* drops a connection still waiting for the peer's hello */
+static void uipc_drop_pending_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
+  tUIPC_CHAN* p = &uipc.ch[ch_id];
+  if (p->pending_fd == UIPC_DISCONNECTED) return;
+
+  BTIF_TRACE_EVENT("CLOSE PENDING CONNECTION (FD %d)", p->pending_fd);
+  uipc_unwatch_fd_locked(uipc, p->pending_fd);
+  close(p->pending_fd);
+  p->pending_fd = UIPC_DISCONNECTED;
+}
+
+/* makes |fd| the connection of the channel and notifies the user */
+static void uipc_open_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, int fd,
+                                bool watched) {
+  tUIPC_CHAN* p = &uipc.ch[ch_id];
+
+  p->fd = fd;
+
+  BTIF_TRACE_EVENT("NEW FD %d", p->fd);
+
+  if (p->cback) {
+    /*  if we have a callback we should add this fd to the active set
+        and notify user with callback event */
+    BTIF_TRACE_EVENT("ADD FD %d TO ACTIVE SET", p->fd);
+    if (!watched) uipc_watch_fd_locked(uipc, ch_id, p->fd, false);
+    p->fd_active = true;
+    p->cback(ch_id, UIPC_OPEN_EVT);
+  } else if (watched) {
+    uipc_unwatch_fd_locked(uipc, fd);
+  }
+}
+
+/* accepts all pending connections, the last one replaces the others */
+static void uipc_accept_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
+  tUIPC_CHAN* p = &uipc.ch[ch_id];
 
-  // BTIF_TRACE_EVENT("CHECK SRVFD %d (ch %d)", uipc.ch[ch_id].srvfd,
-  // ch_id);
+  while (p->srvfd != UIPC_DISCONNECTED) {
+    int fd = accept_server_socket(p->srvfd);
+    if (fd < 0) return;
 
-  if (SAFE_FD_ISSET(uipc.ch[ch_id].srvfd, &uipc.read_set)) {
     BTIF_TRACE_EVENT("INCOMING CONNECTION ON CH %d", ch_id);
 
     // Close the previous connection
-    if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
-      BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", uipc.ch[ch_id].fd);
-      close(uipc.ch[ch_id].fd);
-      FD_CLR(uipc.ch[ch_id].fd, &uipc.active_set);
-      uipc.ch[ch_id].fd = UIPC_DISCONNECTED;
+    uipc_drop_pending_locked(uipc, ch_id);
+    if (p->fd != UIPC_DISCONNECTED) {
+      BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", p->fd);
+      uipc_deactivate_fd_locked(uipc, ch_id);
+      uipc_pcm_ring_destroy_locked(p);
+      close(p->fd);
+      p->fd = UIPC_DISCONNECTED;
     }
 
-    uipc.ch[ch_id].fd = accept_server_socket(uipc.ch[ch_id].srvfd);
+    if (p->pcm_ring_mode == UIPC_PCM_RING_OFF) {
+      uipc_open_fd_locked(uipc, ch_id, fd, false);
+      continue;
+    }
 
-    BTIF_TRACE_EVENT("NEW FD %d", uipc.ch[ch_id].fd);
+    /* the connection is opened once the read task is done with the hello,
+       see uipc_check_pending_fds() */
+    BTIF_TRACE_EVENT("FD %d WAITS FOR THE PCM TRANSPORT HELLO", fd);
+    p->pending_fd = fd;
+    p->pending_deadline_ms = uipc_now_ms() + UIPC_PCM_RING_HANDSHAKE_TMO_MS;
+    uipc_watch_fd_locked(uipc, ch_id, fd, false);
+  }
+}
 
-    if ((uipc.ch[ch_id].fd >= 0) && uipc.ch[ch_id].cback) {
-      /*  if we have a callback we should add this fd to the active set
-          and notify user with callback event */
-      BTIF_TRACE_EVENT("ADD FD %d TO ACTIVE SET", uipc.ch[ch_id].fd);
-      FD_SET(uipc.ch[ch_id].fd, &uipc.active_set);
-      uipc.max_fd = MAX(uipc.max_fd, uipc.ch[ch_id].fd);
-    }
+/* ends the handshake on the pending connection of a channel */
+static void uipc_open_pending_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
+                                     tA2DP_PCM_RING_ACCEPT status,
+                                     const tA2DP_PCM_RING* ring) {
+  tUIPC_CHAN* p = &uipc.ch[ch_id];
+  int fd = p->pending_fd;
+
+  if (status == A2DP_PCM_RING_ACCEPT_FAILED) {
+    BTIF_TRACE_ERROR("CH %d PCM TRANSPORT HANDSHAKE FAILED", ch_id);
+    uipc_drop_pending_locked(uipc, ch_id);
+    BTIF_TRACE_ERROR("FAILED TO ACCEPT CH %d", ch_id);
+    return;
+  }
 
-    if (uipc.ch[ch_id].fd < 0) {
-      BTIF_TRACE_ERROR("FAILED TO ACCEPT CH %d", ch_id);
-      return -1;
-    }
+  p->pending_fd = UIPC_DISCONNECTED;
 
-    if (uipc.ch[ch_id].cback) uipc.ch[ch_id].cback(ch_id, UIPC_OPEN_EVT);
+  {
+    std::lock_guard<std::mutex> lock(p->pcm_ring_mutex);
+    p->pcm_ring = *ring;
   }
 
-  // BTIF_TRACE_EVENT("CHECK FD %d (ch %d)", uipc.ch[ch_id].fd, ch_id);
+  BTIF_TRACE_EVENT("CH %d READS PCM FROM %s", ch_id,
+                   a2dp_pcm_ring_is_attached(&p->pcm_ring) ? "SHARED MEMORY"
+                                                           : "SOCKET");
+
+  uipc_open_fd_locked(uipc, ch_id, fd, true);
+}
 
-  if (SAFE_FD_ISSET(uipc.ch[ch_id].fd, &uipc.read_set)) {
-    // BTIF_TRACE_EVENT("INCOMING DATA ON CH %d", ch_id);
+static void uipc_check_data_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
+  tUIPC_CHAN* p = &uipc.ch[ch_id];
+  int fd = p->fd;
+  int queued;
+  int left;
 
-    if (uipc.ch[ch_id].cback)
-      uipc.ch[ch_id].cback(ch_id, UIPC_RX_DATA_READY_EVT);
+  if (!p->fd_active || !p->cback) return;
+
+  // BTIF_TRACE_EVENT("INCOMING DATA ON CH %d", ch_id);
+
+  /* readiness is edge triggered, so keep notifying as long as the user
+     takes data off the socket, however it reads it, and some is left. Data
+     arriving meanwhile raises a new edge. */
+  do {
+    if (ioctl(fd, FIONREAD, &queued) != 0) queued = 0;
+    p->cback(ch_id, UIPC_RX_DATA_READY_EVT);
+  } while (p->fd == fd && p->fd_active &&
+           ioctl(fd, FIONREAD, &left) == 0 && left > 0 && left < queued);
+}
+
+/* time left until a connection waiting for a hello gives up on it, -1 if
+   there is none */
+static int uipc_pending_timeout_ms(tUIPC_STATE& uipc) {
+  std::lock_guard<std::recursive_mutex> lock(uipc.mutex);
+  int timeout_ms = -1;
+  uint64_t now = uipc_now_ms();
+
+  for (int ch_id = 0; ch_id < UIPC_CH_NUM; ch_id++) {
+    tUIPC_CHAN* p = &uipc.ch[ch_id];
+    if (p->pending_fd == UIPC_DISCONNECTED) continue;
+    int left = p->pending_deadline_ms > now
+                   ? (int)(p->pending_deadline_ms - now)
+                   : 0;
+    if (timeout_ms < 0 || left < timeout_ms) timeout_ms = left;
   }
-  return 0;
+
+  return timeout_ms;
 }
 
-static void uipc_check_interrupt_locked(tUIPC_STATE& uipc) {
-  if (SAFE_FD_ISSET(uipc.signal_fds[0], &uipc.read_set)) {
-    char sig_recv = 0;
-    OSI_NO_INTR(
-        recv(uipc.signal_fds[0], &sig_recv, sizeof(sig_recv), MSG_WAITALL));
+/* runs the handshake on the connections waiting for the peer's hello. The
+   reads don't block and uipc.mutex is not held meanwhile, so a slow peer
+   holds up neither the other channels nor the UIPC callers. Without a hello
+   by the deadline, the plain socket is used. */
+static void uipc_check_pending_fds(tUIPC_STATE& uipc) {
+  for (int ch_id = 0; ch_id < UIPC_CH_NUM; ch_id++) {
+    tUIPC_CHAN* p = &uipc.ch[ch_id];
+    int fd;
+    uint64_t deadline_ms;
+    bool use_ring;
+    {
+      std::lock_guard<std::recursive_mutex> lock(uipc.mutex);
+      fd = p->pending_fd;
+      deadline_ms = p->pending_deadline_ms;
+      use_ring = p->pcm_ring_mode == UIPC_PCM_RING_ACCEPT;
+    }
+    if (fd == UIPC_DISCONNECTED) continue;
+
+    tA2DP_PCM_RING ring;
+    tA2DP_PCM_RING_ACCEPT status =
+        a2dp_pcm_ring_try_accept(fd, use_ring, &ring);
+    if (status == A2DP_PCM_RING_ACCEPT_PENDING) {
+      if (uipc_now_ms() < deadline_ms) continue;
+      BTIF_TRACE_WARNING("CH %d GOT NO PCM TRANSPORT HELLO", ch_id);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(uipc.mutex);
+    if (p->pending_fd != fd) {
+      /* the channel was closed meanwhile */
+      if (status == A2DP_PCM_RING_ACCEPT_DONE) a2dp_pcm_ring_destroy(&ring);
+      continue;
+    }
+    uipc_open_pending_locked(uipc, ch_id, status, &ring);
+    /* the data that told the peer apart already consumed the edge */
+    if (status == A2DP_PCM_RING_ACCEPT_NO_HELLO)
+      uipc_check_data_locked(uipc, ch_id);
   }
 }
 
+static void uipc_check_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
+                                 const bool* srv_ready, const int* data_fd) {
+  /* data first: a connection accepted below may reuse the fd number */
+  if (data_fd[ch_id] != UIPC_DISCONNECTED &&
+      data_fd[ch_id] == uipc.ch[ch_id].fd) {
+    uipc_check_data_locked(uipc, ch_id);
+  }
+
+  if (srv_ready[ch_id]) uipc_accept_locked(uipc, ch_id);
+}
+
+static void uipc_check_interrupt_locked(tUIPC_STATE& uipc) {
+  eventfd_t value;
+  eventfd_read(uipc.wakeup_fd, &value);
+}
+
 static inline void uipc_wakeup_locked(tUIPC_STATE& uipc) {
-  char sig_on = 1;
   BTIF_TRACE_EVENT("UIPC SEND WAKE UP");
 
-  OSI_NO_INTR(send(uipc.signal_fds[1], &sig_on, sizeof(sig_on), 0));
+  eventfd_write(uipc.wakeup_fd, 1);
 }
 
 static int uipc_setup_server_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
@@ -317,55 +510,45 @@ static int uipc_setup_server_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
   }
 
   BTIF_TRACE_EVENT("ADD SERVER FD TO ACTIVE SET %d", fd);
-  FD_SET(fd, &uipc.active_set);
-  uipc.max_fd = MAX(uipc.max_fd, fd);
+  uipc_watch_fd_locked(uipc, ch_id, fd, true);
 
   uipc.ch[ch_id].srvfd = fd;
   uipc.ch[ch_id].cback = cback;
   uipc.ch[ch_id].read_poll_tmo_ms = DEFAULT_READ_POLL_TMO_MS;
 
-  /* trigger main thread to update read set */
-  uipc_wakeup_locked(uipc);
-
   return 0;
 }
 
 static void uipc_flush_ch_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
   char buf[UIPC_FLUSH_BUFFER_SIZE];
-  struct pollfd pfd;
-
-  pfd.events = POLLIN;
-  pfd.fd = uipc.ch[ch_id].fd;
+  int fd = uipc.ch[ch_id].fd;
 
-  if (uipc.ch[ch_id].fd == UIPC_DISCONNECTED) {
+  if (fd == UIPC_DISCONNECTED) {
     BTIF_TRACE_EVENT("%s() - fd disconnected. Exiting", __func__);
     return;
   }
 
-  while (1) {
-    int ret;
-    OSI_NO_INTR(ret = poll(&pfd, 1, 1));
-    if (ret == 0) {
-      BTIF_TRACE_VERBOSE("%s(): poll() timeout - nothing to do. Exiting",
-                         __func__);
-      return;
-    }
-    if (ret < 0) {
-      BTIF_TRACE_WARNING(
-          "%s() - poll() failed: return %d errno %d (%s). Exiting", __func__,
-          ret, errno, strerror(errno));
-      return;
-    }
-    BTIF_TRACE_VERBOSE("%s() - polling fd %d, revents: 0x%x, ret %d", __func__,
-                       pfd.fd, pfd.revents, ret);
-    if (pfd.revents & (POLLERR | POLLHUP)) {
-      BTIF_TRACE_WARNING("%s() - POLLERR or POLLHUP. Exiting", __func__);
-      return;
-    }
+  if (a2dp_pcm_ring_is_attached(&uipc.ch[ch_id].pcm_ring)) {
+    std::lock_guard<std::mutex> lock(uipc.ch[ch_id].pcm_ring_mutex);
+    a2dp_pcm_ring_flush(&uipc.ch[ch_id].pcm_ring);
+    return;
+  }
 
+  while (1) {
     /* read sufficiently large buffer to ensure flush empties socket faster than
        it is getting refilled */
-    read(pfd.fd, &buf, UIPC_FLUSH_BUFFER_SIZE);
+    ssize_t ret;
+    OSI_NO_INTR(ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT));
+    if (ret > 0) continue;
+    if (ret == 0) {
+      BTIF_TRACE_WARNING("%s() - peer closed. Exiting", __func__);
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      BTIF_TRACE_WARNING("%s() - recv() failed: errno %d (%s). Exiting",
+                         __func__, errno, strerror(errno));
+    } else {
+      BTIF_TRACE_VERBOSE("%s(): nothing left to do. Exiting", __func__);
+    }
+    return;
   }
 }
 
@@ -384,34 +567,31 @@ static void uipc_flush_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
 }
 
 static int uipc_close_ch_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
-  int wakeup = 0;
-
   BTIF_TRACE_EVENT("CLOSE CHANNEL %d", ch_id);
 
   if (ch_id >= UIPC_CH_NUM) return -1;
 
+  /* the epoll set is updated immediately, no need to wake up the read task */
   if (uipc.ch[ch_id].srvfd != UIPC_DISCONNECTED) {
     BTIF_TRACE_EVENT("CLOSE SERVER (FD %d)", uipc.ch[ch_id].srvfd);
+    uipc_unwatch_fd_locked(uipc, uipc.ch[ch_id].srvfd);
     close(uipc.ch[ch_id].srvfd);
-    FD_CLR(uipc.ch[ch_id].srvfd, &uipc.active_set);
     uipc.ch[ch_id].srvfd = UIPC_DISCONNECTED;
-    wakeup = 1;
   }
 
+  uipc_drop_pending_locked(uipc, ch_id);
+
   if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
     BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", uipc.ch[ch_id].fd);
+    uipc_deactivate_fd_locked(uipc, ch_id);
+    uipc_pcm_ring_destroy_locked(&uipc.ch[ch_id]);
     close(uipc.ch[ch_id].fd);
-    FD_CLR(uipc.ch[ch_id].fd, &uipc.active_set);
     uipc.ch[ch_id].fd = UIPC_DISCONNECTED;
-    wakeup = 1;
   }
 
   /* notify this connection is closed */
   if (uipc.ch[ch_id].cback) uipc.ch[ch_id].cback(ch_id, UIPC_CLOSE_EVT);
 
-  /* trigger main thread update if something was updated */
-  if (wakeup) uipc_wakeup_locked(uipc);
-
   return 0;
 }
 
@@ -428,6 +608,7 @@ void uipc_close_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
 
 static void* uipc_read_task(void* arg) {
   tUIPC_STATE& uipc = *((tUIPC_STATE*)arg);
+  struct epoll_event events[UIPC_MAX_EPOLL_EVENTS];
   int ch_id;
   int result;
 
@@ -436,38 +617,57 @@ static void* uipc_read_task(void* arg) {
   raise_priority_a2dp(TASK_UIPC_READ);
 
   while (uipc.running) {
-    uipc.read_set = uipc.active_set;
-
-    result = select(uipc.max_fd + 1, &uipc.read_set, NULL, NULL, NULL);
-
-    if (result == 0) {
-      BTIF_TRACE_EVENT("select timeout");
-      continue;
-    }
+    OSI_NO_INTR(result = epoll_wait(uipc.epoll_fd, events,
+                                    UIPC_MAX_EPOLL_EVENTS,
+                                    uipc_pending_timeout_ms(uipc)));
     if (result < 0) {
-      if (errno != EINTR) {
-        BTIF_TRACE_EVENT("select failed %s", strerror(errno));
-      }
+      BTIF_TRACE_EVENT("epoll_wait failed %s", strerror(errno));
       continue;
     }
 
     {
       std::lock_guard<std::recursive_mutex> guard(uipc.mutex);
+      bool srv_ready[UIPC_CH_NUM] = {};
+      int data_fd[UIPC_CH_NUM];
+
+      for (ch_id = 0; ch_id < UIPC_CH_NUM; ch_id++) {
+        data_fd[ch_id] = UIPC_DISCONNECTED;
+      }
 
-      /* clear any wakeup interrupt */
-      uipc_check_interrupt_locked(uipc);
+      for (int i = 0; i < result; i++) {
+        uint64_t token = events[i].data.u64;
+
+        if (token == UIPC_EPOLL_TOKEN_WAKEUP) {
+          /* clear any wakeup interrupt */
+          uipc_check_interrupt_locked(uipc);
+          continue;
+        }
+
+        tUIPC_CH_ID ch = UIPC_EPOLL_TOKEN_CH(token);
+        if (ch >= UIPC_CH_NUM) continue;
+
+        if (UIPC_EPOLL_TOKEN_IS_SRV(token)) {
+          srv_ready[ch] = true;
+        } else {
+          data_fd[ch] = UIPC_EPOLL_TOKEN_FD(token);
+          uipc.ch[ch].stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
 
       /* check pending task events */
       uipc_check_task_flags_locked(uipc);
 
       /* make sure we service audio channel first */
-      uipc_check_fd_locked(uipc, UIPC_CH_ID_AV_AUDIO);
+      uipc_check_fd_locked(uipc, UIPC_CH_ID_AV_AUDIO, srv_ready, data_fd);
 
       /* check for other connections */
       for (ch_id = 0; ch_id < UIPC_CH_NUM; ch_id++) {
-        if (ch_id != UIPC_CH_ID_AV_AUDIO) uipc_check_fd_locked(uipc, ch_id);
+        if (ch_id != UIPC_CH_ID_AV_AUDIO)
+          uipc_check_fd_locked(uipc, ch_id, srv_ready, data_fd);
       }
     }
+
+    uipc_check_pending_fds(uipc);
   }
 
   BTIF_TRACE_EVENT("UIPC READ THREAD EXITING");
@@ -626,8 +826,9 @@ uint32_t UIPC_Read(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
     return 0;
   }
 
+  tUIPC_CHAN* p = &uipc.ch[ch_id];
   int n_read = 0;
-  int fd = uipc.ch[ch_id].fd;
+  int fd = p->fd;
   struct pollfd pfd;
 
   if (fd == UIPC_DISCONNECTED) {
@@ -635,18 +836,74 @@ uint32_t UIPC_Read(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
     return 0;
   }
 
+  p->stats.reads.fetch_add(1, std::memory_order_relaxed);
+
+  if (a2dp_pcm_ring_is_attached(&p->pcm_ring)) {
+    // Keep the read task from unmapping the ring underneath us, without
+    // blocking it while we wait for data. It wakes us up before unmapping.
+    ssize_t n;
+    {
+      std::lock_guard<std::mutex> lock(p->pcm_ring_mutex);
+      if (!a2dp_pcm_ring_is_attached(&p->pcm_ring)) return 0;
+      if (a2dp_pcm_ring_readable(&p->pcm_ring) < len)
+        p->stats.stalls.fetch_add(1, std::memory_order_relaxed);
+      n = a2dp_pcm_ring_read(&p->pcm_ring, p_buf, len, p->read_poll_tmo_ms,
+                             fd);
+    }
+    if (n < 0) {
+      BTIF_TRACE_WARNING("UIPC_Read : channel detached remotely");
+      // Unless the ring was unmapped because the connection was replaced
+      std::lock_guard<std::recursive_mutex> lock(uipc.mutex);
+      if (p->fd == fd) uipc_close_locked(uipc, ch_id);
+      return 0;
+    }
+    if (n < (ssize_t)len) {
+      BTIF_TRACE_WARNING("ring timeout (%d ms)", p->read_poll_tmo_ms);
+      p->stats.timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+    p->stats.rx_bytes.fetch_add(n, std::memory_order_relaxed);
+    return n;
+  }
+
   while (n_read < (int)len) {
+    /* take whatever is queued without waiting, only poll once the socket is
+       drained so that a steady stream costs a single syscall per read */
+    ssize_t n;
+    OSI_NO_INTR(n = recv(fd, p_buf + n_read, len - n_read, MSG_DONTWAIT));
+
+    // BTIF_TRACE_EVENT("read %d bytes", n);
+
+    if (n > 0) {
+      n_read += n;
+      continue;
+    }
+
+    if (n == 0) {
+      BTIF_TRACE_WARNING("UIPC_Read : channel detached remotely");
+      std::lock_guard<std::recursive_mutex> lock(uipc.mutex);
+      uipc_close_locked(uipc, ch_id);
+      /* still hand out what the peer sent before hanging up */
+      break;
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      BTIF_TRACE_WARNING("UIPC_Read : read failed (%s)", strerror(errno));
+      return 0;
+    }
+
     pfd.fd = fd;
     pfd.events = POLLIN | POLLHUP;
 
     /* make sure there is data prior to attempting read to avoid blocking
        a read for more than poll timeout */
 
+    p->stats.stalls.fetch_add(1, std::memory_order_relaxed);
+
     int poll_ret;
-    OSI_NO_INTR(poll_ret = poll(&pfd, 1, uipc.ch[ch_id].read_poll_tmo_ms));
+    OSI_NO_INTR(poll_ret = poll(&pfd, 1, p->read_poll_tmo_ms));
     if (poll_ret == 0) {
-      BTIF_TRACE_WARNING("poll timeout (%d ms)",
-                         uipc.ch[ch_id].read_poll_tmo_ms);
+      BTIF_TRACE_WARNING("poll timeout (%d ms)", p->read_poll_tmo_ms);
+      p->stats.timeouts.fetch_add(1, std::memory_order_relaxed);
       break;
     }
     if (poll_ret < 0) {
@@ -655,6 +912,8 @@ uint32_t UIPC_Read(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
       break;
     }
 
+    p->stats.wakeups.fetch_add(1, std::memory_order_relaxed);
+
     // BTIF_TRACE_EVENT("poll revents %x", pfd.revents);
 
     if (pfd.revents & (POLLHUP | POLLNVAL)) {
@@ -663,27 +922,9 @@ uint32_t UIPC_Read(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
       uipc_close_locked(uipc, ch_id);
       return 0;
     }
-
-    ssize_t n;
-    OSI_NO_INTR(n = recv(fd, p_buf + n_read, len - n_read, 0));
-
-    // BTIF_TRACE_EVENT("read %d bytes", n);
-
-    if (n == 0) {
-      BTIF_TRACE_WARNING("UIPC_Read : channel detached remotely");
-      std::lock_guard<std::recursive_mutex> lock(uipc.mutex);
-      uipc_close_locked(uipc, ch_id);
-      return 0;
-    }
-
-    if (n < 0) {
-      BTIF_TRACE_WARNING("UIPC_Read : read failed (%s)", strerror(errno));
-      return 0;
-    }
-
-    n_read += n;
   }
 
+  p->stats.rx_bytes.fetch_add(n_read, std::memory_order_relaxed);
   return n_read;
 }
 
@@ -715,22 +956,36 @@ extern bool UIPC_Ioctl(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, uint32_t request,
       break;
 
     case UIPC_REG_REMOVE_ACTIVE_READSET:
-      /* user will read data directly and not use select loop */
+      /* user will read data directly and not use the read task */
       if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
         /* remove this channel from active set */
-        FD_CLR(uipc.ch[ch_id].fd, &uipc.active_set);
-
-        /* refresh active set */
-        uipc_wakeup_locked(uipc);
+        uipc_deactivate_fd_locked(uipc, ch_id);
       }
       break;
 
+    case UIPC_SET_PCM_RING_MODE:
+      uipc.ch[ch_id].pcm_ring_mode = (tUIPC_PCM_RING_MODE)(intptr_t)param;
+      BTIF_TRACE_EVENT("UIPC_SET_PCM_RING_MODE : CH %d, MODE %d", ch_id,
+                       uipc.ch[ch_id].pcm_ring_mode);
+      break;
+
     case UIPC_SET_READ_POLL_TMO:
       uipc.ch[ch_id].read_poll_tmo_ms = (intptr_t)param;
       BTIF_TRACE_EVENT("UIPC_SET_READ_POLL_TMO : CH %d, TMO %d ms", ch_id,
                        uipc.ch[ch_id].read_poll_tmo_ms);
       break;
 
+    case UIPC_REQ_GET_STATS: {
+      const auto& counters = uipc.ch[ch_id].stats;
+      tUIPC_CHAN_STATS* p_stats = (tUIPC_CHAN_STATS*)param;
+      p_stats->wakeups = counters.wakeups.load(std::memory_order_relaxed);
+      p_stats->reads = counters.reads.load(std::memory_order_relaxed);
+      p_stats->rx_bytes = counters.rx_bytes.load(std::memory_order_relaxed);
+      p_stats->stalls = counters.stalls.load(std::memory_order_relaxed);
+      p_stats->timeouts = counters.timeouts.load(std::memory_order_relaxed);
+      break;
+    }
+
     default:
       BTIF_TRACE_EVENT("UIPC_Ioctl : request not handled (%d)", request);
       break;